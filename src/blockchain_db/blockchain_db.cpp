@@ -296,6 +296,8 @@ uint64_t BlockchainDB::add_block( const block& blk
   {
     //update staked token sum for interval for whitch this blok is last
     update_staked_token_for_interval(safex::calculate_interval_for_height(blk_height, m_nettype), get_current_staked_token_sum());
+    //interval is over, accumulate its interest
+    update_cumulative_interest_for_interval(safex::calculate_interval_for_height(blk_height, m_nettype));
   }
 
   m_hardfork->add(blk, prev_height);
@@ -321,6 +323,7 @@ void BlockchainDB::pop_block(block& blk, std::vector<transaction>& txs)
   if (safex::is_interval_last_block(blk_height, m_nettype))
   {
     //update staked token sum for interval for whitch this blok is last
+    remove_cumulative_interest_for_interval(safex::calculate_interval_for_height(blk_height, m_nettype));
     remove_staked_token_for_interval(safex::calculate_interval_for_height(blk_height, m_nettype));
   }
 
@@ -449,6 +452,61 @@ void BlockchainDB::show_stats()
   );
 }
 
+db_snapshot_stats BlockchainDB::get_snapshot_stats() const
+{
+  db_snapshot_stats stats;
+  stats.active = m_snapshots_active;
+  stats.opened = m_snapshots_opened;
+  stats.expired = m_snapshots_expired;
+  get_reader_count(stats.readers, stats.max_readers);
+  return stats;
+}
+
+db_snapshot::db_snapshot(const BlockchainDB &db, uint64_t max_lifetime_ms):
+  m_db(db), m_start(std::chrono::steady_clock::now()), m_max_lifetime_ms(max_lifetime_ms), m_owned(false), m_held(true)
+{
+  m_owned = m_db.snapshot_start();
+  if (m_owned)
+  {
+    ++m_db.m_snapshots_active;
+    ++m_db.m_snapshots_opened;
+  }
+}
+
+db_snapshot::~db_snapshot()
+{
+  try
+  {
+    release();
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Failed to release db snapshot: " << e.what());
+  }
+}
+
+void db_snapshot::release()
+{
+  if (!m_held)
+    return;
+  m_held = false;
+  if (!m_owned)
+    return;
+
+  m_db.snapshot_stop();
+  --m_db.m_snapshots_active;
+  if (expired())
+  {
+    ++m_db.m_snapshots_expired;
+    MWARNING("DB snapshot was held for " << age() << " ms, longer than its " << m_max_lifetime_ms << " ms lifetime");
+  }
+}
+
+uint64_t db_snapshot::age() const
+{
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_start).count();
+}
+
 void BlockchainDB::fixup()
 {
   if (is_read_only()) {
@@ -32,6 +32,8 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <list>
 #include <string>
 #include <exception>
@@ -177,12 +179,26 @@ namespace cryptonote
     uint8_t padding[75]; // till 192 bytes
   };
 
+/**
+ * @brief counters describing the read-only snapshots of a BlockchainDB
+ */
+  struct db_snapshot_stats
+  {
+    uint64_t active;       //!< snapshots currently held
+    uint64_t opened;       //!< snapshots opened since startup
+    uint64_t expired;      //!< snapshots which were held past their lifetime
+    uint64_t readers;      //!< read transactions registered with the backing store
+    uint64_t max_readers;  //!< maximum number of concurrent read transactions of the backing store
+  };
+
 #define DBF_SAFE       1
 #define DBF_FAST       2
 #define DBF_FASTEST    4
 #define DBF_RDONLY     8
 #define DBF_SALVAGE 0x10
 
+#define DB_SNAPSHOT_MAX_LIFETIME_MS 30000  // a read snapshot held longer than this is counted as expired
+
 /***********************************
  * Exception Definitions
  ***********************************/
@@ -668,6 +684,12 @@ namespace cryptonote
       uint64_t time_add_block1 = 0;  //!< a performance metric
       uint64_t time_add_transaction = 0;  //!< a performance metric
 
+      friend class db_snapshot;
+
+      mutable std::atomic<uint64_t> m_snapshots_active{0};  //!< snapshots currently held
+      mutable std::atomic<uint64_t> m_snapshots_opened{0};  //!< snapshots opened since startup
+      mutable std::atomic<uint64_t> m_snapshots_expired{0};  //!< snapshots held past their lifetime
+
 
     protected:
 
@@ -696,6 +718,21 @@ namespace cryptonote
         */
       virtual bool remove_staked_token_for_interval(const uint64_t interval) = 0;
 
+      /**
+        * Accumulates interest per token of finished interval on top of previous interval cumulative interest
+        *
+        * Called for interval last block, when both collected fee and staked token sum for interval are final
+        *
+        * @return cumulative interest per token up to and including this interval
+        */
+      virtual uint64_t update_cumulative_interest_for_interval(const uint64_t interval) = 0;
+      /**
+        * Remove cumulative interest for interval
+        *
+        * @return true if it runs OK, false if it fails
+        */
+      virtual bool remove_cumulative_interest_for_interval(const uint64_t interval) = 0;
+
       mutable uint64_t time_tx_exists = 0;  //!< a performance metric
       uint64_t time_commit1 = 0;  //!< a performance metric
       bool m_auto_remove_logs = true;  //!< whether or not to automatically remove old logs
@@ -951,6 +988,40 @@ namespace cryptonote
 
       virtual void block_txn_abort() = 0;
 
+      /**
+       * @brief opens a read-only snapshot of the database on the calling thread
+       *
+       * Until snapshot_stop() is called, every read made on this thread uses
+       * the same read transaction, so consecutive queries see one consistent
+       * state of the database.  Use the db_snapshot guard rather than calling
+       * this directly.
+       *
+       * @return true if a snapshot was opened, false if the thread already
+       * reads from a transaction (an outer snapshot or the write txn), which is
+       * then used as is and must not be stopped
+       */
+      virtual bool snapshot_start() const = 0;
+
+      /**
+       * @brief closes the snapshot opened by snapshot_start() on the calling thread
+       */
+      virtual void snapshot_stop() const = 0;
+
+      /**
+       * @brief gets the read transaction slots of the backing store
+       *
+       * @param readers return-by-reference the number of slots in use
+       * @param max_readers return-by-reference the number of slots available
+       */
+      virtual void get_reader_count(uint64_t &readers, uint64_t &max_readers) const = 0;
+
+      /**
+       * @brief gets snapshot and reader counters
+       *
+       * @return the current counters
+       */
+      db_snapshot_stats get_snapshot_stats() const;
+
       virtual void set_hard_fork(HardFork *hf);
 
       // adds a block with the given metadata to the top of the blockchain, returns the new height
@@ -1577,6 +1648,14 @@ namespace cryptonote
        */
       virtual bool has_key_image(const crypto::key_image &img) const = 0;
 
+      /**
+       * @brief check if each of a set of key images is stored as spent
+       *
+       * @param imgs the key images to check for
+       * @param found return-by-reference whether each image is present
+       */
+      virtual void has_key_images(const std::vector<crypto::key_image> &imgs, std::vector<bool> &found) const = 0;
+
       /**
        * @brief add a txpool transaction
        *
@@ -1728,6 +1807,24 @@ namespace cryptonote
 
       virtual bool for_all_outputs(uint64_t amount, const std::function<bool(uint64_t height)> &f, const tx_out_type output_type) const = 0;
 
+      /**
+       * @brief gets the per-block output counts for an amount over a height range
+       *
+       * The counts come from the cumulative distribution the subclass keeps
+       * up to date as outputs are added and removed, so the cost depends on
+       * the size of the range rather than on the number of outputs.
+       *
+       * @param amount the amount of the outputs
+       * @param output_type a utxo type (cash or token)
+       * @param from_height the first height of the range
+       * @param to_height the last height of the range, inclusive
+       * @param distribution return-by-reference the output count of each height in the range
+       * @param base return-by-reference the number of outputs below from_height
+       *
+       * @return false if the range is empty, otherwise true
+       */
+      virtual bool get_output_distribution(uint64_t amount, const tx_out_type output_type, uint64_t from_height, uint64_t to_height, std::vector<uint64_t> &distribution, uint64_t &base) const = 0;
+
       virtual bool for_all_advanced_outputs(std::function<bool(const crypto::hash &tx_hash, uint64_t height, uint64_t output_id, const cryptonote::txout_to_script &txout)> f, const tx_out_type output_type) const = 0; //todo
 
 
@@ -1796,6 +1893,17 @@ namespace cryptonote
        */
       virtual uint64_t calculate_staked_token_interest_for_output(const txin_to_script &txin, const uint64_t unlock_height) const = 0;
 
+      /**
+       * Returns sum of interest per token for all intervals up to and including given interval
+       *
+       * Interest of intervals [a, b] per token is cumulative(b) - cumulative(a-1)
+       *
+       * @param interval interval number
+       * @param cumulative_interest[out] accumulated safex cash interest per token
+       * @return false if interval is not finished yet
+       */
+      virtual bool get_cumulative_interest_for_interval(const uint64_t interval, uint64_t &cumulative_interest) const = 0;
+
       /**
        * Get safex account public key
        *
@@ -1878,6 +1986,16 @@ namespace cryptonote
        */
       virtual bool get_safex_accounts( std::vector<std::pair<std::string,std::string>> &safex_accounts) const = 0;
 
+      /**
+       * @brief fetch one page of safex accounts from the blockchain
+       *
+       * @param safex_accounts accounts are appended here
+       * @param page limit and start_after, next is set if there are more accounts
+       *
+       * @return True if no error ocurred
+       */
+      virtual bool get_safex_accounts( std::vector<std::pair<std::string,std::string>> &safex_accounts, safex::listing_page &page) const = 0;
+
 
       /**
        * @brief fetch safex offers from the blockchain
@@ -1888,6 +2006,20 @@ namespace cryptonote
        */
       virtual bool get_safex_offers( std::vector<safex::safex_offer> &safex_offers) const = 0;
 
+      /**
+       * @brief fetch one page of safex offers matching the filter from the blockchain
+       *
+       * The subclass should use its seller, active status and price peg
+       * indexes instead of walking all offers
+       *
+       * @param safex_offers matching offers are appended here
+       * @param filter seller, active status and price peg criteria
+       * @param page limit and start_after, next is set if there are more offers
+       *
+       * @return True if no error ocurred
+       */
+      virtual bool get_safex_offers( std::vector<safex::safex_offer> &safex_offers, const safex::safex_offer_filter &filter, safex::listing_page &page) const = 0;
+
 
       /**
        * @brief fetch safex offer height from blockchain
@@ -1908,6 +2040,16 @@ namespace cryptonote
        */
       virtual bool get_safex_price_pegs( std::vector<safex::safex_price_peg> &safex_price_pegs, const std::string& currency) const = 0;
 
+      /**
+       * @brief fetch one page of safex price pegs from the blockchain
+       *
+       * @param currency string of currency, empty string for all price pegs
+       * @param page limit and start_after, next is set if there are more price pegs
+       *
+       * @return True if no error ocurred
+       */
+      virtual bool get_safex_price_pegs( std::vector<safex::safex_price_peg> &safex_price_pegs, const std::string& currency, safex::listing_page &page) const = 0;
+
       /**
        * @brief fetch safex price peg from the blockchain
        *
@@ -1926,6 +2068,15 @@ namespace cryptonote
       */
       virtual bool get_safex_feedbacks( std::vector<safex::safex_feedback> &safex_feedbacks, const crypto::hash& offer_id) const = 0;
 
+      /**
+      * @brief fetch one page of safex feedbacks for given offer id from the blockchain
+      *
+      * @param page limit and start_after, next is set if there are more feedbacks
+      *
+      * @return True if no error ocurred
+      */
+      virtual bool get_safex_feedbacks( std::vector<safex::safex_feedback> &safex_feedbacks, const crypto::hash& offer_id, safex::listing_page &page) const = 0;
+
       /**
        * @brief fetch safex offer's stars from the blockchain
        *
@@ -1935,6 +2086,16 @@ namespace cryptonote
        */
       virtual bool get_offer_stars_given(const crypto::hash offer_id, uint64_t &stars_received) const = 0;
 
+      /**
+       * @brief fetch rating totals of a safex offer from the blockchain
+       *
+       * @param offer_id the offer id
+       * @param rating return-by-reference feedback count, star sum and star histogram
+       *
+       * @return false if the offer has no feedback
+       */
+      virtual bool get_offer_rating(const crypto::hash &offer_id, safex::safex_offer_rating &rating) const = 0;
+
       /**
        * @brief fetch safex tables sizes from the blockchain
        *
@@ -2019,6 +2180,59 @@ namespace cryptonote
 
   };  // class BlockchainDB
 
+/**
+ * @brief a scoped read-only snapshot of a BlockchainDB
+ *
+ * Reads made on the constructing thread while the snapshot is held all see
+ * the same state of the database and share one read transaction.  The
+ * snapshot is bound to that thread and is released on destruction at the
+ * latest.
+ *
+ * A held snapshot keeps the pages it sees from being reused while the chain
+ * grows, so it has a bounded lifetime: long running scans should poll
+ * expired() and stop, or start over with a new snapshot.  A database resize
+ * waits for all snapshots to be released, so do not take the blockchain lock
+ * while holding one.
+ */
+  class db_snapshot
+  {
+    public:
+      /**
+       * @brief opens a snapshot, or joins the read txn the thread already has
+       *
+       * @param db the database to read from
+       * @param max_lifetime_ms how long the snapshot may be held
+       */
+      db_snapshot(const BlockchainDB &db, uint64_t max_lifetime_ms = DB_SNAPSHOT_MAX_LIFETIME_MS);
+
+      ~db_snapshot();
+
+      db_snapshot(const db_snapshot &) = delete;
+      db_snapshot &operator=(const db_snapshot &) = delete;
+
+      /**
+       * @brief releases the snapshot before the guard goes out of scope
+       */
+      void release();
+
+      /**
+       * @return how long the snapshot has been held, in milliseconds
+       */
+      uint64_t age() const;
+
+      /**
+       * @return true if the snapshot was held longer than its lifetime
+       */
+      bool expired() const { return age() > m_max_lifetime_ms; }
+
+    private:
+      const BlockchainDB &m_db;
+      const std::chrono::steady_clock::time_point m_start;
+      const uint64_t m_max_lifetime_ms;
+      bool m_owned;
+      bool m_held;
+  };
+
   BlockchainDB *new_db(const std::string &db_type, cryptonote::network_type nettype);
 
 }  // namespace cryptonote
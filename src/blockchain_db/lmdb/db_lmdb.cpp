@@ -59,7 +59,10 @@ using namespace crypto;
 
 // Increase when the DB changes in a non backward compatible way, and there
 // is no automatic conversion, so that a full resync is needed.
-#define VERSION 1
+#define VERSION 6
+
+// number of (amount, output type) results kept by get_output_histogram
+#define OUTPUT_HISTOGRAM_CACHE_SIZE 4096
 
 namespace
 {
@@ -268,6 +271,7 @@ int compare_string(const MDB_val *a, const MDB_val *b)
  * output_txs            output ID    {txn hash, local index}
  * output_amounts        amount       [{amount output index, metadata}...]
  * output_token_amounts  token_amount [{token amount output index, metadata}...]
+ * output_distribution   {type, amount} [{height, cumulative output count}...]
  *
  * spent_keys            input hash   -
  *
@@ -279,8 +283,13 @@ int compare_string(const MDB_val *a, const MDB_val *b)
  * token_staked_sum      interval     token sum
  * token_staked_sum_total 0           total_token sum
  * network_fee_sum           interval     collected fee sum
+ * cumulative_interest   interval     sum of interest per token for all intervals up to this one
  * token_lock_expiry     block_number {list of loked outputs that expiry on this block number}
  * safex_account         username hash {public_key, description data blob}
+ * safex_offer_seller    username hash {offer ID}...
+ * safex_offer_active    active flag  {offer ID}...
+ * safex_offer_price_peg price peg ID {offer ID}...
+ * safex_offer_rating    offer ID     {feedback count, star sum, star histogram}
  *
  * Note: where the data items are of uniform size, DUPFIXED tables have
  * been used to save space. In most of these cases, a dummy "zerokval"
@@ -288,8 +297,10 @@ int compare_string(const MDB_val *a, const MDB_val *b)
  * attached as a prefix on the Data to serve as the DUPSORT key.
  * (DUPFIXED saves 8 bytes per record.)
  *
- * The output_amounts, output_token_amounts, output_advanced_type, token_lock_expiry tables
- * doesn't use a dummy key, but use DUPSORT.
+ * The output_amounts, output_token_amounts, output_distribution, output_advanced_type,
+ * token_lock_expiry and safex_offer_* index tables doesn't use a dummy key, but use DUPSORT.
+ * output_distribution only has an entry for the heights where outputs of the
+ * amount were created, holding the number of such outputs up to and including it.
  */
 const char* const LMDB_BLOCKS = "blocks";
 const char* const LMDB_BLOCK_HEIGHTS = "block_heights";
@@ -302,6 +313,7 @@ const char* const LMDB_TX_OUTPUTS = "tx_outputs";
 const char* const LMDB_OUTPUT_TXS = "output_txs";
 const char* const LMDB_OUTPUT_AMOUNTS = "output_amounts";
 const char* const LMDB_OUTPUT_TOKEN_AMOUNTS = "output_token_amounts";
+const char* const LMDB_OUTPUT_DISTRIBUTION = "output_distribution";
 const char* const LMDB_SPENT_KEYS = "spent_keys";
 
 const char* const LMDB_TXPOOL_META = "txpool_meta";
@@ -321,6 +333,11 @@ const char* const LMDB_SAFEX_ACCOUNT = "safex_account";
 const char* const LMDB_SAFEX_OFFER = "safex_offer";
 const char* const LMDB_SAFEX_FEEDBACK = "output_safex_feedback";
 const char* const LMDB_SAFEX_PRICE_PEG = "safex_price_peg";
+const char* const LMDB_CUMULATIVE_INTEREST = "cumulative_interest";
+const char* const LMDB_SAFEX_OFFER_SELLER = "safex_offer_seller";
+const char* const LMDB_SAFEX_OFFER_ACTIVE = "safex_offer_active";
+const char* const LMDB_SAFEX_OFFER_PRICE_PEG = "safex_offer_price_peg";
+const char* const LMDB_SAFEX_OFFER_RATING = "safex_offer_rating";
 
 const char* const LMDB_PROPERTIES = "properties";
 
@@ -339,6 +356,78 @@ inline void lmdb_db_open(MDB_txn* txn, const char* name, int flags, MDB_dbi& dbi
     throw0(cryptonote::DB_OPEN_FAILURE((lmdb_error(error_string + " : ", res) + std::string(" - you may want to start with --db-salvage")).c_str()));
 }
 
+// position cursor on the first entry after page.start_after key, or on the first entry
+inline int listing_page_start(MDB_cursor* cur, MDB_val& k, MDB_val& v, const safex::listing_page& page)
+{
+  if (page.start_after.empty())
+    return mdb_cursor_get(cur, &k, &v, MDB_FIRST);
+
+  k.mv_size = page.start_after.size();
+  k.mv_data = (void *)page.start_after.data();
+  int result = mdb_cursor_get(cur, &k, &v, MDB_SET_RANGE);
+  if (result == MDB_SUCCESS && k.mv_size == page.start_after.size() && !memcmp(k.mv_data, page.start_after.data(), k.mv_size))
+    result = mdb_cursor_get(cur, &k, &v, MDB_NEXT);
+  return result;
+}
+
+// position cursor on the first duplicate of k after the one starting with page.start_after, or on the first duplicate
+inline int listing_page_start_dup(MDB_cursor* cur, MDB_val& k, MDB_val& v, const safex::listing_page& page)
+{
+  if (page.start_after.empty())
+    return mdb_cursor_get(cur, &k, &v, MDB_SET);
+
+  v.mv_size = page.start_after.size();
+  v.mv_data = (void *)page.start_after.data();
+  int result = mdb_cursor_get(cur, &k, &v, MDB_GET_BOTH_RANGE);
+  if (result == MDB_SUCCESS && v.mv_size >= page.start_after.size() && !memcmp(v.mv_data, page.start_after.data(), page.start_after.size()))
+    result = mdb_cursor_get(cur, &k, &v, MDB_NEXT_DUP);
+  return result;
+}
+
+// offer table value before DB version 4, without heights
+struct safex_offer_record_v3
+{
+  crypto::hash offer_id{};
+  std::vector<uint8_t> seller{};
+  uint64_t quantity{};
+  uint64_t price{};
+  bool active{};
+  uint64_t output_id{};
+  uint64_t output_id_creation{};
+  bool edited{false};
+
+  BEGIN_SERIALIZE_OBJECT()
+    FIELD(offer_id)
+    FIELD(seller)
+    FIELD(price)
+    FIELD(quantity)
+    FIELD(active)
+    FIELD(output_id)
+    FIELD(output_id_creation)
+    FIELD(edited)
+  END_SERIALIZE()
+};
+
+inline void add_offer_index_entry(MDB_cursor* cur, MDB_val& key, const crypto::hash& offer_id)
+{
+  MDB_val_set(val_offer_id, offer_id);
+  auto result = mdb_cursor_put(cur, &key, &val_offer_id, MDB_NODUPDATA);
+  if (result && result != MDB_KEYEXIST)
+    throw0(cryptonote::DB_ERROR(lmdb_error("Failed to add safex offer index entry: ", result).c_str()));
+}
+
+inline void remove_offer_index_entry(MDB_cursor* cur, MDB_val& key, const crypto::hash& offer_id)
+{
+  MDB_val_set(val_offer_id, offer_id);
+  auto result = mdb_cursor_get(cur, &key, &val_offer_id, MDB_GET_BOTH);
+  if (result == MDB_NOTFOUND)
+    return;
+  if (result)
+    throw0(cryptonote::DB_ERROR(lmdb_error("Error finding safex offer index entry: ", result).c_str()));
+  if ((result = mdb_cursor_del(cur, 0)))
+    throw0(cryptonote::DB_ERROR(lmdb_error("Error removing safex offer index entry: ", result).c_str()));
+}
+
 
 }  // anonymous namespace
 
@@ -410,6 +499,16 @@ typedef struct outkey_advanced {
     uint64_t output_id;
 } outkey_advanced;
 
+typedef struct outdist_key {
+    uint64_t output_type;
+    uint64_t amount;
+} outdist_key;
+
+typedef struct outdist {
+    uint64_t height;
+    uint64_t count;
+} outdist;
+
 
 
 std::atomic<uint64_t> mdb_txn_safe::num_active_txns{0};
@@ -521,6 +620,20 @@ void mdb_txn_safe::allow_new_txns()
   creation_gate.clear();
 }
 
+void mdb_txn_safe::increment_txns(int i)
+{
+  if (i > 0)
+  {
+    while (creation_gate.test_and_set());
+    num_active_txns += i;
+    creation_gate.clear();
+  }
+  else
+  {
+    num_active_txns += i;
+  }
+}
+
 void lmdb_resized(MDB_env *env)
 {
   mdb_txn_safe::prevent_new_txns();
@@ -1082,6 +1195,8 @@ uint64_t BlockchainLMDB::add_token_output(const tx_out& tx_output, const uint64_
   if ((result = mdb_cursor_put(cur_token_output_amount, &token_amount, &data, MDB_APPENDDUP)))
     throw0(DB_ERROR(lmdb_error("Failed to add token output amount: ", result).c_str()));
 
+  add_output_distribution_entry(out_token_amount, tx_out_type::out_token, blockchain_height);
+
   return ok.amount_index;
 }
 
@@ -1126,6 +1241,8 @@ uint64_t BlockchainLMDB::add_cash_output(const tx_out& tx_output, const uint64_t
   if ((result = mdb_cursor_put(cur_cash_output_amount, &cash_amount, &data, MDB_APPENDDUP)))
     throw0(DB_ERROR(lmdb_error("Failed to add cash output amount: ", result).c_str()));
 
+  add_output_distribution_entry(out_cash_amount, tx_out_type::out_cash, blockchain_height);
+
   return ok.amount_index;
 }
 
@@ -1206,8 +1323,11 @@ void BlockchainLMDB::process_advanced_output(const tx_out& tx_output, const uint
       parse_and_validate_object_from_blob<safex::create_offer_result>(tmp,offer);
 
       offer.output_id = output_id;
-      if(tx_output.target.type() == typeid(txout_to_script) && get_tx_out_type(tx_output.target) == cryptonote::tx_out_type::out_safex_offer)
+      offer.height = m_height;
+      if(tx_output.target.type() == typeid(txout_to_script) && get_tx_out_type(tx_output.target) == cryptonote::tx_out_type::out_safex_offer) {
         offer.output_id_creation = output_id;
+        offer.height_creation = m_height;
+      }
 
       blobdata blob{};
       t_serializable_object_to_blob(offer,blob);
@@ -1217,6 +1337,11 @@ void BlockchainLMDB::process_advanced_output(const tx_out& tx_output, const uint
 
       if (result != MDB_SUCCESS)
           throw0(DB_ERROR(lmdb_error("Failed to add output id to refer safex offer entry: ", result).c_str()));
+
+      //Offer output is in place, index new offer state
+      safex::safex_offer indexed_offer;
+      if (get_safex_offer_index_state(offer_id, indexed_offer))
+          add_safex_offer_index(indexed_offer);
     }
 }
 
@@ -1508,6 +1633,7 @@ void BlockchainLMDB::remove_output(const uint64_t amount, const uint64_t& out_in
     throw0(DB_ERROR(lmdb_error("DB error attempting to get an output", result).c_str()));
 
   const pre_rct_outkey *ok = (const pre_rct_outkey *)v.mv_data;
+  const uint64_t output_height = ok->data.height;
   MDB_val_set(otxk, ok->output_id);
   result = mdb_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &otxk, MDB_GET_BOTH);
   if (result == MDB_NOTFOUND)
@@ -1526,6 +1652,106 @@ void BlockchainLMDB::remove_output(const uint64_t amount, const uint64_t& out_in
   result = mdb_cursor_del(cur_output_amount, 0);
   if (result)
     throw0(DB_ERROR(lmdb_error(std::string("Error deleting amount for output index ").append(boost::lexical_cast<std::string>(out_index).append(": ")).c_str(), result).c_str()));
+
+  remove_output_distribution_entry(amount, output_type, output_height);
+}
+
+void BlockchainLMDB::add_output_distribution_entry(const uint64_t amount, const tx_out_type output_type, const uint64_t height)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  mdb_txn_cursors *m_cursors = &m_wcursors;
+
+  CURSOR(output_distribution)
+
+  const outdist_key key = {static_cast<uint64_t>(output_type), amount};
+  outdist od = {height, 1};
+  MDB_val_set(k, key);
+  MDB_val v;
+  int result = mdb_cursor_get(m_cur_output_distribution, &k, &v, MDB_SET);
+  if (result == MDB_SUCCESS)
+  {
+    if ((result = mdb_cursor_get(m_cur_output_distribution, &k, &v, MDB_LAST_DUP)))
+      throw0(DB_ERROR(lmdb_error("Failed to get last output distribution entry: ", result).c_str()));
+    const outdist last = *(const outdist*)v.mv_data;
+    if (last.height > height)
+      throw0(DB_ERROR("Unexpected: output distribution has an entry above the current height"));
+    od.count = last.count + 1;
+    if (last.height == height)
+    {
+      MDB_val_set(vod, od);
+      if ((result = mdb_cursor_put(m_cur_output_distribution, &k, &vod, MDB_CURRENT)))
+        throw0(DB_ERROR(lmdb_error("Failed to update output distribution entry: ", result).c_str()));
+      return;
+    }
+  }
+  else if (result != MDB_NOTFOUND)
+    throw0(DB_ERROR(lmdb_error("Failed to get output distribution: ", result).c_str()));
+
+  MDB_val_set(kput, key);
+  MDB_val_set(vod, od);
+  if ((result = mdb_cursor_put(m_cur_output_distribution, &kput, &vod, MDB_APPENDDUP)))
+    throw0(DB_ERROR(lmdb_error("Failed to add output distribution entry: ", result).c_str()));
+}
+
+void BlockchainLMDB::remove_output_distribution_entry(const uint64_t amount, const tx_out_type output_type, const uint64_t height)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  mdb_txn_cursors *m_cursors = &m_wcursors;
+
+  CURSOR(output_distribution)
+
+  const outdist_key key = {static_cast<uint64_t>(output_type), amount};
+  outdist od = {height, 0};
+  MDB_val k, v;
+  auto seek = [&]() {
+    k.mv_size = sizeof(key);
+    k.mv_data = (void*)&key;
+    v.mv_size = sizeof(od);
+    v.mv_data = (void*)&od;
+    int ret = mdb_cursor_get(m_cur_output_distribution, &k, &v, MDB_GET_BOTH);
+    if (ret == MDB_NOTFOUND)
+      throw0(DB_ERROR("Unexpected: output distribution entry not found"));
+    else if (ret)
+      throw0(DB_ERROR(lmdb_error("Failed to get output distribution entry: ", ret).c_str()));
+  };
+
+  seek();
+  const uint64_t count = ((const outdist*)v.mv_data)->count;
+  uint64_t prev_count = 0;
+  int result = mdb_cursor_get(m_cur_output_distribution, &k, &v, MDB_PREV_DUP);
+  if (result == MDB_SUCCESS)
+    prev_count = ((const outdist*)v.mv_data)->count;
+  else if (result != MDB_NOTFOUND)
+    throw0(DB_ERROR(lmdb_error("Failed to get output distribution entry: ", result).c_str()));
+
+  // outputs are popped from the top, but keep the counts above consistent in any case
+  seek();
+  while ((result = mdb_cursor_get(m_cur_output_distribution, &k, &v, MDB_NEXT_DUP)) == MDB_SUCCESS)
+  {
+    outdist next = *(const outdist*)v.mv_data;
+    --next.count;
+    MDB_val_set(vnext, next);
+    if ((result = mdb_cursor_put(m_cur_output_distribution, &k, &vnext, MDB_CURRENT)))
+      throw0(DB_ERROR(lmdb_error("Failed to update output distribution entry: ", result).c_str()));
+  }
+  if (result != MDB_NOTFOUND)
+    throw0(DB_ERROR(lmdb_error("Failed to enumerate output distribution: ", result).c_str()));
+
+  seek();
+  if (count - 1 == prev_count)
+  {
+    if ((result = mdb_cursor_del(m_cur_output_distribution, 0)))
+      throw0(DB_ERROR(lmdb_error("Failed to remove output distribution entry: ", result).c_str()));
+  }
+  else
+  {
+    od.count = count - 1;
+    MDB_val_set(vod, od);
+    if ((result = mdb_cursor_put(m_cur_output_distribution, &k, &vod, MDB_CURRENT)))
+      throw0(DB_ERROR(lmdb_error("Failed to update output distribution entry: ", result).c_str()));
+  }
 }
 
 void BlockchainLMDB::add_spent_key(const crypto::key_image& k_image)
@@ -1594,7 +1820,7 @@ void BlockchainLMDB::process_command_input(const cryptonote::txin_to_script &txi
   else if (txin.command_type == safex::command_t::create_account)
   {
 
-    std::unique_ptr<safex::command> cmd = safex::safex_command_serializer::parse_safex_object(txin.script, txin.command_type);
+    std::shared_ptr<const safex::command> cmd = safex::safex_command_serializer::get_safex_command(txin);
     std::unique_ptr<safex::create_account_result> result(dynamic_cast<safex::create_account_result*>(cmd->execute(*this, txin)));
     if (result->status != safex::execution_status::ok)
     {
@@ -1611,7 +1837,7 @@ void BlockchainLMDB::process_command_input(const cryptonote::txin_to_script &txi
   else if (txin.command_type == safex::command_t::edit_account)
   {
 
-    std::unique_ptr<safex::command> cmd = safex::safex_command_serializer::parse_safex_object(txin.script, txin.command_type);
+    std::shared_ptr<const safex::command> cmd = safex::safex_command_serializer::get_safex_command(txin);
     std::unique_ptr<safex::edit_account_result> result(dynamic_cast<safex::edit_account_result*>(cmd->execute(*this, txin)));
     if (result->status != safex::execution_status::ok)
     {
@@ -1628,7 +1854,7 @@ void BlockchainLMDB::process_command_input(const cryptonote::txin_to_script &txi
   else if (txin.command_type == safex::command_t::create_offer)
   {
 
-      std::unique_ptr<safex::command> cmd = safex::safex_command_serializer::parse_safex_object(txin.script, txin.command_type);
+      std::shared_ptr<const safex::command> cmd = safex::safex_command_serializer::get_safex_command(txin);
       std::unique_ptr<safex::create_offer_result> result(dynamic_cast<safex::create_offer_result*>(cmd->execute(*this, txin)));
       if (result->status != safex::execution_status::ok)
       {
@@ -1643,7 +1869,7 @@ void BlockchainLMDB::process_command_input(const cryptonote::txin_to_script &txi
   else if (txin.command_type == safex::command_t::edit_offer)
   {
 
-      std::unique_ptr<safex::command> cmd = safex::safex_command_serializer::parse_safex_object(txin.script, txin.command_type);
+      std::shared_ptr<const safex::command> cmd = safex::safex_command_serializer::get_safex_command(txin);
       std::unique_ptr<safex::edit_offer_result> result(dynamic_cast<safex::edit_offer_result*>(cmd->execute(*this, txin)));
       if (result->status != safex::execution_status::ok)
       {
@@ -1658,7 +1884,7 @@ void BlockchainLMDB::process_command_input(const cryptonote::txin_to_script &txi
   else if (txin.command_type == safex::command_t::simple_purchase)
   {
 
-      std::unique_ptr<safex::command> cmd = safex::safex_command_serializer::parse_safex_object(txin.script, txin.command_type);
+      std::shared_ptr<const safex::command> cmd = safex::safex_command_serializer::get_safex_command(txin);
       std::unique_ptr<safex::simple_purchase_result> result(dynamic_cast<safex::simple_purchase_result*>(cmd->execute(*this, txin)));
       if (result->status != safex::execution_status::ok)
       {
@@ -1673,7 +1899,7 @@ void BlockchainLMDB::process_command_input(const cryptonote::txin_to_script &txi
   else if (txin.command_type == safex::command_t::create_feedback)
   {
 
-      std::unique_ptr<safex::command> cmd = safex::safex_command_serializer::parse_safex_object(txin.script, txin.command_type);
+      std::shared_ptr<const safex::command> cmd = safex::safex_command_serializer::get_safex_command(txin);
       std::unique_ptr<safex::create_feedback_result> result(dynamic_cast<safex::create_feedback_result*>(cmd->execute(*this, txin)));
       if (result->status != safex::execution_status::ok)
       {
@@ -1689,7 +1915,7 @@ void BlockchainLMDB::process_command_input(const cryptonote::txin_to_script &txi
   else if (txin.command_type == safex::command_t::create_price_peg)
   {
 
-    std::unique_ptr<safex::command> cmd = safex::safex_command_serializer::parse_safex_object(txin.script, txin.command_type);
+    std::shared_ptr<const safex::command> cmd = safex::safex_command_serializer::get_safex_command(txin);
     std::unique_ptr<safex::create_price_peg_result> result(dynamic_cast<safex::create_price_peg_result*>(cmd->execute(*this, txin)));
     if (result->status != safex::execution_status::ok)
     {
@@ -1704,7 +1930,7 @@ void BlockchainLMDB::process_command_input(const cryptonote::txin_to_script &txi
   else if (txin.command_type == safex::command_t::update_price_peg)
   {
 
-    std::unique_ptr<safex::command> cmd = safex::safex_command_serializer::parse_safex_object(txin.script, txin.command_type);
+    std::shared_ptr<const safex::command> cmd = safex::safex_command_serializer::get_safex_command(txin);
     std::unique_ptr<safex::update_price_peg_result> result(dynamic_cast<safex::update_price_peg_result*>(cmd->execute(*this, txin)));
     if (result->status != safex::execution_status::ok)
     {
@@ -1885,6 +2111,7 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
   lmdb_db_open(txn, LMDB_OUTPUT_TXS, MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_output_txs, "Failed to open db handle for m_output_txs");
   lmdb_db_open(txn, LMDB_OUTPUT_AMOUNTS, MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED | MDB_CREATE, m_output_amounts, "Failed to open db handle for m_output_amounts");
   lmdb_db_open(txn, LMDB_OUTPUT_TOKEN_AMOUNTS, MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED | MDB_CREATE, m_output_token_amounts, "Failed to open db handle for m_output_token_amounts");
+  lmdb_db_open(txn, LMDB_OUTPUT_DISTRIBUTION, MDB_DUPSORT | MDB_DUPFIXED | MDB_CREATE, m_output_distribution, "Failed to open db handle for m_output_distribution");
 
   lmdb_db_open(txn, LMDB_SPENT_KEYS, MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_spent_keys, "Failed to open db handle for m_spent_keys");
 
@@ -1910,6 +2137,11 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
   lmdb_db_open(txn, LMDB_SAFEX_OFFER, MDB_CREATE, m_safex_offer, "Failed to open db handle for m_safex_offer");
   lmdb_db_open(txn, LMDB_SAFEX_FEEDBACK, MDB_CREATE | MDB_DUPSORT, m_safex_feedback, "Failed to open db handle for m_safex_feedback");
   lmdb_db_open(txn, LMDB_SAFEX_PRICE_PEG, MDB_CREATE, m_safex_price_peg, "Failed to open db handle for m_safex_price_peg");
+  lmdb_db_open(txn, LMDB_CUMULATIVE_INTEREST, MDB_INTEGERKEY | MDB_CREATE, m_cumulative_interest, "Failed to open db handle for m_cumulative_interest");
+  lmdb_db_open(txn, LMDB_SAFEX_OFFER_SELLER, MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_safex_offer_seller, "Failed to open db handle for m_safex_offer_seller");
+  lmdb_db_open(txn, LMDB_SAFEX_OFFER_ACTIVE, MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_safex_offer_active, "Failed to open db handle for m_safex_offer_active");
+  lmdb_db_open(txn, LMDB_SAFEX_OFFER_PRICE_PEG, MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_safex_offer_price_peg, "Failed to open db handle for m_safex_offer_price_peg");
+  lmdb_db_open(txn, LMDB_SAFEX_OFFER_RATING, MDB_CREATE, m_safex_offer_rating, "Failed to open db handle for m_safex_offer_rating");
 
   lmdb_db_open(txn, LMDB_PROPERTIES, MDB_CREATE, m_properties, "Failed to open db handle for m_properties");
 
@@ -1918,11 +2150,15 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
   mdb_set_dupsort(txn, m_tx_indices, compare_hash32);
   mdb_set_dupsort(txn, m_output_amounts, compare_uint64);
   mdb_set_dupsort(txn, m_output_token_amounts, compare_uint64);
+  mdb_set_dupsort(txn, m_output_distribution, compare_uint64);
   mdb_set_dupsort(txn, m_output_txs, compare_uint64);
   mdb_set_dupsort(txn, m_block_info, compare_uint64);
   mdb_set_dupsort(txn, m_output_advanced_type, compare_uint64);
   mdb_set_dupsort(txn, m_token_lock_expiry, compare_uint64);
   mdb_set_dupsort(txn, m_safex_feedback, compare_uint64);
+  mdb_set_dupsort(txn, m_safex_offer_seller, compare_hash32);
+  mdb_set_dupsort(txn, m_safex_offer_active, compare_hash32);
+  mdb_set_dupsort(txn, m_safex_offer_price_peg, compare_hash32);
 
 
   mdb_set_compare(txn, m_txpool_meta, compare_hash32);
@@ -1930,6 +2166,9 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
   mdb_set_compare(txn, m_safex_account, compare_hash32);
   mdb_set_compare(txn, m_safex_offer, compare_hash32);
   mdb_set_compare(txn, m_safex_price_peg, compare_hash32);
+  mdb_set_compare(txn, m_safex_offer_seller, compare_hash32);
+  mdb_set_compare(txn, m_safex_offer_price_peg, compare_hash32);
+  mdb_set_compare(txn, m_safex_offer_rating, compare_hash32);
 
     mdb_set_compare(txn, m_properties, compare_string);
 
@@ -2076,6 +2315,8 @@ void BlockchainLMDB::reset()
     throw0(DB_ERROR(lmdb_error("Failed to drop m_output_amounts: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_output_token_amounts, 0))
       throw0(DB_ERROR(lmdb_error("Failed to drop m_output_token_amounts: ", result).c_str()));
+  if (auto result = mdb_drop(txn, m_output_distribution, 0))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_output_distribution: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_spent_keys, 0))
     throw0(DB_ERROR(lmdb_error("Failed to drop m_spent_keys: ", result).c_str()));
   (void)mdb_drop(txn, m_hf_starting_heights, 0); // this one is dropped in new code
@@ -2101,6 +2342,16 @@ void BlockchainLMDB::reset()
     throw0(DB_ERROR(lmdb_error("Failed to drop m_safex_feedback: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_safex_price_peg, 0))
     throw0(DB_ERROR(lmdb_error("Failed to drop m_safex_price_peg: ", result).c_str()));
+  if (auto result = mdb_drop(txn, m_cumulative_interest, 0))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_cumulative_interest: ", result).c_str()));
+  if (auto result = mdb_drop(txn, m_safex_offer_seller, 0))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_safex_offer_seller: ", result).c_str()));
+  if (auto result = mdb_drop(txn, m_safex_offer_active, 0))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_safex_offer_active: ", result).c_str()));
+  if (auto result = mdb_drop(txn, m_safex_offer_price_peg, 0))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_safex_offer_price_peg: ", result).c_str()));
+  if (auto result = mdb_drop(txn, m_safex_offer_rating, 0))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_safex_offer_rating: ", result).c_str()));
 
   if (auto result = mdb_drop(txn, m_properties, 0))
     throw0(DB_ERROR(lmdb_error("Failed to drop m_properties: ", result).c_str()));
@@ -2165,13 +2416,15 @@ void BlockchainLMDB::unlock()
       throw0(DB_ERROR(lmdb_error(std::string("Failed to create a transaction for the db in ")+__FUNCTION__+": ", mdb_res).c_str())); \
   } \
 
+// a thread reading inside a snapshot already counts as an active txn, and
+// must not wait at the creation gate for a resize which waits for it
 #define TXN_PREFIX_RDONLY() \
   MDB_txn *m_txn; \
   mdb_txn_cursors *m_cursors; \
-  mdb_txn_safe auto_txn; \
+  mdb_txn_safe auto_txn(!rtxn_held()); \
   bool my_rtxn = block_rtxn_start(&m_txn, &m_cursors); \
   if (my_rtxn) auto_txn.m_tinfo = m_tinfo.get(); \
-  else auto_txn.uncheck()
+  else if (auto_txn.m_check) auto_txn.uncheck()
 #define TXN_POSTFIX_RDONLY()
 
 #define TXN_POSTFIX_SUCCESS() \
@@ -3281,6 +3534,54 @@ bool BlockchainLMDB::has_key_image(const crypto::key_image& img) const
   return ret;
 }
 
+void BlockchainLMDB::has_key_images(const std::vector<crypto::key_image> &imgs, std::vector<bool> &found) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  found.assign(imgs.size(), false);
+  if (imgs.empty())
+    return;
+
+  // look the images up in the order they are stored, so the cursor only
+  // moves forward and a single seek can answer several images at once
+  std::vector<size_t> order(imgs.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [&imgs](size_t a, size_t b) {
+    const MDB_val va = {sizeof(crypto::key_image), (void *)&imgs[a]};
+    const MDB_val vb = {sizeof(crypto::key_image), (void *)&imgs[b]};
+    return compare_hash32(&va, &vb) < 0;
+  });
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(spent_keys);
+
+  // the first stored image not below the last image searched for
+  MDB_val next = {0, NULL};
+  for (const size_t i : order)
+  {
+    const MDB_val k = {sizeof(crypto::key_image), (void *)&imgs[i]};
+    if (next.mv_data && compare_hash32(&k, &next) <= 0)
+    {
+      found[i] = compare_hash32(&k, &next) == 0;
+      continue;
+    }
+
+    MDB_val v = k;
+    int result = mdb_cursor_get(m_cur_spent_keys, (MDB_val *)&zerokval, &v, MDB_GET_BOTH_RANGE);
+    if (result == MDB_NOTFOUND)
+      break; // this and every remaining image sort after the last stored one
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to look up key images: ", result).c_str()));
+
+    next = v;
+    found[i] = compare_hash32(&k, &next) == 0;
+  }
+
+  TXN_POSTFIX_RDONLY();
+}
+
 bool BlockchainLMDB::for_all_key_images(std::function<bool(const crypto::key_image&)> f) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -3569,6 +3870,77 @@ bool BlockchainLMDB::for_all_outputs(uint64_t amount, const std::function<bool(u
   return fret;
 }
 
+bool BlockchainLMDB::get_output_distribution(uint64_t amount, const tx_out_type output_type, uint64_t from_height, uint64_t to_height, std::vector<uint64_t> &distribution, uint64_t &base) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  distribution.clear();
+  base = 0;
+  if (output_type != tx_out_type::out_cash && output_type != tx_out_type::out_token)
+    throw0(DB_ERROR("Unknown utxo output type"));
+  if (from_height > to_height)
+    return false;
+  distribution.resize(to_height - from_height + 1, 0);
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(output_distribution);
+
+  const outdist_key key = {static_cast<uint64_t>(output_type), amount};
+  const outdist from = {from_height, 0};
+  MDB_val k, v;
+  auto seek = [&](MDB_cursor_op op) {
+    k.mv_size = sizeof(key);
+    k.mv_data = (void*)&key;
+    v.mv_size = sizeof(from);
+    v.mv_data = (void*)&from;
+    return mdb_cursor_get(m_cur_output_distribution, &k, &v, op);
+  };
+
+  int result = seek(MDB_GET_BOTH_RANGE);
+  if (result == MDB_NOTFOUND)
+  {
+    // no outputs of this amount at or above from_height, everything there is goes into base
+    result = seek(MDB_SET);
+    if (result == MDB_SUCCESS)
+    {
+      if ((result = mdb_cursor_get(m_cur_output_distribution, &k, &v, MDB_LAST_DUP)))
+        throw0(DB_ERROR(lmdb_error("Failed to get last output distribution entry: ", result).c_str()));
+      base = ((const outdist*)v.mv_data)->count;
+    }
+    else if (result != MDB_NOTFOUND)
+      throw0(DB_ERROR(lmdb_error("Failed to get output distribution: ", result).c_str()));
+  }
+  else if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to get output distribution: ", result).c_str()));
+  else
+  {
+    result = mdb_cursor_get(m_cur_output_distribution, &k, &v, MDB_PREV_DUP);
+    if (result == MDB_SUCCESS)
+      base = ((const outdist*)v.mv_data)->count;
+    else if (result != MDB_NOTFOUND)
+      throw0(DB_ERROR(lmdb_error("Failed to get output distribution entry: ", result).c_str()));
+
+    if ((result = seek(MDB_GET_BOTH_RANGE)))
+      throw0(DB_ERROR(lmdb_error("Failed to get output distribution entry: ", result).c_str()));
+    uint64_t prev_count = base;
+    do
+    {
+      const outdist *od = (const outdist*)v.mv_data;
+      if (od->height > to_height)
+        break;
+      distribution[od->height - from_height] = od->count - prev_count;
+      prev_count = od->count;
+    } while ((result = mdb_cursor_get(m_cur_output_distribution, &k, &v, MDB_NEXT_DUP)) == MDB_SUCCESS);
+    if (result && result != MDB_NOTFOUND)
+      throw0(DB_ERROR(lmdb_error("Failed to enumerate output distribution: ", result).c_str()));
+  }
+
+  TXN_POSTFIX_RDONLY();
+
+  return true;
+}
+
 // batch_num_blocks: (optional) Used to check if resize needed before batch transaction starts.
 bool BlockchainLMDB::batch_start(uint64_t batch_num_blocks, uint64_t batch_bytes)
 {
@@ -3758,6 +4130,62 @@ void BlockchainLMDB::block_rtxn_stop() const
   memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
 }
 
+// return true if this thread already reads from a txn started elsewhere
+bool BlockchainLMDB::rtxn_held() const
+{
+  if (m_write_txn && m_writer == boost::this_thread::get_id())
+    return true;
+  const mdb_threadinfo *tinfo = m_tinfo.get();
+  return tinfo && tinfo->m_ti_rflags.m_rf_txn && mdb_txn_env(tinfo->m_ti_rtxn) == m_env;
+}
+
+bool BlockchainLMDB::snapshot_start() const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  if (rtxn_held())
+    return false;
+
+  // the snapshot counts as an active txn until it is stopped, so a resize
+  // waits for it rather than remapping under its readers
+  mdb_txn_safe::increment_txns(1);
+  bool ret = false;
+  try
+  {
+    MDB_txn *mtxn;
+    mdb_txn_cursors *mcur;
+    ret = block_rtxn_start(&mtxn, &mcur);
+  }
+  catch (...)
+  {
+    mdb_txn_safe::increment_txns(-1);
+    throw;
+  }
+  if (!ret)
+    mdb_txn_safe::increment_txns(-1);
+  return ret;
+}
+
+void BlockchainLMDB::snapshot_stop() const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  block_rtxn_stop();
+  mdb_txn_safe::increment_txns(-1);
+}
+
+void BlockchainLMDB::get_reader_count(uint64_t &readers, uint64_t &max_readers) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  MDB_envinfo mei;
+  if (auto result = mdb_env_info(m_env, &mei))
+    throw0(DB_ERROR(lmdb_error("Failed to query reader slots: ", result).c_str()));
+  readers = mei.me_numreaders;
+  max_readers = mei.me_maxreaders;
+}
+
 void BlockchainLMDB::block_txn_start(bool readonly)
 {
   if (readonly)
@@ -4214,35 +4642,87 @@ std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> BlockchainLMDB::get
 
   if (unlocked || recent_cutoff > 0) {
     const uint64_t blockchain_height = height();
+    const crypto::hash top_hash = blockchain_height > 0 ? get_block_hash_from_height(blockchain_height - 1) : crypto::null_hash;
+    // outputs are appended to an amount in block order, so the height is monotone along its output index
+    const uint64_t unlocked_height = blockchain_height + 1 > CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE ? blockchain_height + 1 - CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE : 0;
+    const uint64_t recent_height = recent_cutoff > 0 ? get_first_block_height_at_time(recent_cutoff, blockchain_height) : blockchain_height;
     for (std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>>::iterator i = histogram.begin(); i != histogram.end(); ++i) {
       uint64_t amount = i->first;
       uint64_t num_elems = std::get<0>(i->second);
-      while (num_elems > 0) {
-        const tx_out_index toi = get_output_tx_and_index(amount, num_elems - 1, output_type);
-        const uint64_t height = get_tx_block_height(toi.first);
-        const uint64_t unlock_time = get_tx_unlock_time(toi.first);
-        if (blockchain_height - 1 + CRYPTONOTE_LOCKED_TX_ALLOWED_DELTA_BLOCKS >= unlock_time && height + CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE <= blockchain_height)
-          break;
-        --num_elems;
+      const output_histogram_cache_key key(amount, static_cast<uint64_t>(output_type), blockchain_height);
+
+      output_histogram_cache_entry entry;
+      bool cached = false;
+      {
+        boost::lock_guard<boost::mutex> lock(m_output_histogram_cache_lock);
+        const auto it = m_output_histogram_cache.find(key);
+        if (it != m_output_histogram_cache.end() && it->second.first.top_hash == top_hash && it->second.first.total == num_elems)
+        {
+          entry = it->second.first;
+          cached = true;
+        }
       }
-      // modifying second does not invalidate the iterator
-      std::get<1>(i->second) = num_elems;
 
-      if (recent_cutoff > 0)
+      if (!cached)
       {
-        uint64_t recent = 0;
-        while (num_elems > 0) {
-          const tx_out_index toi = get_output_tx_and_index(amount, num_elems - 1, output_type);
-          const uint64_t height = get_tx_block_height(toi.first);
-          const uint64_t ts = get_block_timestamp(height);
-          if (ts < recent_cutoff)
-            break;
-          --num_elems;
-          ++recent;
+        entry.top_hash = top_hash;
+        entry.total = num_elems;
+        num_elems = get_num_outputs_below_height(cur_output_amount, amount, num_elems, unlocked_height);
+        // the unlock time is per tx rather than monotone, step back over the outputs still locked
+        if (num_elems > 0)
+        {
+          uint64_t index = num_elems - 1;
+          MDB_val_set(ki, amount);
+          MDB_val_set(vi, index);
+          int ret = mdb_cursor_get(cur_output_amount, &ki, &vi, MDB_GET_BOTH);
+          while (ret == MDB_SUCCESS)
+          {
+            const pre_rct_outkey *ok = (const pre_rct_outkey *)vi.mv_data;
+            if (blockchain_height - 1 + CRYPTONOTE_LOCKED_TX_ALLOWED_DELTA_BLOCKS >= ok->data.unlock_time)
+              break;
+            if (--num_elems == 0)
+              break;
+            ret = mdb_cursor_get(cur_output_amount, &ki, &vi, MDB_PREV_DUP);
+          }
+          if (ret)
+            throw0(DB_ERROR(lmdb_error("Failed to enumerate outputs: ", ret).c_str()));
+        }
+        entry.unlocked = num_elems;
+        // nothing is recent from the top height on, so this is a valid empty result
+        entry.recent_height = blockchain_height;
+        entry.recent = 0;
+      }
+
+      if (recent_cutoff > 0 && entry.recent_height != recent_height)
+      {
+        entry.recent_height = recent_height;
+        entry.recent = entry.unlocked - get_num_outputs_below_height(cur_output_amount, amount, entry.unlocked, recent_height);
+      }
+
+      {
+        boost::lock_guard<boost::mutex> lock(m_output_histogram_cache_lock);
+        const auto it = m_output_histogram_cache.find(key);
+        if (it != m_output_histogram_cache.end())
+        {
+          it->second.first = entry;
+          m_output_histogram_cache_lru.splice(m_output_histogram_cache_lru.begin(), m_output_histogram_cache_lru, it->second.second);
+        }
+        else
+        {
+          m_output_histogram_cache_lru.push_front(key);
+          m_output_histogram_cache.insert(std::make_pair(key, std::make_pair(entry, m_output_histogram_cache_lru.begin())));
+          while (m_output_histogram_cache.size() > OUTPUT_HISTOGRAM_CACHE_SIZE)
+          {
+            m_output_histogram_cache.erase(m_output_histogram_cache_lru.back());
+            m_output_histogram_cache_lru.pop_back();
+          }
         }
-        // modifying second does not invalidate the iterator
-        std::get<2>(i->second) = recent;
       }
+
+      // modifying second does not invalidate the iterator
+      std::get<1>(i->second) = entry.unlocked;
+      if (recent_cutoff > 0)
+        std::get<2>(i->second) = entry.recent;
     }
   }
 
@@ -4251,6 +4731,46 @@ std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> BlockchainLMDB::get
   return histogram;
 }
 
+uint64_t BlockchainLMDB::get_num_outputs_below_height(MDB_cursor *cur_output_amount, const uint64_t amount, const uint64_t num_elems, const uint64_t height) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+
+  uint64_t lo = 0, hi = num_elems;
+  while (lo < hi)
+  {
+    uint64_t mid = lo + (hi - lo) / 2;
+    MDB_val_set(k, amount);
+    MDB_val_set(v, mid);
+    int ret = mdb_cursor_get(cur_output_amount, &k, &v, MDB_GET_BOTH);
+    if (ret == MDB_NOTFOUND)
+      throw1(OUTPUT_DNE("Attempting to get an output index by amount and amount index, but amount not found"));
+    else if (ret)
+      throw0(DB_ERROR(lmdb_error("DB error attempting to get an output", ret).c_str()));
+    const pre_rct_outkey *ok = (const pre_rct_outkey *)v.mv_data;
+    if (ok->data.height < height)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+uint64_t BlockchainLMDB::get_first_block_height_at_time(const uint64_t timestamp, const uint64_t blockchain_height) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+
+  uint64_t lo = 0, hi = blockchain_height;
+  while (lo < hi)
+  {
+    const uint64_t mid = lo + (hi - lo) / 2;
+    if (get_block_timestamp(mid) < timestamp)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
 void BlockchainLMDB::check_hard_fork_info()
 {
 }
@@ -4346,51 +4866,402 @@ void BlockchainLMDB::fixup()
 
 #define LOGIF(y)    if (ELPP->vRegistry()->allowed(y, SAFEX_DEFAULT_LOG_CATEGORY))
 
-void BlockchainLMDB::migrate(const uint32_t oldversion)
+void BlockchainLMDB::migrate_1_2()
 {
-  //currently only version 1 is used
-  //for future use
-  switch(oldversion) {
-  default:
-    break;
-  }
-}
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  MGINFO_YELLOW("Migrating blockchain from DB version 1 to 2 - this may take a while:");
+  MINFO("building cumulative interest table...");
 
-bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txout)
-{
-  // check if valid output type, txout_to_key, txout_token_to_key
-  if ((txout.type() == typeid(txout_to_key))
-      || (txout.type() == typeid(txout_token_to_key))
-      || (txout.type() == typeid(txout_to_script)) )
-  {
-    return true;
-  }
+  mdb_txn_safe txn(false);
+  int result = mdb_txn_begin(m_env, NULL, 0, txn);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
 
-  return false;
-}
+  MDB_stat db_stats;
+  if ((result = mdb_stat(txn, m_blocks, &db_stats)))
+    throw0(DB_ERROR(lmdb_error("Failed to query m_blocks: ", result).c_str()));
+  const uint64_t db_height = db_stats.ms_entries;
 
+  if ((result = mdb_drop(txn, m_cumulative_interest, 0)))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_cumulative_interest: ", result).c_str()));
 
-/* Keep the currently staked sum in interval 0 */
-  uint64_t BlockchainLMDB::update_current_staked_token_sum(const uint64_t delta, int sign)
+  //interval is finished if its last block is already in the chain, interval 0 is just the genesis block
+  const uint64_t last_finished_interval = db_height == 0 ? 0 : safex::calculate_interval_for_height(db_height - 1, m_nettype) - (safex::is_interval_last_block(db_height - 1, m_nettype) ? 0 : 1);
+
+  uint64_t cumulative_interest = 0;
+  for (uint64_t interval = 0; db_height > 0 && interval <= last_finished_interval; interval++)
   {
-    LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-    check_open();
-    mdb_txn_cursors *m_cursors = &m_wcursors;
-    uint64_t m_height = height();
+    //same as get_staked_token_sum_for_interval, what is staked at the end of previous interval receives interest
+    const uint64_t previous_interval = interval > 0 ? interval - 1 : 0;
+    uint64_t staked_tokens = 0;
+    uint64_t collected_fee = 0;
 
-    const uint64_t db_total_sum_position = 0;
+    MDB_val_set(k_staked, previous_interval);
+    MDB_val v;
+    result = mdb_get(txn, m_token_staked_sum, &k_staked, &v);
+    if (result == MDB_SUCCESS)
+      staked_tokens = *(const uint64_t *) v.mv_data;
+    else if (result != MDB_NOTFOUND)
+      throw0(DB_ERROR(lmdb_error("DB error attempting to fetch staked sum for interval: ", result).c_str()));
 
-    MDB_cursor *cur_token_staked_sum_total;
-    CURSOR(token_staked_sum_total);
-    cur_token_staked_sum_total = m_cur_token_staked_sum_total;
+    MDB_val_set(k_fee, interval);
+    result = mdb_get(txn, m_network_fee_sum, &k_fee, &v);
+    if (result == MDB_SUCCESS)
+      collected_fee = *(const uint64_t *) v.mv_data;
+    else if (result != MDB_NOTFOUND)
+      throw0(DB_ERROR(lmdb_error("DB error attempting to fetch network fee sum for interval: ", result).c_str()));
 
-    uint64_t staked_tokens = 0; //staked tokens in interval
+    if (staked_tokens != 0 && collected_fee != 0)
+      cumulative_interest += collected_fee / (staked_tokens / SAFEX_TOKEN);
 
-    MDB_val_set(k, db_total_sum_position);
-    MDB_val_set(v, staked_tokens);
+    MDB_val_set(k, interval);
+    MDB_val_set(vupdate, cumulative_interest);
+    if ((result = mdb_put(txn, m_cumulative_interest, &k, &vupdate, MDB_APPEND)))
+      throw0(DB_ERROR(lmdb_error("Failed to add cumulative interest for interval: ", result).c_str()));
+  }
 
-    //get already staked tokens for this period
-    bool existing_interval = false;
+  MDB_val_copy<const char*> vk("version");
+  MDB_val_copy<uint32_t> vv(2);
+  if ((result = mdb_put(txn, m_properties, &vk, &vv, 0)))
+    throw0(DB_ERROR(lmdb_error("Failed to update version for the db: ", result).c_str()));
+
+  txn.commit();
+}
+
+void BlockchainLMDB::migrate_2_3()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  MGINFO_YELLOW("Migrating blockchain from DB version 2 to 3 - this may take a while:");
+  MINFO("building safex offer indexes...");
+
+  //offer state is spread over offer and advanced output tables, collect it before opening write txn
+  std::vector<safex::safex_offer> offers;
+  {
+    TXN_PREFIX_RDONLY();
+    RCURSOR(safex_offer);
+
+    MDB_val k, v;
+    int result = mdb_cursor_get(m_cur_safex_offer, &k, &v, MDB_FIRST);
+    while (result == MDB_SUCCESS)
+    {
+      safex_offer_record_v3 record;
+      const cryptonote::blobdata recordblob((uint8_t*)v.mv_data, (uint8_t*)v.mv_data+v.mv_size);
+      if (!cryptonote::parse_and_validate_from_blob(recordblob, record))
+        throw0(DB_ERROR("Failed to parse safex offer record"));
+
+      safex::safex_offer offer;
+      offer.offer_id = record.offer_id;
+      offer.seller = std::string{record.seller.begin(), record.seller.end()};
+      offer.active = record.active;
+
+      const tx_out_type out_type = record.edited ? tx_out_type::out_safex_offer_update : tx_out_type::out_safex_offer;
+      const output_advanced_data_t adv_data = get_output_advanced_data(out_type, record.output_id);
+      if (record.edited) {
+        safex::edit_offer_data offer_data;
+        parse_and_validate_object_from_blob<safex::edit_offer_data>(adv_data.data, offer_data);
+        offer.price_peg_used = offer_data.price_peg_used;
+        offer.price_peg_id = offer_data.price_peg_id;
+      } else {
+        safex::create_offer_data offer_data;
+        parse_and_validate_object_from_blob<safex::create_offer_data>(adv_data.data, offer_data);
+        offer.price_peg_used = offer_data.price_peg_used;
+        offer.price_peg_id = offer_data.price_peg_id;
+      }
+      offers.push_back(offer);
+
+      result = mdb_cursor_get(m_cur_safex_offer, &k, &v, MDB_NEXT);
+    }
+    if (result != MDB_NOTFOUND)
+      throw0(DB_ERROR(lmdb_error("Failed to enumerate safex offers: ", result).c_str()));
+
+    TXN_POSTFIX_RDONLY();
+  }
+
+  mdb_txn_safe txn(false);
+  int result = mdb_txn_begin(m_env, NULL, 0, txn);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+
+  if ((result = mdb_drop(txn, m_safex_offer_seller, 0)))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_safex_offer_seller: ", result).c_str()));
+  if ((result = mdb_drop(txn, m_safex_offer_active, 0)))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_safex_offer_active: ", result).c_str()));
+  if ((result = mdb_drop(txn, m_safex_offer_price_peg, 0)))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_safex_offer_price_peg: ", result).c_str()));
+
+  MDB_cursor *c_seller, *c_active, *c_price_peg;
+  if ((result = mdb_cursor_open(txn, m_safex_offer_seller, &c_seller)))
+    throw0(DB_ERROR(lmdb_error("Failed to open a cursor for safex_offer_seller: ", result).c_str()));
+  if ((result = mdb_cursor_open(txn, m_safex_offer_active, &c_active)))
+    throw0(DB_ERROR(lmdb_error("Failed to open a cursor for safex_offer_active: ", result).c_str()));
+  if ((result = mdb_cursor_open(txn, m_safex_offer_price_peg, &c_price_peg)))
+    throw0(DB_ERROR(lmdb_error("Failed to open a cursor for safex_offer_price_peg: ", result).c_str()));
+
+  for (const safex::safex_offer &offer: offers)
+  {
+    crypto::hash seller_hash = safex::account_username{offer.seller}.hash();
+    MDB_val_set(k_seller, seller_hash);
+    add_offer_index_entry(c_seller, k_seller, offer.offer_id);
+
+    uint64_t active = offer.active ? 1 : 0;
+    MDB_val_set(k_active, active);
+    add_offer_index_entry(c_active, k_active, offer.offer_id);
+
+    if (offer.price_peg_used)
+    {
+      MDB_val_set(k_price_peg, offer.price_peg_id);
+      add_offer_index_entry(c_price_peg, k_price_peg, offer.offer_id);
+    }
+  }
+  MINFO(offers.size() << " offers indexed");
+
+  MDB_val_copy<const char*> vk("version");
+  MDB_val_copy<uint32_t> vv(3);
+  if ((result = mdb_put(txn, m_properties, &vk, &vv, 0)))
+    throw0(DB_ERROR(lmdb_error("Failed to update version for the db: ", result).c_str()));
+
+  txn.commit();
+}
+
+void BlockchainLMDB::migrate_3_4()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  MGINFO_YELLOW("Migrating blockchain from DB version 3 to 4 - this may take a while:");
+  MINFO("storing heights in safex offer records...");
+
+  //heights come from advanced output table, collect new records before opening write txn
+  std::vector<std::pair<crypto::hash, blobdata>> records;
+  {
+    TXN_PREFIX_RDONLY();
+    RCURSOR(safex_offer);
+
+    MDB_val k, v;
+    int result = mdb_cursor_get(m_cur_safex_offer, &k, &v, MDB_FIRST);
+    while (result == MDB_SUCCESS)
+    {
+      safex_offer_record_v3 old_record;
+      const cryptonote::blobdata recordblob((uint8_t*)v.mv_data, (uint8_t*)v.mv_data+v.mv_size);
+      if (!cryptonote::parse_and_validate_from_blob(recordblob, old_record))
+        throw0(DB_ERROR("Failed to parse safex offer record"));
+
+      safex::create_offer_result record{old_record.offer_id, old_record.seller, old_record.price, old_record.quantity, old_record.active};
+      record.output_id = old_record.output_id;
+      record.output_id_creation = old_record.output_id_creation;
+      record.edited = old_record.edited;
+      record.height_creation = get_output_advanced_data(tx_out_type::out_safex_offer, record.output_id_creation).height;
+      record.height = record.edited ? get_output_advanced_data(tx_out_type::out_safex_offer_update, record.output_id).height : record.height_creation;
+
+      records.emplace_back(record.offer_id, t_serializable_object_to_blob(record));
+
+      result = mdb_cursor_get(m_cur_safex_offer, &k, &v, MDB_NEXT);
+    }
+    if (result != MDB_NOTFOUND)
+      throw0(DB_ERROR(lmdb_error("Failed to enumerate safex offers: ", result).c_str()));
+
+    TXN_POSTFIX_RDONLY();
+  }
+
+  mdb_txn_safe txn(false);
+  int result = mdb_txn_begin(m_env, NULL, 0, txn);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+
+  for (const auto &record: records)
+  {
+    MDB_val_set(k, record.first);
+    MDB_val_copy<blobdata> v(record.second);
+    if ((result = mdb_put(txn, m_safex_offer, &k, &v, 0)))
+      throw0(DB_ERROR(lmdb_error("Failed to update safex offer record: ", result).c_str()));
+  }
+  MINFO(records.size() << " offer records updated");
+
+  MDB_val_copy<const char*> vk("version");
+  MDB_val_copy<uint32_t> vv(4);
+  if ((result = mdb_put(txn, m_properties, &vk, &vv, 0)))
+    throw0(DB_ERROR(lmdb_error("Failed to update version for the db: ", result).c_str()));
+
+  txn.commit();
+}
+
+void BlockchainLMDB::migrate_4_5()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  MGINFO_YELLOW("Migrating blockchain from DB version 4 to 5 - this may take a while:");
+  MINFO("building safex offer rating totals...");
+
+  std::unordered_map<crypto::hash, safex::safex_offer_rating> ratings;
+  {
+    TXN_PREFIX_RDONLY();
+    RCURSOR(safex_feedback);
+
+    MDB_val k, v;
+    int result = mdb_cursor_get(m_cur_safex_feedback, &k, &v, MDB_FIRST);
+    while (result == MDB_SUCCESS)
+    {
+      const crypto::hash offer_id = *(const crypto::hash*)k.mv_data;
+      safex::safex_feedback_db_data sfx_feedback;
+      const cryptonote::blobdata feedbackblob((uint8_t*)v.mv_data, (uint8_t*)v.mv_data+v.mv_size);
+      if (!parse_and_validate_object_from_blob<safex::safex_feedback_db_data>(feedbackblob, sfx_feedback) || sfx_feedback.stars_given > SAFEX_FEEDBACK_MAX_RATING)
+        throw0(DB_ERROR("Failed to parse safex feedback"));
+
+      safex::safex_offer_rating &rating = ratings[offer_id];
+      rating.count++;
+      rating.stars_sum += sfx_feedback.stars_given;
+      rating.stars_histogram[sfx_feedback.stars_given]++;
+
+      result = mdb_cursor_get(m_cur_safex_feedback, &k, &v, MDB_NEXT);
+    }
+    if (result != MDB_NOTFOUND)
+      throw0(DB_ERROR(lmdb_error("Failed to enumerate safex feedbacks: ", result).c_str()));
+
+    TXN_POSTFIX_RDONLY();
+  }
+
+  mdb_txn_safe txn(false);
+  int result = mdb_txn_begin(m_env, NULL, 0, txn);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+
+  if ((result = mdb_drop(txn, m_safex_offer_rating, 0)))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_safex_offer_rating: ", result).c_str()));
+
+  for (const auto &rating: ratings)
+  {
+    MDB_val_set(k, rating.first);
+    MDB_val_set(v, rating.second);
+    if ((result = mdb_put(txn, m_safex_offer_rating, &k, &v, 0)))
+      throw0(DB_ERROR(lmdb_error("Failed to add safex offer rating: ", result).c_str()));
+  }
+  MINFO(ratings.size() << " offer ratings built");
+
+  MDB_val_copy<const char*> vk("version");
+  MDB_val_copy<uint32_t> vv(5);
+  if ((result = mdb_put(txn, m_properties, &vk, &vv, 0)))
+    throw0(DB_ERROR(lmdb_error("Failed to update version for the db: ", result).c_str()));
+
+  txn.commit();
+}
+
+void BlockchainLMDB::migrate_5_6()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  MGINFO_YELLOW("Migrating blockchain from DB version 5 to 6 - this may take a while:");
+  MINFO("building cumulative output distribution...");
+
+  // (type, amount) -> height -> number of outputs created at that height
+  std::map<std::pair<uint64_t, uint64_t>, std::map<uint64_t, uint64_t>> counts;
+  {
+    TXN_PREFIX_RDONLY();
+    RCURSOR(output_amounts);
+    RCURSOR(output_token_amounts);
+
+    const std::pair<tx_out_type, MDB_cursor*> tables[] = {
+      {tx_out_type::out_cash, m_cur_output_amounts},
+      {tx_out_type::out_token, m_cur_output_token_amounts}
+    };
+    for (const auto &table: tables)
+    {
+      MDB_val k, v;
+      int result = mdb_cursor_get(table.second, &k, &v, MDB_FIRST);
+      while (result == MDB_SUCCESS)
+      {
+        const uint64_t amount = *(const uint64_t*)k.mv_data;
+        const pre_rct_outkey *ok = (const pre_rct_outkey*)v.mv_data;
+        counts[std::make_pair(static_cast<uint64_t>(table.first), amount)][ok->data.height]++;
+        result = mdb_cursor_get(table.second, &k, &v, MDB_NEXT);
+      }
+      if (result != MDB_NOTFOUND)
+        throw0(DB_ERROR(lmdb_error("Failed to enumerate outputs: ", result).c_str()));
+    }
+
+    TXN_POSTFIX_RDONLY();
+  }
+
+  mdb_txn_safe txn(false);
+  int result = mdb_txn_begin(m_env, NULL, 0, txn);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+
+  if ((result = mdb_drop(txn, m_output_distribution, 0)))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_output_distribution: ", result).c_str()));
+
+  for (const auto &amount_counts: counts)
+  {
+    const outdist_key key = {amount_counts.first.first, amount_counts.first.second};
+    uint64_t cumulative = 0;
+    for (const auto &height_count: amount_counts.second)
+    {
+      cumulative += height_count.second;
+      const outdist od = {height_count.first, cumulative};
+      MDB_val_set(k, key);
+      MDB_val_set(v, od);
+      if ((result = mdb_put(txn, m_output_distribution, &k, &v, MDB_APPENDDUP)))
+        throw0(DB_ERROR(lmdb_error("Failed to add output distribution entry: ", result).c_str()));
+    }
+  }
+  MINFO(counts.size() << " output distributions built");
+
+  MDB_val_copy<const char*> vk("version");
+  MDB_val_copy<uint32_t> vv(6);
+  if ((result = mdb_put(txn, m_properties, &vk, &vv, 0)))
+    throw0(DB_ERROR(lmdb_error("Failed to update version for the db: ", result).c_str()));
+
+  txn.commit();
+}
+
+void BlockchainLMDB::migrate(const uint32_t oldversion)
+{
+  switch(oldversion) {
+  case 1:
+    migrate_1_2(); /* FALLTHRU */
+  case 2:
+    migrate_2_3(); /* FALLTHRU */
+  case 3:
+    migrate_3_4(); /* FALLTHRU */
+  case 4:
+    migrate_4_5(); /* FALLTHRU */
+  case 5:
+    migrate_5_6(); /* FALLTHRU */
+  default:
+    break;
+  }
+}
+
+bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txout)
+{
+  // check if valid output type, txout_to_key, txout_token_to_key
+  if ((txout.type() == typeid(txout_to_key))
+      || (txout.type() == typeid(txout_token_to_key))
+      || (txout.type() == typeid(txout_to_script)) )
+  {
+    return true;
+  }
+
+  return false;
+}
+
+
+/* Keep the currently staked sum in interval 0 */
+  uint64_t BlockchainLMDB::update_current_staked_token_sum(const uint64_t delta, int sign)
+  {
+    LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+    check_open();
+    mdb_txn_cursors *m_cursors = &m_wcursors;
+    uint64_t m_height = height();
+
+    const uint64_t db_total_sum_position = 0;
+
+    MDB_cursor *cur_token_staked_sum_total;
+    CURSOR(token_staked_sum_total);
+    cur_token_staked_sum_total = m_cur_token_staked_sum_total;
+
+    uint64_t staked_tokens = 0; //staked tokens in interval
+
+    MDB_val_set(k, db_total_sum_position);
+    MDB_val_set(v, staked_tokens);
+
+    //get already staked tokens for this period
+    bool existing_interval = false;
     auto result = mdb_cursor_get(cur_token_staked_sum_total, &k, &v, MDB_SET);
     if (result == MDB_NOTFOUND)
     {
@@ -4503,6 +5374,66 @@ bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txou
     return true;
   }
 
+  uint64_t BlockchainLMDB::update_cumulative_interest_for_interval(const uint64_t interval)
+  {
+    LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+    check_open();
+    mdb_txn_cursors *m_cursors = &m_wcursors;
+
+    uint64_t previous_cumulative_interest = 0;
+    if (interval > 0 && !get_cumulative_interest_for_interval(interval - 1, previous_cumulative_interest))
+      throw0(DB_ERROR("Missing cumulative interest for previous interval"));
+
+    //cumulative value is kept modulo 2^64, difference of two values is exact while interest of the range fits in uint64_t
+    const uint64_t cumulative_interest = previous_cumulative_interest + get_interest_for_interval(interval);
+
+    MDB_cursor *cur_cumulative_interest;
+    CURSOR(cumulative_interest);
+    cur_cumulative_interest = m_cur_cumulative_interest;
+
+    uint64_t existing_interest = 0;
+    bool existing_interval = false;
+    MDB_val_set(k, interval);
+    MDB_val_set(v, existing_interest);
+    auto result = mdb_cursor_get(cur_cumulative_interest, &k, &v, MDB_SET);
+    if (result == MDB_SUCCESS)
+      existing_interval = true;
+    else if (result != MDB_NOTFOUND)
+      throw0(DB_ERROR(lmdb_error("DB error attempting to fetch cumulative interest for interval: ", result).c_str()));
+
+    MDB_val_set(k2, interval);
+    MDB_val_set(vupdate, cumulative_interest);
+    if ((result = mdb_cursor_put(cur_cumulative_interest, &k2, &vupdate, existing_interval ? (unsigned int) MDB_CURRENT : (unsigned int) MDB_APPEND)))
+      throw0(DB_ERROR(lmdb_error("Failed to update cumulative interest for interval: ", result).c_str()));
+
+    return cumulative_interest;
+  }
+
+  bool BlockchainLMDB::remove_cumulative_interest_for_interval(const uint64_t interval)
+  {
+    LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+    check_open();
+    mdb_txn_cursors *m_cursors = &m_wcursors;
+
+    MDB_cursor *cur_cumulative_interest;
+    CURSOR(cumulative_interest);
+    cur_cumulative_interest = m_cur_cumulative_interest;
+
+    uint64_t cumulative_interest = 0;
+    MDB_val_set(k, interval);
+    MDB_val_set(v, cumulative_interest);
+    auto result = mdb_cursor_get(cur_cumulative_interest, &k, &v, MDB_SET);
+    if (result != MDB_SUCCESS)
+    {
+      throw0(DB_ERROR(lmdb_error("DB error attempting to fetch cumulative interest for interval: ", result).c_str()));
+    }
+
+    if((result = mdb_cursor_del(cur_cumulative_interest, 0)))
+      throw0(DB_ERROR(lmdb_error("Failed to remove cumulative interest for interval: ", result).c_str()));
+
+    return true;
+  }
+
 
   uint64_t BlockchainLMDB::update_network_fee_sum_for_interval(const uint64_t interval_starting_block, const uint64_t collected_fee)
   {
@@ -4748,27 +5679,62 @@ bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txou
   };
 
 
+  uint64_t BlockchainLMDB::get_interest_for_interval(const uint64_t interval) const
+  {
+    const uint64_t interval_token_staked_amount = get_staked_token_sum_for_interval(interval);
+    const uint64_t collected_fee_amount = get_network_fee_sum_for_interval(interval);
+    uint64_t interest = 0;
+    if(interval_token_staked_amount != 0 && collected_fee_amount != 0)
+    {
+      interest = collected_fee_amount/(interval_token_staked_amount / SAFEX_TOKEN);
+    }
+    LOG_PRINT_L3("Interval " << interval << " staked tokens:" << (interval_token_staked_amount/SAFEX_TOKEN) << " collected fee:" << collected_fee_amount<<" interest:"<<interest);
+
+    return interest;
+  }
+
   bool BlockchainLMDB::get_interval_interest_map(const uint64_t starting_interval, const uint64_t end_interval, safex::map_interval_interest &interest_map) const
   {
     interest_map.clear();
 
     for (uint64_t interval = starting_interval; interval <= end_interval; interval++)
     {
-      const uint64_t interval_token_staked_amount = get_staked_token_sum_for_interval(interval);
-      const uint64_t collected_fee_amount = get_network_fee_sum_for_interval(interval);
-      if(interval_token_staked_amount == 0 || collected_fee_amount == 0)
-      {
-        interest_map[interval] = 0;
-      }
-      else {
-        interest_map[interval] = collected_fee_amount/(interval_token_staked_amount / SAFEX_TOKEN);
-      }
-      LOG_PRINT_L3("Interval " << interval << " staked tokens:" << (interval_token_staked_amount/SAFEX_TOKEN) << " collected fee:" << collected_fee_amount<<" interest:"<<interest_map[interval]);
+      interest_map[interval] = get_interest_for_interval(interval);
     }
 
     return true;
   };
 
+  bool BlockchainLMDB::get_cumulative_interest_for_interval(const uint64_t interval, uint64_t &cumulative_interest) const
+  {
+    LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+    check_open();
+
+    TXN_PREFIX_RDONLY();
+
+    MDB_cursor *cur_cumulative_interest;
+    RCURSOR(cumulative_interest);
+    cur_cumulative_interest = m_cur_cumulative_interest;
+
+    bool found = false;
+    MDB_val_set(k, interval);
+    MDB_val v;
+    auto get_result = mdb_cursor_get(cur_cumulative_interest, &k, &v, MDB_SET);
+    if (get_result == MDB_SUCCESS)
+    {
+      cumulative_interest = *(const uint64_t *) v.mv_data;
+      found = true;
+    }
+    else if (get_result != MDB_NOTFOUND)
+    {
+      throw0(DB_ERROR(lmdb_error("DB error attempting to fetch cumulative interest for interval: ", get_result).c_str()));
+    }
+
+    TXN_POSTFIX_RDONLY();
+
+    return found;
+  }
+
   uint64_t BlockchainLMDB::calculate_staked_token_interest_for_output(const txin_to_script &txin, const uint64_t unlock_height) const
   {
 
@@ -4791,6 +5757,19 @@ bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txou
           return 0;
       }
 
+      const uint64_t token_amount = txin.token_amount/SAFEX_TOKEN;
+
+      //all intervals up to end_interval are finished, so interest is difference of two cumulative values
+      //if result does not fit, fall back to per interval calculation so that overflow handling stays the same
+      uint64_t end_cumulative_interest = 0, start_cumulative_interest = 0;
+      if (get_cumulative_interest_for_interval(end_interval, end_cumulative_interest)
+          && get_cumulative_interest_for_interval(starting_interval - 1, start_cumulative_interest))
+      {
+          const uint64_t interest_per_token = end_cumulative_interest - start_cumulative_interest;
+          if (token_amount == 0 || interest_per_token <= std::numeric_limits<uint64_t>::max() / token_amount)
+              return interest_per_token * token_amount;
+      }
+
       safex::map_interval_interest interest_map;
       if (!get_interval_interest_map(starting_interval, end_interval, interest_map)) {
           MERROR("Could not get interval map");
@@ -4799,7 +5778,7 @@ bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txou
 
       uint64_t  interest = 0;
       for (uint64_t i=starting_interval;i<=end_interval;++i) {
-          uint64_t add_interest = interest_map[i]*(txin.token_amount/SAFEX_TOKEN);
+          uint64_t add_interest = interest_map[i]*token_amount;
           if(interest > interest + add_interest)
               return 0;
           interest += add_interest;
@@ -4930,6 +5909,11 @@ bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txou
         check_open();
         mdb_txn_cursors *m_cursors = &m_wcursors;
 
+        //Old state is unindexed here, new one is indexed when offer update output is added
+        safex::safex_offer indexed_offer;
+        if (get_safex_offer_index_state(offer_id, indexed_offer))
+            remove_safex_offer_index(indexed_offer);
+
         MDB_cursor *cur_safex_offer;
         CURSOR(safex_offer)
         cur_safex_offer = m_cur_safex_offer;
@@ -4971,6 +5955,10 @@ bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txou
         check_open();
         mdb_txn_cursors *m_cursors = &m_wcursors;
 
+        safex::safex_offer indexed_offer;
+        if (get_safex_offer_index_state(offer_id, indexed_offer))
+            remove_safex_offer_index(indexed_offer);
+
         CURSOR(safex_offer);
 
         MDB_val_set(k, offer_id);
@@ -4994,6 +5982,10 @@ bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txou
         check_open();
         mdb_txn_cursors *m_cursors = &m_wcursors;
 
+        safex::safex_offer indexed_offer;
+        if (get_safex_offer_index_state(offer_id, indexed_offer))
+            remove_safex_offer_index(indexed_offer);
+
         CURSOR(safex_offer);
 
         MDB_val_set(k, offer_id);
@@ -5017,6 +6009,69 @@ bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txou
             auto result2 = mdb_cursor_put(m_cur_safex_offer, &k, &vupdate, (unsigned int) MDB_CURRENT);
             if (result)
                 throw1(DB_ERROR(lmdb_error("Error removing offer: ", result).c_str()));
+
+            if (get_safex_offer_index_state(offer_id, indexed_offer))
+                add_safex_offer_index(indexed_offer);
+        }
+    }
+
+    bool BlockchainLMDB::get_safex_offer_index_state(const crypto::hash &offer_id, safex::safex_offer &offer) const
+    {
+        //get_offer takes active flag from output data, offer table holds the current one
+        bool active = false;
+        if (!get_offer_active_status(offer_id, active) || !get_offer(offer_id, offer))
+            return false;
+        offer.active = active;
+        return true;
+    }
+
+    void BlockchainLMDB::add_safex_offer_index(const safex::safex_offer &offer)
+    {
+        LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+        check_open();
+        mdb_txn_cursors *m_cursors = &m_wcursors;
+
+        CURSOR(safex_offer_seller);
+        CURSOR(safex_offer_active);
+        CURSOR(safex_offer_price_peg);
+
+        crypto::hash seller_hash = safex::account_username{offer.seller}.hash();
+        MDB_val_set(k_seller, seller_hash);
+        add_offer_index_entry(m_cur_safex_offer_seller, k_seller, offer.offer_id);
+
+        uint64_t active = offer.active ? 1 : 0;
+        MDB_val_set(k_active, active);
+        add_offer_index_entry(m_cur_safex_offer_active, k_active, offer.offer_id);
+
+        if (offer.price_peg_used)
+        {
+            MDB_val_set(k_price_peg, offer.price_peg_id);
+            add_offer_index_entry(m_cur_safex_offer_price_peg, k_price_peg, offer.offer_id);
+        }
+    }
+
+    void BlockchainLMDB::remove_safex_offer_index(const safex::safex_offer &offer)
+    {
+        LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+        check_open();
+        mdb_txn_cursors *m_cursors = &m_wcursors;
+
+        CURSOR(safex_offer_seller);
+        CURSOR(safex_offer_active);
+        CURSOR(safex_offer_price_peg);
+
+        crypto::hash seller_hash = safex::account_username{offer.seller}.hash();
+        MDB_val_set(k_seller, seller_hash);
+        remove_offer_index_entry(m_cur_safex_offer_seller, k_seller, offer.offer_id);
+
+        uint64_t active = offer.active ? 1 : 0;
+        MDB_val_set(k_active, active);
+        remove_offer_index_entry(m_cur_safex_offer_active, k_active, offer.offer_id);
+
+        if (offer.price_peg_used)
+        {
+            MDB_val_set(k_price_peg, offer.price_peg_id);
+            remove_offer_index_entry(m_cur_safex_offer_price_peg, k_price_peg, offer.offer_id);
         }
     }
 
@@ -5057,6 +6112,7 @@ bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txou
               sfx_offer.seller = restored_sfx_offer_create.seller;
               sfx_offer.edited = false;
               sfx_offer.output_id = current.type_index;
+              sfx_offer.height = current.height;
 
               return;
             }
@@ -5073,6 +6129,7 @@ bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txou
 
               memcpy(&output_id, key.mv_data,sizeof(uint64_t));
               sfx_offer.output_id = current.type_index;
+              sfx_offer.height = current.height;
 
               return;
             }
@@ -5258,6 +6315,8 @@ bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txou
 
       if ((result = mdb_cursor_del(cur_safex_feedback, 0)))
           throw1(DB_ERROR(lmdb_error("Failed to add removal of block info to db transaction: ", result).c_str()));
+
+      update_offer_rating(offer_id, feedback_output_data.stars_given, false);
     }
     else
     {
@@ -5505,6 +6564,59 @@ bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txou
 
         if ((result = mdb_cursor_put(cur_safex_feedback, &k, &v, MDB_APPENDDUP)))
           throw0(DB_ERROR(lmdb_error("Failed to add feedback output index: ", result).c_str()));
+
+        update_offer_rating(feedback.offer_id, feedback.stars_given, true);
+    }
+
+    void BlockchainLMDB::update_offer_rating(const crypto::hash& offer_id, const uint8_t stars_given, const bool add) {
+        LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+        check_open();
+        mdb_txn_cursors *m_cursors = &m_wcursors;
+        CURSOR(safex_offer_rating)
+
+        if (stars_given > SAFEX_FEEDBACK_MAX_RATING)
+          throw0(DB_ERROR("Safex feedback rating out of range"));
+
+        safex::safex_offer_rating rating{};
+        MDB_val_set(k, offer_id);
+        MDB_val v;
+        auto result = mdb_cursor_get(m_cur_safex_offer_rating, &k, &v, MDB_SET);
+        if (result == MDB_SUCCESS)
+        {
+          if (v.mv_size != sizeof(rating))
+            throw0(DB_ERROR("Unexpected safex offer rating size"));
+          memcpy(&rating, v.mv_data, sizeof(rating));
+        }
+        else if (result != MDB_NOTFOUND || !add)
+        {
+          throw0(DB_ERROR(lmdb_error("DB error attempting to fetch offer rating: ", result).c_str()));
+        }
+
+        if (add)
+        {
+          rating.count++;
+          rating.stars_sum += stars_given;
+          rating.stars_histogram[stars_given]++;
+        }
+        else
+        {
+          if (rating.count == 0 || rating.stars_sum < stars_given || rating.stars_histogram[stars_given] == 0)
+            throw0(DB_ERROR("Safex offer rating does not contain removed feedback"));
+          rating.count--;
+          rating.stars_sum -= stars_given;
+          rating.stars_histogram[stars_given]--;
+        }
+
+        if (rating.count == 0)
+        {
+          if ((result = mdb_cursor_del(m_cur_safex_offer_rating, 0)))
+            throw1(DB_ERROR(lmdb_error("Failed to remove safex offer rating: ", result).c_str()));
+          return;
+        }
+
+        MDB_val_set(v_rating, rating);
+        if ((result = mdb_cursor_put(m_cur_safex_offer_rating, &k, &v_rating, 0)))
+          throw0(DB_ERROR(lmdb_error("Failed to update safex offer rating: ", result).c_str()));
     }
 
     void BlockchainLMDB::add_safex_price_peg(const crypto::hash& price_peg_id, const blobdata &blob){
@@ -5606,26 +6718,38 @@ bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txou
   };
 
     bool BlockchainLMDB::get_safex_accounts( std::vector<std::pair<std::string,std::string>> &safex_accounts) const{
+      safex::listing_page page;
+      return get_safex_accounts(safex_accounts, page);
+    }
+
+    bool BlockchainLMDB::get_safex_accounts( std::vector<std::pair<std::string,std::string>> &safex_accounts, safex::listing_page &page) const{
 
       LOG_PRINT_L3("BlockchainLMDB::" << __func__);
       check_open();
 
+      page.next.clear();
+      if (!page.start_after.empty() && page.start_after.size() != sizeof(crypto::hash))
+        return false;
+
       TXN_PREFIX_RDONLY();
 
       MDB_cursor *cur_safex_account;
       RCURSOR(safex_account);
       cur_safex_account = m_cur_safex_account;
 
-      crypto::hash username_hash{};
-      uint8_t temp[sizeof(safex::create_account_data)];
+      MDB_val k, v;
+      std::string last_key;
+      uint64_t count = 0;
 
-      MDB_val_set(k, username_hash);
-      MDB_val_set(v, temp);
-
-      auto result = mdb_cursor_get(cur_safex_account, &k, &v, MDB_FIRST);
+      auto result = listing_page_start(cur_safex_account, k, v, page);
 
       while (result == MDB_SUCCESS)
       {
+          if (page.limit && count == page.limit) {
+              page.next = last_key;
+              break;
+          }
+
           safex::create_account_result sfx_account;
           const cryptonote::blobdata accblob((uint8_t*)v.mv_data, (uint8_t*)v.mv_data+v.mv_size);
 
@@ -5638,6 +6762,8 @@ bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txou
           std::string str_data{sfx_account.account_data.begin(),sfx_account.account_data.end()};
 
           safex_accounts.emplace_back(std::make_pair(str_username,str_data));
+          last_key.assign((const char *)k.mv_data, k.mv_size);
+          count++;
 
           result = mdb_cursor_get(cur_safex_account, &k, &v, MDB_NEXT);
       }
@@ -5658,9 +6784,6 @@ bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txou
       RCURSOR(safex_offer)
       cur_safex_offer = m_cur_safex_offer;
 
-      uint64_t output_index{};
-      bool edited = false;
-
       uint8_t temp[SAFEX_OFFER_DATA_MAX_SIZE + sizeof(crypto::hash)];
 
       MDB_val_set(k, offer_id);
@@ -5680,61 +6803,121 @@ bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txou
           std::string tmp{(char*)v.mv_data, v.mv_size};
           parse_and_validate_object_from_blob<safex::create_offer_result>(tmp,offer_result);
 
-          output_index = offer_result.output_id;
-          edited = offer_result.edited;
+          height = offer_result.height;
       }
 
-
-      tx_out_type out_type = edited ? tx_out_type::out_safex_offer_update : tx_out_type::out_safex_offer;
-
-      output_advanced_data_t adv_data = get_output_advanced_data(out_type, output_index);
-
-      height = adv_data.height;
+      TXN_POSTFIX_RDONLY();
 
       return true;
   }
 
 
     bool BlockchainLMDB::get_safex_offers( std::vector<safex::safex_offer> &safex_offers) const{
+        safex::listing_page page;
+        return get_safex_offers(safex_offers, safex::safex_offer_filter{}, page);
+    }
+
+    bool BlockchainLMDB::get_safex_offers( std::vector<safex::safex_offer> &safex_offers, const safex::safex_offer_filter &filter, safex::listing_page &page) const{
 
         LOG_PRINT_L3("BlockchainLMDB::" << __func__);
         check_open();
 
+        page.next.clear();
+        if (!page.start_after.empty() && page.start_after.size() != sizeof(crypto::hash))
+            return false;
+
         TXN_PREFIX_RDONLY();
 
-        MDB_cursor *cur_safex_offer;
-        RCURSOR(safex_offer)
-        cur_safex_offer = m_cur_safex_offer;
+        const bool use_index = !filter.seller.empty() || filter.price_peg_used || filter.only_active;
+        uint64_t count = 0;
 
-        crypto::hash offer_id{};
-        uint8_t temp[sizeof(safex::create_offer_result)];
+        if (!use_index)
+        {
+            MDB_cursor *cur_safex_offer;
+            RCURSOR(safex_offer)
+            cur_safex_offer = m_cur_safex_offer;
+
+            MDB_val k, v;
+            auto result = listing_page_start(cur_safex_offer, k, v, page);
+
+            while (result == MDB_SUCCESS)
+            {
+                if (page.limit && count == page.limit) {
+                    page.next = std::string{safex_offers.back().offer_id.data, sizeof(crypto::hash)};
+                    break;
+                }
+
+                safex::create_offer_result sfx_offer_result;
+                safex::safex_offer sfx_offer;
+                const cryptonote::blobdata offerblob((uint8_t*)v.mv_data, (uint8_t*)v.mv_data+v.mv_size);
+
+                if(!cryptonote::parse_and_validate_from_blob(offerblob, sfx_offer_result)){
+                    result = mdb_cursor_get(cur_safex_offer, &k, &v, MDB_NEXT);
+                    continue;
+                }
+
+                get_offer_from_record(sfx_offer_result, sfx_offer);
+                sfx_offer.quantity = sfx_offer_result.quantity;
+                sfx_offer.price = sfx_offer_result.price;
+                sfx_offer.active = sfx_offer_result.active;
+                safex_offers.emplace_back(sfx_offer);
+                count++;
 
-        MDB_val_set(k, offer_id);
-        MDB_val_set(v, temp);
+                result = mdb_cursor_get(cur_safex_offer, &k, &v, MDB_NEXT);
+            }
+
+            TXN_POSTFIX_RDONLY();
 
-        auto result = mdb_cursor_get(cur_safex_offer, &k, &v, MDB_FIRST);
+            return true;
+        }
+
+        //Walk the most selective index, remaining criteria are checked per offer
+        MDB_cursor *cur_index;
+        crypto::hash seller_hash{};
+        crypto::hash price_peg_id = filter.price_peg_id;
+        uint64_t active = 1;
+        MDB_val k;
+        if (!filter.seller.empty()) {
+            RCURSOR(safex_offer_seller);
+            cur_index = m_cur_safex_offer_seller;
+            seller_hash = safex::account_username{filter.seller}.hash();
+            k = {sizeof(seller_hash), (void *)&seller_hash};
+        } else if (filter.price_peg_used) {
+            RCURSOR(safex_offer_price_peg);
+            cur_index = m_cur_safex_offer_price_peg;
+            k = {sizeof(price_peg_id), (void *)&price_peg_id};
+        } else {
+            RCURSOR(safex_offer_active);
+            cur_index = m_cur_safex_offer_active;
+            k = {sizeof(active), (void *)&active};
+        }
 
+        MDB_val v;
+        auto result = listing_page_start_dup(cur_index, k, v, page);
         while (result == MDB_SUCCESS)
         {
-            safex::create_offer_result sfx_offer_result;
+            const crypto::hash offer_id = *(const crypto::hash *)v.mv_data;
+
             safex::safex_offer sfx_offer;
-            const cryptonote::blobdata offerblob((uint8_t*)v.mv_data, (uint8_t*)v.mv_data+v.mv_size);
+            if (!get_safex_offer_index_state(offer_id, sfx_offer))
+                return false;
 
-            if(!cryptonote::parse_and_validate_from_blob(offerblob, sfx_offer_result)){
-                result = mdb_cursor_get(cur_safex_offer, &k, &v, MDB_NEXT);
-                continue;
+            const bool matches = (filter.seller.empty() || sfx_offer.seller == filter.seller)
+                                 && (!filter.only_active || sfx_offer.active)
+                                 && (!filter.price_peg_used || (sfx_offer.price_peg_used && sfx_offer.price_peg_id == filter.price_peg_id));
+            if (matches) {
+                if (page.limit && count == page.limit) {
+                    page.next = std::string{safex_offers.back().offer_id.data, sizeof(crypto::hash)};
+                    break;
+                }
+                safex_offers.emplace_back(sfx_offer);
+                count++;
             }
 
-            result = get_offer(sfx_offer_result.offer_id,sfx_offer);
-            if(!result)
-                return false;
-            sfx_offer.quantity = sfx_offer_result.quantity;
-            sfx_offer.price = sfx_offer_result.price;
-            sfx_offer.active = sfx_offer_result.active;
-            safex_offers.emplace_back(sfx_offer);
-
-            result = mdb_cursor_get(cur_safex_offer, &k, &v, MDB_NEXT);
+            result = mdb_cursor_get(cur_index, &k, &v, MDB_NEXT_DUP);
         }
+        if (result != MDB_SUCCESS && result != MDB_NOTFOUND)
+            throw0(DB_ERROR(lmdb_error("DB error attempting to fetch safex offer index: ", result).c_str()));
 
         TXN_POSTFIX_RDONLY();
 
@@ -5795,48 +6978,38 @@ bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txou
 
   bool BlockchainLMDB::get_offer_stars_given(const crypto::hash offer_id, uint64_t &stars_received) const{
       LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-      check_open();
 
-      TXN_PREFIX_RDONLY();
+      safex::safex_offer_rating rating;
+      if (!get_offer_rating(offer_id, rating))
+        return false;
 
-      MDB_cursor *cur_safex_feedback;
-      RCURSOR(safex_feedback)
-      cur_safex_feedback = m_cur_safex_feedback;
+      stars_received = (rating.stars_sum * COIN)/rating.count;
 
+      return true;
+    }
 
-      uint8_t temp[sizeof(uint64_t)+sizeof(SAFEX_FEEDBACK_DATA_MAX_SIZE)];
+  bool BlockchainLMDB::get_offer_rating(const crypto::hash &offer_id, safex::safex_offer_rating &rating) const{
+      LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+      check_open();
+
+      TXN_PREFIX_RDONLY();
+      RCURSOR(safex_offer_rating)
 
       MDB_val_set(k, offer_id);
-      MDB_val_set(v, temp);
-      auto get_result = mdb_cursor_get(m_cur_safex_feedback, &k, &v, MDB_SET);
+      MDB_val v;
+      auto get_result = mdb_cursor_get(m_cur_safex_offer_rating, &k, &v, MDB_SET);
       if (get_result == MDB_NOTFOUND)
       {
         return false;
       }
-      get_result = mdb_cursor_get(m_cur_safex_feedback, &k, &v, MDB_FIRST_DUP);
-
-      if (get_result)
+      else if (get_result)
       {
-          throw0(DB_ERROR(lmdb_error(std::string("DB error attempting to fetch rating for offer with id: ").append(offer_id.data), get_result).c_str()));
-      }
-
-      stars_received = 0;
-      uint64_t feedbacks_count = 0;
-
-      while(get_result == MDB_SUCCESS){
-
-          safex::safex_feedback_db_data sfx_feedback;
-          blobdata tmp{(char*)v.mv_data, v.mv_size};
-          parse_and_validate_object_from_blob<safex::safex_feedback_db_data>(tmp,sfx_feedback);
-          stars_received += sfx_feedback.stars_given;
-          feedbacks_count++;
-
-          get_result = mdb_cursor_get(cur_safex_feedback, &k, &v, MDB_NEXT_DUP);
-
+        throw0(DB_ERROR(lmdb_error("DB error attempting to fetch offer rating: ", get_result).c_str()));
       }
 
-      stars_received = (stars_received * COIN)/feedbacks_count;
-
+      if (v.mv_size != sizeof(rating))
+        throw0(DB_ERROR("Unexpected safex offer rating size"));
+      memcpy(&rating, v.mv_data, sizeof(rating));
 
       TXN_POSTFIX_RDONLY();
 
@@ -5892,9 +7065,7 @@ bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txou
         RCURSOR(safex_offer)
         cur_safex_offer = m_cur_safex_offer;
 
-        uint64_t output_index{};
-        uint64_t output_index_creation{};
-        bool edited = false;
+        safex::create_offer_result offer_result;
 
         uint8_t temp[SAFEX_OFFER_DATA_MAX_SIZE + sizeof(crypto::hash)];
 
@@ -5911,18 +7082,31 @@ bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txou
         }
         else if (get_result == MDB_SUCCESS)
         {
-            safex::create_offer_result offer_result;
             std::string tmp{(char*)v.mv_data, v.mv_size};
             parse_and_validate_object_from_blob<safex::create_offer_result>(tmp,offer_result);
+        }
 
-            offer.quantity = offer_result.quantity;
+        get_offer_from_record(offer_result, offer);
 
+        TXN_POSTFIX_RDONLY();
 
-            output_index = offer_result.output_id;
-            output_index_creation = offer_result.output_id_creation;
-            edited = offer_result.edited;
-        }
+        return true;
+    };
 
+    void BlockchainLMDB::get_offer_from_record(const safex::create_offer_result &offer_result, safex::safex_offer &offer) const{
+
+        LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+        check_open();
+
+        TXN_PREFIX_RDONLY();
+
+        const uint64_t output_index = offer_result.output_id;
+        const uint64_t output_index_creation = offer_result.output_id_creation;
+        const bool edited = offer_result.edited;
+
+        offer.quantity = offer_result.quantity;
+        offer.height = offer_result.height;
+        offer.height_creation = offer_result.height_creation;
 
         tx_out_type out_type = edited ? tx_out_type::out_safex_offer_update : tx_out_type::out_safex_offer;
         uint64_t output_id;
@@ -5940,39 +7124,39 @@ bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txou
 
         output_advanced_data_t current = AUTO_VAL_INIT(current);
 
-        get_result = mdb_cursor_get(cur_output_advanced, &key, &value_blob, MDB_SET);
+        auto get_result = mdb_cursor_get(cur_output_advanced, &key, &value_blob, MDB_SET);
 
         if (get_result == MDB_SUCCESS)
         {
             current = parse_output_advanced_data_from_mdb(value_blob);
 
             if( edited ){
-              safex::edit_offer_data offer_result;
-              parse_and_validate_object_from_blob<safex::edit_offer_data>(current.data,offer_result);
-
-              offer.description = offer_result.description;
-              offer.seller = std::string{offer_result.seller.begin(),offer_result.seller.end()};
-              offer.price = offer_result.price;
-              offer.offer_id = offer_result.offer_id;
-              offer.active = offer_result.active;
-              offer.title = std::string{offer_result.title.begin(),offer_result.title.end()};
-              offer.price_peg_id = offer_result.price_peg_id;
-              offer.price_peg_used = offer_result.price_peg_used;
-              offer.min_sfx_price = offer_result.min_sfx_price;
+              safex::edit_offer_data offer_data;
+              parse_and_validate_object_from_blob<safex::edit_offer_data>(current.data,offer_data);
+
+              offer.description = offer_data.description;
+              offer.seller = std::string{offer_data.seller.begin(),offer_data.seller.end()};
+              offer.price = offer_data.price;
+              offer.offer_id = offer_data.offer_id;
+              offer.active = offer_data.active;
+              offer.title = std::string{offer_data.title.begin(),offer_data.title.end()};
+              offer.price_peg_id = offer_data.price_peg_id;
+              offer.price_peg_used = offer_data.price_peg_used;
+              offer.min_sfx_price = offer_data.min_sfx_price;
             }
             else {
-              safex::create_offer_data offer_result;
-              parse_and_validate_object_from_blob<safex::create_offer_data>(current.data,offer_result);
-
-              offer.description = offer_result.description;
-              offer.seller = std::string{offer_result.seller.begin(),offer_result.seller.end()};
-              offer.price = offer_result.price;
-              offer.offer_id = offer_result.offer_id;
-              offer.active = offer_result.active;
-              offer.title = std::string{offer_result.title.begin(),offer_result.title.end()};
-              offer.price_peg_id = offer_result.price_peg_id;
-              offer.price_peg_used = offer_result.price_peg_used;
-              offer.min_sfx_price = offer_result.min_sfx_price;
+              safex::create_offer_data offer_data;
+              parse_and_validate_object_from_blob<safex::create_offer_data>(current.data,offer_data);
+
+              offer.description = offer_data.description;
+              offer.seller = std::string{offer_data.seller.begin(),offer_data.seller.end()};
+              offer.price = offer_data.price;
+              offer.offer_id = offer_data.offer_id;
+              offer.active = offer_data.active;
+              offer.title = std::string{offer_data.title.begin(),offer_data.title.end()};
+              offer.price_peg_id = offer_data.price_peg_id;
+              offer.price_peg_used = offer_data.price_peg_used;
+              offer.min_sfx_price = offer_data.min_sfx_price;
             }
 
         }
@@ -5996,11 +7180,11 @@ bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txou
       if (get_result == MDB_SUCCESS)
       {
         current = parse_output_advanced_data_from_mdb(v_blob);
-        safex::create_offer_data offer_result;
-        parse_and_validate_object_from_blob<safex::create_offer_data>(current.data,offer_result);
+        safex::create_offer_data offer_data;
+        parse_and_validate_object_from_blob<safex::create_offer_data>(current.data,offer_data);
 
-        offer.seller_address = offer_result.seller_address;
-        offer.seller_private_view_key = offer_result.seller_private_view_key;
+        offer.seller_address = offer_data.seller_address;
+        offer.seller_private_view_key = offer_data.seller_private_view_key;
       }
       else if (get_result == MDB_NOTFOUND)
       {
@@ -6010,8 +7194,6 @@ bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txou
         throw0(DB_ERROR(lmdb_error("DB error attempting to get advanced output data: ", get_result).c_str()));
 
         TXN_POSTFIX_RDONLY();
-
-        return true;
     };
 
     bool BlockchainLMDB::get_offer_seller(const crypto::hash offer_id, std::string &username) const{
@@ -6173,40 +7355,53 @@ bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txou
     }
 
     bool BlockchainLMDB::get_safex_feedbacks( std::vector<safex::safex_feedback> &safex_feedbacks, const crypto::hash& offer_id) const{
+      safex::listing_page page;
+      return get_safex_feedbacks(safex_feedbacks, offer_id, page);
+    }
+
+    bool BlockchainLMDB::get_safex_feedbacks( std::vector<safex::safex_feedback> &safex_feedbacks, const crypto::hash& offer_id, safex::listing_page &page) const{
       LOG_PRINT_L3("BlockchainLMDB::" << __func__);
       check_open();
 
+      //feedbacks of an offer are sorted by output id, it is the leading field of the stored blob
+      page.next.clear();
+      if (!page.start_after.empty() && page.start_after.size() != sizeof(uint64_t))
+        return false;
+
       TXN_PREFIX_RDONLY();
 
       MDB_cursor *cur_safex_feedback;
       RCURSOR(safex_feedback)
       cur_safex_feedback = m_cur_safex_feedback;
 
-
-      uint8_t temp[sizeof(uint64_t)+sizeof(SAFEX_FEEDBACK_DATA_MAX_SIZE)];
-
       MDB_val_set(k, offer_id);
-      MDB_val_set(v, temp);
-      auto get_result = mdb_cursor_get(cur_safex_feedback, &k, &v, MDB_SET);
-      if (get_result == MDB_NOTFOUND)
+      MDB_val v;
+      auto get_result = listing_page_start_dup(cur_safex_feedback, k, v, page);
+      if (get_result == MDB_NOTFOUND && page.start_after.empty())
       {
         return false;
       }
 
-      MDB_val_set(k2, offer_id);
-      MDB_val_set(v2, temp);
-      get_result = mdb_cursor_get(cur_safex_feedback, &k2, &v2, MDB_FIRST_DUP);
+      std::string last_key;
+      uint64_t count = 0;
 
       while (get_result == MDB_SUCCESS)
       {
+          if (page.limit && count == page.limit) {
+              page.next = last_key;
+              break;
+          }
+
           safex::safex_feedback_db_data sfx_feedback;
-          const cryptonote::blobdata tmp((uint8_t*)v2.mv_data, (uint8_t*)v2.mv_data+v2.mv_size);
+          const cryptonote::blobdata tmp((uint8_t*)v.mv_data, (uint8_t*)v.mv_data+v.mv_size);
           parse_and_validate_object_from_blob<safex::safex_feedback_db_data>(tmp,sfx_feedback);
 
           std::string comment{sfx_feedback.comment.begin(),sfx_feedback.comment.end()};
 
-          get_result = mdb_cursor_get(cur_safex_feedback, &k2, &v2, MDB_NEXT_DUP);
+          get_result = mdb_cursor_get(cur_safex_feedback, &k, &v, MDB_NEXT_DUP);
           safex_feedbacks.emplace_back(sfx_feedback.stars_given, comment, offer_id);
+          last_key = tmp.substr(0, sizeof(uint64_t));
+          count++;
       }
 
       TXN_POSTFIX_RDONLY();
@@ -6216,25 +7411,33 @@ bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txou
 
     bool BlockchainLMDB::get_safex_price_pegs(std::vector<safex::safex_price_peg> &safex_price_pegs,
                                               const std::string &currency) const {
+      safex::listing_page page;
+      return get_safex_price_pegs(safex_price_pegs, currency, page);
+    }
+
+    bool BlockchainLMDB::get_safex_price_pegs(std::vector<safex::safex_price_peg> &safex_price_pegs,
+                                              const std::string &currency, safex::listing_page &page) const {
 
       LOG_PRINT_L3("BlockchainLMDB::" << __func__);
       check_open();
 
+      page.next.clear();
+      if (!page.start_after.empty() && page.start_after.size() != sizeof(crypto::hash))
+        return false;
+
       TXN_PREFIX_RDONLY();
 
       MDB_cursor *cur_safex_price_peg;
       RCURSOR(safex_price_peg)
       cur_safex_price_peg = m_cur_safex_price_peg;
 
-      crypto::hash price_peg_id{};
-      uint8_t temp[sizeof(safex::create_price_peg_result)];
-
-      MDB_val_set(k, price_peg_id);
-      MDB_val_set(v, temp);
+      MDB_val k, v;
+      std::string last_key;
+      uint64_t count = 0;
 
       bool currency_search = (currency != "");
 
-      auto result = mdb_cursor_get(cur_safex_price_peg, &k, &v, MDB_FIRST);
+      auto result = listing_page_start(cur_safex_price_peg, k, v, page);
 
       while (result == MDB_SUCCESS)
       {
@@ -6247,13 +7450,16 @@ bool BlockchainLMDB::is_valid_transaction_output_type(const txout_target_v &txou
           continue;
         }
 
-        if(currency_search){
-          std::string db_currency{sfx_price_peg_result.currency.begin(),sfx_price_peg_result.currency.end()};
-          if(currency == db_currency)
-            safex_price_pegs.emplace_back(sfx_price_peg_result.title,sfx_price_peg_result.creator,sfx_price_peg_result.currency,sfx_price_peg_result.description,sfx_price_peg_result.price_peg_id,sfx_price_peg_result.rate);
-        }
-        else
+        std::string db_currency{sfx_price_peg_result.currency.begin(),sfx_price_peg_result.currency.end()};
+        if(!currency_search || currency == db_currency) {
+          if (page.limit && count == page.limit) {
+            page.next = last_key;
+            break;
+          }
           safex_price_pegs.emplace_back(sfx_price_peg_result.title,sfx_price_peg_result.creator,sfx_price_peg_result.currency,sfx_price_peg_result.description,sfx_price_peg_result.price_peg_id,sfx_price_peg_result.rate);
+          last_key.assign((const char *)k.mv_data, k.mv_size);
+          count++;
+        }
 
         result = mdb_cursor_get(cur_safex_price_peg, &k, &v, MDB_NEXT);
       }
@@ -29,11 +29,15 @@
 #pragma once
 
 #include <atomic>
+#include <list>
+#include <map>
+#include <tuple>
 
 #include "blockchain_db/blockchain_db.h"
 #include "cryptonote_basic/blobdatatype.h" // for type blobdata
 #include "ringct/rctTypes.h"
 #include <boost/thread/tss.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include <lmdb.h>
 #include <safex/safex_account.h>
@@ -56,6 +60,7 @@ typedef struct mdb_txn_cursors
   MDB_cursor *m_txc_output_txs;
   MDB_cursor *m_txc_output_amounts;
   MDB_cursor *m_txc_output_token_amounts;
+  MDB_cursor *m_txc_output_distribution;
 
   MDB_cursor *m_txc_txs;
   MDB_cursor *m_txc_tx_indices;
@@ -78,6 +83,11 @@ typedef struct mdb_txn_cursors
   MDB_cursor *m_txc_safex_offer;
   MDB_cursor *m_txc_safex_feedback;
   MDB_cursor *m_txc_safex_price_peg;
+  MDB_cursor *m_txc_cumulative_interest;
+  MDB_cursor *m_txc_safex_offer_seller;
+  MDB_cursor *m_txc_safex_offer_active;
+  MDB_cursor *m_txc_safex_offer_price_peg;
+  MDB_cursor *m_txc_safex_offer_rating;
 
 } mdb_txn_cursors;
 
@@ -87,6 +97,7 @@ typedef struct mdb_txn_cursors
 #define m_cur_output_txs	m_cursors->m_txc_output_txs
 #define m_cur_output_amounts	m_cursors->m_txc_output_amounts
 #define m_cur_output_token_amounts    m_cursors->m_txc_output_token_amounts
+#define m_cur_output_distribution	m_cursors->m_txc_output_distribution
 #define m_cur_txs	m_cursors->m_txc_txs
 #define m_cur_tx_indices	m_cursors->m_txc_tx_indices
 #define m_cur_tx_outputs	m_cursors->m_txc_tx_outputs
@@ -104,6 +115,11 @@ typedef struct mdb_txn_cursors
 #define m_cur_safex_offer	m_cursors->m_txc_safex_offer
 #define m_cur_safex_feedback	m_cursors->m_txc_safex_feedback
 #define m_cur_safex_price_peg	m_cursors->m_txc_safex_price_peg
+#define m_cur_cumulative_interest	m_cursors->m_txc_cumulative_interest
+#define m_cur_safex_offer_seller	m_cursors->m_txc_safex_offer_seller
+#define m_cur_safex_offer_active	m_cursors->m_txc_safex_offer_active
+#define m_cur_safex_offer_price_peg	m_cursors->m_txc_safex_offer_price_peg
+#define m_cur_safex_offer_rating	m_cursors->m_txc_safex_offer_rating
 
 typedef struct mdb_rflags
 {
@@ -114,6 +130,7 @@ typedef struct mdb_rflags
   bool m_rf_output_txs;
   bool m_rf_output_amounts;
   bool m_rf_output_token_amounts;
+  bool m_rf_output_distribution;
   bool m_rf_txs;
   bool m_rf_tx_indices;
   bool m_rf_tx_outputs;
@@ -131,6 +148,11 @@ typedef struct mdb_rflags
   bool m_rf_safex_offer;
   bool m_rf_safex_feedback;
   bool m_rf_safex_price_peg;
+  bool m_rf_cumulative_interest;
+  bool m_rf_safex_offer_seller;
+  bool m_rf_safex_offer_active;
+  bool m_rf_safex_offer_price_peg;
+  bool m_rf_safex_offer_rating;
 } mdb_rflags;
 
 typedef struct mdb_threadinfo
@@ -171,6 +193,7 @@ struct mdb_txn_safe
   static void prevent_new_txns();
   static void wait_no_active_txns();
   static void allow_new_txns();
+  static void increment_txns(int i);
 
   mdb_threadinfo* m_tinfo;
   MDB_txn* m_txn;
@@ -297,6 +320,7 @@ public:
   virtual std::vector<uint64_t> get_tx_amount_output_indices(const uint64_t tx_id) const override;
 
   virtual bool has_key_image(const crypto::key_image& img) const override;
+  virtual void has_key_images(const std::vector<crypto::key_image> &imgs, std::vector<bool> &found) const override;
 
   virtual void add_txpool_tx(const transaction &tx, const txpool_tx_meta_t& meta) override;
   virtual void update_txpool_tx(const crypto::hash &txid, const txpool_tx_meta_t& meta) override;
@@ -313,6 +337,7 @@ public:
   virtual bool for_all_transactions(std::function<bool(const crypto::hash&, const cryptonote::transaction&)>) const override;
   virtual bool for_all_outputs(std::function<bool(uint64_t amount, const crypto::hash &tx_hash, uint64_t height, size_t tx_idx)> f, const tx_out_type output_type) const override;
   virtual bool for_all_outputs(uint64_t amount, const std::function<bool(uint64_t height)> &f, const tx_out_type output_type) const override;
+  virtual bool get_output_distribution(uint64_t amount, const tx_out_type output_type, uint64_t from_height, uint64_t to_height, std::vector<uint64_t> &distribution, uint64_t &base) const override;
   virtual bool for_all_advanced_outputs(std::function<bool(const crypto::hash &tx_hash, uint64_t height, uint64_t output_id, const cryptonote::txout_to_script& txout)> f, const tx_out_type output_type) const override;
 
   virtual uint64_t get_current_staked_token_sum() const override;
@@ -321,6 +346,7 @@ public:
   virtual std::vector<uint64_t> get_token_stake_expiry_outputs(const uint64_t block_height) const override;
   virtual bool get_interval_interest_map(const uint64_t start_interval, const uint64_t  end_interval, safex::map_interval_interest &map) const override;
   virtual uint64_t calculate_staked_token_interest_for_output(const txin_to_script &txin, const uint64_t unlock_height) const override;
+  virtual bool get_cumulative_interest_for_interval(const uint64_t interval, uint64_t &cumulative_interest) const override;
   virtual bool get_account_key(const safex::account_username &username, crypto::public_key &pkey) const override;
   virtual bool get_account_data(const safex::account_username &username, std::vector<uint8_t> &data) const override;
   virtual bool get_offer(const crypto::hash offer_id, safex::safex_offer &offer) const override;
@@ -330,11 +356,16 @@ public:
   virtual bool get_offer_active_status(const crypto::hash offer_id, bool &active) const override;
 
   virtual bool get_safex_accounts( std::vector<std::pair<std::string,std::string>> &safex_accounts) const override;
+  virtual bool get_safex_accounts( std::vector<std::pair<std::string,std::string>> &safex_accounts, safex::listing_page &page) const override;
   virtual bool get_safex_offers(std::vector<safex::safex_offer> &offers) const override;
+  virtual bool get_safex_offers(std::vector<safex::safex_offer> &offers, const safex::safex_offer_filter &filter, safex::listing_page &page) const override;
   virtual bool get_safex_offer_height( crypto::hash &offer_id, uint64_t& height) const override;
   virtual bool get_offer_stars_given(const crypto::hash offer_id, uint64_t &stars_received) const override;
+  virtual bool get_offer_rating(const crypto::hash &offer_id, safex::safex_offer_rating &rating) const override;
   virtual bool get_safex_feedbacks( std::vector<safex::safex_feedback> &safex_feedbacks, const crypto::hash& offer_id) const override;
+  virtual bool get_safex_feedbacks( std::vector<safex::safex_feedback> &safex_feedbacks, const crypto::hash& offer_id, safex::listing_page &page) const override;
   virtual bool get_safex_price_pegs( std::vector<safex::safex_price_peg> &safex_price_pegs, const std::string& currency) const override;
+  virtual bool get_safex_price_pegs( std::vector<safex::safex_price_peg> &safex_price_pegs, const std::string& currency, safex::listing_page &page) const override;
   virtual bool get_safex_price_peg( const crypto::hash& price_peg_id,safex::safex_price_peg &safex_price_peg) const override;
 
   virtual bool get_table_sizes( std::vector<uint64_t> &table_sizes) const override;
@@ -359,6 +390,11 @@ public:
   virtual void block_txn_abort() override;
   virtual bool block_rtxn_start(MDB_txn **mtxn, mdb_txn_cursors **mcur) const;
   virtual void block_rtxn_stop() const;
+  bool rtxn_held() const;
+
+  virtual bool snapshot_start() const override;
+  virtual void snapshot_stop() const override;
+  virtual void get_reader_count(uint64_t &readers, uint64_t &max_readers) const override;
 
   virtual void pop_block(block& blk, std::vector<transaction>& txs) override;
 
@@ -413,6 +449,16 @@ private:
 
   void remove_output(const uint64_t amount, const uint64_t& out_index, tx_out_type output_type);
 
+  // number of outputs of the amount created below the given height, found by bisecting the amount output index
+  uint64_t get_num_outputs_below_height(MDB_cursor *cur_output_amount, const uint64_t amount, const uint64_t num_elems, const uint64_t height) const;
+
+  // height of the first block with a timestamp at or after the given one, block timestamps taken as monotone
+  uint64_t get_first_block_height_at_time(const uint64_t timestamp, const uint64_t blockchain_height) const;
+
+  // keep the cumulative per-height output count of (amount, output_type) in step with the output tables
+  void add_output_distribution_entry(const uint64_t amount, const tx_out_type output_type, const uint64_t height);
+  void remove_output_distribution_entry(const uint64_t amount, const tx_out_type output_type, const uint64_t height);
+
   virtual void add_spent_key(const crypto::key_image& k_image) override;
 
   virtual void remove_spent_key(const crypto::key_image& k_image) override;
@@ -460,6 +506,21 @@ private:
   // migrate from older DB version to current
   void migrate(const uint32_t oldversion);
 
+  // build cumulative interest table for all finished intervals
+  void migrate_1_2();
+
+  // build seller, active status and price peg indexes for existing offers
+  void migrate_2_3();
+
+  // store offer creation and last edit heights in offer records
+  void migrate_3_4();
+
+  // build rating totals for offers that already have feedback
+  void migrate_4_5();
+
+  // build the cumulative output distribution for existing cash and token outputs
+  void migrate_5_6();
+
   void cleanup_batch();
 
   virtual bool is_valid_transaction_output_type(const txout_target_v &txout);
@@ -478,6 +539,13 @@ private:
   uint64_t update_current_staked_token_sum(const uint64_t delta, int sign);
   uint64_t update_network_fee_sum_for_interval(const uint64_t interval_starting_block, const uint64_t collected_fee) override;
 
+  /**
+   * Calculate interest per staked token for one interval
+   *
+   * @param interval interval number
+   * @return safex cash interest per token, from collected fee and staked token sum of the interval
+   */
+  uint64_t get_interest_for_interval(const uint64_t interval) const;
   /**
      * Add new account to database
      *
@@ -613,6 +681,17 @@ private:
     */
     void create_safex_feedback(const safex::safex_feedback& feedback);
     /**
+    * Add a feedback to, or take it out of, the rating totals of its offer
+    *
+    * @param offer_id ID of offer where feedback is given
+    * @param stars_given rating of the feedback
+    * @param add true when the feedback is added, false when it is removed
+    *
+    * If any of this cannot be done, it throw the corresponding subclass of DB_EXCEPTION
+    *
+    */
+    void update_offer_rating(const crypto::hash& offer_id, const uint8_t stars_given, const bool add);
+    /**
     * Remove advanced output from DB
     *
     * @param out_type Type of the advanced output
@@ -691,6 +770,24 @@ private:
     */
     void restore_safex_offer_data(safex::create_offer_result& sfx_offer);
 
+    /**
+     * Secondary offer indexes (seller, active status, price peg) maintenance
+     *
+     * Index entries are removed before an offer record changes and added
+     * back once the record and its advanced output are in place.
+    */
+    bool get_safex_offer_index_state(const crypto::hash &offer_id, safex::safex_offer &offer) const;
+    void add_safex_offer_index(const safex::safex_offer &offer);
+    void remove_safex_offer_index(const safex::safex_offer &offer);
+
+    /**
+     * Fill offer with data from offer record and its advanced outputs
+     *
+     * @param offer_result offer record from the offer table
+     * @param offer offer to fill
+    */
+    void get_offer_from_record(const safex::create_offer_result &offer_result, safex::safex_offer &offer) const;
+
     /**
      * Restore safex price_peg data by getting it from advanced output table
      *
@@ -706,6 +803,10 @@ protected:
 
   bool remove_staked_token_for_interval(const uint64_t interval) override;
 
+  uint64_t update_cumulative_interest_for_interval(const uint64_t interval) override;
+
+  bool remove_cumulative_interest_for_interval(const uint64_t interval) override;
+
 private:
   MDB_env* m_env;
 
@@ -720,6 +821,7 @@ private:
   MDB_dbi m_output_txs;
   MDB_dbi m_output_amounts;
   MDB_dbi m_output_token_amounts;
+  MDB_dbi m_output_distribution;
 
 
   MDB_dbi m_spent_keys;
@@ -743,6 +845,11 @@ private:
   MDB_dbi m_safex_offer;
   MDB_dbi m_safex_feedback;
   MDB_dbi m_safex_price_peg;
+  MDB_dbi m_cumulative_interest;
+  MDB_dbi m_safex_offer_seller;
+  MDB_dbi m_safex_offer_active;
+  MDB_dbi m_safex_offer_price_peg;
+  MDB_dbi m_safex_offer_rating;
 
   mutable uint64_t m_cum_size;	// used in batch size estimation
   mutable unsigned int m_cum_count;
@@ -757,6 +864,20 @@ private:
   mdb_txn_cursors m_wcursors;
   mutable boost::thread_specific_ptr<mdb_threadinfo> m_tinfo;
 
+  // LRU of get_output_histogram results keyed by (amount, output type, chain height)
+  struct output_histogram_cache_entry
+  {
+    crypto::hash top_hash; // guards against a reorg back to the same height
+    uint64_t total;
+    uint64_t unlocked;
+    uint64_t recent_height; // first recent block height the recent count was computed for
+    uint64_t recent;
+  };
+  typedef std::tuple<uint64_t, uint64_t, uint64_t> output_histogram_cache_key;
+  mutable boost::mutex m_output_histogram_cache_lock;
+  mutable std::list<output_histogram_cache_key> m_output_histogram_cache_lru;
+  mutable std::map<output_histogram_cache_key, std::pair<output_histogram_cache_entry, std::list<output_histogram_cache_key>::iterator>> m_output_histogram_cache;
+
 
 #if defined(__arm__)
   // force a value so it can compile with 32-bit ARM
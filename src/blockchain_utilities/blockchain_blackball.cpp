@@ -32,6 +32,7 @@
 #include <boost/algorithm/string.hpp>
 #include "common/command_line.h"
 #include "common/varint.h"
+#include "common/threadpool.h"
 #include "cryptonote_core/tx_pool.h"
 #include "cryptonote_core/cryptonote_core.h"
 #include "cryptonote_core/blockchain.h"
@@ -43,10 +44,13 @@
 #undef SAFEX_DEFAULT_LOG_CATEGORY
 #define SAFEX_DEFAULT_LOG_CATEGORY "bcutil"
 
+#define TXS_PER_SHARD 4096 // transactions parsed by one thread pool task
+
 namespace po = boost::program_options;
 using namespace epee;
 using namespace cryptonote;
 
+#pragma pack(push, 1)
 struct output_data
 {
   uint64_t amount;
@@ -54,19 +58,41 @@ struct output_data
   output_data(uint64_t a, uint64_t i): amount(a), index(i) {}
   bool operator==(const output_data &other) const { return other.amount == amount && other.index == index; }
 };
-namespace std
+
+// how far an input db was scanned, and the chain it was scanned on
+struct scan_progress
 {
-  template<> struct hash<output_data>
-  {
-    size_t operator()(const output_data &od) const
-    {
-      const uint64_t data[2] = {od.amount, od.index};
-      crypto::hash h;
-      crypto::cn_fast_hash(data, 2 * sizeof(uint64_t), h);
-      return reinterpret_cast<const std::size_t &>(h);
-    }
-  };
-}
+  uint64_t next_idx;
+  uint64_t height;
+  crypto::hash top_hash;
+};
+#pragma pack(pop)
+// a spending input, with its ring made absolute (and thus sorted)
+struct ring_input
+{
+  crypto::key_image key_image;
+  uint64_t amount;
+  std::vector<uint64_t> ring;
+};
+
+struct tx_shard
+{
+  uint64_t first_idx;
+  uint64_t last_idx;
+  std::vector<ring_input> inputs;
+  std::string error;
+};
+
+// blackball state carried over between runs, so only new transactions need scanning
+struct blackball_cache
+{
+  MDB_env *env;
+  MDB_dbi dbi_rings; // key image -> absolute ring, narrowed down as more rings are seen
+  MDB_dbi dbi_outputs; // output -> key images of the main chain rings it is in
+  MDB_dbi dbi_spent; // outputs known to be spent
+  MDB_dbi dbi_pending; // newly spent outputs (and their keys) not yet blackballed nor their rings checked again
+  MDB_dbi dbi_progress; // input db -> next tx index to scan, and the chain tip it was scanned up to
+};
 
 static std::string get_default_db_path()
 {
@@ -76,12 +102,51 @@ static std::string get_default_db_path()
   return dir.string();
 }
 
-static bool for_all_transactions(const std::string &filename, const std::function<bool(const cryptonote::transaction_prefix&)> &f)
+static int resize_env(MDB_env *env, const char *db_path, size_t needed)
+{
+  MDB_envinfo mei;
+  MDB_stat mst;
+  int ret;
+
+  needed = std::max(needed, (size_t)(100ul * 1024 * 1024)); // at least 100 MB
+
+  ret = mdb_env_info(env, &mei);
+  if (ret)
+    return ret;
+  ret = mdb_env_stat(env, &mst);
+  if (ret)
+    return ret;
+  uint64_t size_used = mst.ms_psize * mei.me_last_pgno;
+  uint64_t mapsize = mei.me_mapsize;
+  if (size_used + needed > mei.me_mapsize)
+  {
+    try
+    {
+      boost::filesystem::path path(db_path);
+      boost::filesystem::space_info si = boost::filesystem::space(path);
+      if(si.available < needed)
+      {
+        MERROR("!! WARNING: Insufficient free space to extend database !!: " << (si.available >> 20L) << " MB available");
+        return ENOSPC;
+      }
+    }
+    catch(...)
+    {
+      // print something but proceed.
+      MWARNING("Unable to query free disk space.");
+    }
+
+    mapsize += needed;
+  }
+  return mdb_env_set_mapsize(env, mapsize);
+}
+
+static MDB_env *open_txs_db(const std::string &filename, MDB_dbi &dbi, uint64_t &num_txs)
 {
   MDB_env *env;
-  MDB_dbi dbi;
   MDB_txn *txn;
   MDB_cursor *cur;
+  MDB_val k, v;
   int dbr;
   bool tx_active = false;
 
@@ -89,12 +154,12 @@ static bool for_all_transactions(const std::string &filename, const std::functio
   if (dbr) throw std::runtime_error("Failed to create LDMB environment: " + std::string(mdb_strerror(dbr)));
   dbr = mdb_env_set_maxdbs(env, 2);
   if (dbr) throw std::runtime_error("Failed to set max env dbs: " + std::string(mdb_strerror(dbr)));
-  const std::string actual_filename = filename;
-  dbr = mdb_env_open(env, actual_filename.c_str(), 0, 0664);
+  // read transactions are opened from the thread pool workers
+  dbr = mdb_env_open(env, filename.c_str(), MDB_RDONLY | MDB_NOTLS, 0664);
   if (dbr) throw std::runtime_error("Failed to open rings database file '"
-      + actual_filename + "': " + std::string(mdb_strerror(dbr)));
+      + filename + "': " + std::string(mdb_strerror(dbr)));
 
-  dbr = mdb_txn_begin(env, NULL, 0, &txn);
+  dbr = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
   if (dbr) throw std::runtime_error("Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
   epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
   tx_active = true;
@@ -103,44 +168,280 @@ static bool for_all_transactions(const std::string &filename, const std::functio
   if (dbr)
     dbr = mdb_dbi_open(txn, "txs", MDB_INTEGERKEY, &dbi);
   if (dbr) throw std::runtime_error("Failed to open LMDB dbi: " + std::string(mdb_strerror(dbr)));
+
   dbr = mdb_cursor_open(txn, dbi, &cur);
   if (dbr) throw std::runtime_error("Failed to create LMDB cursor: " + std::string(mdb_strerror(dbr)));
+  dbr = mdb_cursor_get(cur, &k, &v, MDB_LAST);
+  if (dbr && dbr != MDB_NOTFOUND) throw std::runtime_error("Failed to enumerate transactions: " + std::string(mdb_strerror(dbr)));
+  num_txs = dbr ? 0 : *(const uint64_t*)k.mv_data + 1;
+  mdb_cursor_close(cur);
 
-  MDB_val k;
-  MDB_val v;
-  bool fret = true;
+  mdb_txn_commit(txn);
+  tx_active = false;
+  return env;
+}
+
+// parses the transactions of a shard and collects the rings of their inputs
+static void scan_shard(MDB_env *env, MDB_dbi dbi, bool rct_only, tx_shard &shard)
+{
+  MDB_txn *txn;
+  MDB_cursor *cur;
+  int dbr;
+  bool tx_active = false;
 
-  MDB_cursor_op op = MDB_FIRST;
-  while (1)
+  try
   {
-    int ret = mdb_cursor_get(cur, &k, &v, op);
-    op = MDB_NEXT;
-    if (ret == MDB_NOTFOUND)
-      break;
-    if (ret)
-      throw std::runtime_error("Failed to enumerate transactions: " + std::string(mdb_strerror(ret)));
-
-    cryptonote::transaction_prefix tx;
-    blobdata bd;
-    bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
-    std::stringstream ss;
-    ss << bd;
-    binary_archive<false> ba(ss);
-    bool r = do_serialize(ba, tx);
-    CHECK_AND_ASSERT_MES(r, false, "Failed to parse transaction from blob");
-
-    if (!f(tx)) {
-      fret = false;
-      break;
+    dbr = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
+    if (dbr) throw std::runtime_error("Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+    epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
+    tx_active = true;
+    dbr = mdb_cursor_open(txn, dbi, &cur);
+    if (dbr) throw std::runtime_error("Failed to create LMDB cursor: " + std::string(mdb_strerror(dbr)));
+    epee::misc_utils::auto_scope_leave_caller cur_dtor = epee::misc_utils::create_scope_leave_handler([&](){mdb_cursor_close(cur);});
+
+    uint64_t idx = shard.first_idx;
+    MDB_val k = {sizeof(idx), (void*)&idx};
+    MDB_val v;
+    for (dbr = mdb_cursor_get(cur, &k, &v, MDB_SET_RANGE); dbr == 0; dbr = mdb_cursor_get(cur, &k, &v, MDB_NEXT))
+    {
+      if (*(const uint64_t*)k.mv_data > shard.last_idx)
+        break;
+
+      cryptonote::transaction_prefix tx;
+      blobdata bd;
+      bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+      std::stringstream ss;
+      ss << bd;
+      binary_archive<false> ba(ss);
+      if (!do_serialize(ba, tx))
+        throw std::runtime_error("Failed to parse transaction from blob");
+
+      for (const auto &in: tx.vin)
+      {
+        if (in.type() != typeid(txin_to_key))
+          continue;
+        const auto &txin = boost::get<txin_to_key>(in);
+        if (rct_only && txin.amount != 0)
+          continue;
+        shard.inputs.push_back({txin.k_image, txin.amount, cryptonote::relative_output_offsets_to_absolute(txin.key_offsets)});
+      }
     }
+    if (dbr && dbr != MDB_NOTFOUND)
+      throw std::runtime_error("Failed to enumerate transactions: " + std::string(mdb_strerror(dbr)));
   }
+  catch (const std::exception &e)
+  {
+    shard.error = e.what();
+  }
+}
 
+static void open_cache(const std::string &path, blackball_cache &cache)
+{
+  MDB_txn *txn;
+  int dbr;
+  bool tx_active = false;
+
+  tools::create_directories_if_necessary(path);
+
+  dbr = mdb_env_create(&cache.env);
+  if (dbr) throw std::runtime_error("Failed to create LDMB environment: " + std::string(mdb_strerror(dbr)));
+  dbr = mdb_env_set_maxdbs(cache.env, 5);
+  if (dbr) throw std::runtime_error("Failed to set max env dbs: " + std::string(mdb_strerror(dbr)));
+  dbr = mdb_env_open(cache.env, path.c_str(), 0, 0664);
+  if (dbr) throw std::runtime_error("Failed to open blackball cache '" + path + "': " + std::string(mdb_strerror(dbr)));
+  dbr = resize_env(cache.env, path.c_str(), 0);
+  if (dbr) throw std::runtime_error("Failed to set env map size: " + std::string(mdb_strerror(dbr)));
+
+  dbr = mdb_txn_begin(cache.env, NULL, 0, &txn);
+  if (dbr) throw std::runtime_error("Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+  epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
+  tx_active = true;
+
+  dbr = mdb_dbi_open(txn, "rings", MDB_CREATE, &cache.dbi_rings);
+  if (dbr) throw std::runtime_error("Failed to open LMDB dbi: " + std::string(mdb_strerror(dbr)));
+  dbr = mdb_dbi_open(txn, "outputs", MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, &cache.dbi_outputs);
+  if (dbr) throw std::runtime_error("Failed to open LMDB dbi: " + std::string(mdb_strerror(dbr)));
+  dbr = mdb_dbi_open(txn, "spent", MDB_CREATE, &cache.dbi_spent);
+  if (dbr) throw std::runtime_error("Failed to open LMDB dbi: " + std::string(mdb_strerror(dbr)));
+  dbr = mdb_dbi_open(txn, "progress", MDB_CREATE, &cache.dbi_progress);
+  if (dbr) throw std::runtime_error("Failed to open LMDB dbi: " + std::string(mdb_strerror(dbr)));
+  dbr = mdb_dbi_open(txn, "pending", MDB_CREATE, &cache.dbi_pending);
+  if (dbr) throw std::runtime_error("Failed to open LMDB dbi: " + std::string(mdb_strerror(dbr)));
+
+  dbr = mdb_txn_commit(txn);
+  if (dbr) throw std::runtime_error("Failed to commit txn creating/opening database: " + std::string(mdb_strerror(dbr)));
+  tx_active = false;
+}
+
+static void close_cache(blackball_cache &cache)
+{
+  mdb_dbi_close(cache.env, cache.dbi_rings);
+  mdb_dbi_close(cache.env, cache.dbi_outputs);
+  mdb_dbi_close(cache.env, cache.dbi_spent);
+  mdb_dbi_close(cache.env, cache.dbi_progress);
+  mdb_dbi_close(cache.env, cache.dbi_pending);
+  mdb_env_close(cache.env);
+}
+
+static bool get_ring(MDB_txn *txn, const blackball_cache &cache, const crypto::key_image &key_image, std::vector<uint64_t> &ring)
+{
+  MDB_val k = {sizeof(key_image), (void*)&key_image};
+  MDB_val v;
+  int dbr = mdb_get(txn, cache.dbi_rings, &k, &v);
+  if (dbr == MDB_NOTFOUND)
+    return false;
+  if (dbr) throw std::runtime_error("Failed to look up ring: " + std::string(mdb_strerror(dbr)));
+  ring.resize(v.mv_size / sizeof(uint64_t));
+  memcpy(ring.data(), v.mv_data, ring.size() * sizeof(uint64_t));
+  return true;
+}
+
+static void set_ring(MDB_txn *txn, const blackball_cache &cache, const crypto::key_image &key_image, const std::vector<uint64_t> &ring)
+{
+  MDB_val k = {sizeof(key_image), (void*)&key_image};
+  MDB_val v = {ring.size() * sizeof(uint64_t), (void*)ring.data()};
+  int dbr = mdb_put(txn, cache.dbi_rings, &k, &v, 0);
+  if (dbr) throw std::runtime_error("Failed to store ring: " + std::string(mdb_strerror(dbr)));
+}
+
+static void add_ring_member(MDB_txn *txn, const blackball_cache &cache, const output_data &od, const crypto::key_image &key_image)
+{
+  MDB_val k = {sizeof(od), (void*)&od};
+  MDB_val v = {sizeof(key_image), (void*)&key_image};
+  int dbr = mdb_put(txn, cache.dbi_outputs, &k, &v, MDB_NODUPDATA);
+  if (dbr && dbr != MDB_KEYEXIST) throw std::runtime_error("Failed to store ring member: " + std::string(mdb_strerror(dbr)));
+}
+
+static std::vector<crypto::key_image> get_ring_key_images(MDB_txn *txn, const blackball_cache &cache, const output_data &od)
+{
+  std::vector<crypto::key_image> key_images;
+  MDB_cursor *cur;
+  int dbr = mdb_cursor_open(txn, cache.dbi_outputs, &cur);
+  if (dbr) throw std::runtime_error("Failed to create LMDB cursor: " + std::string(mdb_strerror(dbr)));
+  MDB_val k = {sizeof(od), (void*)&od};
+  MDB_val v;
+  for (dbr = mdb_cursor_get(cur, &k, &v, MDB_SET); dbr == 0; dbr = mdb_cursor_get(cur, &k, &v, MDB_NEXT_DUP))
+    key_images.push_back(*(const crypto::key_image*)v.mv_data);
   mdb_cursor_close(cur);
-  mdb_txn_commit(txn);
+  if (dbr != MDB_NOTFOUND) throw std::runtime_error("Failed to enumerate ring members: " + std::string(mdb_strerror(dbr)));
+  return key_images;
+}
+
+static bool is_spent(MDB_txn *txn, const blackball_cache &cache, const output_data &od)
+{
+  MDB_val k = {sizeof(od), (void*)&od};
+  MDB_val v;
+  int dbr = mdb_get(txn, cache.dbi_spent, &k, &v);
+  if (dbr && dbr != MDB_NOTFOUND) throw std::runtime_error("Failed to look up spent output: " + std::string(mdb_strerror(dbr)));
+  return dbr == 0;
+}
+
+static bool set_spent(MDB_txn *txn, const blackball_cache &cache, const output_data &od)
+{
+  MDB_val k = {sizeof(od), (void*)&od};
+  MDB_val v = {0, NULL};
+  int dbr = mdb_put(txn, cache.dbi_spent, &k, &v, MDB_NOOVERWRITE);
+  if (dbr == MDB_KEYEXIST)
+    return false;
+  if (dbr) throw std::runtime_error("Failed to store spent output: " + std::string(mdb_strerror(dbr)));
+  return true;
+}
+
+static void add_pending(MDB_txn *txn, const blackball_cache &cache, const output_data &od, const crypto::public_key &pkey)
+{
+  MDB_val k = {sizeof(od), (void*)&od};
+  MDB_val v = {sizeof(pkey), (void*)&pkey};
+  int dbr = mdb_put(txn, cache.dbi_pending, &k, &v, 0);
+  if (dbr) throw std::runtime_error("Failed to store pending output: " + std::string(mdb_strerror(dbr)));
+}
+
+static std::vector<std::pair<output_data, crypto::public_key>> get_pending(MDB_txn *txn, const blackball_cache &cache)
+{
+  std::vector<std::pair<output_data, crypto::public_key>> pending;
+  MDB_cursor *cur;
+  int dbr = mdb_cursor_open(txn, cache.dbi_pending, &cur);
+  if (dbr) throw std::runtime_error("Failed to create LMDB cursor: " + std::string(mdb_strerror(dbr)));
+  MDB_val k, v;
+  for (dbr = mdb_cursor_get(cur, &k, &v, MDB_FIRST); dbr == 0; dbr = mdb_cursor_get(cur, &k, &v, MDB_NEXT))
+  {
+    if (v.mv_size != sizeof(crypto::public_key))
+    {
+      mdb_cursor_close(cur);
+      throw std::runtime_error("Invalid pending record, use --rescan");
+    }
+    pending.push_back(std::make_pair(*(const output_data*)k.mv_data, *(const crypto::public_key*)v.mv_data));
+  }
+  mdb_cursor_close(cur);
+  if (dbr != MDB_NOTFOUND) throw std::runtime_error("Failed to enumerate pending outputs: " + std::string(mdb_strerror(dbr)));
+  return pending;
+}
+
+static void remove_pending(MDB_txn *txn, const blackball_cache &cache, const output_data &od)
+{
+  MDB_val k = {sizeof(od), (void*)&od};
+  int dbr = mdb_del(txn, cache.dbi_pending, &k, NULL);
+  if (dbr && dbr != MDB_NOTFOUND) throw std::runtime_error("Failed to remove pending output: " + std::string(mdb_strerror(dbr)));
+}
+
+static bool get_progress(MDB_txn *txn, const blackball_cache &cache, const crypto::hash &input, scan_progress &progress)
+{
+  MDB_val k = {sizeof(input), (void*)&input};
+  MDB_val v;
+  int dbr = mdb_get(txn, cache.dbi_progress, &k, &v);
+  if (dbr == MDB_NOTFOUND)
+    return false;
+  if (dbr) throw std::runtime_error("Failed to look up progress: " + std::string(mdb_strerror(dbr)));
+  if (v.mv_size != sizeof(progress))
+    throw std::runtime_error("Invalid progress record, use --rescan");
+  memcpy(&progress, v.mv_data, sizeof(progress));
+  return true;
+}
+
+static void set_progress(MDB_txn *txn, const blackball_cache &cache, const crypto::hash &input, const scan_progress &progress)
+{
+  MDB_val k = {sizeof(input), (void*)&input};
+  MDB_val v = {sizeof(progress), (void*)&progress};
+  int dbr = mdb_put(txn, cache.dbi_progress, &k, &v, 0);
+  if (dbr) throw std::runtime_error("Failed to store progress: " + std::string(mdb_strerror(dbr)));
+}
+
+// the transactions scanned so far are still on the chain if the tip they were
+// scanned up to still is
+static bool is_progress_on_chain(const scan_progress &progress, Blockchain &blockchain)
+{
+  if (progress.height == 0)
+    return true;
+  if (blockchain.get_current_blockchain_height() < progress.height)
+    return false;
+  return blockchain.get_block_id_by_height(progress.height - 1) == progress.top_hash;
+}
+
+// rings narrowed down by transactions which were since reorganized away can't
+// be widened again, so everything is scanned again from scratch
+static void reset_cache(blackball_cache &cache)
+{
+  MDB_txn *txn;
+  int dbr = mdb_txn_begin(cache.env, NULL, 0, &txn);
+  if (dbr) throw std::runtime_error("Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+  bool tx_active = true;
+  epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
+
+  for (MDB_dbi dbi: {cache.dbi_rings, cache.dbi_outputs, cache.dbi_spent, cache.dbi_progress, cache.dbi_pending})
+  {
+    dbr = mdb_drop(txn, dbi, 0);
+    if (dbr) throw std::runtime_error("Failed to empty LMDB dbi: " + std::string(mdb_strerror(dbr)));
+  }
+
+  dbr = mdb_txn_commit(txn);
   tx_active = false;
-  mdb_dbi_close(env, dbi);
-  mdb_env_close(env);
-  return fret;
+  if (dbr) throw std::runtime_error("Failed to commit txn: " + std::string(mdb_strerror(dbr)));
+}
+
+static crypto::hash get_input_id(std::string filename)
+{
+  while (boost::ends_with(filename, "/") || boost::ends_with(filename, "\\"))
+    filename.pop_back();
+  return crypto::cn_fast_hash(filename.data(), filename.size());
 }
 
 int main(int argc, char* argv[])
@@ -179,6 +480,7 @@ int main(int argc, char* argv[])
     "database", available_dbs.c_str(), default_db_type
   };
   const command_line::arg_descriptor<bool> arg_rct_only  = {"rct-only", "Only work on ringCT outputs", false};
+  const command_line::arg_descriptor<bool> arg_rescan  = {"rescan", "Discard the results of previous runs and scan all transactions again", false};
   const command_line::arg_descriptor<std::vector<std::string> > arg_inputs = {"inputs", "Path to Safex DB, and path to any fork DBs"};
 
   command_line::add_arg(desc_cmd_sett, arg_blackball_db_dir);
@@ -187,6 +489,7 @@ int main(int argc, char* argv[])
   command_line::add_arg(desc_cmd_sett, arg_log_level);
   command_line::add_arg(desc_cmd_sett, arg_database);
   command_line::add_arg(desc_cmd_sett, arg_rct_only);
+  command_line::add_arg(desc_cmd_sett, arg_rescan);
   command_line::add_arg(desc_cmd_sett, arg_inputs);
   command_line::add_arg(desc_cmd_only, command_line::arg_help);
 
@@ -227,6 +530,7 @@ int main(int argc, char* argv[])
   network_type net_type = opt_testnet ? TESTNET : opt_stagenet ? STAGENET : MAINNET;
   output_file_path = command_line::get_arg(vm, arg_blackball_db_dir);
   bool opt_rct_only = command_line::get_arg(vm, arg_rct_only);
+  bool opt_rescan = command_line::get_arg(vm, arg_rescan);
 
   std::string db_type = command_line::get_arg(vm, arg_database);
   if (!cryptonote::blockchain_valid_db_type(db_type))
@@ -260,7 +564,7 @@ int main(int argc, char* argv[])
   {
     core_storage[n].reset(new Blockchain(m_mempool));
 
-    BlockchainDB* db = new_db(db_type);
+    BlockchainDB* db = new_db(db_type, net_type);
     if (db == NULL)
     {
       LOG_ERROR("Attempted to use non-existent database type: " << db_type);
@@ -308,120 +612,253 @@ int main(int argc, char* argv[])
 
   LOG_PRINT_L0("Scanning for blackballable outputs...");
 
-  size_t done = 0;
-  std::unordered_map<crypto::key_image, std::vector<uint64_t>> relative_rings;
-  std::unordered_map<output_data, std::unordered_set<crypto::key_image>> outputs;
-  std::unordered_set<output_data> spent, newly_spent;
-
   cryptonote::block b = core_storage[0]->get_db().get_block_from_height(0);
   tools::ringdb ringdb(output_file_path.string(), epee::string_tools::pod_to_hex(get_block_hash(b)));
 
-  for (size_t n = 0; n < inputs.size(); ++n)
+  const std::string cache_path = (output_file_path / "blackball-cache").string();
+  if (opt_rescan)
   {
-    LOG_PRINT_L0("Reading blockchain from " << inputs[n]);
-    for_all_transactions(inputs[n], [&](const cryptonote::transaction_prefix &tx)->bool
+    LOG_PRINT_L0("Discarding previous scan results");
+    boost::filesystem::remove_all(cache_path);
+  }
+  blackball_cache cache;
+  open_cache(cache_path, cache);
+  epee::misc_utils::auto_scope_leave_caller cache_dtor = epee::misc_utils::create_scope_leave_handler([&](){close_cache(cache);});
+
+  // a reorg on any input invalidates the rings it contributed to the shared cache
+  {
+    MDB_txn *txn;
+    int dbr = mdb_txn_begin(cache.env, NULL, MDB_RDONLY, &txn);
+    if (dbr) throw std::runtime_error("Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+    bool reorganized = false;
+    try
     {
-      for (const auto &in: tx.vin)
+      for (size_t n = 0; n < inputs.size() && !reorganized; ++n)
       {
-        if (in.type() != typeid(txin_to_key))
-          continue;
-        const auto &txin = boost::get<txin_to_key>(in);
-        if (opt_rct_only && txin.amount != 0)
-          continue;
+        scan_progress progress;
+        if (get_progress(txn, cache, get_input_id(inputs[n]), progress) && !is_progress_on_chain(progress, *core_storage[n]))
+        {
+          LOG_PRINT_L0("Blockchain " << inputs[n] << " was reorganized below height " << progress.height << " since the last run");
+          reorganized = true;
+        }
+      }
+    }
+    catch (...)
+    {
+      mdb_txn_abort(txn);
+      throw;
+    }
+    mdb_txn_abort(txn);
+    if (reorganized)
+    {
+      LOG_PRINT_L0("Discarding previous scan results");
+      reset_cache(cache);
+    }
+  }
 
-        const std::vector<uint64_t> absolute = cryptonote::relative_output_offsets_to_absolute(txin.key_offsets);
-        if (n == 0)
-          for (uint64_t out: absolute)
-            outputs[output_data(txin.amount, out)].insert(txin.k_image);
+  auto blackball_output = [&](MDB_txn *txn, size_t n, const output_data &od, const char *reason)
+  {
+    if (!set_spent(txn, cache, od))
+      return;
+    const crypto::public_key pkey = core_storage[n]->get_output_key(od.amount, od.index, cryptonote::tx_out_type::out_cash);
+    MINFO("Output " << pkey << " to be blackballed, due to " << reason);
+    add_pending(txn, cache, od, pkey);
+  };
 
-        std::vector<uint64_t> new_ring = txin.key_offsets;
-        const uint32_t ring_size = txin.key_offsets.size();
-        if (ring_size == 1)
+  // a ring where all outputs but one are known to be spent gives the real spend away
+  auto check_ring = [&](MDB_txn *txn, size_t n, uint64_t amount, const std::vector<uint64_t> &ring)
+  {
+    size_t known = 0;
+    uint64_t last_unknown = 0;
+    for (uint64_t out: ring)
+    {
+      if (is_spent(txn, cache, output_data(amount, out)))
+        ++known;
+      else
+        last_unknown = out;
+    }
+    if (ring.size() > 1 && known == ring.size() - 1)
+      blackball_output(txn, n, output_data(amount, last_unknown), "being used in a ring where all other outputs are known to be spent");
+  };
+
+  // newly spent outputs are persisted in the same txn as the scan progress.
+  // Only once committed are they blackballed, which is the one place writing
+  // to ringdb, and their rings checked again until no more are found
+  auto drain_pending = [&]()
+  {
+    while (true)
+    {
+      int dbr = resize_env(cache.env, cache_path.c_str(), 0);
+      if (dbr) throw std::runtime_error("Failed to set env map size: " + std::string(mdb_strerror(dbr)));
+      MDB_txn *txn;
+      dbr = mdb_txn_begin(cache.env, NULL, 0, &txn);
+      if (dbr) throw std::runtime_error("Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+      bool tx_active = true;
+      epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
+
+      const std::vector<std::pair<output_data, crypto::public_key>> work_spent = get_pending(txn, cache);
+      if (work_spent.empty())
+        break;
+      LOG_PRINT_L0("Secondary pass due to " << work_spent.size() << " newly found spent outputs");
+
+      // they stay pending until this txn commits, blackballing them again after
+      // a failure is harmless
+      for (const auto &pending: work_spent)
+        if (!ringdb.blackball(pending.second))
+          throw std::runtime_error("Failed to blackball output " + epee::string_tools::pod_to_hex(pending.second));
+
+      // outputs found here are not yet spent, so are never among the ones removed below
+      for (const auto &pending: work_spent)
+      {
+        const output_data &od = pending.first;
+        for (const crypto::key_image &ki: get_ring_key_images(txn, cache, od))
         {
-          const crypto::public_key pkey = core_storage[n]->get_output_key(txin.amount, txin.key_offsets[0], cryptonote::tx_out_type::out_cash);
-          MINFO("Blackballing output " << pkey << ", due to being used in a 1-ring");
-          ringdb.blackball(pkey);
-          newly_spent.insert(output_data(txin.amount, txin.key_offsets[0]));
-          spent.insert(output_data(txin.amount, txin.key_offsets[0]));
+          std::vector<uint64_t> ring;
+          if (get_ring(txn, cache, ki, ring))
+            check_ring(txn, 0, od.amount, ring);
         }
-        else if (relative_rings.find(txin.k_image) != relative_rings.end())
+        remove_pending(txn, cache, od);
+      }
+
+      dbr = mdb_txn_commit(txn);
+      tx_active = false;
+      if (dbr) throw std::runtime_error("Failed to commit txn: " + std::string(mdb_strerror(dbr)));
+    }
+  };
+
+  // finish the secondary pass of an interrupted run
+  drain_pending();
+
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  const uint64_t shards_per_batch = std::max<int>(tpool.get_max_concurrency(), 1) * 2;
+
+  for (size_t n = 0; n < inputs.size(); ++n)
+  {
+    LOG_PRINT_L0("Reading blockchain from " << inputs[n]);
+
+    std::string filename = inputs[n];
+    while (boost::ends_with(filename, "/") || boost::ends_with(filename, "\\"))
+      filename.pop_back();
+    const crypto::hash input_id = get_input_id(filename);
+
+    MDB_dbi dbi;
+    uint64_t num_txs;
+    MDB_env *env = open_txs_db(filename, dbi, num_txs);
+    epee::misc_utils::auto_scope_leave_caller env_dtor = epee::misc_utils::create_scope_leave_handler([&](){mdb_dbi_close(env, dbi); mdb_env_close(env);});
+
+    // the tip is read after the tx count, so all counted transactions are at or below it
+    scan_progress tip = {0, core_storage[n]->get_current_blockchain_height(), crypto::null_hash};
+    if (tip.height > 0)
+      tip.top_hash = core_storage[n]->get_block_id_by_height(tip.height - 1);
+
+    uint64_t start_idx = 0;
+    {
+      MDB_txn *txn;
+      int dbr = mdb_txn_begin(cache.env, NULL, MDB_RDONLY, &txn);
+      if (dbr) throw std::runtime_error("Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+      scan_progress progress;
+      try
+      {
+        if (get_progress(txn, cache, input_id, progress))
+          start_idx = progress.next_idx;
+      }
+      catch (...)
+      {
+        mdb_txn_abort(txn);
+        throw;
+      }
+      mdb_txn_abort(txn);
+    }
+    if (start_idx >= num_txs)
+    {
+      LOG_PRINT_L0("No new transactions since the last run");
+      continue;
+    }
+    LOG_PRINT_L0("Scanning transactions " << start_idx << " to " << num_txs - 1);
+
+    for (uint64_t batch_start = start_idx; batch_start < num_txs; batch_start += shards_per_batch * TXS_PER_SHARD)
+    {
+      std::vector<tx_shard> shards;
+      for (uint64_t first = batch_start; first < num_txs && first < batch_start + shards_per_batch * TXS_PER_SHARD; first += TXS_PER_SHARD)
+        shards.push_back({first, std::min(first + TXS_PER_SHARD, num_txs) - 1, {}, {}});
+
+      tools::threadpool::waiter waiter;
+      for (size_t i = 0; i < shards.size(); ++i)
+        tpool.submit(&waiter, boost::bind(&scan_shard, env, dbi, opt_rct_only, boost::ref(shards[i])));
+      waiter.wait();
+
+      // shards are merged in order, each in its own write transaction which also
+      // records the progress, so an interrupted run resumes after the last one
+      for (const tx_shard &shard: shards)
+      {
+        if (!shard.error.empty())
+          throw std::runtime_error("Failed to scan transactions " + std::to_string(shard.first_idx) + " to " +
+              std::to_string(shard.last_idx) + ": " + shard.error);
+
+        int dbr = resize_env(cache.env, cache_path.c_str(), shard.inputs.size() * 256);
+        if (dbr) throw std::runtime_error("Failed to set env map size: " + std::string(mdb_strerror(dbr)));
+        MDB_txn *txn;
+        dbr = mdb_txn_begin(cache.env, NULL, 0, &txn);
+        if (dbr) throw std::runtime_error("Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+        bool tx_active = true;
+        epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
+
+        for (const ring_input &in: shard.inputs)
         {
-          MINFO("Key image " << txin.k_image << " already seen: rings " <<
-              boost::join(relative_rings[txin.k_image] | boost::adaptors::transformed([](uint64_t out){return std::to_string(out);}), " ") <<
-              ", " << boost::join(txin.key_offsets | boost::adaptors::transformed([](uint64_t out){return std::to_string(out);}), " "));
-          if (relative_rings[txin.k_image] != txin.key_offsets)
+          if (n == 0)
+            for (uint64_t out: in.ring)
+              add_ring_member(txn, cache, output_data(in.amount, out), in.key_image);
+
+          if (in.ring.size() == 1)
           {
-            MINFO("Rings are different");
-            const std::vector<uint64_t> r0 = cryptonote::relative_output_offsets_to_absolute(relative_rings[txin.k_image]);
-            const std::vector<uint64_t> r1 = cryptonote::relative_output_offsets_to_absolute(txin.key_offsets);
+            blackball_output(txn, n, output_data(in.amount, in.ring[0]), "being used in a 1-ring");
+            continue;
+          }
+
+          std::vector<uint64_t> ring;
+          if (get_ring(txn, cache, in.key_image, ring) && ring != in.ring)
+          {
+            MINFO("Key image " << in.key_image << " already seen: rings " <<
+                boost::join(ring | boost::adaptors::transformed([](uint64_t out){return std::to_string(out);}), " ") <<
+                ", " << boost::join(in.ring | boost::adaptors::transformed([](uint64_t out){return std::to_string(out);}), " "));
             std::vector<uint64_t> common;
-            for (uint64_t out: r0)
-            {
-              if (std::find(r1.begin(), r1.end(), out) != r1.end())
-                common.push_back(out);
-            }
+            std::set_intersection(ring.begin(), ring.end(), in.ring.begin(), in.ring.end(), std::back_inserter(common));
             if (common.empty())
             {
               MERROR("Rings for the same key image are disjoint");
+              ring = in.ring;
             }
             else if (common.size() == 1)
             {
-              const crypto::public_key pkey = core_storage[n]->get_output_key(txin.amount, common[0], cryptonote::tx_out_type::out_cash);
-              MINFO("Blackballing output " << pkey << ", due to being used in rings with a single common element");
-              ringdb.blackball(pkey);
-              newly_spent.insert(output_data(txin.amount, common[0]));
-              spent.insert(output_data(txin.amount, common[0]));
+              blackball_output(txn, n, output_data(in.amount, common[0]), "being used in rings with a single common element");
+              ring = std::move(common);
             }
             else
             {
               MINFO("The intersection has more than one element, it's still ok");
-              for (const auto &out: r0)
-                if (std::find(common.begin(), common.end(), out) != common.end())
-                  new_ring.push_back(out);
-              new_ring = cryptonote::absolute_output_offsets_to_relative(new_ring);
+              ring = std::move(common);
             }
           }
-        }
-        relative_rings[txin.k_image] = new_ring;
-      }
-      return true;
-    });
-  }
-
-  while (!newly_spent.empty())
-  {
-    LOG_PRINT_L0("Secondary pass due to " << newly_spent.size() << " newly found spent outputs");
-    std::unordered_set<output_data> work_spent = std::move(newly_spent);
-    newly_spent.clear();
-
-    for (const output_data &od: work_spent)
-    {
-      for (const crypto::key_image &ki: outputs[od])
-      {
-        std::vector<uint64_t> absolute = cryptonote::relative_output_offsets_to_absolute(relative_rings[ki]);
-        size_t known = 0;
-        uint64_t last_unknown = 0;
-        for (uint64_t out: absolute)
-        {
-          output_data new_od(od.amount, out);
-          if (spent.find(new_od) != spent.end())
-            ++known;
           else
-            last_unknown = out;
-        }
-        if (known == absolute.size() - 1)
-        {
-          const crypto::public_key pkey = core_storage[0]->get_output_key(od.amount, last_unknown, cryptonote::tx_out_type::out_cash);
-          MINFO("Blackballing output " << pkey << ", due to being used in a " <<
-              absolute.size() << "-ring where all other outputs are known to be spent");
-          ringdb.blackball(pkey);
-          newly_spent.insert(output_data(od.amount, last_unknown));
-          spent.insert(output_data(od.amount, last_unknown));
+          {
+            ring = in.ring;
+          }
+          set_ring(txn, cache, in.key_image, ring);
+          check_ring(txn, n, in.amount, ring);
         }
+
+        tip.next_idx = shard.last_idx + 1;
+        set_progress(txn, cache, input_id, tip);
+        dbr = mdb_txn_commit(txn);
+        tx_active = false;
+        if (dbr) throw std::runtime_error("Failed to commit txn: " + std::string(mdb_strerror(dbr)));
       }
+      LOG_PRINT_L0(std::min(batch_start + shards_per_batch * TXS_PER_SHARD, num_txs) << "/" << num_txs << " transactions scanned");
     }
   }
 
+  drain_pending();
+
   LOG_PRINT_L0("Blockchain blackball data exported OK");
   return 0;
 
@@ -29,12 +29,16 @@
 // Parts of this file are originally copyright (c) 2014-2018 The Monero Project
 
 #include <atomic>
+#include <chrono>
 #include <cstdio>
 #include <algorithm>
+#include <deque>
 #include <fstream>
 
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include "misc_log_ex.h"
 #include "bootstrap_file.h"
 #include "bootstrap_serialization.h"
@@ -44,6 +48,7 @@
 #include "include_base_utils.h"
 #include "blockchain_db/db_types.h"
 #include "cryptonote_core/cryptonote_core.h"
+#include "common/threadpool.h"
 
 #undef SAFEX_DEFAULT_LOG_CATEGORY
 #define SAFEX_DEFAULT_LOG_CATEGORY "bcutil"
@@ -71,6 +76,104 @@ uint64_t db_batch_size = 100;
 uint64_t db_batch_size_verify = 5000;
 
 std::string refresh_string = "\r                                    \r";
+
+// number of chunks the parse stage hands to the thread pool at once
+const size_t parse_group_size = 256;
+// chunks buffered between two stages
+const size_t stage_queue_size = 4 * parse_group_size;
+
+// blocking FIFO with a fixed capacity, hands work from one import stage to the next.
+// close() ends the stream: pending items are still popped, pushes fail.
+template<typename T>
+class stage_queue
+{
+public:
+  explicit stage_queue(size_t capacity): m_capacity(capacity), m_closed(false) {}
+
+  bool push(T &&item)
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    while (!m_closed && m_queue.size() >= m_capacity)
+      m_not_full.wait(lock);
+    if (m_closed)
+      return false;
+    m_queue.push_back(std::move(item));
+    m_not_empty.notify_one();
+    return true;
+  }
+
+  bool pop(T &item)
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    while (!m_closed && m_queue.empty())
+      m_not_empty.wait(lock);
+    if (m_queue.empty())
+      return false;
+    item = std::move(m_queue.front());
+    m_queue.pop_front();
+    m_not_full.notify_one();
+    return true;
+  }
+
+  void close()
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_closed = true;
+    m_not_empty.notify_all();
+    m_not_full.notify_all();
+  }
+
+private:
+  const size_t m_capacity;
+  bool m_closed;
+  std::deque<T> m_queue;
+  boost::mutex m_mutex;
+  boost::condition_variable m_not_empty;
+  boost::condition_variable m_not_full;
+};
+
+// a chunk as read from the bootstrap file, pointing into the file mapping
+struct raw_chunk
+{
+  uint64_t height;
+  uint64_t end;
+  epee::span<const uint8_t> blob;
+};
+
+// a chunk after the parse stage, with everything the writer needs precomputed
+struct parsed_chunk
+{
+  uint64_t height;
+  uint64_t end;
+  size_t bytes;
+  bool ok;
+  std::string error;
+  bootstrap::block_package bp;
+  crypto::hash block_hash;
+  block_complete_entry entry;  // only filled in when verifying
+};
+
+struct stage_stats
+{
+  std::atomic<uint64_t> blocks;
+  std::atomic<uint64_t> bytes;
+  std::atomic<uint64_t> busy_us;
+
+  stage_stats(): blocks(0), bytes(0), busy_us(0) {}
+};
+
+void print_stage_stats(const char *name, const stage_stats &stats)
+{
+  const double seconds = stats.busy_us / 1e6;
+  MINFO(name << ": " << stats.blocks << " blocks, " << stats.bytes / 1e6 << " MB in " << seconds << " s busy"
+      << " (" << (seconds > 0 ? stats.blocks / seconds : 0) << " blocks/s, "
+      << (seconds > 0 ? stats.bytes / 1e6 / seconds : 0) << " MB/s)");
+}
+
+uint64_t elapsed_us(const std::chrono::steady_clock::time_point &start)
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
 }
 
 
@@ -166,7 +269,7 @@ int pop_blocks(cryptonote::core& core, int num_blocks)
   return num_blocks;
 }
 
-int check_flush(cryptonote::core &core, std::list<block_complete_entry> &blocks, bool force)
+int check_flush(cryptonote::core &core, std::list<block_complete_entry> &blocks, std::list<crypto::hash> &hashes, bool force)
 {
   if (blocks.empty())
     return 0;
@@ -178,19 +281,7 @@ int check_flush(cryptonote::core &core, std::list<block_complete_entry> &blocks,
   if (!force && new_height % HASH_OF_HASHES_STEP)
     return 0;
 
-  std::list<crypto::hash> hashes;
-  for (const auto &b: blocks)
-  {
-    cryptonote::block block;
-    if (!parse_and_validate_block_from_blob(b.block, block))
-    {
-      MERROR("Failed to parse block: "
-          << epee::string_tools::pod_to_hex(get_blob_hash(b.block)));
-      core.cleanup_handle_incoming_blocks();
-      return 1;
-    }
-    hashes.push_back(cryptonote::get_block_hash(block));
-  }
+  // block hashes were computed in the parse stage
   core.prevalidate_block_hashes(core.get_blockchain_storage().get_db().height(), hashes);
 
   core.prepare_handle_incoming_blocks(blocks);
@@ -236,9 +327,132 @@ int check_flush(cryptonote::core &core, std::list<block_complete_entry> &blocks,
     return 1;
 
   blocks.clear();
+  hashes.clear();
   return 0;
 }
 
+// reader stage: hands out chunks of the mapped bootstrap file, in order
+int read_chunks(BootstrapFileReader &reader, uint64_t height, uint64_t block_stop, stage_queue<raw_chunk> &chunks, stage_stats &stats)
+{
+  int ret = 0;
+  while (true)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    raw_chunk chunk;
+    try
+    {
+      if (!reader.next_chunk(chunk.blob))
+      {
+        std::cout << refresh_string;
+        MINFO("End of file reached");
+        break;
+      }
+    }
+    catch (const std::exception &e)
+    {
+      std::cout << refresh_string;
+      MFATAL("Error reading chunk at height " << height << ": " << e.what());
+      ret = 2;
+      break;
+    }
+    chunk.height = height;
+    chunk.end = reader.tell();
+
+    if (height > block_stop)
+    {
+      std::cout << refresh_string;
+      MINFO("Specified block number reached - stopping.  block: " << height-1 << "  total blocks: " << height);
+      break;
+    }
+
+    stats.blocks += NUM_BLOCKS_PER_CHUNK;
+    stats.bytes += sizeof(uint32_t) + chunk.blob.size();
+    stats.busy_us += elapsed_us(start);
+
+    height += NUM_BLOCKS_PER_CHUNK;
+    if (!chunks.push(std::move(chunk)))
+      break; // the import was stopped
+  }
+  chunks.close();
+  return ret;
+}
+
+void parse_chunk(const raw_chunk &chunk, parsed_chunk &parsed)
+{
+  parsed.height = chunk.height;
+  parsed.end = chunk.end;
+  parsed.bytes = chunk.blob.size();
+  parsed.ok = false;
+  try
+  {
+    if (! BootstrapFileReader::parse_chunk(chunk.blob, parsed.bp))
+      throw std::runtime_error("Error in deserialization of chunk");
+    parsed.block_hash = cryptonote::get_block_hash(parsed.bp.block);
+
+    if (opt_verify)
+    {
+      cryptonote::block_to_blob(parsed.bp.block, parsed.entry.block);
+      for (const auto &tx: parsed.bp.txs)
+      {
+        parsed.entry.txs.push_back(cryptonote::blobdata());
+        cryptonote::tx_to_blob(tx, parsed.entry.txs.back());
+      }
+    }
+    parsed.ok = true;
+  }
+  catch (const std::exception &e)
+  {
+    parsed.error = e.what();
+  }
+}
+
+// parse stage: deserializes groups of chunks and hashes their blocks on the
+// thread pool, then passes them on in file order
+void parse_chunks(stage_queue<raw_chunk> &chunks, stage_queue<parsed_chunk> &parsed_chunks, stage_stats &stats)
+{
+  tools::threadpool &tpool = tools::threadpool::getInstance();
+  std::vector<raw_chunk> group;
+  bool done = false;
+  while (!done)
+  {
+    group.clear();
+    raw_chunk chunk;
+    while (group.size() < parse_group_size)
+    {
+      if (!chunks.pop(chunk))
+      {
+        done = true;
+        break;
+      }
+      group.push_back(std::move(chunk));
+    }
+    if (group.empty())
+      break;
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<parsed_chunk> parsed(group.size());
+    tools::threadpool::waiter waiter;
+    for (size_t i = 0; i < group.size(); ++i)
+      tpool.submit(&waiter, [&group, &parsed, i]() { parse_chunk(group[i], parsed[i]); });
+    waiter.wait();
+    stats.busy_us += elapsed_us(start);
+
+    for (parsed_chunk &p: parsed)
+    {
+      stats.blocks += NUM_BLOCKS_PER_CHUNK;
+      stats.bytes += p.bytes;
+      if (!parsed_chunks.push(std::move(p)))
+      {
+        // the writer stopped, stop reading too
+        chunks.close();
+        done = true;
+        break;
+      }
+    }
+  }
+  parsed_chunks.close();
+}
+
 int import_from_file(cryptonote::core& core, const std::string& import_file_path, uint64_t block_stop=0)
 {
   // Reset stats, in case we're using newly created db, accumulating stats
@@ -260,7 +474,7 @@ int import_from_file(cryptonote::core& core, const std::string& import_file_path
 
   seek_height = start_height;
   BootstrapFile bootstrap;
-  std::streampos pos;
+  std::streampos pos = 0;
   // BootstrapFile bootstrap(import_file_path);
   uint64_t total_source_blocks = bootstrap.count_blocks(import_file_path, pos, seek_height);
   MINFO("bootstrap file last block number: " << total_source_blocks-1 << " (zero-based height)  total blocks: " << total_source_blocks);
@@ -274,27 +488,21 @@ int import_from_file(cryptonote::core& core, const std::string& import_file_path
   std::cout << "Preparing to read blocks..." << ENDL;
   std::cout << ENDL;
 
-  std::ifstream import_file;
-  import_file.open(import_file_path, std::ios_base::binary | std::ifstream::in);
+  BootstrapFileReader reader;
+  if (!reader.open(import_file_path))
+    return false;
 
   uint64_t h = 0;
   uint64_t num_imported = 0;
-  if (import_file.fail())
-  {
-    MFATAL("import_file.open() fail");
-    return false;
-  }
 
   // 4 byte magic + (currently) 1024 byte header structures
-  bootstrap.seek_to_first_chunk(import_file);
+  reader.seek_to_first_chunk();
 
-  std::string str1;
-  char buffer1[1024];
-  char buffer_block[BUFFER_SIZE];
   block b;
-  transaction tx;
   int quit = 0;
-  uint64_t bytes_read;
+  int reader_ret = 0;
+  bool parse_failed = false;
+  uint64_t batch_bytes = 0;
 
   // Note that a new blockchain will start with block number 0 (total blocks: 1)
   // due to genesis block being added at initialization.
@@ -315,224 +523,157 @@ int import_from_file(cryptonote::core& core, const std::string& import_file_path
   std::cout << ENDL;
 
   std::list<block_complete_entry> blocks;
+  std::list<crypto::hash> hashes;
 
   // Skip to start_height before we start adding.
   {
-    bool q2 = false;
-    import_file.seekg(pos);
-    bytes_read = bootstrap.count_bytes(import_file, start_height-seek_height, h, q2);
-    if (q2)
+    if (pos != std::streampos(0))
+      reader.seek(static_cast<std::streamoff>(pos));
+    const uint64_t skip = start_height - seek_height;
+    if (reader.skip_chunks(skip) < skip)
     {
-      quit = 2;
-      goto quitting;
+      reader.close();
+      core.get_blockchain_storage().get_db().show_stats();
+      return 0;
     }
     h = start_height;
   }
 
   if (use_batch)
   {
-    uint64_t bytes, h2;
-    bool q2;
-    pos = import_file.tellg();
-    bytes = bootstrap.count_bytes(import_file, db_batch_size, h2, q2);
-    if (import_file.eof())
-      import_file.clear();
-    import_file.seekg(pos);
-    core.get_blockchain_storage().get_db().batch_start(db_batch_size, bytes);
-  }
-  while (! quit)
-  {
-    uint32_t chunk_size;
-    import_file.read(buffer1, sizeof(chunk_size));
-    // TODO: bootstrap.read_chunk();
-    if (! import_file) {
-      std::cout << refresh_string;
-      MINFO("End of file reached");
-      quit = 1;
-      break;
-    }
-    bytes_read += sizeof(chunk_size);
+    batch_bytes = reader.count_bytes(reader.tell(), db_batch_size);
+    core.get_blockchain_storage().get_db().batch_start(db_batch_size, batch_bytes);
+  }
 
-    str1.assign(buffer1, sizeof(chunk_size));
-    if (! ::serialization::parse_binary(str1, chunk_size))
-    {
-      throw std::runtime_error("Error in deserialization of chunk size");
-    }
-    MDEBUG("chunk_size: " << chunk_size);
+  // reader -> parser -> writer pipeline, the writer being this thread since
+  // blocks have to go into the db one by one, in order
+  stage_stats reader_stats, parser_stats, writer_stats;
+  stage_queue<raw_chunk> raw_chunks(stage_queue_size);
+  stage_queue<parsed_chunk> parsed_chunks(stage_queue_size);
+  const uint64_t first_height = h;
+  boost::thread reader_thread([&reader, &reader_ret, first_height, block_stop, &raw_chunks, &reader_stats]() {
+    reader_ret = read_chunks(reader, first_height, block_stop, raw_chunks, reader_stats);
+  });
+  boost::thread parser_thread([&raw_chunks, &parsed_chunks, &parser_stats]() { parse_chunks(raw_chunks, parsed_chunks, parser_stats); });
 
-    if (chunk_size > BUFFER_SIZE)
+  const int display_interval = 1000;
+  const int progress_interval = 10;
+  const int stats_interval = 10000;
+  parsed_chunk chunk;
+  while (!quit && parsed_chunks.pop(chunk))
+  {
+    if (!chunk.ok)
     {
-      MWARNING("WARNING: chunk_size " << chunk_size << " > BUFFER_SIZE " << BUFFER_SIZE);
-      throw std::runtime_error("Aborting: chunk size exceeds buffer size");
+      std::cout << refresh_string;
+      MFATAL("exception while reading from file, height=" << chunk.height << ": " << chunk.error);
+      parse_failed = true;
+      quit = 2;
+      break;
     }
-    if (chunk_size > CHUNK_SIZE_WARNING_THRESHOLD)
+
+    const auto start = std::chrono::steady_clock::now();
+    bootstrap::block_package &bp = chunk.bp;
+    // NOTE: use of NUM_BLOCKS_PER_CHUNK is a placeholder in case multi-block chunks are later supported.
+    for (int chunk_ind = 0; chunk_ind < NUM_BLOCKS_PER_CHUNK; ++chunk_ind)
     {
-      MINFO("NOTE: chunk_size " << chunk_size << " > " << CHUNK_SIZE_WARNING_THRESHOLD);
-    }
-    else if (chunk_size == 0) {
-      MFATAL("ERROR: chunk_size == 0");
-      return 2;
-    }
-    import_file.read(buffer_block, chunk_size);
-    if (! import_file) {
-      if (import_file.eof())
+      ++h;
+      if ((h-1) % display_interval == 0)
       {
         std::cout << refresh_string;
-        MINFO("End of file reached - file was truncated");
-        quit = 1;
-        break;
+        MDEBUG("loading block number " << h-1);
       }
       else
       {
-        MFATAL("ERROR: unexpected end of file: bytes read before error: "
-            << import_file.gcount() << " of chunk_size " << chunk_size);
-        return 2;
+        MDEBUG("loading block number " << h-1);
       }
-    }
-    bytes_read += chunk_size;
-    MDEBUG("Total bytes read: " << bytes_read);
+      b = bp.block;
+      MDEBUG("block prev_id: " << b.prev_id << ENDL);
 
-    if (h > block_stop)
-    {
-      std::cout << refresh_string << "block " << h-1
-        << " / " << block_stop
-        << std::flush;
-      std::cout << ENDL << ENDL;
-      MINFO("Specified block number reached - stopping.  block: " << h-1 << "  total blocks: " << h);
-      quit = 1;
-      break;
-    }
+      if ((h-1) % progress_interval == 0)
+      {
+        std::cout << refresh_string << "block " << h-1
+          << " / " << block_stop
+          << std::flush;
+      }
 
-    try
-    {
-      str1.assign(buffer_block, chunk_size);
-      bootstrap::block_package bp;
-      if (! ::serialization::parse_binary(str1, bp))
-        throw std::runtime_error("Error in deserialization of chunk");
-
-      int display_interval = 1000;
-      int progress_interval = 10;
-      // NOTE: use of NUM_BLOCKS_PER_CHUNK is a placeholder in case multi-block chunks are later supported.
-      for (int chunk_ind = 0; chunk_ind < NUM_BLOCKS_PER_CHUNK; ++chunk_ind)
+      if (opt_verify)
       {
-        ++h;
-        if ((h-1) % display_interval == 0)
+        blocks.push_back(std::move(chunk.entry));
+        hashes.push_back(chunk.block_hash);
+        int ret = check_flush(core, blocks, hashes, false);
+        if (ret)
         {
-          std::cout << refresh_string;
-          MDEBUG("loading block number " << h-1);
+          quit = 2; // make sure we don't commit partial block data
+          break;
         }
-        else
+      }
+      else
+      {
+        // tx number 1: coinbase tx
+        // tx number 2 onwards: bp.txs
+        //
+        // add_block() calls add_transaction(blk_hash, blk.miner_tx) first,
+        // and then a for loop for the transactions in txs, so the coinbase
+        // transaction is not part of txs.
+        try
         {
-          MDEBUG("loading block number " << h-1);
+          core.get_blockchain_storage().get_db().add_block(b, bp.block_size, bp.cumulative_difficulty, bp.coins_generated, bp.tokens_migrated, bp.txs);
         }
-        b = bp.block;
-        MDEBUG("block prev_id: " << b.prev_id << ENDL);
-
-        if ((h-1) % progress_interval == 0)
+        catch (const std::exception& e)
         {
-          std::cout << refresh_string << "block " << h-1
-            << " / " << block_stop
-            << std::flush;
+          std::cout << refresh_string;
+          MFATAL("Error adding block to blockchain: " << e.what());
+          quit = 2; // make sure we don't commit partial block data
+          break;
         }
 
-        if (opt_verify)
+        if (use_batch)
         {
-          cryptonote::blobdata block;
-          cryptonote::block_to_blob(bp.block, block);
-          std::list<cryptonote::blobdata> txs;
-          for (const auto &tx: bp.txs)
-          {
-            txs.push_back(cryptonote::blobdata());
-            cryptonote::tx_to_blob(tx, txs.back());
-          }
-          blocks.push_back({block, txs});
-          int ret = check_flush(core, blocks, false);
-          if (ret)
-          {
-            quit = 2; // make sure we don't commit partial block data
-            break;
-          }
-        }
-        else
-        {
-          std::vector<transaction> txs;
-          std::vector<transaction> archived_txs;
-
-          archived_txs = bp.txs;
-
-          // tx number 1: coinbase tx
-          // tx number 2 onwards: archived_txs
-          for (const transaction &tx : archived_txs)
-          {
-            // add blocks with verification.
-            // for Blockchain and blockchain_storage add_new_block().
-            // for add_block() method, without (much) processing.
-            // don't add coinbase transaction to txs.
-            //
-            // because add_block() calls
-            // add_transaction(blk_hash, blk.miner_tx) first, and
-            // then a for loop for the transactions in txs.
-            txs.push_back(tx);
-          }
-
-          size_t block_size;
-          difficulty_type cumulative_difficulty;
-          uint64_t coins_generated;
-          uint64_t tokens_migrated;
-
-          block_size = bp.block_size;
-          cumulative_difficulty = bp.cumulative_difficulty;
-          coins_generated = bp.coins_generated;
-          tokens_migrated = bp.tokens_migrated;
-
-          try
-          {
-            core.get_blockchain_storage().get_db().add_block(b, block_size, cumulative_difficulty, coins_generated, tokens_migrated, txs);
-          }
-          catch (const std::exception& e)
+          if ((h-1) % db_batch_size == 0)
           {
             std::cout << refresh_string;
-            MFATAL("Error adding block to blockchain: " << e.what());
-            quit = 2; // make sure we don't commit partial block data
-            break;
-          }
-
-          if (use_batch)
-          {
-            if ((h-1) % db_batch_size == 0)
-            {
-              uint64_t bytes, h2;
-              bool q2;
-              std::cout << refresh_string;
-              // zero-based height
-              std::cout << ENDL << "[- batch commit at height " << h-1 << " -]" << ENDL;
-              core.get_blockchain_storage().get_db().batch_stop();
-              pos = import_file.tellg();
-              bytes = bootstrap.count_bytes(import_file, db_batch_size, h2, q2);
-              import_file.seekg(pos);
-              core.get_blockchain_storage().get_db().batch_start(db_batch_size, bytes);
-              std::cout << ENDL;
-              core.get_blockchain_storage().get_db().show_stats();
-            }
+            // zero-based height
+            std::cout << ENDL << "[- batch commit at height " << h-1 << " -]" << ENDL;
+            core.get_blockchain_storage().get_db().batch_stop();
+            // the whole file is mapped, so the next batch can be sized
+            // exactly even though its chunks may not have been read yet
+            batch_bytes = reader.count_bytes(chunk.end, db_batch_size);
+            core.get_blockchain_storage().get_db().batch_start(db_batch_size, batch_bytes);
+            std::cout << ENDL;
+            core.get_blockchain_storage().get_db().show_stats();
           }
         }
-        ++num_imported;
       }
+      ++num_imported;
     }
-    catch (const std::exception& e)
+    writer_stats.blocks += NUM_BLOCKS_PER_CHUNK;
+    writer_stats.bytes += chunk.bytes;
+    writer_stats.busy_us += elapsed_us(start);
+
+    if (writer_stats.blocks % stats_interval == 0)
     {
       std::cout << refresh_string;
-      MFATAL("exception while reading from file, height=" << h << ": " << e.what());
-      return 2;
+      print_stage_stats("reader", reader_stats);
+      print_stage_stats("parser", parser_stats);
+      print_stage_stats("writer", writer_stats);
     }
-  } // while
+  }
 
-quitting:
-  import_file.close();
+  // stop the other stages if the writer bailed out early
+  parsed_chunks.close();
+  raw_chunks.close();
+  parser_thread.join();
+  reader_thread.join();
+  reader.close();
 
-  if (opt_verify)
+  // a malformed chunk stops the reader, but the blocks written before it are
+  // complete and still get committed below
+  if (parse_failed)
+    return 2;
+
+  if (opt_verify && quit <= 1)
   {
-    int ret = check_flush(core, blocks, true);
+    int ret = check_flush(core, blocks, hashes, true);
     if (ret)
       return ret;
   }
@@ -551,13 +692,16 @@ quitting:
   }
 
   core.get_blockchain_storage().get_db().show_stats();
+  print_stage_stats("reader", reader_stats);
+  print_stage_stats("parser", parser_stats);
+  print_stage_stats("writer", writer_stats);
   MINFO("Number of blocks imported: " << num_imported);
   if (h > 0)
     // TODO: if there was an error, the last added block is probably at zero-based height h-2
     MINFO("Finished at block: " << h-1 << "  total blocks: " << h);
 
   std::cout << ENDL;
-  return 0;
+  return reader_ret;
 }
 
 int main(int argc, char* argv[])
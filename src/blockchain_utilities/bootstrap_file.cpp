@@ -34,6 +34,15 @@
 
 #include "bootstrap_file.h"
 
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #undef SAFEX_DEFAULT_LOG_CATEGORY
 #define SAFEX_DEFAULT_LOG_CATEGORY "bcutil"
 
@@ -50,6 +59,9 @@ namespace
   const uint32_t header_size = 1024;
 
   std::string refresh_string = "\r                                    \r";
+
+  // how far ahead of the read position the mapped reader asks for prefetching
+  const uint64_t read_ahead_size = 64 * 1024 * 1024;
 }
 
 
@@ -503,3 +515,252 @@ uint64_t BootstrapFile::count_blocks(const std::string& import_file_path, std::s
   // one-based height.
   return h;
 }
+
+BootstrapFileReader::BootstrapFileReader():
+  m_data(NULL), m_size(0), m_pos(0), m_read_ahead_pos(0)
+#ifdef WIN32
+  , m_file(INVALID_HANDLE_VALUE), m_mapping(NULL)
+#else
+  , m_fd(-1)
+#endif
+{
+}
+
+BootstrapFileReader::~BootstrapFileReader()
+{
+  close();
+}
+
+bool BootstrapFileReader::open(const std::string& file_path)
+{
+  close();
+
+  boost::filesystem::path raw_file_path(file_path);
+  boost::system::error_code ec;
+  if (!boost::filesystem::exists(raw_file_path, ec))
+  {
+    MFATAL("bootstrap file not found: " << raw_file_path);
+    return false;
+  }
+  const uint64_t file_size = boost::filesystem::file_size(raw_file_path, ec);
+  if (ec)
+  {
+    MFATAL("Failed to get size of bootstrap file " << file_path << ": " << ec.message());
+    return false;
+  }
+  if (file_size == 0 || file_size > std::numeric_limits<size_t>::max())
+  {
+    MFATAL("Bootstrap file " << file_path << " has a size of " << file_size << " bytes, which cannot be mapped");
+    return false;
+  }
+
+#ifdef WIN32
+  HANDLE file = CreateFileA(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    MFATAL("Failed to open bootstrap file " << file_path << ": error " << GetLastError());
+    return false;
+  }
+  HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mapping == NULL)
+  {
+    MFATAL("Failed to map bootstrap file " << file_path << ": error " << GetLastError());
+    CloseHandle(file);
+    return false;
+  }
+  const void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (data == NULL)
+  {
+    MFATAL("Failed to map bootstrap file " << file_path << ": error " << GetLastError());
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+  m_file = file;
+  m_mapping = mapping;
+#else
+  int fd = ::open(file_path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    MFATAL("Failed to open bootstrap file " << file_path << ": " << strerror(errno));
+    return false;
+  }
+  void* data = mmap(NULL, file_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED)
+  {
+    MFATAL("Failed to map bootstrap file " << file_path << ": " << strerror(errno));
+    ::close(fd);
+    return false;
+  }
+  // the file is consumed front to back once, let the kernel read ahead
+  // aggressively and drop pages behind us
+  int ret = posix_madvise(data, file_size, POSIX_MADV_SEQUENTIAL);
+  if (ret)
+    MWARNING("posix_madvise failed on bootstrap file: " << strerror(ret));
+  m_fd = fd;
+#endif
+
+  m_data = static_cast<const uint8_t*>(data);
+  m_size = file_size;
+  m_pos = 0;
+  m_read_ahead_pos = 0;
+  read_ahead();
+  return true;
+}
+
+void BootstrapFileReader::close()
+{
+  if (m_data == NULL)
+    return;
+#ifdef WIN32
+  UnmapViewOfFile(m_data);
+  CloseHandle(m_mapping);
+  CloseHandle(m_file);
+  m_mapping = NULL;
+  m_file = INVALID_HANDLE_VALUE;
+#else
+  munmap(const_cast<uint8_t*>(m_data), m_size);
+  ::close(m_fd);
+  m_fd = -1;
+#endif
+  m_data = NULL;
+  m_size = 0;
+  m_pos = 0;
+  m_read_ahead_pos = 0;
+}
+
+uint64_t BootstrapFileReader::seek_to_first_chunk()
+{
+  uint32_t file_magic;
+  uint32_t buflen_file_info;
+
+  if (m_size < sizeof(file_magic) + sizeof(buflen_file_info))
+    throw std::runtime_error("Error reading expected number of bytes");
+  if (! parse_chunk(epee::span<const uint8_t>(m_data, sizeof(file_magic)), file_magic))
+    throw std::runtime_error("Error in deserialization of file_magic");
+
+  if (file_magic != blockchain_raw_magic)
+  {
+    MFATAL("bootstrap file not recognized");
+    throw std::runtime_error("Aborting");
+  }
+  else
+    MINFO("bootstrap file recognized");
+
+  if (! parse_chunk(epee::span<const uint8_t>(m_data + sizeof(file_magic), sizeof(buflen_file_info)), buflen_file_info))
+    throw std::runtime_error("Error in deserialization of buflen_file_info");
+  MINFO("bootstrap::file_info size: " << buflen_file_info);
+
+  if (buflen_file_info > m_size - sizeof(file_magic) - sizeof(buflen_file_info))
+    throw std::runtime_error("Error reading expected number of bytes");
+  bootstrap::file_info bfi;
+  if (! parse_chunk(epee::span<const uint8_t>(m_data + sizeof(file_magic) + sizeof(buflen_file_info), buflen_file_info), bfi))
+    throw std::runtime_error("Error in deserialization of bootstrap::file_info");
+  MINFO("bootstrap file v" << unsigned(bfi.major_version) << "." << unsigned(bfi.minor_version));
+  MINFO("bootstrap magic size: " << sizeof(file_magic));
+  MINFO("bootstrap header size: " << bfi.header_size);
+
+  uint64_t full_header_size = sizeof(file_magic) + bfi.header_size;
+  seek(full_header_size);
+
+  return full_header_size;
+}
+
+void BootstrapFileReader::seek(uint64_t offset)
+{
+  m_pos = std::min(offset, m_size);
+  m_read_ahead_pos = m_pos;
+  read_ahead();
+}
+
+bool BootstrapFileReader::chunk_at(uint64_t offset, uint32_t& chunk_size) const
+{
+  if (offset + sizeof(chunk_size) > m_size)
+  {
+    if (offset < m_size)
+      MINFO("End of file reached - file was truncated: " << m_size - offset << " bytes left for the chunk size");
+    return false;
+  }
+  if (! parse_chunk(epee::span<const uint8_t>(m_data + offset, sizeof(chunk_size)), chunk_size))
+    throw std::runtime_error("Error in deserialization of chunk_size");
+
+  if (chunk_size > BUFFER_SIZE)
+  {
+    MWARNING("WARNING: chunk_size " << chunk_size << " > BUFFER_SIZE " << BUFFER_SIZE << " at offset " << offset);
+    throw std::runtime_error("Aborting: chunk size exceeds buffer size");
+  }
+  if (chunk_size == 0)
+  {
+    MDEBUG("ERROR: chunk_size " << chunk_size << " <= 0" << " at offset " << offset);
+    throw std::runtime_error("Aborting");
+  }
+  if (chunk_size > m_size - offset - sizeof(chunk_size))
+  {
+    // a partly written last chunk, everything before it is still usable
+    MINFO("End of file reached - file was truncated: " << m_size - offset - sizeof(chunk_size) << " bytes left for chunk_size " << chunk_size);
+    return false;
+  }
+  return true;
+}
+
+bool BootstrapFileReader::next_chunk(epee::span<const uint8_t>& chunk)
+{
+  uint32_t chunk_size;
+  if (!chunk_at(m_pos, chunk_size))
+    return false;
+  if (chunk_size > CHUNK_SIZE_WARNING_THRESHOLD)
+    MDEBUG("NOTE: chunk_size " << chunk_size << " > " << CHUNK_SIZE_WARNING_THRESHOLD);
+  chunk = epee::span<const uint8_t>(m_data + m_pos + sizeof(chunk_size), chunk_size);
+  m_pos += sizeof(chunk_size) + chunk_size;
+  if (m_pos + read_ahead_size / 2 > m_read_ahead_pos)
+    read_ahead();
+  return true;
+}
+
+uint64_t BootstrapFileReader::skip_chunks(uint64_t chunks)
+{
+  uint64_t skipped = 0;
+  uint32_t chunk_size;
+  while (skipped < chunks && chunk_at(m_pos, chunk_size))
+  {
+    m_pos += sizeof(chunk_size) + chunk_size;
+    ++skipped;
+  }
+  m_read_ahead_pos = m_pos;
+  read_ahead();
+  return skipped;
+}
+
+uint64_t BootstrapFileReader::count_bytes(uint64_t offset, uint64_t chunks) const
+{
+  uint64_t bytes = 0;
+  uint32_t chunk_size;
+  try
+  {
+    while (chunks-- > 0 && chunk_at(offset + bytes, chunk_size))
+      bytes += sizeof(chunk_size) + chunk_size;
+  }
+  catch (const std::exception &e)
+  {
+    // only a size estimate, a bad chunk is reported when it is actually read
+  }
+  return bytes;
+}
+
+void BootstrapFileReader::read_ahead()
+{
+  if (m_read_ahead_pos >= m_size)
+    return;
+  uint64_t start = std::max(m_pos, m_read_ahead_pos);
+  const uint64_t end = std::min(m_pos + read_ahead_size, m_size);
+  if (start >= end)
+    return;
+#ifdef WIN32
+  // FILE_FLAG_SEQUENTIAL_SCAN already has the cache manager read ahead
+#else
+  static const uint64_t page_size = sysconf(_SC_PAGESIZE);
+  start -= start % page_size;
+  posix_madvise(const_cast<uint8_t*>(m_data) + start, end - start, POSIX_MADV_WILLNEED);
+#endif
+  m_read_ahead_pos = end;
+}
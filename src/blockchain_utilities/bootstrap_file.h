@@ -34,6 +34,7 @@
 #include <boost/iostreams/stream.hpp>
 #include <boost/iostreams/device/back_inserter.hpp>
 #include <boost/iostreams/filtering_streambuf.hpp>
+#include <boost/iostreams/device/array.hpp>
 #include <boost/filesystem/path.hpp>
 #include <boost/filesystem/operations.hpp>
 
@@ -47,6 +48,8 @@
 #include <atomic>
 
 #include "common/command_line.h"
+#include "serialization/binary_archive.h"
+#include "span.h"
 #include "version.h"
 
 #include "blockchain_utilities.h"
@@ -90,3 +93,60 @@ private:
   uint64_t m_cur_height; // tracks current height during export
   uint32_t m_max_chunk;
 };
+
+// Read only view of a bootstrap file mapped into memory. Chunks are handed
+// out as spans into the mapping and can be parsed from there, without being
+// copied into a buffer first. The kernel is told the file is read
+// sequentially and the pages ahead of the read position are prefetched.
+class BootstrapFileReader
+{
+public:
+
+  BootstrapFileReader();
+  ~BootstrapFileReader();
+
+  bool open(const std::string& file_path);
+  void close();
+
+  // checks the file magic and header, and moves to the first chunk
+  uint64_t seek_to_first_chunk();
+  void seek(uint64_t offset);
+  uint64_t tell() const { return m_pos; }
+  uint64_t size() const { return m_size; }
+
+  // returns false at the end of the file or at a truncated last chunk,
+  // throws on a malformed chunk
+  bool next_chunk(epee::span<const uint8_t>& chunk);
+  // returns the number of chunks actually skipped
+  uint64_t skip_chunks(uint64_t chunks);
+  // size of the next chunks starting at offset, does not move the read position
+  // and stops early at the end of the file or at a malformed chunk
+  uint64_t count_bytes(uint64_t offset, uint64_t chunks) const;
+
+  template<typename T>
+  static bool parse_chunk(const epee::span<const uint8_t>& chunk, T& object)
+  {
+    boost::iostreams::stream<boost::iostreams::array_source> istr(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+    binary_archive<false> iar(istr);
+    return ::serialization::serialize(iar, object);
+  }
+
+private:
+
+  // reads the chunk header at offset, returns false at the end of the file
+  // or when the file ends inside the chunk
+  bool chunk_at(uint64_t offset, uint32_t& chunk_size) const;
+  void read_ahead();
+
+  const uint8_t* m_data;
+  uint64_t m_size;
+  uint64_t m_pos;
+  uint64_t m_read_ahead_pos;
+#ifdef WIN32
+  void* m_file;
+  void* m_mapping;
+#else
+  int m_fd;
+#endif
+};
+
@@ -1664,6 +1664,38 @@ void ge_tobytes(unsigned char *s, const ge_p2 *h) {
   s[31] ^= fe_isnegative(x) << 7;
 }
 
+/* ge_tobytes for n points at once, sharing a single field inversion
+   (Montgomery's trick). s receives 32 * n bytes, acc must hold n elements. */
+
+void ge_tobytes_batch(unsigned char *s, const ge_p2 *h, fe *acc, size_t n) {
+  fe inv;
+  fe recip;
+  fe x;
+  fe y;
+  size_t i;
+
+  if (n == 0) {
+    return;
+  }
+  fe_copy(acc[0], h[0].Z);
+  for (i = 1; i < n; i++) {
+    fe_mul(acc[i], acc[i - 1], h[i].Z);
+  }
+  fe_invert(inv, acc[n - 1]);
+  for (i = n - 1; i > 0; i--) {
+    fe_mul(recip, inv, acc[i - 1]);
+    fe_mul(inv, inv, h[i].Z);
+    fe_mul(x, h[i].X, recip);
+    fe_mul(y, h[i].Y, recip);
+    fe_tobytes(s + 32 * i, y);
+    s[32 * i + 31] ^= fe_isnegative(x) << 7;
+  }
+  fe_mul(x, h[0].X, inv);
+  fe_mul(y, h[0].Y, inv);
+  fe_tobytes(s, y);
+  s[31] ^= fe_isnegative(x) << 7;
+}
+
 /* From sc_reduce.c */
 
 /*
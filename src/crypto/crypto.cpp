@@ -585,4 +585,69 @@ POP_WARNINGS
     sc_sub(&h, &h, &sum);
     return sc_isnonzero(&h) == 0;
   }
+
+  bool crypto_ops::check_ring_signatures(const ring_signature_check *checks, size_t count) {
+    size_t i, j, total = 0;
+    for (i = 0; i < count; i++) {
+      total += checks[i].pubs_count;
+    }
+    if (total == 0) {
+      return true;
+    }
+    // every ring member contributes two points, serialized together at the end
+    std::vector<ge_p2> points(2 * total);
+    std::vector<ec_point> points_bytes(2 * total);
+    std::unique_ptr<fe[]> scratch(new fe[2 * total]);
+    ge_p2 *point = points.data();
+    for (i = 0; i < count; i++) {
+      const ring_signature_check &check = checks[i];
+      ge_p3 image_unp;
+      ge_dsmp image_pre;
+#if !defined(NDEBUG)
+      for (j = 0; j < check.pubs_count; j++) {
+        assert(check_key(*check.pubs[j]));
+      }
+#endif
+      if (ge_frombytes_vartime(&image_unp, &*check.image) != 0) {
+        return false;
+      }
+      ge_dsm_precomp(image_pre, &image_unp);
+      for (j = 0; j < check.pubs_count; j++) {
+        ge_p3 tmp3;
+        if (sc_check(&check.sig[j].c) != 0 || sc_check(&check.sig[j].r) != 0) {
+          return false;
+        }
+        if (ge_frombytes_vartime(&tmp3, &*check.pubs[j]) != 0) {
+          return false;
+        }
+        ge_double_scalarmult_base_vartime(point++, &check.sig[j].c, &tmp3, &check.sig[j].r);
+        hash_to_ec(*check.pubs[j], tmp3);
+        ge_double_scalarmult_precomp_vartime(point++, &check.sig[j].r, &tmp3, &check.sig[j].c, image_pre);
+      }
+    }
+    ge_tobytes_batch(reinterpret_cast<unsigned char *>(points_bytes.data()), points.data(), scratch.get(), points.size());
+
+    const ec_point *point_bytes = points_bytes.data();
+    for (i = 0; i < count; i++) {
+      const ring_signature_check &check = checks[i];
+      ec_scalar sum, h;
+      boost::shared_ptr<rs_comm> buf(reinterpret_cast<rs_comm *>(malloc(rs_comm_size(check.pubs_count))), free);
+      if (!buf)
+        return false;
+      sc_0(&sum);
+      buf->h = *check.prefix_hash;
+      memcpy(buf->ab, point_bytes, 2 * sizeof(ec_point) * check.pubs_count);
+      point_bytes += 2 * check.pubs_count;
+      for (j = 0; j < check.pubs_count; j++) {
+        sc_add(&sum, &sum, &check.sig[j].c);
+      }
+      hash_to_scalar(buf.get(), rs_comm_size(check.pubs_count), h);
+      sc_sub(&h, &h, &sum);
+      if (sc_isnonzero(&h) != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
 }
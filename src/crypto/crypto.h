@@ -103,6 +103,16 @@ namespace crypto {
 
   void hash_to_scalar(const void *data, size_t length, ec_scalar &res);
 
+  /* One ring signature to verify as part of a batch.
+   */
+  struct ring_signature_check {
+    const hash *prefix_hash;
+    const key_image *image;
+    const public_key *const *pubs;
+    std::size_t pubs_count;
+    const signature *sig;
+  };
+
   static_assert(sizeof(ec_point) == 32 && sizeof(ec_scalar) == 32 &&
     sizeof(public_key) == 32 && sizeof(secret_key) == 32 &&
     sizeof(key_derivation) == 32 && sizeof(key_image) == 32 &&
@@ -148,6 +158,8 @@ namespace crypto {
       const public_key *const *, std::size_t, const signature *);
     friend bool check_ring_signature(const hash &, const key_image &,
       const public_key *const *, std::size_t, const signature *);
+    static bool check_ring_signatures(const ring_signature_check *, std::size_t);
+    friend bool check_ring_signatures(const ring_signature_check *, std::size_t);
   };
 
   /* Generate N random bytes
@@ -250,6 +262,14 @@ namespace crypto {
     return crypto_ops::check_ring_signature(prefix_hash, image, pubs, pubs_count, sig);
   }
 
+  /* Checks several ring signatures at once, sharing the field inversions
+   * needed to serialize the ring commitments. Returns true only if all of them
+   * are valid; on failure, check_ring_signature tells which one is bad.
+   */
+  inline bool check_ring_signatures(const ring_signature_check *checks, std::size_t count) {
+    return crypto_ops::check_ring_signatures(checks, count);
+  }
+
   /* Variants with vector<const public_key *> parameters.
    */
   inline void generate_ring_signature(const hash &prefix_hash, const key_image &image,
@@ -263,6 +283,9 @@ namespace crypto {
     const signature *sig) {
     return check_ring_signature(prefix_hash, image, pubs.data(), pubs.size(), sig);
   }
+  inline bool check_ring_signatures(const std::vector<ring_signature_check> &checks) {
+    return check_ring_signatures(checks.data(), checks.size());
+  }
 
   inline std::ostream &operator <<(std::ostream &o, const crypto::public_key &v) {
     epee::to_hex::formatted(o, epee::as_byte_span(v)); return o;
@@ -95,4 +95,8 @@ void rx_slow_hash_free_state(void);
 uint64_t rx_seedheight(const uint64_t height);
 void rx_seedheights(const uint64_t height, uint64_t *seed_height, uint64_t *next_height);
 void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const char *seedhash, const void *data, size_t length, char *hash, int miners, int is_alt);
+void rx_slow_hash_first(const uint64_t mainheight, const uint64_t seedheight, const char *seedhash, const void *data, size_t length, int miners);
+void rx_slow_hash_next(const void *data, size_t length, char *hash);
 void rx_reorg(const uint64_t split_height);
+void rx_set_next_seedhash(const uint64_t seedheight, const char *seedhash);
+void rx_stop_prefetch(void);
@@ -63,6 +63,32 @@ static rx_state rx_s[2] = {{CTHR_MUTEX_INIT,{0},0,0},{CTHR_MUTEX_INIT,{0},0,0}};
 static randomx_dataset *rx_dataset;
 static uint64_t rx_dataset_height;
 static THREADV randomx_vm *rx_vm = NULL;
+static THREADV int rx_vm_full = 0;
+
+/* VMs released by rx_slow_hash_free_state are kept here and handed to the
+ * next thread that needs one, so verification batches and miner restarts
+ * don't reallocate a VM (and its JIT/scratchpad pages) every time.
+ * Index 0 holds light-mode VMs, index 1 full-memory (dataset) VMs. */
+#define RX_VM_POOL_MAX	64
+
+static CTHR_MUTEX_TYPE rx_vm_pool_mutex = CTHR_MUTEX_INIT;
+static randomx_vm *rx_vm_pool[2][RX_VM_POOL_MAX];
+static int rx_vm_pool_count[2];
+
+/* background initialization of the next epoch's cache. rp_running is set
+ * while rp_thread has not been joined, rp_busy while it is still working;
+ * the thread keeps going as long as rp_height/rp_hash change under it, so
+ * callers never have to wait for it. */
+typedef struct rx_prefetch {
+  CTHR_THREAD_TYPE rp_thread;
+  int rp_running;
+  int rp_busy;
+  uint64_t rp_height;
+  char rp_hash[HASH_SIZE];
+} rx_prefetch;
+
+static CTHR_MUTEX_TYPE rx_prefetch_mutex = CTHR_MUTEX_INIT;
+static rx_prefetch rx_p;
 
 static void local_abort(const char *msg)
 {
@@ -111,6 +137,41 @@ static inline int enabled_flags(void) {
   return flags;
 }
 
+static inline int large_pages_flag(void) {
+  return (disabled_flags() & RANDOMX_FLAG_LARGE_PAGES) ? 0 : RANDOMX_FLAG_LARGE_PAGES;
+}
+
+static randomx_cache *rx_alloc_cache(randomx_flags flags) {
+  randomx_cache *cache = NULL;
+  if (large_pages_flag())
+    cache = randomx_alloc_cache(flags | RANDOMX_FLAG_LARGE_PAGES);
+  if (cache == NULL)
+    cache = randomx_alloc_cache(flags);
+  if (cache == NULL)
+    local_abort("Couldn't allocate RandomX cache");
+  return cache;
+}
+
+static randomx_vm *rx_vm_pool_get(int full) {
+  randomx_vm *vm = NULL;
+  CTHR_MUTEX_LOCK(rx_vm_pool_mutex);
+  if (rx_vm_pool_count[full] > 0)
+    vm = rx_vm_pool[full][--rx_vm_pool_count[full]];
+  CTHR_MUTEX_UNLOCK(rx_vm_pool_mutex);
+  return vm;
+}
+
+static void rx_vm_pool_put(randomx_vm *vm, int full) {
+  CTHR_MUTEX_LOCK(rx_vm_pool_mutex);
+  if (rx_vm_pool_count[full] < RX_VM_POOL_MAX) {
+    rx_vm_pool[full][rx_vm_pool_count[full]++] = vm;
+    vm = NULL;
+  }
+  CTHR_MUTEX_UNLOCK(rx_vm_pool_mutex);
+  if (vm != NULL)
+    randomx_destroy_vm(vm);
+}
+
 #define SEEDHASH_EPOCH_BLOCKS	2048	/* Must be same as BLOCKS_SYNCHRONIZING_MAX_COUNT in cryptonote_config.h */
 #define SEEDHASH_EPOCH_LAG		64
 
@@ -189,8 +250,11 @@ static void rx_initdata(randomx_cache *rs_cache, const int miners, const uint64_
   rx_dataset_height = seedheight;
 }
 
-void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const char *seedhash, const void *data, size_t length,
-  char *hash, int miners, int is_alt) {
+/* Selects the cache slot for seedhash, brings it and this thread's VM up to
+ * date and returns the slot with its rs_mutex held. *is_alt is updated to
+ * tell the caller whether the slot must stay locked while hashing. */
+static rx_state *rx_prepare_vm(const uint64_t mainheight, const uint64_t seedheight, const char *seedhash, int miners, int *is_altp) {
+  int is_alt = *is_altp;
   uint64_t s_height = rx_seedheight(mainheight);
   int toggle = (s_height & SEEDHASH_EPOCH_BLOCKS) != 0;
   randomx_flags flags = enabled_flags() & ~disabled_flags();
@@ -219,15 +283,8 @@ void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const ch
   CTHR_MUTEX_UNLOCK(rx_mutex);
 
   cache = rx_sp->rs_cache;
-  if (cache == NULL) {
-    if (cache == NULL) {
-      cache = randomx_alloc_cache(flags | RANDOMX_FLAG_LARGE_PAGES);
-      if (cache == NULL)
-        cache = randomx_alloc_cache(flags);
-      if (cache == NULL)
-        local_abort("Couldn't allocate RandomX cache");
-    }
-  }
+  if (cache == NULL)
+    cache = rx_alloc_cache(flags);
   if (rx_sp->rs_height != seedheight || rx_sp->rs_cache == NULL || memcmp(seedhash, rx_sp->rs_hash, HASH_SIZE)) {
     randomx_init_cache(cache, seedhash, HASH_SIZE);
     rx_sp->rs_cache = cache;
@@ -244,7 +301,8 @@ void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const ch
     if (miners) {
       CTHR_MUTEX_LOCK(rx_dataset_mutex);
       if (rx_dataset == NULL) {
-        rx_dataset = randomx_alloc_dataset(RANDOMX_FLAG_LARGE_PAGES);
+        if (large_pages_flag())
+          rx_dataset = randomx_alloc_dataset(RANDOMX_FLAG_LARGE_PAGES);
         if (rx_dataset == NULL)
           rx_dataset = randomx_alloc_dataset(RANDOMX_FLAG_DEFAULT);
         if (rx_dataset != NULL)
@@ -257,7 +315,10 @@ void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const ch
       }
       CTHR_MUTEX_UNLOCK(rx_dataset_mutex);
     }
-    rx_vm = randomx_create_vm(flags | RANDOMX_FLAG_LARGE_PAGES, rx_sp->rs_cache, rx_dataset);
+    rx_vm_full = miners != 0;
+    rx_vm = rx_vm_pool_get(rx_vm_full);
+    if (rx_vm == NULL && large_pages_flag())
+      rx_vm = randomx_create_vm(flags | RANDOMX_FLAG_LARGE_PAGES, rx_sp->rs_cache, rx_dataset);
     if(rx_vm == NULL)  //large pages failed
       rx_vm = randomx_create_vm(flags, rx_sp->rs_cache, rx_dataset);
     if(rx_vm == NULL) {//fallback if everything fails
@@ -266,15 +327,24 @@ void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const ch
     }
     if (rx_vm == NULL)
       local_abort("Couldn't allocate RandomX VM");
-  } else if (miners) {
+  }
+  if (rx_vm_full) {
     CTHR_MUTEX_LOCK(rx_dataset_mutex);
     if (rx_dataset != NULL && rx_dataset_height != seedheight)
-      rx_initdata(cache, miners, seedheight);
+      rx_initdata(cache, miners > 0 ? miners : 1, seedheight);
     CTHR_MUTEX_UNLOCK(rx_dataset_mutex);
   } else {
-    /* this is a no-op if the cache hasn't changed */
+    /* this is a no-op if the cache hasn't changed, which also covers
+     * a VM just taken from the pool */
     randomx_vm_set_cache(rx_vm, rx_sp->rs_cache);
   }
+  *is_altp = is_alt;
+  return rx_sp;
+}
+
+void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const char *seedhash, const void *data, size_t length,
+  char *hash, int miners, int is_alt) {
+  rx_state *rx_sp = rx_prepare_vm(mainheight, seedheight, seedhash, miners, &is_alt);
   /* mainchain users can run in parallel */
   if (!is_alt)
     CTHR_MUTEX_UNLOCK(rx_sp->rs_mutex);
@@ -284,18 +354,114 @@ void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const ch
     CTHR_MUTEX_UNLOCK(rx_sp->rs_mutex);
 }
 
+/* Pipelined hashing for the miner: rx_slow_hash_first starts hashing data
+ * on this thread's VM, each rx_slow_hash_next returns the previous input's
+ * hash while starting on the next one. A pending hash is simply dropped
+ * when the template changes. Only meant for mainchain templates, so the
+ * slot is never held across calls. */
+void rx_slow_hash_first(const uint64_t mainheight, const uint64_t seedheight, const char *seedhash, const void *data, size_t length,
+  int miners) {
+  int is_alt = 0;
+  rx_state *rx_sp = rx_prepare_vm(mainheight, seedheight, seedhash, miners, &is_alt);
+  CTHR_MUTEX_UNLOCK(rx_sp->rs_mutex);
+  randomx_calculate_hash_first(rx_vm, data, length);
+}
+
+void rx_slow_hash_next(const void *data, size_t length, char *hash) {
+  assert(rx_vm != NULL);
+  randomx_calculate_hash_next(rx_vm, data, length, hash);
+}
+
+static CTHR_THREAD_RTYPE rx_prefetchthread(void *arg) {
+  rx_prefetch *rp = arg;
+  randomx_flags flags = enabled_flags() & ~disabled_flags();
+  uint64_t height;
+  char hash[HASH_SIZE];
+
+  CTHR_MUTEX_LOCK(rx_prefetch_mutex);
+  while (rp->rp_running) {
+    height = rp->rp_height;
+    memcpy(hash, rp->rp_hash, HASH_SIZE);
+    CTHR_MUTEX_UNLOCK(rx_prefetch_mutex);
+
+    rx_state *rx_sp = &rx_s[(height & SEEDHASH_EPOCH_BLOCKS) != 0];
+    CTHR_MUTEX_LOCK(rx_sp->rs_mutex);
+    if (rx_sp->rs_height != height || rx_sp->rs_cache == NULL || memcmp(hash, rx_sp->rs_hash, HASH_SIZE)) {
+      if (rx_sp->rs_cache == NULL)
+        rx_sp->rs_cache = rx_alloc_cache(flags);
+      randomx_init_cache(rx_sp->rs_cache, hash, HASH_SIZE);
+      rx_sp->rs_height = height;
+      memcpy(rx_sp->rs_hash, hash, HASH_SIZE);
+    }
+    CTHR_MUTEX_UNLOCK(rx_sp->rs_mutex);
+
+    CTHR_MUTEX_LOCK(rx_prefetch_mutex);
+    if (rp->rp_height == height && !memcmp(rp->rp_hash, hash, HASH_SIZE))
+      break;
+  }
+  rp->rp_busy = 0;
+  CTHR_MUTEX_UNLOCK(rx_prefetch_mutex);
+  CTHR_THREAD_RETURN;
+}
+
+/* Called with the blockchain lock held, so it only hands the seed over: a
+ * prefetch still in progress picks it up when done, and a finished one is
+ * joined (which doesn't block) before starting the next. */
+void rx_set_next_seedhash(const uint64_t seedheight, const char *seedhash) {
+  CTHR_MUTEX_LOCK(rx_prefetch_mutex);
+  if (rx_p.rp_running && rx_p.rp_height == seedheight && !memcmp(rx_p.rp_hash, seedhash, HASH_SIZE)) {
+    CTHR_MUTEX_UNLOCK(rx_prefetch_mutex);
+    return;
+  }
+  rx_p.rp_height = seedheight;
+  memcpy(rx_p.rp_hash, seedhash, HASH_SIZE);
+  if (rx_p.rp_busy) {
+    CTHR_MUTEX_UNLOCK(rx_prefetch_mutex);
+    return;
+  }
+  if (rx_p.rp_running)
+    CTHR_THREAD_JOIN(rx_p.rp_thread);
+  rx_p.rp_running = 1;
+  rx_p.rp_busy = 1;
+  CTHR_THREAD_CREATE(rx_p.rp_thread, rx_prefetchthread, &rx_p);
+  CTHR_MUTEX_UNLOCK(rx_prefetch_mutex);
+}
+
+/* Waits for the prefetch thread, it stops after the cache it is working on.
+ * Called on shutdown, before the caches can go away. */
+void rx_stop_prefetch(void) {
+  CTHR_THREAD_TYPE thread;
+  CTHR_MUTEX_LOCK(rx_prefetch_mutex);
+  if (!rx_p.rp_running) {
+    CTHR_MUTEX_UNLOCK(rx_prefetch_mutex);
+    return;
+  }
+  thread = rx_p.rp_thread;
+  rx_p.rp_running = 0;
+  CTHR_MUTEX_UNLOCK(rx_prefetch_mutex);
+  CTHR_THREAD_JOIN(thread);
+}
+
 void rx_slow_hash_allocate_state(void) {
 }
 
 void rx_slow_hash_free_state(void) {
   if (rx_vm != NULL) {
-    randomx_destroy_vm(rx_vm);
+    rx_vm_pool_put(rx_vm, rx_vm_full);
     rx_vm = NULL;
+    rx_vm_full = 0;
   }
 }
 
 void rx_stop_mining(void) {
+  int i;
   CTHR_MUTEX_LOCK(rx_dataset_mutex);
+  /* pooled full-memory VMs point at the dataset, drop them with it */
+  CTHR_MUTEX_LOCK(rx_vm_pool_mutex);
+  for (i = 0; i < rx_vm_pool_count[1]; i++)
+    randomx_destroy_vm(rx_vm_pool[1][i]);
+  rx_vm_pool_count[1] = 0;
+  CTHR_MUTEX_UNLOCK(rx_vm_pool_mutex);
   if (rx_dataset != NULL) {
     randomx_dataset *rd = rx_dataset;
     rx_dataset = NULL;
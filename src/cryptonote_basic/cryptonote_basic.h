@@ -35,6 +35,7 @@
 #include <boost/variant.hpp>
 #include <boost/functional/hash/hash.hpp>
 #include <vector>
+#include <memory>
 #include <cstring>  // memcmp
 #include <sstream>
 #include <atomic>
@@ -54,6 +55,11 @@
 #include "device/device.hpp"
 #include "safex/safex_core.h"
 
+namespace safex
+{
+  class command;
+}
+
 namespace cryptonote
 {
   typedef std::vector<crypto::signature> ring_signature;
@@ -140,8 +146,16 @@ namespace cryptonote
     safex::command_t command_type = safex::command_t::nop; //Command type, to ease processing of input
     std::vector<uint8_t> script; //Contains Safex protocol layer commands executed on txout_to_script state
 
+    //Command parsed from script, filled on first use by safex_command_serializer::get_safex_command and
+    //shared by copies of this input, so tx verification and block insertion parse script only once.
+    //Reset it whenever script or command_type are assigned.
+    mutable std::shared_ptr<const safex::command> parsed_command;
+
 
     BEGIN_SERIALIZE_OBJECT()
+      if (!typename Archive<W>::is_saving())
+        parsed_command.reset();
+
       VARINT_FIELD(amount)
       VARINT_FIELD(token_amount)
       VARINT_FIELD(*(reinterpret_cast<uint32_t*>(&command_type)))
@@ -126,6 +126,7 @@ namespace boost
   template <class Archive>
   inline void serialize(Archive &a, cryptonote::txin_to_script &x, const boost::serialization::version_type ver)
   {
+    x.parsed_command.reset();
     a & x.key_offsets;
     a & x.k_image;
     a & x.amount;
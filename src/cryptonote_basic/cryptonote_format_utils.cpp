@@ -41,6 +41,7 @@ using namespace epee;
 #include "cryptonote_config.h"
 #include "crypto/crypto.h"
 #include "crypto/hash.h"
+#include "common/int-util.h"
 #include "ringct/rctSigs.h"
 #include "safex/command.h"
 
@@ -1064,6 +1065,32 @@ namespace cryptonote
     return blob;
   }
   //---------------------------------------------------------------
+  size_t get_block_hashing_blob_nonce_offset(const block& b)
+  {
+    return tools::get_varint_data(b.major_version).size() + tools::get_varint_data(b.minor_version).size() +
+      tools::get_varint_data(b.timestamp).size() + sizeof(crypto::hash);
+  }
+  //---------------------------------------------------------------
+  crypto::hash get_short_tx_id_key(const crypto::hash& block_hash, uint64_t salt)
+  {
+    char data[sizeof(crypto::hash) + sizeof(uint64_t)];
+    salt = SWAP64LE(salt);
+    memcpy(data, &block_hash, sizeof(crypto::hash));
+    memcpy(data + sizeof(crypto::hash), &salt, sizeof(salt));
+    return crypto::cn_fast_hash(data, sizeof(data));
+  }
+  //---------------------------------------------------------------
+  uint64_t get_short_tx_id(const crypto::hash& key, const crypto::hash& txid)
+  {
+    char data[2 * sizeof(crypto::hash)];
+    memcpy(data, &key, sizeof(crypto::hash));
+    memcpy(data + sizeof(crypto::hash), &txid, sizeof(crypto::hash));
+    const crypto::hash h = crypto::cn_fast_hash(data, sizeof(data));
+    uint64_t id;
+    memcpy(&id, &h, sizeof(id));
+    return SWAP64LE(id);
+  }
+  //---------------------------------------------------------------
   bool calculate_block_hash(const block& b, crypto::hash& res)
   {
     bool hash_result = get_object_hash(get_block_hashing_blob(b), res);
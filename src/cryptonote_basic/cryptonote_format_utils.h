@@ -137,6 +137,9 @@ namespace cryptonote
   bool get_transaction_hash(const transaction& t, crypto::hash& res, size_t* blob_size);
   bool calculate_transaction_hash(const transaction& t, crypto::hash& res, size_t* blob_size);
   blobdata get_block_hashing_blob(const block& b);
+  size_t get_block_hashing_blob_nonce_offset(const block& b);
+  crypto::hash get_short_tx_id_key(const crypto::hash& block_hash, uint64_t salt);
+  uint64_t get_short_tx_id(const crypto::hash& key, const crypto::hash& txid);
   bool calculate_block_hash(const block& b, crypto::hash& res);
   bool get_block_hash(const block& b, crypto::hash& res);
   crypto::hash get_block_hash(const block& b);
@@ -183,6 +186,15 @@ namespace cryptonote
   }
   //---------------------------------------------------------------
   template<class t_object>
+  bool t_serializable_object_from_blob(t_object& to, const blobdata& b_blob)
+  {
+    std::stringstream ss;
+    ss << b_blob;
+    binary_archive<false> ba(ss);
+    return ::serialization::serialize(ba, to);
+  }
+  //---------------------------------------------------------------
+  template<class t_object>
   bool get_object_hash(const t_object& o, crypto::hash& res)
   {
     get_blob_hash(t_serializable_object_to_blob(o), res);
@@ -44,6 +44,7 @@
 #include "file_io_utils.h"
 #include "common/command_line.h"
 #include "common/util.h"
+#include "common/int-util.h"
 #include "string_coding.h"
 #include "string_tools.h"
 #include "storages/portable_storage_template_helper.h"
@@ -98,13 +99,14 @@ namespace cryptonote
   }
 
 
-  miner::miner(i_miner_handler* phandler, const get_block_hash_t &gbh):m_stop(1),
+  miner::miner(i_miner_handler* phandler, const get_block_hash_t &gbh, const get_seed_hash_t &gsh):m_stop(1),
     m_template(boost::value_initialized<block>()),
     m_template_no(0),
     m_diffic(0),
     m_thread_index(0),
     m_phandler(phandler),
     m_gbh(gbh),
+    m_gsh(gsh),
     m_height(0),
     m_pausers_count(0),
     m_threads_total(0),
@@ -193,7 +195,14 @@ namespace cryptonote
   {
     if(m_last_hr_merge_time && is_mining())
     {
-      m_current_hash_rate = m_hashes * 1000 / ((misc_utils::get_tick_count() - m_last_hr_merge_time + 1));
+      const uint64_t elapsed = misc_utils::get_tick_count() - m_last_hr_merge_time + 1;
+      m_current_hash_rate = m_hashes * 1000 / elapsed;
+      {
+        CRITICAL_REGION_LOCAL(m_threads_hash_rate_lock);
+        m_threads_hash_rate.resize(m_threads_hashes.size());
+        for (size_t i = 0; i < m_threads_hashes.size(); ++i)
+          m_threads_hash_rate[i] = m_threads_hashes[i].exchange(0) * 1000 / elapsed;
+      }
       CRITICAL_REGION_LOCAL(m_last_hash_rates_lock);
       m_last_hash_rates.push_back(m_current_hash_rate);
       if(m_last_hash_rates.size() > 19)
@@ -314,6 +323,14 @@ namespace cryptonote
 
     request_block_template();//lets update block template
 
+    {
+      CRITICAL_REGION_LOCAL(m_threads_hash_rate_lock);
+      m_threads_hashes.clear();
+      for(size_t i = 0; i != threads_count; i++)
+        m_threads_hashes.emplace_back(0);
+      m_threads_hash_rate.assign(threads_count, 0);
+    }
+
     boost::interprocess::ipcdetail::atomic_write32(&m_stop, 0);
     boost::interprocess::ipcdetail::atomic_write32(&m_thread_index, 0);
     set_is_background_mining_enabled(do_background);
@@ -345,6 +362,14 @@ namespace cryptonote
     }
   }
   //-----------------------------------------------------------------------------------------------------
+  std::vector<uint64_t> miner::get_threads_speed() const
+  {
+    if(!is_mining())
+      return std::vector<uint64_t>();
+    CRITICAL_REGION_LOCAL(m_threads_hash_rate_lock);
+    return m_threads_hash_rate;
+  }
+  //-----------------------------------------------------------------------------------------------------
   void miner::send_stop_signal()
   {
     boost::interprocess::ipcdetail::atomic_write32(&m_stop, 1);
@@ -433,6 +458,12 @@ namespace cryptonote
       MDEBUG("MINING RESUMED");
   }
   //-----------------------------------------------------------------------------------------------------
+  static void set_blob_nonce(blobdata &blob, size_t offset, uint32_t nonce)
+  {
+    nonce = SWAP32LE(nonce);
+    memcpy(&blob[offset], &nonce, sizeof(nonce));
+  }
+  //-----------------------------------------------------------------------------------------------------
   bool miner::worker_thread()
   {
     uint32_t th_local_index = boost::interprocess::ipcdetail::atomic_inc32(&m_thread_index);
@@ -443,6 +474,17 @@ namespace cryptonote
     difficulty_type local_diff = 0;
     uint32_t local_template_ver = 0;
     block b;
+    // RandomX templates are hashed through the pipelined API: the hashing
+    // blob is built once per template and only its nonce is patched, and
+    // each call returns the previous nonce's hash while the next one runs
+    bool pipelined = false;
+    bool hash_pending = false;
+    blobdata hashing_blob;
+    size_t nonce_offset = 0;
+    uint32_t pending_nonce = 0;
+    uint64_t main_height = 0, seed_height = 0;
+    crypto::hash seed_hash = crypto::null_hash;
+    const unsigned int miners = tools::get_max_concurrency();
     slow_hash_allocate_state();
     while(!m_stop)
     {
@@ -474,6 +516,14 @@ namespace cryptonote
         CRITICAL_REGION_END();
         local_template_ver = m_template_no;
         nonce = m_starter_nonce + th_local_index;
+        hash_pending = false;
+        pipelined = m_gsh && b.major_version >= RX_BLOCK_VERSION;
+        if (pipelined)
+        {
+          hashing_blob = get_block_hashing_blob(b);
+          nonce_offset = get_block_hashing_blob_nonce_offset(b);
+          m_gsh(height, main_height, seed_height, seed_hash);
+        }
       }
 
       if(!local_template_ver)//no any set_block_template call
@@ -483,12 +533,31 @@ namespace cryptonote
         continue;
       }
 
-      b.nonce = nonce;
       crypto::hash h;
-      m_gbh(b, height, tools::get_max_concurrency(), h);
+      if (pipelined)
+      {
+        if (!hash_pending)
+        {
+          set_blob_nonce(hashing_blob, nonce_offset, nonce);
+          crypto::rx_slow_hash_first(main_height, seed_height, seed_hash.data, hashing_blob.data(), hashing_blob.size(), miners);
+          pending_nonce = nonce;
+          nonce += m_threads_total;
+          hash_pending = true;
+        }
+        set_blob_nonce(hashing_blob, nonce_offset, nonce);
+        crypto::rx_slow_hash_next(hashing_blob.data(), hashing_blob.size(), h.data);
+        b.nonce = pending_nonce;
+        pending_nonce = nonce;
+      }
+      else
+      {
+        b.nonce = nonce;
+        m_gbh(b, height, miners, h);
+      }
 
       if(check_hash(h, local_diff))
       {
+        b.invalidate_hashes();
         //we lucky!
         ++m_config.current_extra_message_index;
         MGINFO_GREEN("Found block for difficulty: " << local_diff);
@@ -504,6 +573,7 @@ namespace cryptonote
       }
       nonce+=m_threads_total;
       ++m_hashes;
+      ++m_threads_hashes[th_local_index];
     }
     slow_hash_free_state();
     MGINFO("Miner thread stopped ["<< th_local_index << "]");
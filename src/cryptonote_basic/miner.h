@@ -34,6 +34,7 @@
 #include <boost/program_options.hpp>
 #include <boost/logic/tribool_fwd.hpp>
 #include <atomic>
+#include <deque>
 #include "cryptonote_basic.h"
 #include "difficulty.h"
 #include "math_helper.h"
@@ -58,6 +59,8 @@ namespace cryptonote
   };
 
   typedef std::function<bool(const cryptonote::block&, uint64_t, unsigned int, crypto::hash&)> get_block_hash_t;
+  // RandomX seed for a template at the given height: (height, main_height, seed_height, seed_hash)
+  typedef std::function<void(uint64_t, uint64_t&, uint64_t&, crypto::hash&)> get_seed_hash_t;
 
   /************************************************************************/
   /*                                                                      */
@@ -65,7 +68,7 @@ namespace cryptonote
   class miner
   {
   public: 
-    miner(i_miner_handler* phandler, const get_block_hash_t& gbh);
+    miner(i_miner_handler* phandler, const get_block_hash_t& gbh, const get_seed_hash_t& gsh = get_seed_hash_t());
     ~miner();
     bool init(const boost::program_options::variables_map& vm, network_type nettype);
     static void init_options(boost::program_options::options_description& desc);
@@ -73,6 +76,7 @@ namespace cryptonote
     bool on_block_chain_update();
     bool start(const account_public_address& adr, size_t threads_count, const boost::thread::attributes& attrs, bool do_background = false, bool ignore_battery = false);
     uint64_t get_speed() const;
+    std::vector<uint64_t> get_threads_speed() const;
     uint32_t get_threads_count() const;
     void send_stop_signal();
     bool stop();
@@ -138,6 +142,7 @@ namespace cryptonote
     epee::critical_section m_threads_lock;
     i_miner_handler* m_phandler;
     get_block_hash_t m_gbh;
+    get_seed_hash_t m_gsh;
     account_public_address m_mine_address;
     epee::math_helper::once_a_time_seconds<5> m_update_block_template_interval;
     epee::math_helper::once_a_time_seconds<2> m_update_merge_hr_interval;
@@ -149,6 +154,9 @@ namespace cryptonote
     std::atomic<uint64_t> m_current_hash_rate;
     epee::critical_section m_last_hash_rates_lock;
     std::list<uint64_t> m_last_hash_rates;
+    mutable epee::critical_section m_threads_hash_rate_lock;
+    std::deque<std::atomic<uint64_t>> m_threads_hashes;
+    std::vector<uint64_t> m_threads_hash_rate;
     bool m_do_print_hashrate;
     bool m_do_mining;
 
@@ -137,7 +137,8 @@
 #define P2P_IDLE_CONNECTION_KILL_INTERVAL               (5*60) //5 minutes
 
 #define P2P_SUPPORT_FLAG_FLUFFY_BLOCKS                  0x01
-#define P2P_SUPPORT_FLAGS                               P2P_SUPPORT_FLAG_FLUFFY_BLOCKS
+#define P2P_SUPPORT_FLAG_COMPACT_BLOCKS                 0x02
+#define P2P_SUPPORT_FLAGS                               (P2P_SUPPORT_FLAG_FLUFFY_BLOCKS | P2P_SUPPORT_FLAG_COMPACT_BLOCKS)
 
 #define ALLOW_DEBUG_COMMANDS
 
@@ -171,6 +172,8 @@
 #define HF_VERSION_ALLOW_TX_VERSION_2           7
 #define HF_VERSION_MINER_DUST_HANDLE_DIGIT      7
 
+#define HF_VERSION_SAFEX_FIXED_POINT_PRICE_PEG  HF_VERSION_TBD
+
 constexpr uint8_t MIN_SUPPORTED_TX_VERSION = 1;
 constexpr uint8_t MAX_SUPPORTED_TX_VERSION = 2;
 
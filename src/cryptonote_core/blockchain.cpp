@@ -152,7 +152,8 @@ static const struct {
 Blockchain::Blockchain(tx_memory_pool& tx_pool) :
   m_db(), m_tx_pool(tx_pool), m_hardfork(NULL), m_timestamps_and_difficulties_height(0), m_current_block_cumul_sz_limit(0), m_current_block_cumul_sz_median(0),
   m_enforce_dns_checkpoints(false), m_max_prepare_blocks_threads(4), m_db_blocks_per_sync(1), m_db_sync_mode(db_async), m_db_default_sync(false),
-  m_fast_sync(true), m_show_time_stats(false), m_sync_counter(0), m_cancel(false), m_prepare_height(0), m_batch_success(true)
+  m_fast_sync(true), m_show_time_stats(false), m_sync_counter(0), m_cancel(false), m_prepare_height(0), m_batch_success(true),
+  m_btc_valid(false)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
 }
@@ -177,6 +178,13 @@ bool Blockchain::have_tx_keyimg_as_spent(const crypto::key_image &key_im) const
   return  m_db->has_key_image(key_im);
 }
 //------------------------------------------------------------------
+void Blockchain::have_tx_keyimgs_as_spent(const std::vector<crypto::key_image> &key_im, std::vector<bool> &spent) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  // same locking caveats as have_tx_keyimg_as_spent
+  m_db->has_key_images(key_im, spent);
+}
+//------------------------------------------------------------------
 // This function makes sure that each "input" in an input (mixins) exists
 // and collects the public key for each from the transaction it was included in
 // via the visitor passed to it.
@@ -880,6 +888,9 @@ bool Blockchain::deinit()
   m_async_pool.join_all();
   m_async_service.stop();
 
+  // don't leave the next seed's cache being built behind us
+  get_block_longhash_stop_prefetch();
+
   // as this should be called if handling a SIGSEGV, need to check
   // if m_db is a NULL pointer (and thus may have caused the illegal
   // memory operation), otherwise we may cause a loop.
@@ -974,6 +985,8 @@ block Blockchain::pop_block_from_blockchain()
   m_scan_table_adv.clear();
   m_blocks_txs_check.clear();
   m_check_txin_table.clear();
+  m_prevalidated_inputs.clear();
+  m_safex_account_keys.clear();
 
   update_next_cumulative_size_limit();
   m_tx_pool.on_blockchain_dec(m_db->height()-1, get_tail_id());
@@ -1636,9 +1649,22 @@ bool Blockchain::create_block_template(block& b, const account_public_address& m
   LOG_PRINT_L3("Blockchain::" << __func__);
   size_t median_size;
   uint64_t already_generated_coins;
+  uint64_t pool_cookie;
 
   CRITICAL_REGION_BEGIN(m_blockchain_lock);
   height = m_db->height();
+  pool_cookie = m_tx_pool.cookie();
+  if (m_btc_valid && m_btc.prev_id == get_tail_id() && m_btc_pool_cookie == pool_cookie &&
+      !memcmp(&miner_address, &m_btc_address, sizeof(account_public_address)) && ex_nonce == m_btc_nonce)
+  {
+    MDEBUG("Using cached block template");
+    b = m_btc;
+    b.timestamp = std::max<uint64_t>(b.timestamp, time(NULL));
+    diffic = m_btc_difficulty;
+    height = m_btc_height;
+    expected_reward = m_btc_expected_reward;
+    return true;
+  }
 
   b.major_version = m_hardfork->get_current_version();
   b.minor_version = m_hardfork->get_ideal_version();
@@ -1777,6 +1803,18 @@ bool Blockchain::create_block_template(block& b, const account_public_address& m
     MDEBUG("Creating block template: miner tx size " << coinbase_blob_size <<
         ", cumulative size " << cumulative_size << " is now good");
 #endif
+    CRITICAL_REGION_LOCAL(m_blockchain_lock);
+    if (b.prev_id == get_tail_id())
+    {
+      m_btc = b;
+      m_btc_address = miner_address;
+      m_btc_nonce = ex_nonce;
+      m_btc_difficulty = diffic;
+      m_btc_height = height;
+      m_btc_expected_reward = expected_reward;
+      m_btc_pool_cookie = pool_cookie;
+      m_btc_valid = true;
+    }
     return true;
   }
   LOG_ERROR("Failed to create_block_template with " << 10 << " tries");
@@ -2468,7 +2506,7 @@ void Blockchain::get_output_key_mask_unlocked(const uint64_t& amount, const uint
   unlocked = is_tx_spendtime_unlocked(m_db->get_tx_unlock_time(toi.first));
 }
 //------------------------------------------------------------------
-bool Blockchain::get_output_distribution(uint64_t amount, const tx_out_type output_type, uint64_t from_height, uint64_t &start_height, std::vector<uint64_t> &distribution, uint64_t &base) const
+bool Blockchain::get_output_distribution(uint64_t amount, const tx_out_type output_type, uint64_t from_height, uint64_t to_height, uint64_t &start_height, std::vector<uint64_t> &distribution, uint64_t &base) const
 {
   // rct outputs don't exist before v3
   if (amount == 0)
@@ -2485,7 +2523,6 @@ bool Blockchain::get_output_distribution(uint64_t amount, const tx_out_type outp
     start_height = 0;
   base = 0;
 
-  const uint64_t real_start_height = start_height;
   if (from_height > start_height)
     start_height = from_height;
 
@@ -2493,18 +2530,12 @@ bool Blockchain::get_output_distribution(uint64_t amount, const tx_out_type outp
   uint64_t db_height = m_db->height();
   if (start_height >= db_height)
     return false;
-  distribution.resize(db_height - start_height, 0);
-  bool r = for_all_outputs(amount, [&](uint64_t height) {
-    CHECK_AND_ASSERT_MES(height >= real_start_height && height <= db_height, false, "Height not in expected range");
-    if (height >= start_height)
-      distribution[height - start_height]++;
-    else
-      base++;
-    return true;
-  }, output_type);
-  if (!r)
-    return false;
-  return true;
+  uint64_t stop_height = db_height - 1;
+  if (to_height > 0 && to_height >= start_height && to_height < stop_height)
+    stop_height = to_height;
+
+  // the db keeps a cumulative count per height, so only the requested range is read
+  return m_db->get_output_distribution(amount, output_type, start_height, stop_height, distribution, base);
 }
 //------------------------------------------------------------------
 // This function takes a list of block hashes from another node
@@ -2971,13 +3002,13 @@ bool Blockchain::check_safex_tx(const transaction &tx, tx_verification_context &
 
   if (tx.version == 1) return true;
 
-  std::vector<txin_to_script> input_commands_to_execute;
+  std::vector<const txin_to_script*> input_commands_to_execute;
   safex::command_t input_command_to_check;
 
   bool only_donate_seen = true;
   bool only_stake_seen = true;
 
-  for (auto txin: tx.vin)
+  for (const auto &txin: tx.vin)
   {
     if ((txin.type() == typeid(txin_to_script)))
     {
@@ -2989,7 +3020,7 @@ bool Blockchain::check_safex_tx(const transaction &tx, tx_verification_context &
       if(txin_script.command_type != safex::command_t::token_stake)
         only_stake_seen = false;
 
-      input_commands_to_execute.push_back(txin_script);
+      input_commands_to_execute.push_back(&txin_script);
       input_command_to_check = txin_script.command_type;
     }
   }
@@ -3036,8 +3067,8 @@ bool Blockchain::check_safex_tx(const transaction &tx, tx_verification_context &
   }
 
   //validate all command logic
-  for (const txin_to_script& cmd: input_commands_to_execute)
-      if (!safex::validate_safex_command(*m_db, cmd)) {
+  for (const txin_to_script* cmd: input_commands_to_execute)
+      if (!safex::validate_safex_command(*m_db, *cmd)) {
         tvc.m_safex_command_execution_failed = true;
         return false;
       }
@@ -3124,7 +3155,7 @@ bool Blockchain::check_safex_tx_command(const transaction &tx, const safex::comm
         uint64_t total_locked_tokens = 0;
         bool create_account_seen = false;
         txin_to_script command;
-        for(auto txin: tx.vin){
+        for(const auto &txin: tx.vin){
             if (txin.type() == typeid(txin_to_script))
             {
                 const txin_to_script &stxin = boost::get<txin_to_script>(txin);
@@ -3134,7 +3165,7 @@ bool Blockchain::check_safex_tx_command(const transaction &tx, const safex::comm
                 }
             }
         }
-        std::unique_ptr<safex::create_account> cmd = safex::safex_command_serializer::parse_safex_command<safex::create_account>(command.script);
+        std::shared_ptr<const safex::create_account> cmd = safex::safex_command_serializer::get_safex_command<safex::create_account>(command);
 
         for (const auto &vout: tx.vout)
         {
@@ -3182,7 +3213,7 @@ bool Blockchain::check_safex_tx_command(const transaction &tx, const safex::comm
     {
         bool edit_account_seen = false;
         txin_to_script command;
-        for(auto txin: tx.vin){
+        for(const auto &txin: tx.vin){
             if (txin.type() == typeid(txin_to_script))
             {
                 const txin_to_script &stxin = boost::get<txin_to_script>(txin);
@@ -3192,7 +3223,7 @@ bool Blockchain::check_safex_tx_command(const transaction &tx, const safex::comm
                 }
             }
         }
-        std::unique_ptr<safex::edit_account> cmd = safex::safex_command_serializer::parse_safex_command<safex::edit_account>(command.script);
+        std::shared_ptr<const safex::edit_account> cmd = safex::safex_command_serializer::get_safex_command<safex::edit_account>(command);
 
 
         for (const auto &vout: tx.vout)
@@ -3230,7 +3261,7 @@ bool Blockchain::check_safex_tx_command(const transaction &tx, const safex::comm
     {
         bool create_offer_seen = false;
         txin_to_script command;
-        for(auto txin: tx.vin){
+        for(const auto &txin: tx.vin){
             if (txin.type() == typeid(txin_to_script))
             {
                 const txin_to_script &stxin = boost::get<txin_to_script>(txin);
@@ -3240,7 +3271,7 @@ bool Blockchain::check_safex_tx_command(const transaction &tx, const safex::comm
                 }
             }
         }
-        std::unique_ptr<safex::create_offer> cmd = safex::safex_command_serializer::parse_safex_command<safex::create_offer>(command.script);
+        std::shared_ptr<const safex::create_offer> cmd = safex::safex_command_serializer::get_safex_command<safex::create_offer>(command);
 
 
         for (const auto &vout: tx.vout)
@@ -3280,7 +3311,7 @@ bool Blockchain::check_safex_tx_command(const transaction &tx, const safex::comm
     {
         bool edit_offer_seen = false;
         txin_to_script command;
-        for(auto txin: tx.vin){
+        for(const auto &txin: tx.vin){
             if (txin.type() == typeid(txin_to_script))
             {
                 const txin_to_script &stxin = boost::get<txin_to_script>(txin);
@@ -3290,7 +3321,7 @@ bool Blockchain::check_safex_tx_command(const transaction &tx, const safex::comm
                 }
             }
         }
-        std::unique_ptr<safex::edit_offer> cmd = safex::safex_command_serializer::parse_safex_command<safex::edit_offer>(command.script);
+        std::shared_ptr<const safex::edit_offer> cmd = safex::safex_command_serializer::get_safex_command<safex::edit_offer>(command);
 
         for (const auto &vout: tx.vout)
         {
@@ -3331,7 +3362,7 @@ bool Blockchain::check_safex_tx_command(const transaction &tx, const safex::comm
         crypto::public_key public_seller_spend_key;
         bool purchase_seen = false;
         txin_to_script command;
-        for(auto txin: tx.vin){
+        for(const auto &txin: tx.vin){
             if (txin.type() == typeid(txin_to_script))
             {
                 const txin_to_script &stxin = boost::get<txin_to_script>(txin);
@@ -3341,7 +3372,7 @@ bool Blockchain::check_safex_tx_command(const transaction &tx, const safex::comm
                 }
             }
         }
-        std::unique_ptr<safex::simple_purchase> cmd = safex::safex_command_serializer::parse_safex_command<safex::simple_purchase>(command.script);
+        std::shared_ptr<const safex::simple_purchase> cmd = safex::safex_command_serializer::get_safex_command<safex::simple_purchase>(command);
 
 
         if (tx.unlock_time > m_db->height())
@@ -3431,7 +3462,7 @@ bool Blockchain::check_safex_tx_command(const transaction &tx, const safex::comm
     {
         bool feedback_seen = false;
         txin_to_script command;
-        for(auto txin: tx.vin){
+        for(const auto &txin: tx.vin){
             if (txin.type() == typeid(txin_to_script))
             {
                 const txin_to_script &stxin = boost::get<txin_to_script>(txin);
@@ -3441,7 +3472,7 @@ bool Blockchain::check_safex_tx_command(const transaction &tx, const safex::comm
                 }
             }
         }
-        std::unique_ptr<safex::create_feedback> cmd = safex::safex_command_serializer::parse_safex_command<safex::create_feedback>(command.script);
+        std::shared_ptr<const safex::create_feedback> cmd = safex::safex_command_serializer::get_safex_command<safex::create_feedback>(command);
 
         for (const auto &vout: tx.vout)
         {
@@ -3476,7 +3507,7 @@ bool Blockchain::check_safex_tx_command(const transaction &tx, const safex::comm
     {
         bool create_price_peg_seen = false;
         txin_to_script command;
-        for(auto txin: tx.vin){
+        for(const auto &txin: tx.vin){
             if (txin.type() == typeid(txin_to_script))
             {
                 const txin_to_script &stxin = boost::get<txin_to_script>(txin);
@@ -3486,7 +3517,7 @@ bool Blockchain::check_safex_tx_command(const transaction &tx, const safex::comm
                 }
             }
         }
-        std::unique_ptr<safex::create_price_peg> cmd = safex::safex_command_serializer::parse_safex_command<safex::create_price_peg>(command.script);
+        std::shared_ptr<const safex::create_price_peg> cmd = safex::safex_command_serializer::get_safex_command<safex::create_price_peg>(command);
 
         for (const auto &vout: tx.vout)
         {
@@ -3524,7 +3555,7 @@ bool Blockchain::check_safex_tx_command(const transaction &tx, const safex::comm
     {
         bool update_price_peg_seen = false;
         txin_to_script command;
-        for(auto txin: tx.vin){
+        for(const auto &txin: tx.vin){
             if (txin.type() == typeid(txin_to_script))
             {
                 const txin_to_script &stxin = boost::get<txin_to_script>(txin);
@@ -3534,7 +3565,7 @@ bool Blockchain::check_safex_tx_command(const transaction &tx, const safex::comm
                 }
             }
         }
-        std::unique_ptr<safex::update_price_peg> cmd = safex::safex_command_serializer::parse_safex_command<safex::update_price_peg>(command.script);
+        std::shared_ptr<const safex::update_price_peg> cmd = safex::safex_command_serializer::get_safex_command<safex::update_price_peg>(command);
 
         for (const auto &vout: tx.vout)
         {
@@ -3840,6 +3871,15 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
   std::vector<std::vector<rct::ctkey>> pubkeys(tx.vin.size());
   std::vector<uint64_t> results;
   results.resize(tx.vin.size(), 0);
+  std::vector<size_t> ring_signature_inputs;
+
+  const std::vector<uint8_t> *prevalidated = NULL;
+  if (!m_prevalidated_inputs.empty())
+  {
+    auto itp = m_prevalidated_inputs.find(get_transaction_hash(tx));
+    if (itp != m_prevalidated_inputs.end() && itp->second.size() == tx.vin.size())
+      prevalidated = &itp->second;
+  }
 
   tools::threadpool& tpool = tools::threadpool::getInstance();
   tools::threadpool::waiter waiter;
@@ -3950,49 +3990,52 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
           tpool.submit(&waiter, boost::bind(&Blockchain::check_migration_signature, this, std::cref(tx_prefix_hash), std::cref(tx.signatures[sig_index][0]), std::ref(results[sig_index])));
         }
         else if ((txin.type() == typeid(txin_to_script)) && (boost::get<txin_to_script>(txin).command_type == safex::command_t::edit_account)) {
-          std::unique_ptr<safex::edit_account> cmd = safex::safex_command_serializer::parse_safex_command<safex::edit_account>(boost::get<txin_to_script>(txin).script);
+          std::shared_ptr<const safex::edit_account> cmd = safex::safex_command_serializer::get_safex_command<safex::edit_account>(boost::get<txin_to_script>(txin));
           crypto::public_key account_pkey{};
-          get_safex_account_public_key(cmd->get_username(), account_pkey);
+          get_batch_safex_account_public_key(cmd->get_username(), account_pkey);
           tpool.submit(&waiter, boost::bind(&Blockchain::check_safex_account_signature, this, std::cref(tx_prefix_hash), std::cref(account_pkey),
                                             std::cref(tx.signatures[sig_index][0]), std::ref(results[sig_index]))
           );
         }
         else if ((txin.type() == typeid(txin_to_script)) && (boost::get<txin_to_script>(txin).command_type == safex::command_t::create_offer)) {
-            std::unique_ptr<safex::create_offer> cmd = safex::safex_command_serializer::parse_safex_command<safex::create_offer>(boost::get<txin_to_script>(txin).script);
+            std::shared_ptr<const safex::create_offer> cmd = safex::safex_command_serializer::get_safex_command<safex::create_offer>(boost::get<txin_to_script>(txin));
             crypto::public_key account_pkey{};
-            get_safex_account_public_key(cmd->get_seller(), account_pkey);
+            get_batch_safex_account_public_key(cmd->get_seller(), account_pkey);
             tpool.submit(&waiter, boost::bind(&Blockchain::check_safex_account_signature, this, std::cref(tx_prefix_hash), std::cref(account_pkey),
                                               std::cref(tx.signatures[sig_index][0]), std::ref(results[sig_index]))
             );
         }
         else if ((txin.type() == typeid(txin_to_script)) && (boost::get<txin_to_script>(txin).command_type == safex::command_t::edit_offer)) {
-            std::unique_ptr<safex::edit_offer> cmd = safex::safex_command_serializer::parse_safex_command<safex::edit_offer>(boost::get<txin_to_script>(txin).script);
+            std::shared_ptr<const safex::edit_offer> cmd = safex::safex_command_serializer::get_safex_command<safex::edit_offer>(boost::get<txin_to_script>(txin));
             crypto::public_key account_pkey{};
-            get_safex_account_public_key(cmd->get_seller(), account_pkey);
+            get_batch_safex_account_public_key(cmd->get_seller(), account_pkey);
             tpool.submit(&waiter, boost::bind(&Blockchain::check_safex_account_signature, this, std::cref(tx_prefix_hash), std::cref(account_pkey),
                                               std::cref(tx.signatures[sig_index][0]), std::ref(results[sig_index]))
             );
         }
         else if ((txin.type() == typeid(txin_to_script)) && (boost::get<txin_to_script>(txin).command_type == safex::command_t::create_price_peg)) {
-          std::unique_ptr<safex::create_price_peg> cmd = safex::safex_command_serializer::parse_safex_command<safex::create_price_peg>(boost::get<txin_to_script>(txin).script);
+          std::shared_ptr<const safex::create_price_peg> cmd = safex::safex_command_serializer::get_safex_command<safex::create_price_peg>(boost::get<txin_to_script>(txin));
           crypto::public_key account_pkey{};
-          get_safex_account_public_key(cmd->get_creator(), account_pkey);
+          get_batch_safex_account_public_key(cmd->get_creator(), account_pkey);
           tpool.submit(&waiter, boost::bind(&Blockchain::check_safex_account_signature, this, std::cref(tx_prefix_hash), std::cref(account_pkey),
                                             std::cref(tx.signatures[sig_index][0]), std::ref(results[sig_index]))
           );
         }
         else if ((txin.type() == typeid(txin_to_script)) && (boost::get<txin_to_script>(txin).command_type == safex::command_t::update_price_peg)) {
-          std::unique_ptr<safex::update_price_peg> cmd = safex::safex_command_serializer::parse_safex_command<safex::update_price_peg>(boost::get<txin_to_script>(txin).script);
+          std::shared_ptr<const safex::update_price_peg> cmd = safex::safex_command_serializer::get_safex_command<safex::update_price_peg>(boost::get<txin_to_script>(txin));
           crypto::public_key account_pkey{};
           safex::safex_price_peg sfx_price_peg;
           get_safex_price_peg(cmd->get_price_peg_id(),sfx_price_peg);
-          get_safex_account_public_key(sfx_price_peg.creator, account_pkey);
+          get_batch_safex_account_public_key(sfx_price_peg.creator, account_pkey);
           tpool.submit(&waiter, boost::bind(&Blockchain::check_safex_account_signature, this, std::cref(tx_prefix_hash), std::cref(account_pkey),
                                             std::cref(tx.signatures[sig_index][0]), std::ref(results[sig_index]))
           );
         }
+        else if (prevalidated && (*prevalidated)[sig_index]) {
+          results[sig_index] = 1;
+        }
         else {
-          tpool.submit(&waiter, boost::bind(&Blockchain::check_ring_signature, this, std::cref(tx_prefix_hash), std::cref(k_image), std::cref(pubkeys[sig_index]), std::cref(tx.signatures[sig_index]), std::ref(results[sig_index])));
+          ring_signature_inputs.push_back(sig_index);
         }
       }
       else
@@ -4000,39 +4043,46 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
         if (txin.type() == typeid(txin_token_migration)) {
           check_migration_signature(tx_prefix_hash, tx.signatures[sig_index][0], results[sig_index]);
         } else if ((txin.type() == typeid(txin_to_script)) && (boost::get<txin_to_script>(txin).command_type == safex::command_t::edit_account)) {
-            std::unique_ptr<safex::edit_account> cmd = safex::safex_command_serializer::parse_safex_command<safex::edit_account>(boost::get<txin_to_script>(txin).script);
+            std::shared_ptr<const safex::edit_account> cmd = safex::safex_command_serializer::get_safex_command<safex::edit_account>(boost::get<txin_to_script>(txin));
             crypto::public_key account_pkey{};
-            get_safex_account_public_key(cmd->get_username(), account_pkey);
+            get_batch_safex_account_public_key(cmd->get_username(), account_pkey);
             check_safex_account_signature(tx_prefix_hash,account_pkey,tx.signatures[sig_index][0],results[sig_index]);
         }
         else if ((txin.type() == typeid(txin_to_script)) && (boost::get<txin_to_script>(txin).command_type == safex::command_t::create_offer)) {
-            std::unique_ptr<safex::create_offer> cmd = safex::safex_command_serializer::parse_safex_command<safex::create_offer>(boost::get<txin_to_script>(txin).script);
+            std::shared_ptr<const safex::create_offer> cmd = safex::safex_command_serializer::get_safex_command<safex::create_offer>(boost::get<txin_to_script>(txin));
             crypto::public_key account_pkey{};
-            get_safex_account_public_key(cmd->get_seller(), account_pkey);
+            get_batch_safex_account_public_key(cmd->get_seller(), account_pkey);
             check_safex_account_signature( tx_prefix_hash, account_pkey,tx.signatures[sig_index][0], results[sig_index]);
         }
         else if ((txin.type() == typeid(txin_to_script)) && (boost::get<txin_to_script>(txin).command_type == safex::command_t::edit_offer)) {
-            std::unique_ptr<safex::edit_offer> cmd = safex::safex_command_serializer::parse_safex_command<safex::edit_offer>(boost::get<txin_to_script>(txin).script);
+            std::shared_ptr<const safex::edit_offer> cmd = safex::safex_command_serializer::get_safex_command<safex::edit_offer>(boost::get<txin_to_script>(txin));
             crypto::public_key account_pkey{};
-            get_safex_account_public_key(cmd->get_seller(), account_pkey);
+            get_batch_safex_account_public_key(cmd->get_seller(), account_pkey);
             check_safex_account_signature( tx_prefix_hash, account_pkey,tx.signatures[sig_index][0], results[sig_index]);
         }
         else if ((txin.type() == typeid(txin_to_script)) && (boost::get<txin_to_script>(txin).command_type == safex::command_t::create_price_peg)) {
-          std::unique_ptr<safex::create_price_peg> cmd = safex::safex_command_serializer::parse_safex_command<safex::create_price_peg>(boost::get<txin_to_script>(txin).script);
+          std::shared_ptr<const safex::create_price_peg> cmd = safex::safex_command_serializer::get_safex_command<safex::create_price_peg>(boost::get<txin_to_script>(txin));
           crypto::public_key account_pkey{};
-          get_safex_account_public_key(cmd->get_creator(), account_pkey);
+          get_batch_safex_account_public_key(cmd->get_creator(), account_pkey);
           check_safex_account_signature( tx_prefix_hash, account_pkey,tx.signatures[sig_index][0], results[sig_index]);
         }
         else if ((txin.type() == typeid(txin_to_script)) && (boost::get<txin_to_script>(txin).command_type == safex::command_t::update_price_peg)) {
-          std::unique_ptr<safex::update_price_peg> cmd = safex::safex_command_serializer::parse_safex_command<safex::update_price_peg>(boost::get<txin_to_script>(txin).script);
+          std::shared_ptr<const safex::update_price_peg> cmd = safex::safex_command_serializer::get_safex_command<safex::update_price_peg>(boost::get<txin_to_script>(txin));
           crypto::public_key account_pkey{};
           safex::safex_price_peg sfx_price_peg;
           get_safex_price_peg(cmd->get_price_peg_id(),sfx_price_peg);
-          get_safex_account_public_key(sfx_price_peg.creator, account_pkey);
+          get_batch_safex_account_public_key(sfx_price_peg.creator, account_pkey);
           check_safex_account_signature( tx_prefix_hash, account_pkey,tx.signatures[sig_index][0], results[sig_index]);
         }
+        else if (prevalidated && (*prevalidated)[sig_index]) {
+          // verified together with the rest of its batch in prepare_handle_incoming_blocks
+          results[sig_index] = 1;
+        }
         else {
-          check_ring_signature(tx_prefix_hash, k_image, pubkeys[sig_index], tx.signatures[sig_index], results[sig_index]);
+          // classic ring signatures are verified as one batch after the loop
+          ring_signature_inputs.push_back(sig_index);
+          sig_index++;
+          continue;
         }
 
         if (!results[sig_index])
@@ -4053,6 +4103,39 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
     sig_index++;
   }
 
+    if (!ring_signature_inputs.empty())
+    {
+      if (threads > 1)
+      {
+        // give each thread its own batch
+        const size_t batch_size = (ring_signature_inputs.size() + threads - 1) / threads;
+        for (size_t begin = 0; begin < ring_signature_inputs.size(); begin += batch_size)
+        {
+          const size_t end = std::min(begin + batch_size, ring_signature_inputs.size());
+          tpool.submit(&waiter, boost::bind(&Blockchain::check_ring_signatures, this, std::cref(tx_prefix_hash), std::cref(tx), std::cref(pubkeys),
+                                            std::cref(ring_signature_inputs), begin, end, std::ref(results)));
+        }
+      }
+      else
+      {
+        check_ring_signatures(tx_prefix_hash, tx, pubkeys, ring_signature_inputs, 0, ring_signature_inputs.size(), results);
+        for (const size_t index: ring_signature_inputs)
+        {
+          const crypto::key_image &k_image = *boost::apply_visitor(key_image_visitor(), tx.vin[index]);
+          it->second[k_image] = results[index];
+          if (!results[index])
+          {
+            MERROR_VER("Failed to check ring signature for tx " << get_transaction_hash(tx) << "  vin key with k_image: " << k_image << "  sig_index: " << index);
+            if (pmax_used_block_height)  // a default value of NULL is used when called from Blockchain::handle_block_to_main_chain()
+            {
+              MERROR_VER("*pmax_used_block_height: " << *pmax_used_block_height);
+            }
+            return false;
+          }
+        }
+      }
+    }
+
     if (threads > 1)
     {
        waiter.wait();
@@ -4097,6 +4180,40 @@ void Blockchain::check_ring_signature(const crypto::hash &tx_prefix_hash, const
   result = crypto::check_ring_signature(tx_prefix_hash, key_image, p_output_keys, sig.data()) ? 1 : 0;
 }
 //------------------------------------------------------------------
+void Blockchain::check_ring_signatures(const crypto::hash &tx_prefix_hash, const transaction &tx, const std::vector<std::vector<rct::ctkey>> &pubkeys,
+                                       const std::vector<size_t> &inputs, size_t begin, size_t end, std::vector<uint64_t> &results)
+{
+  std::vector<std::vector<const crypto::public_key *>> p_output_keys(end - begin);
+  std::vector<crypto::ring_signature_check> checks;
+  checks.reserve(end - begin);
+  for (size_t i = begin; i < end; ++i)
+  {
+    const size_t sig_index = inputs[i];
+    std::vector<const crypto::public_key *> &keys = p_output_keys[i - begin];
+    for (auto &key : pubkeys[sig_index])
+    {
+      // rct::key and crypto::public_key have the same structure, avoid object ctor/memcpy
+      keys.push_back(&(const crypto::public_key&)key.dest);
+    }
+    const crypto::key_image &k_image = *boost::apply_visitor(key_image_visitor(), tx.vin[sig_index]);
+    checks.push_back({&tx_prefix_hash, &k_image, keys.data(), keys.size(), tx.signatures[sig_index].data()});
+  }
+
+  if (crypto::check_ring_signatures(checks))
+  {
+    for (size_t i = begin; i < end; ++i)
+      results[inputs[i]] = 1;
+    return;
+  }
+
+  // the batch only tells us something is wrong, find out which input it is
+  for (size_t i = begin; i < end; ++i)
+  {
+    const size_t sig_index = inputs[i];
+    results[sig_index] = crypto::check_ring_signature(tx_prefix_hash, *checks[i - begin].image, p_output_keys[i - begin], tx.signatures[sig_index].data()) ? 1 : 0;
+  }
+}
+//------------------------------------------------------------------
 void Blockchain::check_migration_signature(const crypto::hash &tx_prefix_hash,
                                            const crypto::signature &signature, uint64_t &result)
 {
@@ -4844,6 +4961,16 @@ leave:
         << "/" << t_checktx << "/" << t_dblspnd << "/" << vmt << "/" << addblock << ")ms");
   }
 
+  // once the next seed block is known, build its RandomX cache in the
+  // background so the epoch switch doesn't stall verification
+  if (bl.major_version >= RX_BLOCK_VERSION)
+  {
+    uint64_t seed_height, next_height;
+    rx_seedheights(new_height, &seed_height, &next_height);
+    if (next_height != seed_height)
+      get_block_longhash_prefetch(next_height, m_db->get_block_hash_from_height(next_height));
+  }
+
   bvc.m_added_to_main_chain = true;
   ++m_sync_counter;
 
@@ -5056,6 +5183,8 @@ bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
   m_scan_table_adv.clear();
   m_blocks_txs_check.clear();
   m_check_txin_table.clear();
+  m_prevalidated_inputs.clear();
+  m_safex_account_keys.clear();
 
   // when we're well clear of the precomputed hashes, free the memory
   if (!m_blocks_hash_check.empty() && m_db->height() > m_blocks_hash_check.size() + 4096)
@@ -5370,6 +5499,8 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::list<block_complete_e
   m_scan_table.clear();
   m_scan_table_adv.clear();
   m_check_txin_table.clear();
+  m_prevalidated_inputs.clear();
+  m_safex_account_keys.clear();
 
   TIME_MEASURE_FINISH(prepare);
   m_fake_pow_calc_time = prepare / blocks_entry.size();
@@ -5401,113 +5532,190 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::list<block_complete_e
             return false; \
         } while(0); \
 
-  // generate sorted tables for all amounts and absolute offsets
+  // parse every transaction of the batch once, in parallel, and reuse it below
+  std::vector<const blobdata *> tx_blobs;
   for (const auto &entry : blocks_entry)
   {
-    if (m_cancel)
-      return false;
-
     for (const auto &tx_blob : entry.txs)
-    {
-      crypto::hash tx_hash = null_hash;
-      crypto::hash tx_prefix_hash = null_hash;
-      transaction tx;
+      tx_blobs.push_back(&tx_blob);
+  }
 
-      if (!parse_and_validate_tx_from_blob(tx_blob, tx, tx_hash, tx_prefix_hash))
-        SCAN_TABLE_QUIT("Could not parse tx from incoming blocks.");
+  std::vector<prepared_tx> prepared_txs(tx_blobs.size());
+  threads = tpool.get_max_concurrency();
+  if (threads > 1 && tx_blobs.size() > 1)
+  {
+    tools::threadpool::waiter waiter;
+    const size_t batch_size = (tx_blobs.size() + threads - 1) / threads;
+    for (size_t begin = 0; begin < tx_blobs.size(); begin += batch_size)
+    {
+      const size_t end = std::min(begin + batch_size, tx_blobs.size());
+      tpool.submit(&waiter, boost::bind(&Blockchain::tx_parse_worker, this, std::cref(tx_blobs), begin, end, std::ref(prepared_txs)));
+    }
+    waiter.wait();
+  }
+  else
+  {
+    tx_parse_worker(tx_blobs, 0, tx_blobs.size(), prepared_txs);
+  }
 
-      auto its = m_scan_table.find(tx_prefix_hash);
-      if (its != m_scan_table.end())
-        SCAN_TABLE_QUIT("Duplicate tx found from incoming blocks.");
+  for (const auto &ptx : prepared_txs)
+  {
+    if (!ptx.parsed)
+      SCAN_TABLE_QUIT("Could not parse tx from incoming blocks.");
+  }
 
-      m_scan_table.emplace(tx_prefix_hash, std::unordered_map<crypto::key_image, std::vector<output_data_t>>());
-      its = m_scan_table.find(tx_prefix_hash);
-      assert(its != m_scan_table.end());
+  if (m_cancel)
+    return false;
 
-      auto its_advanced = m_scan_table_adv.find(tx_prefix_hash);
-      if (its_advanced != m_scan_table_adv.end())
-        SCAN_TABLE_QUIT("Duplicate advanced tx found from incoming blocks.");
+  // look up the account keys the safex inputs of the batch are signed with, so
+  // the pool and block checks below do not go to the database for each of them
+  for (const auto &ptx : prepared_txs)
+  {
+    for (const auto &txin : ptx.tx.vin)
+    {
+      if (txin.type() != typeid(txin_to_script))
+        continue;
 
-      m_scan_table_adv.emplace(tx_prefix_hash, std::unordered_map<crypto::key_image, std::vector<output_advanced_data_t>>());
-      its_advanced = m_scan_table_adv.find(tx_prefix_hash);
-      assert(its_advanced != m_scan_table_adv.end());
+      const txin_to_script &in_script = boost::get<txin_to_script>(txin);
+      std::vector<uint8_t> username;
+      try
+      {
+        if (in_script.command_type == safex::command_t::edit_account)
+          username = safex::account_username(safex::safex_command_serializer::get_safex_command<safex::edit_account>(in_script)->get_username()).username;
+        else if (in_script.command_type == safex::command_t::create_offer)
+          username = safex::safex_command_serializer::get_safex_command<safex::create_offer>(in_script)->get_seller();
+        else if (in_script.command_type == safex::command_t::edit_offer)
+          username = safex::safex_command_serializer::get_safex_command<safex::edit_offer>(in_script)->get_seller();
+        else if (in_script.command_type == safex::command_t::create_price_peg)
+          username = safex::safex_command_serializer::get_safex_command<safex::create_price_peg>(in_script)->get_creator();
+        else
+          continue;
+      }
+      catch (...)
+      {
+        // malformed commands are rejected by the regular checks
+        continue;
+      }
 
+      const safex::account_username account{username};
+      const crypto::hash account_hash = account.hash();
+      if (m_safex_account_keys.find(account_hash) != m_safex_account_keys.end())
+        continue;
 
-      // get all amounts from tx.vin(s)
-      for (const auto &txin : tx.vin)
+      // accounts created inside this batch are not in the database yet
+      crypto::public_key pkey;
+      try
       {
-        const crypto::key_image &k_image = *boost::apply_visitor(key_image_visitor(), txin);
+        if (m_db->get_account_key(account, pkey))
+          m_safex_account_keys.emplace(account_hash, pkey);
+      }
+      catch (...)
+      {
+        continue;
+      }
+    }
+  }
 
-        // check for duplicate
-        auto it = its->second.find(k_image);
-        if (it != its->second.end())
-          SCAN_TABLE_QUIT("Duplicate key_image found from incoming blocks.");
+  // generate sorted tables for all amounts and absolute offsets
+  for (const auto &ptx : prepared_txs)
+  {
+    if (m_cancel)
+      return false;
 
-        auto it_advanced = its_advanced->second.find(k_image);
-        if (it_advanced != its_advanced->second.end())
-          SCAN_TABLE_QUIT("Duplicate advanced key_image found from incoming blocks.");
+    const transaction &tx = ptx.tx;
+    const crypto::hash &tx_prefix_hash = ptx.prefix_hash;
 
-        const tx_out_type output_type = boost::apply_visitor(tx_output_type_visitor(), txin);
-        if (output_type == tx_out_type::out_cash || output_type == tx_out_type::out_token)
-        {
-          const uint64_t amount = *boost::apply_visitor(amount_visitor(), txin);
-          amounts.push_back(std::pair<tx_out_type, uint64_t>{output_type, amount});
-        }
-        else
-        {
-          types.insert(output_type);
+    auto its = m_scan_table.find(tx_prefix_hash);
+    if (its != m_scan_table.end())
+      SCAN_TABLE_QUIT("Duplicate tx found from incoming blocks.");
 
-        }
-      }
+    m_scan_table.emplace(tx_prefix_hash, std::unordered_map<crypto::key_image, std::vector<output_data_t>>());
+    its = m_scan_table.find(tx_prefix_hash);
+    assert(its != m_scan_table.end());
 
-      // sort and remove duplicate amounts from amounts list
-      std::sort(amounts.begin(), amounts.end());
-      auto last = std::unique(amounts.begin(), amounts.end());
-      amounts.erase(last, amounts.end());
+    auto its_advanced = m_scan_table_adv.find(tx_prefix_hash);
+    if (its_advanced != m_scan_table_adv.end())
+      SCAN_TABLE_QUIT("Duplicate advanced tx found from incoming blocks.");
 
-      // add amount to the offset_map and tx_map
-      for (const std::pair<tx_out_type, uint64_t> &amount : amounts)
-      {
-        if (offset_map.find(amount) == offset_map.end())
-          offset_map.emplace(amount, std::vector<uint64_t>());
+    m_scan_table_adv.emplace(tx_prefix_hash, std::unordered_map<crypto::key_image, std::vector<output_advanced_data_t>>());
+    its_advanced = m_scan_table_adv.find(tx_prefix_hash);
+    assert(its_advanced != m_scan_table_adv.end());
 
-        if (tx_map.find(amount) == tx_map.end())
-          tx_map.emplace(amount, std::vector<output_data_t>());
-      }
 
-      for(auto type: types)
+    // get all amounts from tx.vin(s)
+    for (const auto &txin : tx.vin)
+    {
+      const crypto::key_image &k_image = *boost::apply_visitor(key_image_visitor(), txin);
+
+      // check for duplicate
+      auto it = its->second.find(k_image);
+      if (it != its->second.end())
+        SCAN_TABLE_QUIT("Duplicate key_image found from incoming blocks.");
+
+      auto it_advanced = its_advanced->second.find(k_image);
+      if (it_advanced != its_advanced->second.end())
+        SCAN_TABLE_QUIT("Duplicate advanced key_image found from incoming blocks.");
+
+      const tx_out_type output_type = boost::apply_visitor(tx_output_type_visitor(), txin);
+      if (output_type == tx_out_type::out_cash || output_type == tx_out_type::out_token)
       {
-        if(tx_advanced_map.find(type)== tx_advanced_map.end())
-          tx_advanced_map.emplace(type, std::vector<output_advanced_data_t>());
+        const uint64_t amount = *boost::apply_visitor(amount_visitor(), txin);
+        amounts.push_back(std::pair<tx_out_type, uint64_t>{output_type, amount});
       }
-
-      // add new absolute_offsets to offset_map
-      for (const auto &txin : tx.vin)
+      else
       {
-        const tx_out_type output_presumed_type = boost::apply_visitor(tx_output_type_visitor(), txin);
+        types.insert(output_type);
 
-        if ((txin.type() == typeid(const txin_to_key)) || (txin.type() == typeid(const txin_token_to_key))
-            || (txin.type() == typeid(const txin_to_script) && (output_presumed_type == tx_out_type::out_cash || output_presumed_type == tx_out_type::out_token))
-                )
-        {
+      }
+    }
 
-          // no need to check for duplicate here.
-          const std::vector<uint64_t> &key_offsets = *boost::apply_visitor(key_offset_visitor(), txin);
-          const uint64_t amount = *boost::apply_visitor(amount_visitor(), txin);
+    // sort and remove duplicate amounts from amounts list
+    std::sort(amounts.begin(), amounts.end());
+    auto last = std::unique(amounts.begin(), amounts.end());
+    amounts.erase(last, amounts.end());
 
+    // add amount to the offset_map and tx_map
+    for (const std::pair<tx_out_type, uint64_t> &amount : amounts)
+    {
+      if (offset_map.find(amount) == offset_map.end())
+        offset_map.emplace(amount, std::vector<uint64_t>());
 
-          auto absolute_offsets = relative_output_offsets_to_absolute(key_offsets);
-          for (const auto &offset : absolute_offsets)
-            offset_map[std::pair<tx_out_type, uint64_t>{output_presumed_type, amount}].push_back(offset);
-        }
-        else if (txin.type() == typeid(const txin_to_script))
-        {
-          const std::vector<uint64_t> &output_ids = *boost::apply_visitor(key_offset_visitor(), txin);
+      if (tx_map.find(amount) == tx_map.end())
+        tx_map.emplace(amount, std::vector<output_data_t>());
+    }
 
-          for (uint64_t output_id: output_ids)
-            advanced_output_ids_map[output_presumed_type].push_back(output_id);
+    for(auto type: types)
+    {
+      if(tx_advanced_map.find(type)== tx_advanced_map.end())
+        tx_advanced_map.emplace(type, std::vector<output_advanced_data_t>());
+    }
+
+    // add new absolute_offsets to offset_map
+    for (const auto &txin : tx.vin)
+    {
+      const tx_out_type output_presumed_type = boost::apply_visitor(tx_output_type_visitor(), txin);
+
+      if ((txin.type() == typeid(const txin_to_key)) || (txin.type() == typeid(const txin_token_to_key))
+          || (txin.type() == typeid(const txin_to_script) && (output_presumed_type == tx_out_type::out_cash || output_presumed_type == tx_out_type::out_token))
+              )
+      {
+
+        // no need to check for duplicate here.
+        const std::vector<uint64_t> &key_offsets = *boost::apply_visitor(key_offset_visitor(), txin);
+        const uint64_t amount = *boost::apply_visitor(amount_visitor(), txin);
+
+
+        auto absolute_offsets = relative_output_offsets_to_absolute(key_offsets);
+        for (const auto &offset : absolute_offsets)
+          offset_map[std::pair<tx_out_type, uint64_t>{output_presumed_type, amount}].push_back(offset);
+      }
+      else if (txin.type() == typeid(const txin_to_script))
+      {
+        const std::vector<uint64_t> &output_ids = *boost::apply_visitor(key_offset_visitor(), txin);
+
+        for (uint64_t output_id: output_ids)
+          advanced_output_ids_map[output_presumed_type].push_back(output_id);
 
-        }
       }
     }
   }
@@ -5570,113 +5778,170 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::list<block_complete_e
   int total_txs = 0;
 
   // now generate a table for each tx_prefix and k_image hashes
-  for (const auto &entry : blocks_entry)
+  for (const auto &ptx : prepared_txs)
   {
     if (m_cancel)
       return false;
 
-    for (const auto &tx_blob : entry.txs)
-    {
-      crypto::hash tx_hash = null_hash;
-      crypto::hash tx_prefix_hash = null_hash;
-      transaction tx;
+    const transaction &tx = ptx.tx;
+    const crypto::hash &tx_prefix_hash = ptx.prefix_hash;
 
-      if (!parse_and_validate_tx_from_blob(tx_blob, tx, tx_hash, tx_prefix_hash))
-        SCAN_TABLE_QUIT("Could not parse tx from incoming blocks.");
+    ++total_txs;
+    auto its = m_scan_table.find(tx_prefix_hash);
+    if (its == m_scan_table.end())
+      SCAN_TABLE_QUIT("Tx not found on scan table from incoming blocks.");
 
-      ++total_txs;
-      auto its = m_scan_table.find(tx_prefix_hash);
-      if (its == m_scan_table.end())
-        SCAN_TABLE_QUIT("Tx not found on scan table from incoming blocks.");
+    auto its_advanced = m_scan_table_adv.find(tx_prefix_hash);
+    if (its_advanced == m_scan_table_adv.end())
+      SCAN_TABLE_QUIT("Tx not found on advanced scan table from incoming blocks.");
 
-      auto its_advanced = m_scan_table_adv.find(tx_prefix_hash);
-      if (its_advanced == m_scan_table_adv.end())
-        SCAN_TABLE_QUIT("Tx not found on advanced scan table from incoming blocks.");
+    for (const auto &txin : tx.vin)
+    {
+      const tx_out_type output_presumed_type = boost::apply_visitor(tx_output_type_visitor(), txin);
 
-      for (const auto &txin : tx.vin)
+      if ((txin.type() == typeid(const txin_to_key)) || (txin.type() == typeid(const txin_token_to_key))
+          || (txin.type() == typeid(const txin_to_script) && (output_presumed_type == tx_out_type::out_cash || output_presumed_type == tx_out_type::out_token))
+          )
       {
-        const tx_out_type output_presumed_type = boost::apply_visitor(tx_output_type_visitor(), txin);
+        const std::vector<uint64_t> &key_offsets = *boost::apply_visitor(key_offset_visitor(), txin);
+        const uint64_t output_value_amount = *boost::apply_visitor(amount_visitor(), txin);
 
-        if ((txin.type() == typeid(const txin_to_key)) || (txin.type() == typeid(const txin_token_to_key))
-            || (txin.type() == typeid(const txin_to_script) && (output_presumed_type == tx_out_type::out_cash || output_presumed_type == tx_out_type::out_token))
-            )
-        {
-          const std::vector<uint64_t> &key_offsets = *boost::apply_visitor(key_offset_visitor(), txin);
-          const uint64_t output_value_amount = *boost::apply_visitor(amount_visitor(), txin);
+        auto needed_offsets = relative_output_offsets_to_absolute(key_offsets);
 
-          auto needed_offsets = relative_output_offsets_to_absolute(key_offsets);
+        std::vector<output_data_t> outputs;
+        for (const uint64_t & offset_needed : needed_offsets)
+        {
+          size_t pos = 0;
+          bool found = false;
 
-          std::vector<output_data_t> outputs;
-          for (const uint64_t & offset_needed : needed_offsets)
+          //todo ATANA double check/retest
+          std::pair<tx_out_type, uint64_t> amount{output_presumed_type, output_value_amount};
+          for (const uint64_t &offset_found : offset_map[amount])
           {
-            size_t pos = 0;
-            bool found = false;
-
-            //todo ATANA double check/retest
-            std::pair<tx_out_type, uint64_t> amount{output_presumed_type, output_value_amount};
-            for (const uint64_t &offset_found : offset_map[amount])
+            if (offset_needed == offset_found)
             {
-              if (offset_needed == offset_found)
-              {
-                found = true;
-                break;
-              }
-
-              ++pos;
+              found = true;
+              break;
             }
 
-            if (found && pos < tx_map[amount].size())
-              outputs.push_back(tx_map[amount].at(pos));
-            else
-              break;
+            ++pos;
           }
 
-          const crypto::key_image &k_image = *boost::apply_visitor(key_image_visitor(), txin);
-          its->second.emplace(k_image, outputs);
-
+          if (found && pos < tx_map[amount].size())
+            outputs.push_back(tx_map[amount].at(pos));
+          else
+            break;
         }
-        else if (txin.type() == typeid(const txin_to_script))
-        {
-          const std::vector<uint64_t> &needed_output_ids = *boost::apply_visitor(key_offset_visitor(), txin);
 
+        const crypto::key_image &k_image = *boost::apply_visitor(key_image_visitor(), txin);
+        its->second.emplace(k_image, outputs);
 
-          std::vector<output_advanced_data_t> advanced_outputs;
-          for (const uint64_t & needed_output_id : needed_output_ids)
-          {
-            size_t pos = 0;
-            bool found = false;
+      }
+      else if (txin.type() == typeid(const txin_to_script))
+      {
+        const std::vector<uint64_t> &needed_output_ids = *boost::apply_visitor(key_offset_visitor(), txin);
 
-            for (const output_advanced_data_t &output_found : tx_advanced_map[output_presumed_type])
-            {
-              if (needed_output_id == output_found.output_id)
-              {
-                found = true;
-                break;
-              }
 
-              ++pos;
-            }
+        std::vector<output_advanced_data_t> advanced_outputs;
+        for (const uint64_t & needed_output_id : needed_output_ids)
+        {
+          size_t pos = 0;
+          bool found = false;
 
-            if (found && pos < tx_advanced_map[output_presumed_type].size())
-              advanced_outputs.push_back(tx_advanced_map[output_presumed_type].at(pos));
-            else
+          for (const output_advanced_data_t &output_found : tx_advanced_map[output_presumed_type])
+          {
+            if (needed_output_id == output_found.output_id)
+            {
+              found = true;
               break;
-          }
+            }
 
-          const crypto::key_image &k_image = *boost::apply_visitor(key_image_visitor(), txin);
-          its_advanced->second.emplace(k_image, advanced_outputs);
+            ++pos;
+          }
 
+          if (found && pos < tx_advanced_map[output_presumed_type].size())
+            advanced_outputs.push_back(tx_advanced_map[output_presumed_type].at(pos));
+          else
+            break;
         }
-        else if (txin.type() == typeid(txin_token_migration)) {
-          const txin_token_migration &in_token_migration = boost::get < txin_token_migration > (txin);
-          std::vector<output_data_t> outputs;
-
-          output_data_t output = AUTO_VAL_INIT(output);
-          output.commitment = rct::zeroCommit(in_token_migration.token_amount);
-          outputs.push_back(output);
-          its->second.emplace(in_token_migration.k_image, outputs);
-        }
+
+        const crypto::key_image &k_image = *boost::apply_visitor(key_image_visitor(), txin);
+        its_advanced->second.emplace(k_image, advanced_outputs);
+
       }
+      else if (txin.type() == typeid(txin_token_migration)) {
+        const txin_token_migration &in_token_migration = boost::get < txin_token_migration > (txin);
+        std::vector<output_data_t> outputs;
+
+        output_data_t output = AUTO_VAL_INIT(output);
+        output.commitment = rct::zeroCommit(in_token_migration.token_amount);
+        outputs.push_back(output);
+        its->second.emplace(in_token_migration.k_image, outputs);
+      }
+    }
+  }
+
+  // the scan table now holds the ring members of most inputs, so their ring
+  // signatures can be verified here across all threads instead of one
+  // transaction at a time once the blocks are added
+  std::vector<ring_signature_prevalidation> checks;
+  for (size_t tx_index = 0; tx_index < prepared_txs.size(); ++tx_index)
+  {
+    const transaction &tx = prepared_txs[tx_index].tx;
+    auto its = m_scan_table.find(prepared_txs[tx_index].prefix_hash);
+    if (its == m_scan_table.end() || tx.signatures.size() != tx.vin.size())
+      continue;
+
+    for (size_t sig_index = 0; sig_index < tx.vin.size(); ++sig_index)
+    {
+      const txin_v &txin = tx.vin[sig_index];
+      if (txin.type() != typeid(txin_to_key) && txin.type() != typeid(txin_token_to_key))
+        continue;
+
+      const crypto::key_image &k_image = *boost::apply_visitor(key_image_visitor(), txin);
+      const std::vector<uint64_t> &key_offsets = *boost::apply_visitor(key_offset_visitor(), txin);
+      auto itk = its->second.find(k_image);
+      if (itk == its->second.end() || itk->second.size() != key_offsets.size() || tx.signatures[sig_index].size() != key_offsets.size())
+        continue;
+
+      ring_signature_prevalidation check{tx_index, sig_index, {}};
+      check.pubkeys.reserve(itk->second.size());
+      for (const output_data_t &output : itk->second)
+        check.pubkeys.push_back(&output.pubkey);
+      checks.push_back(std::move(check));
+    }
+  }
+
+  if (!checks.empty())
+  {
+    std::vector<uint8_t> results(checks.size(), 0);
+    threads = tpool.get_max_concurrency();
+    if (threads > 1)
+    {
+      tools::threadpool::waiter waiter;
+      const size_t batch_size = (checks.size() + threads - 1) / threads;
+      for (size_t begin = 0; begin < checks.size(); begin += batch_size)
+      {
+        const size_t end = std::min(begin + batch_size, checks.size());
+        tpool.submit(&waiter, boost::bind(&Blockchain::ring_signature_prevalidation_worker, this, std::cref(prepared_txs), std::cref(checks),
+                                          begin, end, std::ref(results)));
+      }
+      waiter.wait();
+    }
+    else
+    {
+      ring_signature_prevalidation_worker(prepared_txs, checks, 0, checks.size(), results);
+    }
+
+    // only valid signatures are remembered, failures are found again by the regular checks
+    for (size_t i = 0; i < checks.size(); ++i)
+    {
+      if (!results[i])
+        continue;
+      const prepared_tx &ptx = prepared_txs[checks[i].tx_index];
+      std::vector<uint8_t> &valid = m_prevalidated_inputs[ptx.hash];
+      valid.resize(ptx.tx.vin.size(), 0);
+      valid[checks[i].sig_index] = 1;
     }
   }
 
@@ -5691,6 +5956,46 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::list<block_complete_e
   return true;
 }
 
+//------------------------------------------------------------------
+void Blockchain::tx_parse_worker(const std::vector<const blobdata *> &blobs, size_t begin, size_t end,
+                                 std::vector<prepared_tx> &txs) const
+{
+  for (size_t i = begin; i < end; ++i)
+  {
+    prepared_tx &ptx = txs[i];
+    ptx.hash = null_hash;
+    ptx.prefix_hash = null_hash;
+    ptx.parsed = parse_and_validate_tx_from_blob(*blobs[i], ptx.tx, ptx.hash, ptx.prefix_hash);
+  }
+}
+//------------------------------------------------------------------
+void Blockchain::ring_signature_prevalidation_worker(const std::vector<prepared_tx> &txs, const std::vector<ring_signature_prevalidation> &checks,
+                                                     size_t begin, size_t end, std::vector<uint8_t> &results) const
+{
+  std::vector<crypto::ring_signature_check> batch;
+  batch.reserve(end - begin);
+  for (size_t i = begin; i < end; ++i)
+  {
+    const ring_signature_prevalidation &check = checks[i];
+    const prepared_tx &ptx = txs[check.tx_index];
+    const crypto::key_image &k_image = *boost::apply_visitor(key_image_visitor(), ptx.tx.vin[check.sig_index]);
+    batch.push_back({&ptx.prefix_hash, &k_image, check.pubkeys.data(), check.pubkeys.size(), ptx.tx.signatures[check.sig_index].data()});
+  }
+
+  if (crypto::check_ring_signatures(batch))
+  {
+    for (size_t i = begin; i < end; ++i)
+      results[i] = 1;
+    return;
+  }
+
+  for (size_t i = begin; i < end; ++i)
+  {
+    const crypto::ring_signature_check &c = batch[i - begin];
+    results[i] = crypto::check_ring_signature(*c.prefix_hash, *c.image, checks[i].pubkeys, c.sig) ? 1 : 0;
+  }
+}
+//------------------------------------------------------------------
 void Blockchain::add_txpool_tx(transaction &tx, const txpool_tx_meta_t &meta)
 {
   m_db->add_txpool_tx(tx, meta);
@@ -6032,6 +6337,18 @@ bool Blockchain::get_safex_account_public_key(const safex::account_username &use
   }
 }
 
+bool Blockchain::get_batch_safex_account_public_key(const safex::account_username &username, crypto::public_key &pkey) const
+{
+  auto it = m_safex_account_keys.find(username.hash());
+  if (it != m_safex_account_keys.end())
+  {
+    pkey = it->second;
+    return true;
+  }
+
+  return get_safex_account_public_key(username, pkey);
+}
+
 bool Blockchain::get_safex_account_data(const safex::account_username &username, std::vector<uint8_t> &data) const
 {
 
@@ -6117,6 +6434,18 @@ bool Blockchain::get_safex_offer_rating(const crypto::hash &offerID, uint64_t &r
     }
 }
 
+bool Blockchain::get_safex_offer_rating(const crypto::hash &offerID, safex::safex_offer_rating &rating) const
+{
+    try {
+        bool result = m_db->get_offer_rating(offerID, rating);
+        return result;
+    }
+    catch (std::exception &ex) {
+        MERROR("Error fetching offer rating: "+std::string(ex.what()));
+        return false;
+    }
+}
+
 bool Blockchain::get_safex_accounts( std::vector<std::pair<std::string,std::string>> &safex_accounts) const
 {
     LOG_PRINT_L3("Blockchain::" << __func__);
@@ -6124,6 +6453,13 @@ bool Blockchain::get_safex_accounts( std::vector<std::pair<std::string,std::stri
     return m_db->get_safex_accounts(safex_accounts);
 }
 
+bool Blockchain::get_safex_accounts( std::vector<std::pair<std::string,std::string>> &safex_accounts, safex::listing_page &page) const
+{
+    LOG_PRINT_L3("Blockchain::" << __func__);
+
+    return m_db->get_safex_accounts(safex_accounts, page);
+}
+
 bool Blockchain::get_table_sizes( std::vector<uint64_t> &table_sizes) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -6145,6 +6481,13 @@ bool Blockchain::get_safex_offers( std::vector<safex::safex_offer> &safex_offers
     return m_db->get_safex_offers(safex_offers);
 }
 
+bool Blockchain::get_safex_offers( std::vector<safex::safex_offer> &safex_offers, const safex::safex_offer_filter &filter, safex::listing_page &page) const
+{
+    LOG_PRINT_L3("Blockchain::" << __func__);
+
+    return m_db->get_safex_offers(safex_offers, filter, page);
+}
+
 bool Blockchain::get_safex_feedbacks(std::vector<safex::safex_feedback>& safex_feedbacks, const crypto::hash& offer_id) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -6152,6 +6495,13 @@ bool Blockchain::get_safex_feedbacks(std::vector<safex::safex_feedback>& safex_f
   return m_db->get_safex_feedbacks(safex_feedbacks, offer_id);
 }
 
+bool Blockchain::get_safex_feedbacks(std::vector<safex::safex_feedback>& safex_feedbacks, const crypto::hash& offer_id, safex::listing_page &page) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+
+  return m_db->get_safex_feedbacks(safex_feedbacks, offer_id, page);
+}
+
 bool Blockchain::get_safex_price_pegs( std::vector<safex::safex_price_peg> &safex_price_pegs, const std::string& currency) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -6159,6 +6509,13 @@ bool Blockchain::get_safex_price_pegs( std::vector<safex::safex_price_peg> &safe
   return m_db->get_safex_price_pegs(safex_price_pegs, currency);
 }
 
+bool Blockchain::get_safex_price_pegs( std::vector<safex::safex_price_peg> &safex_price_pegs, const std::string& currency, safex::listing_page &page) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+
+  return m_db->get_safex_price_pegs(safex_price_pegs, currency, page);
+}
+
 bool Blockchain::get_safex_price_peg( const crypto::hash& price_peg_id, safex::safex_price_peg& sfx_price_peg) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
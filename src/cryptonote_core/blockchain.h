@@ -273,6 +273,14 @@ namespace cryptonote
      */
     bool have_tx_keyimg_as_spent(const crypto::key_image &key_im) const;
 
+    /**
+     * @brief check if each of a set of key images is already spent on the blockchain
+     *
+     * @param key_im the key images to search for
+     * @param spent return-by-reference true for each key image already spent in the blockchain
+     */
+    void have_tx_keyimgs_as_spent(const std::vector<crypto::key_image> &key_im, std::vector<bool> &spent) const;
+
     /**
      * @brief get the current height of the blockchain
      *
@@ -337,6 +345,10 @@ namespace cryptonote
      * @param expected_reward return-by-reference the total reward awarded to the miner finding this block, including transaction fees
      * @param ex_nonce extra data to be added to the miner transaction's extra
      *
+     * The last template is cached and handed out again, with a fresh
+     * timestamp, as long as the chain tip, the pool contents, the miner
+     * address and the extra nonce have not changed.
+     *
      * @return true if block template filled in successfully, else false
      */
     bool create_block_template(block& b, const account_public_address& miner_address, difficulty_type& di, uint64_t& height, uint64_t& expected_reward, const blobdata& ex_nonce);
@@ -565,11 +577,12 @@ namespace cryptonote
      * @param amount the amount to get a distribution for
      * @param output_type type of output (cash, token...)
      * @param return-by-reference from_height the height before which we do not care about the data
+     * @param to_height the last height we care about, or 0 for the top of the chain
      * @param return-by-reference start_height the height of the first rct output
      * @param return-by-reference distribution the start offset of the first rct output in this block (same as previous if none)
      * @param return-by-reference base how many outputs of that amount are before the stated distribution
      */
-    bool get_output_distribution(uint64_t amount, const tx_out_type output_type, uint64_t from_height, uint64_t &start_height, std::vector<uint64_t> &distribution, uint64_t &base) const;
+    bool get_output_distribution(uint64_t amount, const tx_out_type output_type, uint64_t from_height, uint64_t to_height, uint64_t &start_height, std::vector<uint64_t> &distribution, uint64_t &base) const;
 
     /**
      * @brief gets the global indices for outputs from a given transaction
@@ -1084,6 +1097,51 @@ namespace cryptonote
     void block_longhash_worker(uint64_t height, const std::vector<block> &blocks,
         std::unordered_map<crypto::hash, crypto::hash> &map) const;
 
+    /**
+     * @brief a transaction from an incoming batch, parsed once during prepare
+     */
+    struct prepared_tx
+    {
+      transaction tx;
+      crypto::hash hash;
+      crypto::hash prefix_hash;
+      bool parsed;
+    };
+
+    /**
+     * @brief a ring signature from an incoming batch which can be checked
+     * against the scan table ahead of block validation
+     */
+    struct ring_signature_prevalidation
+    {
+      size_t tx_index;
+      size_t sig_index;
+      std::vector<const crypto::public_key *> pubkeys;
+    };
+
+    /**
+     * @brief parses a range of transaction blobs from an incoming batch
+     *
+     * @param blobs the transaction blobs
+     * @param begin index of the first blob to parse
+     * @param end index one past the last blob to parse
+     * @param txs return-by-reference the parsed transactions, sized like blobs
+     */
+    void tx_parse_worker(const std::vector<const blobdata *> &blobs, size_t begin, size_t end,
+        std::vector<prepared_tx> &txs) const;
+
+    /**
+     * @brief verifies a range of ring signatures from an incoming batch
+     *
+     * @param txs the parsed transactions of the batch
+     * @param checks the ring signatures to verify
+     * @param begin index of the first check
+     * @param end index one past the last check
+     * @param results return-by-reference 1 for each valid signature, 0 otherwise
+     */
+    void ring_signature_prevalidation_worker(const std::vector<prepared_tx> &txs, const std::vector<ring_signature_prevalidation> &checks,
+        size_t begin, size_t end, std::vector<uint8_t> &results) const;
+
     /**
      * @brief returns a set of known alternate chains
      *
@@ -1142,13 +1200,18 @@ namespace cryptonote
     bool get_safex_offer_quantity(const crypto::hash &offerID, uint64_t &quantity) const;
     bool get_safex_offer_active_status(const crypto::hash &offerID, bool &active) const;
     bool get_safex_offer_rating(const crypto::hash &offerID, uint64_t &rating) const;
+    bool get_safex_offer_rating(const crypto::hash &offerID, safex::safex_offer_rating &rating) const;
     bool get_safex_price_peg( const crypto::hash& price_peg_id, safex::safex_price_peg& sfx_price_peg) const;
 
     bool get_safex_accounts( std::vector<std::pair<std::string,std::string>> &safex_accounts) const;
+    bool get_safex_accounts( std::vector<std::pair<std::string,std::string>> &safex_accounts, safex::listing_page &page) const;
     bool get_safex_offer_height( crypto::hash &offer_id, uint64_t& height) const;
     bool get_safex_offers(std::vector<safex::safex_offer> &safex_offers) const;
+    bool get_safex_offers(std::vector<safex::safex_offer> &safex_offers, const safex::safex_offer_filter &filter, safex::listing_page &page) const;
     bool get_safex_feedbacks(std::vector<safex::safex_feedback>& safex_feedbacks, const crypto::hash& offer_id) const;
+    bool get_safex_feedbacks(std::vector<safex::safex_feedback>& safex_feedbacks, const crypto::hash& offer_id, safex::listing_page &page) const;
     bool get_safex_price_pegs(std::vector<safex::safex_price_peg> &safex_price_pegs, const std::string& currency) const;
+    bool get_safex_price_pegs(std::vector<safex::safex_price_peg> &safex_price_pegs, const std::string& currency, safex::listing_page &page) const;
 
     bool get_table_sizes( std::vector<uint64_t> &table_sizes) const;
 
@@ -1214,6 +1277,10 @@ namespace cryptonote
     std::unordered_map<crypto::hash, std::unordered_map<crypto::key_image, std::vector<output_advanced_data_t>>> m_scan_table_adv;
     std::unordered_map<crypto::hash, crypto::hash> m_blocks_longhash_table;
     std::unordered_map<crypto::hash, std::unordered_map<crypto::key_image, bool>> m_check_txin_table;
+    // ring signatures of the current batch already verified during prepare, by tx hash and input index
+    std::unordered_map<crypto::hash, std::vector<uint8_t>> m_prevalidated_inputs;
+    // account keys referenced by the current batch, by username hash
+    std::unordered_map<crypto::hash, crypto::public_key> m_safex_account_keys;
 
     // SHA-3 hashes for each block and for fast pow checking
     std::vector<crypto::hash> m_blocks_hash_of_hashes;
@@ -1261,6 +1328,16 @@ namespace cryptonote
     uint64_t m_prepare_nblocks;
     std::vector<std::vector<block>> *m_prepare_blocks;
 
+    // last block template handed out, reused while the tip and pool are unchanged
+    block m_btc;
+    account_public_address m_btc_address;
+    blobdata m_btc_nonce;
+    difficulty_type m_btc_difficulty;
+    uint64_t m_btc_height;
+    uint64_t m_btc_expected_reward;
+    uint64_t m_btc_pool_cookie;
+    bool m_btc_valid;
+
     /**
      * @brief collects the keys for all outputs being "spent" as an input
      *
@@ -1627,6 +1704,37 @@ namespace cryptonote
     void check_ring_signature(const crypto::hash &tx_prefix_hash, const crypto::key_image &key_image,
         const std::vector<rct::ctkey> &pubkeys, const std::vector<crypto::signature> &sig, uint64_t &result);
 
+    /**
+     * @brief validates a batch of a transaction's classic ring signatures
+     *
+     * All signatures in the batch are checked together; each one is only
+     * checked on its own if the batch as a whole fails.
+     *
+     * @param tx_prefix_hash the transaction prefix' hash
+     * @param tx the transaction the inputs belong to
+     * @param pubkeys the ring public keys for every input of the transaction
+     * @param inputs indices of the inputs to check
+     * @param begin first entry of inputs in this batch
+     * @param end one past the last entry of inputs in this batch
+     * @param results per input result, set to 1 if the ring signature is valid, otherwise 0
+     */
+    void check_ring_signatures(const crypto::hash &tx_prefix_hash, const transaction &tx, const std::vector<std::vector<rct::ctkey>> &pubkeys,
+        const std::vector<size_t> &inputs, size_t begin, size_t end, std::vector<uint64_t> &results);
+
+    /**
+     * @brief gets the public key of a safex account while checking a batch
+     *
+     * Uses the keys looked up by prepare_handle_incoming_blocks when the
+     * account is referenced by the current batch, the database otherwise.
+     * Only safe to call with the blockchain lock held.
+     *
+     * @param username the account username
+     * @param pkey return-by-reference the account public key
+     *
+     * @return true if the account exists, false otherwise
+     */
+    bool get_batch_safex_account_public_key(const safex::account_username &username, crypto::public_key &pkey) const;
+
     /**
      * @brief validates a migration transaction signature
      *
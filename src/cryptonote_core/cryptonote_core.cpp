@@ -170,6 +170,8 @@ namespace cryptonote
               m_blockchain_storage(m_mempool),
               m_miner(this, [this](const cryptonote::block &b, uint64_t height, unsigned int threads, crypto::hash &hash) {
 		return cryptonote::get_block_longhash(&m_blockchain_storage, b, hash, height, threads);
+	      }, [this](uint64_t height, uint64_t &main_height, uint64_t &seed_height, crypto::hash &seed_hash) {
+		cryptonote::get_block_longhash_seed(&m_blockchain_storage, height, main_height, seed_height, seed_hash);
 	      }),
               m_miner_address(boost::value_initialized<account_public_address>()),
               m_starter_message_showed(false),
@@ -332,6 +334,11 @@ namespace cryptonote
     return m_blockchain_storage.get_safex_accounts(safex_accounts);
   };
 
+  bool core::get_safex_accounts( std::vector<std::pair<std::string,std::string>> &safex_accounts, safex::listing_page &page) const
+  {
+    return m_blockchain_storage.get_safex_accounts(safex_accounts, page);
+  }
+
   bool core::get_table_sizes( std::vector<uint64_t> &table_sizes) const
   {
       return m_blockchain_storage.get_table_sizes(table_sizes);
@@ -345,17 +352,36 @@ namespace cryptonote
   {
       return m_blockchain_storage.get_safex_offers(safex_offers);
   }
+  bool core::get_safex_offers( std::vector<safex::safex_offer> &safex_offers, const safex::safex_offer_filter &filter, safex::listing_page &page) const
+  {
+      return m_blockchain_storage.get_safex_offers(safex_offers, filter, page);
+  }
 
   bool core::get_safex_feedbacks( std::vector<safex::safex_feedback> &safex_feedbacks, const crypto::hash& offer_id) const
   {
     return m_blockchain_storage.get_safex_feedbacks(safex_feedbacks,offer_id);
   }
 
+  bool core::get_safex_feedbacks( std::vector<safex::safex_feedback> &safex_feedbacks, const crypto::hash& offer_id, safex::listing_page &page) const
+  {
+    return m_blockchain_storage.get_safex_feedbacks(safex_feedbacks, offer_id, page);
+  }
+
+  bool core::get_safex_offer_rating(const crypto::hash& offer_id, safex::safex_offer_rating &rating) const
+  {
+    return m_blockchain_storage.get_safex_offer_rating(offer_id, rating);
+  }
+
   bool core::get_safex_price_pegs(std::vector<safex::safex_price_peg> &safex_price_pegs, const std::string& currency) const
   {
     return m_blockchain_storage.get_safex_price_pegs(safex_price_pegs, currency);
   }
 
+  bool core::get_safex_price_pegs(std::vector<safex::safex_price_peg> &safex_price_pegs, const std::string& currency, safex::listing_page &page) const
+  {
+    return m_blockchain_storage.get_safex_price_pegs(safex_price_pegs, currency, page);
+  }
+
   bool core::get_safex_price_peg( const crypto::hash& price_peg_id, safex::safex_price_peg& sfx_price_peg) const
   {
     return m_blockchain_storage.get_safex_price_peg(price_peg_id,sfx_price_peg);
@@ -939,11 +965,7 @@ namespace cryptonote
   //-----------------------------------------------------------------------------------------------
   bool core::are_key_images_spent(const std::vector<crypto::key_image>& key_im, std::vector<bool> &spent) const
   {
-    spent.clear();
-    for(auto& ki: key_im)
-    {
-      spent.push_back(m_blockchain_storage.have_tx_keyimg_as_spent(ki));
-    }
+    m_blockchain_storage.have_tx_keyimgs_as_spent(key_im, spent);
     return true;
   }
   //-----------------------------------------------------------------------------------------------
@@ -956,11 +978,11 @@ namespace cryptonote
 
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::are_key_images_spent_in_pool(const std::vector<crypto::key_image>& key_im, std::vector<bool> &spent) const
+  bool core::are_key_images_spent_in_pool(const std::vector<crypto::key_image>& key_im, std::vector<bool> &spent, bool include_sensitive_data) const
   {
     spent.clear();
 
-    return m_mempool.check_for_key_images(key_im, spent);
+    return m_mempool.check_for_key_images(key_im, spent, include_sensitive_data);
   }
   //-----------------------------------------------------------------------------------------------
   std::pair<uint64_t, uint64_t> core::get_coinbase_tx_sum(const uint64_t start_offset, const size_t count)
@@ -1294,9 +1316,9 @@ namespace cryptonote
     return m_blockchain_storage.get_random_rct_outs(req, res);
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::get_output_distribution(uint64_t amount, const tx_out_type output_type, uint64_t from_height, uint64_t &start_height, std::vector<uint64_t> &distribution, uint64_t &base) const
+  bool core::get_output_distribution(uint64_t amount, const tx_out_type output_type, uint64_t from_height, uint64_t to_height, uint64_t &start_height, std::vector<uint64_t> &distribution, uint64_t &base) const
   {
-    return m_blockchain_storage.get_output_distribution(amount, output_type, from_height, start_height, distribution, base);
+    return m_blockchain_storage.get_output_distribution(amount, output_type, from_height, to_height, start_height, distribution, base);
   }
   //-----------------------------------------------------------------------------------------------
   bool core::get_tx_outputs_gindexs(const crypto::hash& tx_id, std::vector<uint64_t>& indexs) const
@@ -1479,6 +1501,21 @@ namespace cryptonote
     return m_mempool.get_transactions_count();
   }
   //-----------------------------------------------------------------------------------------------
+  uint64_t core::get_pool_cookie() const
+  {
+    return m_mempool.cookie();
+  }
+  //-----------------------------------------------------------------------------------------------
+  uint64_t core::get_block_size_limit() const
+  {
+    return m_blockchain_storage.get_current_cumulative_blocksize_limit();
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::wait_for_pool_cookie_change(uint64_t cookie, const boost::chrono::steady_clock::time_point &deadline) const
+  {
+    return m_mempool.wait_for_cookie_change(cookie, deadline);
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::have_block(const crypto::hash& id) const
   {
     return m_blockchain_storage.have_block(id);
@@ -1517,6 +1554,18 @@ namespace cryptonote
     return m_mempool.get_transaction(id, tx);
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::get_pool_transactions(const std::vector<crypto::hash>& ids, std::vector<cryptonote::blobdata>& txblobs, std::vector<size_t>& missing_indices) const
+  {
+    m_mempool.get_transactions(ids, txblobs, missing_indices);
+    return true;
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::get_pool_transaction_short_ids(const crypto::hash& key, std::unordered_map<uint64_t, crypto::hash>& short_ids) const
+  {
+    m_mempool.get_transaction_short_ids(key, short_ids);
+    return true;
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::pool_has_tx(const crypto::hash &id) const
   {
     return m_mempool.have_tx(id);
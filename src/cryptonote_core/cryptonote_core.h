@@ -469,6 +469,20 @@ namespace cryptonote
       */
      bool get_pool_transaction(const crypto::hash& id, cryptonote::blobdata& tx) const;
 
+     /**
+      * @copydoc tx_memory_pool::get_transactions(const std::vector<crypto::hash>&, std::vector<cryptonote::blobdata>&, std::vector<size_t>&) const
+      *
+      * @note see tx_memory_pool::get_transactions
+      */
+     bool get_pool_transactions(const std::vector<crypto::hash>& ids, std::vector<cryptonote::blobdata>& txblobs, std::vector<size_t>& missing_indices) const;
+
+     /**
+      * @copydoc tx_memory_pool::get_transaction_short_ids
+      *
+      * @note see tx_memory_pool::get_transaction_short_ids
+      */
+     bool get_pool_transaction_short_ids(const crypto::hash& key, std::unordered_map<uint64_t, crypto::hash>& short_ids) const;
+
      /**
       * @copydoc tx_memory_pool::get_pool_transactions_and_spent_keys_info
       * @param include_unrelayed_txes include unrelayed txes in result
@@ -491,6 +505,27 @@ namespace cryptonote
       */
      size_t get_pool_transactions_count() const;
 
+     /**
+      * @copydoc tx_memory_pool::cookie
+      *
+      * @note see tx_memory_pool::cookie
+      */
+     uint64_t get_pool_cookie() const;
+
+     /**
+      * @copydoc Blockchain::get_current_cumulative_blocksize_limit
+      *
+      * @note see Blockchain::get_current_cumulative_blocksize_limit
+      */
+     uint64_t get_block_size_limit() const;
+
+     /**
+      * @copydoc tx_memory_pool::wait_for_cookie_change
+      *
+      * @note see tx_memory_pool::wait_for_cookie_change
+      */
+     bool wait_for_pool_cookie_change(uint64_t cookie, const boost::chrono::steady_clock::time_point &deadline) const;
+
      /**
       * @copydoc Blockchain::get_total_transactions
       *
@@ -590,7 +625,7 @@ namespace cryptonote
       *
       * @brief get per block distribution of outputs of a given amount
       */
-     bool get_output_distribution(uint64_t amount, const tx_out_type output_type, uint64_t from_height, uint64_t &start_height, std::vector<uint64_t> &distribution, uint64_t &base) const;
+     bool get_output_distribution(uint64_t amount, const tx_out_type output_type, uint64_t from_height, uint64_t to_height, uint64_t &start_height, std::vector<uint64_t> &distribution, uint64_t &base) const;
 
      /**
       * @copydoc miner::pause
@@ -726,10 +761,11 @@ namespace cryptonote
       *
       * @param key_im list of key images to check
       * @param spent return-by-reference result for each image checked
+      * @param include_sensitive_data whether images only spent by txes not yet relayed count
       *
       * @return true
       */
-     bool are_key_images_spent_in_pool(const std::vector<crypto::key_image>& key_im, std::vector<bool> &spent) const;
+     bool are_key_images_spent_in_pool(const std::vector<crypto::key_image>& key_im, std::vector<bool> &spent, bool include_sensitive_data = true) const;
 
      /**
       * @brief get the number of blocks to sync in one go
@@ -808,6 +844,13 @@ namespace cryptonote
        */
        bool get_safex_accounts( std::vector<std::pair<std::string,std::string>> &safex_accounts) const;
 
+       /**
+       * @brief gets one page of pairs <username, safex_account_description>
+       *
+       * @return True if we get the elements from Blockchain
+       */
+       bool get_safex_accounts( std::vector<std::pair<std::string,std::string>> &safex_accounts, safex::listing_page &page) const;
+
        bool get_table_sizes( std::vector<uint64_t> &table_sizes) const;
 
        /**
@@ -824,6 +867,13 @@ namespace cryptonote
        */
        bool get_safex_offers( std::vector<safex::safex_offer> &safex_offers) const;
 
+       /**
+       * @brief gets one page of offers matching the filter inside the Blockchain
+       *
+       * @return True if we get the elements from Blockchain
+       */
+       bool get_safex_offers( std::vector<safex::safex_offer> &safex_offers, const safex::safex_offer_filter &filter, safex::listing_page &page) const;
+
        /**
        * @brief gets all price pegs inside the Blockchain for given currency
        *
@@ -831,6 +881,13 @@ namespace cryptonote
        */
        bool get_safex_price_pegs( std::vector<safex::safex_price_peg> &safex_price_pegs, const std::string& currency = "") const;
 
+       /**
+       * @brief gets one page of price pegs inside the Blockchain for given currency
+       *
+       * @return True if we get the elements from Blockchain
+       */
+       bool get_safex_price_pegs( std::vector<safex::safex_price_peg> &safex_price_pegs, const std::string& currency, safex::listing_page &page) const;
+
        /**
        * @brief gets price peg inside the Blockchain for given ID
        *
@@ -844,6 +901,20 @@ namespace cryptonote
       */
        bool get_safex_feedbacks( std::vector<safex::safex_feedback> &safex_feedbacks, const crypto::hash& offer_id) const;
 
+       /**
+      * @brief gets one page of feedbacks for given offer_id
+      *
+      * @return True if we get the elements from Blockchain
+      */
+       bool get_safex_feedbacks( std::vector<safex::safex_feedback> &safex_feedbacks, const crypto::hash& offer_id, safex::listing_page &page) const;
+
+       /**
+      * @brief gets feedback count, star sum and star histogram for given offer_id
+      *
+      * @return False if the offer has no feedback
+      */
+       bool get_safex_offer_rating(const crypto::hash& offer_id, safex::safex_offer_rating &rating) const;
+
      /**
       * @brief get the network type we're on
       *
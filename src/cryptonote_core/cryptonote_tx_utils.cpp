@@ -1838,18 +1838,7 @@ namespace cryptonote
     {
       uint64_t seed_height, main_height;
       crypto::hash hash;
-      if (pbc != NULL)
-      {
-        seed_height = rx_seedheight(height);
-        hash = pbc->get_pending_block_id_by_height(seed_height);
-        main_height = pbc->get_current_blockchain_height();
-      }
-      else
-      {
-        memset(&hash, 0, sizeof(hash));  // only happens when generating genesis block
-        seed_height = 0;
-        main_height = 0;
-      }
+      get_block_longhash_seed(pbc, height, main_height, seed_height, hash);
       rx_slow_hash(main_height, seed_height, hash.data, bd.data(), bd.size(), res.data, miners, 0);
     }
     else
@@ -1867,10 +1856,36 @@ namespace cryptonote
     return p;
   }
 
+  void get_block_longhash_seed(const Blockchain *pbc, const uint64_t height, uint64_t& main_height, uint64_t& seed_height, crypto::hash& seed_hash)
+  {
+    if (pbc != NULL)
+    {
+      seed_height = rx_seedheight(height);
+      seed_hash = pbc->get_pending_block_id_by_height(seed_height);
+      main_height = pbc->get_current_blockchain_height();
+    }
+    else
+    {
+      memset(&seed_hash, 0, sizeof(seed_hash));  // only happens when generating genesis block
+      seed_height = 0;
+      main_height = 0;
+    }
+  }
+
   void get_block_longhash_reorg(const uint64_t split_height)
   {
     rx_reorg(split_height);
   }
+
+  void get_block_longhash_prefetch(const uint64_t seed_height, const crypto::hash& seed_hash)
+  {
+    rx_set_next_seedhash(seed_height, seed_hash.data);
+  }
+
+  void get_block_longhash_stop_prefetch()
+  {
+    rx_stop_prefetch();
+  }
   //---------------------------------------------------------------
   cryptonote::tx_source_entry::output_entry generate_migration_bitcoin_transaction_output(const account_keys& sender_account_keys, const crypto::hash bitcoin_tx_hash, uint64_t token_amount)
   {
@@ -108,7 +108,7 @@ namespace cryptonote
   }
   //---------------------------------------------------------------------------------
   //---------------------------------------------------------------------------------
-  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_blockchain(bchs), m_txpool_max_size(DEFAULT_TXPOOL_MAX_SIZE), m_txpool_size(0)
+  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_blockchain(bchs), m_txpool_max_size(DEFAULT_TXPOOL_MAX_SIZE), m_txpool_size(0), m_cookie(0)
   {
 
   }
@@ -296,7 +296,7 @@ namespace cryptonote
             return false;
           if (!insert_safex_restrictions(tx, kept_by_block))
               return false;
-          m_txs_by_fee_and_receive_time.emplace(std::pair<double, std::time_t>(fee / (double)blob_size, receive_time), id);
+          add_tx_to_sorted_container(std::pair<double, std::time_t>(fee / (double)blob_size, receive_time), id);
           lock.commit();
         }
         catch (const std::exception &e)
@@ -336,13 +336,13 @@ namespace cryptonote
       {
         CRITICAL_REGION_LOCAL1(m_blockchain);
         LockedTXN lock(m_blockchain);
-        m_blockchain.remove_txpool_tx(get_transaction_hash(tx));
+        remove_txpool_tx(get_transaction_hash(tx));
         m_blockchain.add_txpool_tx(tx, meta);
         if (!insert_key_images(tx, kept_by_block))
           return false;
         if (!insert_safex_restrictions(tx, kept_by_block))
             return false;
-        m_txs_by_fee_and_receive_time.emplace(std::pair<double, std::time_t>(fee / (double)blob_size, receive_time), id);
+        add_tx_to_sorted_container(std::pair<double, std::time_t>(fee / (double)blob_size, receive_time), id);
         lock.commit();
       }
       catch (const std::exception &e)
@@ -425,12 +425,12 @@ namespace cryptonote
         }
         // remove first, in case this throws, so key images aren't removed
         MINFO("Pruning tx " << txid << " from txpool: size: " << it->first.second << ", fee/byte: " << it->first.first);
-        m_blockchain.remove_txpool_tx(txid);
+        remove_txpool_tx(txid);
         m_txpool_size -= txblob.size();
         remove_transaction_keyimages(tx);
         remove_safex_restrictions(tx);
         MINFO("Pruned tx " << txid << " from txpool: size: " << it->first.second << ", fee/byte: " << it->first.first);
-        m_txs_by_fee_and_receive_time.erase(it--);
+        remove_tx_from_sorted_container(it--);
       }
       catch (const std::exception &e)
       {
@@ -697,7 +697,7 @@ namespace cryptonote
       double_spend_seen = meta.double_spend_seen;
 
       // remove first, in case this throws, so key images aren't removed
-      m_blockchain.remove_txpool_tx(id);
+      remove_txpool_tx(id);
       m_txpool_size -= blob_size;
       remove_transaction_keyimages(tx);
       remove_safex_restrictions(tx);
@@ -709,7 +709,7 @@ namespace cryptonote
       return false;
     }
 
-    m_txs_by_fee_and_receive_time.erase(sorted_it);
+    remove_tx_from_sorted_container(sorted_it);
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -720,11 +720,93 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   sorted_tx_container::iterator tx_memory_pool::find_tx_in_sorted_container(const crypto::hash& id) const
   {
-    return std::find_if( m_txs_by_fee_and_receive_time.begin(), m_txs_by_fee_and_receive_time.end()
-                       , [&](const sorted_tx_container::value_type& a){
-                         return a.second == id;
-                       }
-    );
+    const auto i = m_txs_by_fee_and_receive_time_index.find(id);
+    if (i == m_txs_by_fee_and_receive_time_index.end())
+      return m_txs_by_fee_and_receive_time.end();
+    return i->second;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::add_tx_to_sorted_container(const std::pair<double, std::time_t> &fee_and_receive_time, const crypto::hash& id)
+  {
+    auto i = m_txs_by_fee_and_receive_time_index.find(id);
+    if (i != m_txs_by_fee_and_receive_time_index.end())
+    {
+      m_txs_by_fee_and_receive_time.erase(i->second);
+      m_txs_by_fee_and_receive_time_index.erase(i);
+    }
+
+    const auto res = m_txs_by_fee_and_receive_time.emplace(fee_and_receive_time, id);
+    m_txs_by_fee_and_receive_time_index.emplace(id, res.first);
+    bump_cookie();
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::remove_tx_from_sorted_container(sorted_tx_container::iterator it)
+  {
+    m_txs_by_fee_and_receive_time_index.erase(it->second);
+    m_txs_by_fee_and_receive_time.erase(it);
+    bump_cookie();
+  }
+  //---------------------------------------------------------------------------------
+  tx_memory_pool::parsed_tx_cache_entry* tx_memory_pool::get_parsed_tx(const crypto::hash &txid)
+  {
+    parsed_tx_cache_entry *cached = find_parsed_tx(txid);
+    if (cached)
+      return cached;
+
+    parsed_tx_cache_entry entry;
+    if (!m_blockchain.get_txpool_tx_meta(txid, entry.meta))
+    {
+      MERROR("Failed to find tx meta in txpool");
+      return nullptr;
+    }
+    cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(txid);
+    if (!parse_and_validate_tx_from_blob(txblob, entry.tx))
+    {
+      MERROR("Failed to parse tx from txpool");
+      return nullptr;
+    }
+
+    return add_parsed_tx(txid, std::move(entry));
+  }
+  //---------------------------------------------------------------------------------
+  tx_memory_pool::parsed_tx_cache_entry* tx_memory_pool::find_parsed_tx(const crypto::hash &txid)
+  {
+    auto i = m_parsed_tx_cache.find(txid);
+    if (i == m_parsed_tx_cache.end())
+      return nullptr;
+    m_parsed_tx_lru.splice(m_parsed_tx_lru.begin(), m_parsed_tx_lru, i->second.lru_position);
+    return &i->second;
+  }
+  //---------------------------------------------------------------------------------
+  tx_memory_pool::parsed_tx_cache_entry* tx_memory_pool::add_parsed_tx(const crypto::hash &txid, parsed_tx_cache_entry &&entry)
+  {
+    if (m_parsed_tx_cache.size() >= MAX_PARSED_TX_CACHE_SIZE && !m_parsed_tx_lru.empty())
+    {
+      m_parsed_tx_cache.erase(m_parsed_tx_lru.back());
+      m_parsed_tx_lru.pop_back();
+    }
+    m_parsed_tx_lru.push_front(txid);
+    entry.lru_position = m_parsed_tx_lru.begin();
+    return &m_parsed_tx_cache.emplace(txid, std::move(entry)).first->second;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::update_txpool_tx_meta(const crypto::hash &txid, const txpool_tx_meta_t &meta)
+  {
+    m_blockchain.update_txpool_tx(txid, meta);
+    auto i = m_parsed_tx_cache.find(txid);
+    if (i != m_parsed_tx_cache.end())
+      i->second.meta = meta;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::remove_txpool_tx(const crypto::hash &txid)
+  {
+    auto i = m_parsed_tx_cache.find(txid);
+    if (i != m_parsed_tx_cache.end())
+    {
+      m_parsed_tx_lru.erase(i->second.lru_position);
+      m_parsed_tx_cache.erase(i);
+    }
+    m_blockchain.remove_txpool_tx(txid);
   }
   //---------------------------------------------------------------------------------
   //TODO: investigate whether boolean return is appropriate
@@ -747,7 +829,7 @@ namespace cryptonote
         }
         else
         {
-          m_txs_by_fee_and_receive_time.erase(sorted_it);
+          remove_tx_from_sorted_container(sorted_it);
         }
         m_timed_out_transactions.insert(txid);
         remove.insert(txid);
@@ -771,7 +853,7 @@ namespace cryptonote
           }
           else
           {
-            m_txs_by_fee_and_receive_time.erase(sorted_it);
+            remove_tx_from_sorted_container(sorted_it);
           }
           m_timed_out_transactions.insert(txid);
           remove.insert(txid);
@@ -797,7 +879,7 @@ namespace cryptonote
           else
           {
             // remove first, so we only remove key images if the tx removal succeeds
-            m_blockchain.remove_txpool_tx(txid);
+            remove_txpool_tx(txid);
             m_txpool_size -= bd.size();
             remove_transaction_keyimages(tx);
             remove_safex_restrictions(tx);
@@ -862,7 +944,7 @@ namespace cryptonote
         {
           meta.relayed = true;
           meta.last_relayed_time = now;
-          m_blockchain.update_txpool_tx(it->first, meta);
+          update_txpool_tx_meta(it->first, meta);
         }
       }
       catch (const std::exception &e)
@@ -1112,16 +1194,46 @@ namespace cryptonote
     return true;
   }
   //---------------------------------------------------------------------------------
-  bool tx_memory_pool::check_for_key_images(const std::vector<crypto::key_image>& key_images, std::vector<bool> spent) const
+  bool tx_memory_pool::check_for_key_images(const std::vector<crypto::key_image>& key_images, std::vector<bool>& spent, bool include_sensitive_data) const
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
 
     spent.clear();
+    spent.reserve(key_images.size());
 
+    txpool_tx_meta_t meta;
     for (const auto& image : key_images)
     {
-      spent.push_back(m_spent_key_images.find(image) == m_spent_key_images.end() ? false : true);
+      const auto it = m_spent_key_images.find(image);
+      bool is_spent = it != m_spent_key_images.end();
+      if (is_spent && !include_sensitive_data)
+      {
+        // In restricted mode, only txes which were relayed can reveal an image
+        is_spent = false;
+        for (const crypto::hash& tx_id_hash : it->second)
+        {
+          try
+          {
+            if (!m_blockchain.get_txpool_tx_meta(tx_id_hash, meta))
+            {
+              MERROR("Failed to get tx meta from txpool");
+              return false;
+            }
+          }
+          catch (const std::exception &e)
+          {
+            MERROR("Failed to get tx meta from txpool: " << e.what());
+            return false;
+          }
+          if (meta.relayed)
+          {
+            is_spent = true;
+            break;
+          }
+        }
+      }
+      spent.push_back(is_spent);
     }
 
     return true;
@@ -1141,16 +1253,63 @@ namespace cryptonote
     }
   }
   //---------------------------------------------------------------------------------
+  void tx_memory_pool::get_transactions(const std::vector<crypto::hash>& ids, std::vector<cryptonote::blobdata>& txblobs, std::vector<size_t>& missing_indices) const
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    CRITICAL_REGION_LOCAL1(m_blockchain);
+    txblobs.resize(ids.size());
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+      try
+      {
+        if (m_blockchain.get_txpool_tx_blob(ids[i], txblobs[i]))
+          continue;
+      }
+      catch (const std::exception &e) {}
+      missing_indices.push_back(i);
+    }
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::get_transaction_short_ids(const crypto::hash& key, std::unordered_map<uint64_t, crypto::hash>& short_ids) const
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    CRITICAL_REGION_LOCAL1(m_blockchain);
+    short_ids.reserve(m_blockchain.get_txpool_tx_count(true));
+    m_blockchain.for_all_txpool_txes([&short_ids, &key](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+      auto ins = short_ids.emplace(get_short_tx_id(key, txid), txid);
+      if (!ins.second)
+        ins.first->second = crypto::null_hash;
+      return true;
+    }, false, true);
+  }
+  //---------------------------------------------------------------------------------
   bool tx_memory_pool::on_blockchain_inc(uint64_t new_block_height, const crypto::hash& top_block_id)
   {
+    bump_cookie();
     return true;
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::on_blockchain_dec(uint64_t new_block_height, const crypto::hash& top_block_id)
   {
+    bump_cookie();
     return true;
   }
   //---------------------------------------------------------------------------------
+  void tx_memory_pool::bump_cookie()
+  {
+    {
+      boost::lock_guard<boost::mutex> lock(m_cookie_lock);
+      ++m_cookie;
+    }
+    m_cookie_changed.notify_all();
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::wait_for_cookie_change(uint64_t cookie, const boost::chrono::steady_clock::time_point &deadline) const
+  {
+    boost::unique_lock<boost::mutex> lock(m_cookie_lock);
+    return m_cookie_changed.wait_until(lock, deadline, [this, cookie]() { return m_cookie != cookie; });
+  }
+  //---------------------------------------------------------------------------------
   bool tx_memory_pool::have_tx(const crypto::hash &id) const
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
@@ -1422,6 +1581,20 @@ namespace cryptonote
                   txd.last_failed_id = m_blockchain.get_block_id_by_height(txd.last_failed_height);
                   return false;
               }
+
+              //price peg rate could have changed since the purchase was made, check it still pays enough
+              if(offer_to_purchase.price_peg_used){
+                  safex::safex_price_peg sfx_price_peg{};
+                  uint64_t pegged_price = 0;
+                  if(!m_blockchain.get_safex_price_peg(offer_to_purchase.price_peg_id, sfx_price_peg)
+                     || !safex::convert_pegged_price(offer_to_purchase.price, sfx_price_peg.rate, m_blockchain.get_current_hard_fork_version(), pegged_price)
+                     || std::max(pegged_price, offer_to_purchase.min_sfx_price) * purchase.quantity > purchase.price){
+                      txd.last_failed_height = m_blockchain.get_current_blockchain_height()-1;
+                      txd.last_failed_id = m_blockchain.get_block_id_by_height(txd.last_failed_height);
+                      return false;
+                  }
+              }
+
               offer_quantity_left[purchase.offer_id] -= purchase.quantity;
           }
       }
@@ -1500,7 +1673,7 @@ namespace cryptonote
               meta.double_spend_seen = true;
               try
               {
-                m_blockchain.update_txpool_tx(txid, meta);
+                update_txpool_tx_meta(txid, meta);
               }
               catch (const std::exception &e)
               {
@@ -1591,15 +1764,18 @@ namespace cryptonote
     std::vector<crypto::hash> safex_offers_purchase_in_block;
     std::vector<crypto::hash> safex_price_peg_in_block;
 
+    const crypto::hash top_id = m_blockchain.get_tail_id();
+
     auto sorted_it = m_txs_by_fee_and_receive_time.begin();
     while (sorted_it != m_txs_by_fee_and_receive_time.end())
     {
-      txpool_tx_meta_t meta;
-      if (!m_blockchain.get_txpool_tx_meta(sorted_it->second, meta))
+      parsed_tx_cache_entry *parsed_tx = get_parsed_tx(sorted_it->second);
+      if (!parsed_tx)
       {
-        MERROR("  failed to find tx meta");
+        sorted_it++;
         continue;
       }
+      txpool_tx_meta_t meta = parsed_tx->meta;
       LOG_PRINT_L2("Considering " << sorted_it->second << ", size " << meta.blob_size << ", current block size " << total_size << "/" << max_total_size << ", current coinbase " << print_money(best_coinbase));
 
       // Can not exceed maximum block size
@@ -1641,26 +1817,23 @@ namespace cryptonote
         }
       }
 
-      cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(sorted_it->second);
-      cryptonote::transaction tx;
-      if (!parse_and_validate_tx_from_blob(txblob, tx))
-      {
-        MERROR("Failed to parse tx from txpool");
-        sorted_it++;
-        continue;
-      }
+      cryptonote::transaction &tx = parsed_tx->tx;
 
       // Skip transactions that are not ready to be
       // included into the blockchain or that are
       // missing key images
+      // chain checks only depend on the chain tip, so txes already found ready on this tip are not checked again
       const cryptonote::txpool_tx_meta_t original_meta = meta;
-      bool ready = is_transaction_ready_to_go(meta, tx) && is_purchase_possible(meta, tx, offer_quantity_left, offers_edited, price_pegs_edited)
-                                                        && insert_and_check_safex_restrictions(tx, safex_accounts_in_block, safex_offer_in_block, safex_offers_purchase_in_block, safex_price_peg_in_block);
+      bool ready = parsed_tx->ready_at_top_id == top_id || is_transaction_ready_to_go(meta, tx);
+      if (ready)
+        parsed_tx->ready_at_top_id = top_id;
+      ready = ready && is_purchase_possible(meta, tx, offer_quantity_left, offers_edited, price_pegs_edited)
+                    && insert_and_check_safex_restrictions(tx, safex_accounts_in_block, safex_offer_in_block, safex_offers_purchase_in_block, safex_price_peg_in_block);
       if (memcmp(&original_meta, &meta, sizeof(meta)))
       {
         try
         {
-          m_blockchain.update_txpool_tx(sorted_it->second, meta);
+          update_txpool_tx_meta(sorted_it->second, meta);
         }
             catch (const std::exception &e)
         {
@@ -1735,7 +1908,7 @@ namespace cryptonote
             continue;
           }
           // remove tx from db first
-          m_blockchain.remove_txpool_tx(txid);
+          remove_txpool_tx(txid);
           m_txpool_size -= txblob.size();
           remove_transaction_keyimages(tx);
           remove_safex_restrictions(tx);
@@ -1746,7 +1919,7 @@ namespace cryptonote
           }
           else
           {
-            m_txs_by_fee_and_receive_time.erase(sorted_it);
+            remove_tx_from_sorted_container(sorted_it);
           }
           ++n_removed;
         }
@@ -1768,6 +1941,10 @@ namespace cryptonote
 
     m_txpool_max_size = max_txpool_size ? max_txpool_size : DEFAULT_TXPOOL_MAX_SIZE;
     m_txs_by_fee_and_receive_time.clear();
+    m_txs_by_fee_and_receive_time_index.clear();
+    m_parsed_tx_cache.clear();
+    m_parsed_tx_lru.clear();
+    bump_cookie();
     m_spent_key_images.clear();
     m_safex_accounts_in_use.clear();
     m_safex_offers_in_use.clear();
@@ -1799,7 +1976,7 @@ namespace cryptonote
             MFATAL("Failed to insert safex data from txpool tx");
             return false;
         }
-        m_txs_by_fee_and_receive_time.emplace(std::pair<double, time_t>(meta.fee / (double)meta.blob_size, meta.receive_time), txid);
+        add_tx_to_sorted_container(std::pair<double, std::time_t>(meta.fee / (double)meta.blob_size, meta.receive_time), txid);
         m_txpool_size += meta.blob_size;
         return true;
       }, true);
@@ -1813,7 +1990,7 @@ namespace cryptonote
       {
         try
         {
-          m_blockchain.remove_txpool_tx(txid);
+          remove_txpool_tx(txid);
         }
         catch (const std::exception &e)
         {
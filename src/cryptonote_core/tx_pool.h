@@ -33,11 +33,15 @@
 #include "include_base_utils.h"
 
 #include <set>
+#include <list>
 #include <unordered_map>
 #include <unordered_set>
 #include <queue>
+#include <atomic>
 #include <boost/serialization/version.hpp>
 #include <boost/utility.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include "string_tools.h"
 #include "syncobj.h"
@@ -49,9 +53,13 @@
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "rpc/message_data_structs.h"
 
+class tx_pool_parsed_tx_cache_evicts_least_recently_used_Test;
+
 namespace cryptonote
 {
   class Blockchain;
+
+  size_t const MAX_PARSED_TX_CACHE_SIZE = 10000; // at most that many parsed txes kept for block template construction
   /************************************************************************/
   /*                                                                      */
   /************************************************************************/
@@ -93,6 +101,8 @@ namespace cryptonote
    */
   class tx_memory_pool: boost::noncopyable
   {
+    friend class ::tx_pool_parsed_tx_cache_evicts_least_recently_used_Test;
+
   public:
     /**
      * @brief Constructor
@@ -156,7 +166,7 @@ namespace cryptonote
     /**
      * @brief action to take when notified of a block added to the blockchain
      *
-     * Currently does nothing
+     * Changes the pool cookie, since block templates built on the old tip are stale
      *
      * @param new_block_height the height of the blockchain after the change
      * @param top_block_id the hash of the new top block
@@ -168,7 +178,7 @@ namespace cryptonote
     /**
      * @brief action to take when notified of a block removed from the blockchain
      *
-     * Currently does nothing
+     * Changes the pool cookie, since block templates built on the old tip are stale
      *
      * @param new_block_height the height of the blockchain after the change
      * @param top_block_id the hash of the new top block
@@ -298,10 +308,11 @@ namespace cryptonote
      *
      * @param key_images [in] vector of key images to check
      * @param spent [out] vector of bool to return
+     * @param include_sensitive_data [in] whether images only spent by txes not yet relayed count
      *
-     * @return true
+     * @return true on success, false on error
      */
-    bool check_for_key_images(const std::vector<crypto::key_image>& key_images, std::vector<bool> spent) const;
+    bool check_for_key_images(const std::vector<crypto::key_image>& key_images, std::vector<bool>& spent, bool include_sensitive_data = true) const;
 
     /**
      * @brief get a specific transaction from the pool
@@ -313,6 +324,26 @@ namespace cryptonote
      */
     bool get_transaction(const crypto::hash& h, cryptonote::blobdata& txblob) const;
 
+    /**
+     * @brief get several transactions from the pool under a single lock
+     *
+     * @param ids the hashes of the transactions to get
+     * @param txblobs return-by-reference the transaction blobs, one per id
+     * @param missing_indices return-by-reference the indices into ids not found in the pool
+     */
+    void get_transactions(const std::vector<crypto::hash>& ids, std::vector<cryptonote::blobdata>& txblobs, std::vector<size_t>& missing_indices) const;
+
+    /**
+     * @brief map salted short ids of all pool transactions to their hashes
+     *
+     * Short ids which collide within the pool map to null_hash, so callers
+     * can tell an ambiguous id from an unknown one.
+     *
+     * @param key the salted key from get_short_tx_id_key
+     * @param short_ids return-by-reference the short id to hash map
+     */
+    void get_transaction_short_ids(const crypto::hash& key, std::unordered_map<uint64_t, crypto::hash>& short_ids) const;
+
     /**
      * @brief get a list of all relayable transactions and their hashes
      *
@@ -342,6 +373,26 @@ namespace cryptonote
      */
     size_t get_transactions_count(bool include_unrelayed_txes = true) const;
 
+    /**
+     * @brief get a value which changes whenever transactions are added to or removed
+     * from the pool, or the blockchain tip changes
+     *
+     * Used to tell whether a block template built from the pool is still current.
+     *
+     * @return the pool cookie
+     */
+    uint64_t cookie() const { return m_cookie; }
+
+    /**
+     * @brief wait until the pool cookie differs from the given one
+     *
+     * @param cookie the cookie the caller last saw
+     * @param deadline when to give up waiting
+     *
+     * @return true if the cookie changed, false if the deadline passed first
+     */
+    bool wait_for_cookie_change(uint64_t cookie, const boost::chrono::steady_clock::time_point &deadline) const;
+
     /**
      * @brief get a string containing human-readable pool information
      *
@@ -642,6 +693,88 @@ private:
      */
     sorted_tx_container::iterator find_tx_in_sorted_container(const crypto::hash& id) const;
 
+    /**
+     * @brief add a transaction to the sorted container and to its txid index
+     *
+     * If the transaction is already in the container, its old entry is replaced.
+     *
+     * @param fee_and_receive_time fee per byte and receive time of the transaction
+     * @param id the hash of the transaction
+     */
+    void add_tx_to_sorted_container(const std::pair<double, std::time_t> &fee_and_receive_time, const crypto::hash& id);
+
+    /**
+     * @brief remove a transaction from the sorted container and from its txid index
+     *
+     * @param it iterator to the transaction in the sorted container
+     */
+    void remove_tx_from_sorted_container(sorted_tx_container::iterator it);
+
+    //! index of m_txs_by_fee_and_receive_time by transaction hash
+    std::unordered_map<crypto::hash, sorted_tx_container::iterator> m_txs_by_fee_and_receive_time_index;
+
+    //! pool transaction parsed from its blob, together with its metadata
+    struct parsed_tx_cache_entry
+    {
+      transaction tx;
+      txpool_tx_meta_t meta;
+      crypto::hash ready_at_top_id = crypto::null_hash; //!< chain tip at which the tx was last found ready to go
+      std::list<crypto::hash>::iterator lru_position; //!< position in m_parsed_tx_lru
+    };
+
+    /**
+     * @brief get a pool transaction and its metadata, loading and parsing it on first use
+     *
+     * Cached entries are kept until the transaction leaves the pool or is
+     * the least recently used one when the cache is full, so repeated block
+     * template construction does not read and parse it again.
+     *
+     * @param txid the hash of the transaction
+     *
+     * @return the cached entry, or nullptr if the transaction could not be loaded
+     */
+    parsed_tx_cache_entry* get_parsed_tx(const crypto::hash &txid);
+
+    /**
+     * @brief get a parsed transaction already in the cache, marking it as most recently used
+     *
+     * @return the cached entry, or nullptr if the transaction is not cached
+     */
+    parsed_tx_cache_entry* find_parsed_tx(const crypto::hash &txid);
+
+    /**
+     * @brief add a parsed transaction to the cache, evicting the least recently used one if full
+     *
+     * @return the cached entry
+     */
+    parsed_tx_cache_entry* add_parsed_tx(const crypto::hash &txid, parsed_tx_cache_entry &&entry);
+
+    /**
+     * @brief update metadata of a pool transaction in the db and in the parsed tx cache
+     */
+    void update_txpool_tx_meta(const crypto::hash &txid, const txpool_tx_meta_t &meta);
+
+    /**
+     * @brief remove a transaction from the pool db and from the parsed tx cache
+     */
+    void remove_txpool_tx(const crypto::hash &txid);
+
+    //! parsed transactions used by fill_block_template, bounded by MAX_PARSED_TX_CACHE_SIZE
+    std::unordered_map<crypto::hash, parsed_tx_cache_entry> m_parsed_tx_cache;
+
+    //! hashes of the parsed transactions, most recently used first
+    std::list<crypto::hash> m_parsed_tx_lru;
+
+    /**
+     * @brief change the pool cookie and wake up anyone waiting for it
+     */
+    void bump_cookie();
+
+    //! changed on every addition to or removal from m_txs_by_fee_and_receive_time, and on tip changes
+    std::atomic<uint64_t> m_cookie;
+    mutable boost::mutex m_cookie_lock;
+    mutable boost::condition_variable m_cookie_changed;
+
     //! transactions which are unlikely to be included in blocks
     /*! These transactions are kept in RAM in case they *are* included
      *  in a block eventually, but this container is not saved to disk.
@@ -37,6 +37,9 @@
 
 #include <boost/program_options/variables_map.hpp>
 #include <string>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "math_helper.h"
 #include "storages/levin_abstract_invoke2.h"
@@ -92,6 +95,7 @@ namespace cryptonote
       HANDLE_NOTIFY_T2(NOTIFY_RESPONSE_CHAIN_ENTRY, &cryptonote_protocol_handler::handle_response_chain_entry)
       HANDLE_NOTIFY_T2(NOTIFY_NEW_FLUFFY_BLOCK, &cryptonote_protocol_handler::handle_notify_new_fluffy_block)			
       HANDLE_NOTIFY_T2(NOTIFY_REQUEST_FLUFFY_MISSING_TX, &cryptonote_protocol_handler::handle_request_fluffy_missing_tx)						
+      HANDLE_NOTIFY_T2(NOTIFY_NEW_COMPACT_BLOCK, &cryptonote_protocol_handler::handle_notify_new_compact_block)
     END_INVOKE_MAP2()
 
     bool on_idle();
@@ -121,6 +125,7 @@ namespace cryptonote
     int handle_response_chain_entry(int command, NOTIFY_RESPONSE_CHAIN_ENTRY::request& arg, cryptonote_connection_context& context);
     int handle_notify_new_fluffy_block(int command, NOTIFY_NEW_FLUFFY_BLOCK::request& arg, cryptonote_connection_context& context);
     int handle_request_fluffy_missing_tx(int command, NOTIFY_REQUEST_FLUFFY_MISSING_TX::request& arg, cryptonote_connection_context& context);
+    int handle_notify_new_compact_block(int command, NOTIFY_NEW_COMPACT_BLOCK::request& arg, cryptonote_connection_context& context);
 		
     //----------------- i_bc_protocol_layout ---------------------------------------
     virtual bool relay_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& exclude_context);
@@ -134,6 +139,8 @@ namespace cryptonote
     void drop_connection(cryptonote_connection_context &context, bool add_fail, bool flush_all_spans);
     bool kick_idle_peers();
     int try_add_next_blocks(cryptonote_connection_context &context);
+    int add_fluffy_block(const blobdata& block_blob, std::list<blobdata>& txs, uint64_t current_blockchain_height, cryptonote_connection_context& context);
+    std::shared_ptr<const std::unordered_map<uint64_t, crypto::hash>> get_pool_short_ids(const crypto::hash &key);
 
     t_core& m_core;
 
@@ -146,6 +153,14 @@ namespace cryptonote
     block_queue m_block_queue;
     epee::math_helper::once_a_time_seconds<30> m_idle_peer_kicker;
 
+    boost::mutex m_compact_block_lock;
+    //! compact blocks being rebuilt from the pool
+    std::unordered_set<crypto::hash> m_compact_blocks_in_progress;
+    //! short ids of the pool txes for the last compact block key, valid while the pool cookie is unchanged
+    std::shared_ptr<const std::unordered_map<uint64_t, crypto::hash>> m_compact_short_ids;
+    crypto::hash m_compact_short_ids_key;
+    uint64_t m_compact_short_ids_cookie;
+
     boost::mutex m_buffer_mutex;
     double get_avg_block_size();
     boost::circular_buffer<size_t> m_avg_buffer = boost::circular_buffer<size_t>(10);
@@ -574,41 +574,34 @@ namespace cryptonote
         return 1;
       }      
       
-      size_t tx_idx = 0;
-      for(auto& tx_hash: new_block.tx_hashes)
+      // look the whole block up in the pool at once, then fall back to
+      // the chain for whatever the pool doesn't have
+      std::vector<cryptonote::blobdata> block_txs;
+      std::vector<size_t> pool_missing;
+      m_core.get_pool_transactions(new_block.tx_hashes, block_txs, pool_missing);
+      if (!pool_missing.empty())
       {
-        cryptonote::blobdata txblob;
-        if(m_core.get_pool_transaction(tx_hash, txblob))
+        std::vector<crypto::hash> tx_ids;
+        tx_ids.reserve(pool_missing.size());
+        for (size_t idx: pool_missing)
+          tx_ids.push_back(new_block.tx_hashes[idx]);
+        std::list<transaction> txes;
+        std::list<crypto::hash> missing;
+        m_core.get_transactions(tx_ids, txes, missing);
+        std::unordered_set<crypto::hash> missing_set(missing.begin(), missing.end());
+        auto txes_it = txes.begin();
+        for (size_t idx: pool_missing)
         {
-          have_tx.push_back(txblob);
-        }
-        else
-        {
-          std::vector<crypto::hash> tx_ids;
-          std::list<transaction> txes;
-          std::list<crypto::hash> missing;
-          tx_ids.push_back(tx_hash);
-          if (m_core.get_transactions(tx_ids, txes, missing) && missing.empty())
+          if (missing_set.find(new_block.tx_hashes[idx]) == missing_set.end() && txes_it != txes.end())
           {
-            if (txes.size() == 1)
-            {
-              have_tx.push_back(tx_to_blob(txes.front()));
-            }
-            else
-            {
-              MERROR("1 tx requested, none not found, but " << txes.size() << " returned");
-              m_core.resume_mine();
-              return 1;
-            }
+            block_txs[idx] = tx_to_blob(*txes_it++);
           }
           else
           {
-            MDEBUG("Tx " << tx_hash << " not found in pool");
-            need_tx_indices.push_back(tx_idx);
+            MDEBUG("Tx " << new_block.tx_hashes[idx] << " not found in pool");
+            need_tx_indices.push_back(idx);
           }
         }
-        
-        ++tx_idx;
       }
         
       if(!need_tx_indices.empty()) // drats, we don't have everything..
@@ -628,52 +621,8 @@ namespace cryptonote
       else // whoo-hoo we've got em all ..
       {
         MDEBUG("We have all needed txes for this fluffy block");
-
-        block_complete_entry b;
-        b.block = arg.b.block;
-        b.txs = have_tx;
-
-        std::list<block_complete_entry> blocks;
-        blocks.push_back(b);
-        if (!m_core.prepare_handle_incoming_blocks(blocks))
-        {
-          LOG_PRINT_CCONTEXT_L0("Failure in prepare_handle_incoming_blocks");
-          m_core.resume_mine();
-          return 1;
-        }
-          
-        block_verification_context bvc = boost::value_initialized<block_verification_context>();
-        m_core.handle_incoming_block(arg.b.block, bvc); // got block from handle_notify_new_block
-        if (!m_core.cleanup_handle_incoming_blocks(true))
-        {
-          LOG_PRINT_CCONTEXT_L0("Failure in cleanup_handle_incoming_blocks");
-          m_core.resume_mine();
-          return 1;
-        }
-        m_core.resume_mine();
-        
-        if( bvc.m_verifivation_failed )
-        {
-          LOG_PRINT_CCONTEXT_L0("Block verification failed, dropping connection");
-          drop_connection(context, true, false);
-          return 1;
-        }
-        if( bvc.m_added_to_main_chain )
-        {
-          //TODO: Add here announce protocol usage
-          NOTIFY_NEW_BLOCK::request reg_arg = AUTO_VAL_INIT(reg_arg);
-          reg_arg.current_blockchain_height = arg.current_blockchain_height;
-          reg_arg.b = b;
-          relay_block(reg_arg, context);
-        }
-        else if( bvc.m_marked_as_orphaned )
-        {
-          context.m_state = cryptonote_connection_context::state_synchronizing;
-          NOTIFY_REQUEST_CHAIN::request r = boost::value_initialized<NOTIFY_REQUEST_CHAIN::request>();
-          m_core.get_short_chain_history(r.block_ids);
-          LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_REQUEST_CHAIN: m_block_ids.size()=" << r.block_ids.size() );
-          post_notify<NOTIFY_REQUEST_CHAIN>(r, context);
-        }            
+        std::move(block_txs.begin(), block_txs.end(), std::back_inserter(have_tx));
+        return add_fluffy_block(arg.b.block, have_tx, arg.current_blockchain_height, context);
       }
     } 
     else
@@ -693,6 +642,201 @@ namespace cryptonote
         
     return 1;
   }  
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::add_fluffy_block(const blobdata& block_blob, std::list<blobdata>& txs, uint64_t current_blockchain_height, cryptonote_connection_context& context)
+  {
+    // mining is paused by the caller and resumed here
+    block_complete_entry b;
+    b.block = block_blob;
+    b.txs = std::move(txs);
+
+    std::list<block_complete_entry> blocks;
+    blocks.push_back(b);
+    if (!m_core.prepare_handle_incoming_blocks(blocks))
+    {
+      LOG_PRINT_CCONTEXT_L0("Failure in prepare_handle_incoming_blocks");
+      m_core.resume_mine();
+      return 1;
+    }
+
+    block_verification_context bvc = boost::value_initialized<block_verification_context>();
+    m_core.handle_incoming_block(block_blob, bvc); // got block from handle_notify_new_block
+    if (!m_core.cleanup_handle_incoming_blocks(true))
+    {
+      LOG_PRINT_CCONTEXT_L0("Failure in cleanup_handle_incoming_blocks");
+      m_core.resume_mine();
+      return 1;
+    }
+    m_core.resume_mine();
+
+    if( bvc.m_verifivation_failed )
+    {
+      LOG_PRINT_CCONTEXT_L0("Block verification failed, dropping connection");
+      drop_connection(context, true, false);
+      return 1;
+    }
+    if( bvc.m_added_to_main_chain )
+    {
+      NOTIFY_NEW_BLOCK::request reg_arg = AUTO_VAL_INIT(reg_arg);
+      reg_arg.current_blockchain_height = current_blockchain_height;
+      reg_arg.b = b;
+      relay_block(reg_arg, context);
+    }
+    else if( bvc.m_marked_as_orphaned )
+    {
+      context.m_state = cryptonote_connection_context::state_synchronizing;
+      NOTIFY_REQUEST_CHAIN::request r = boost::value_initialized<NOTIFY_REQUEST_CHAIN::request>();
+      m_core.get_short_chain_history(r.block_ids);
+      LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_REQUEST_CHAIN: m_block_ids.size()=" << r.block_ids.size() );
+      post_notify<NOTIFY_REQUEST_CHAIN>(r, context);
+    }
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_notify_new_compact_block(int command, NOTIFY_NEW_COMPACT_BLOCK::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_NEW_COMPACT_BLOCK (height " << arg.current_blockchain_height << ", " << arg.short_tx_ids.size() << " short tx ids)");
+    if(context.m_state != cryptonote_connection_context::state_normal)
+      return 1;
+    if(!is_synchronized())
+    {
+      LOG_DEBUG_CC(context, "Received new block while syncing, ignored");
+      return 1;
+    }
+
+    // every tx but the miner tx spends at least one input, which takes up a
+    // key image and a signature in the block
+    const uint64_t max_txs = m_core.get_block_size_limit() / (sizeof(crypto::key_image) + sizeof(crypto::signature));
+    if(arg.short_tx_ids.size() > max_txs)
+    {
+      LOG_ERROR_CCONTEXT("sent wrong compact block: " << arg.short_tx_ids.size() << " short tx ids do not fit in a block, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    if(m_core.have_block(arg.block_hash))
+    {
+      LOG_DEBUG_CC(context, "Received compact block " << arg.block_hash << " which we already have, ignored");
+      return 1;
+    }
+
+    block new_block;
+    if(!t_serializable_object_from_blob(static_cast<block_header&>(new_block), arg.block_header) ||
+       !parse_and_validate_tx_from_blob(arg.miner_tx, new_block.miner_tx))
+    {
+      LOG_ERROR_CCONTEXT("sent wrong compact block: failed to parse block header or miner tx, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    // the announced hash can only be checked once the block is rebuilt, so
+    // the pool is not searched for blocks which don't extend a known one:
+    // they are fetched in full and handled as possible orphans instead
+    if(!m_core.have_block(new_block.prev_id))
+    {
+      MDEBUG("Compact block " << arg.block_hash << " has unknown parent " << new_block.prev_id << ", requesting all txes");
+      NOTIFY_REQUEST_FLUFFY_MISSING_TX::request missing_tx_req;
+      missing_tx_req.block_hash = arg.block_hash;
+      missing_tx_req.current_blockchain_height = arg.current_blockchain_height;
+      for (size_t i = 0; i < arg.short_tx_ids.size(); ++i)
+        missing_tx_req.missing_tx_indices.push_back(i);
+      post_notify<NOTIFY_REQUEST_FLUFFY_MISSING_TX>(missing_tx_req, context);
+      return 1;
+    }
+
+    // other peers announce the same block at about the same time
+    {
+      boost::unique_lock<boost::mutex> lock(m_compact_block_lock);
+      if(!m_compact_blocks_in_progress.insert(arg.block_hash).second)
+      {
+        LOG_DEBUG_CC(context, "Compact block " << arg.block_hash << " is already being processed, ignored");
+        return 1;
+      }
+    }
+    epee::misc_utils::auto_scope_leave_caller in_progress_guard = epee::misc_utils::create_scope_leave_handler([&](){
+      boost::unique_lock<boost::mutex> lock(m_compact_block_lock);
+      m_compact_blocks_in_progress.erase(arg.block_hash);
+    });
+
+    m_core.pause_mine();
+
+    // resolve short ids against the whole pool in one pass; ids unknown
+    // to us, or shared by several pool txes, are fetched from the peer
+    const crypto::hash key = get_short_tx_id_key(arg.block_hash, arg.short_id_salt);
+    const std::shared_ptr<const std::unordered_map<uint64_t, crypto::hash>> short_ids = get_pool_short_ids(key);
+    const std::unordered_map<uint64_t, crypto::hash> &pool_ids = *short_ids;
+
+    std::vector<uint64_t> need_tx_indices;
+    std::vector<size_t> resolved;
+    std::vector<crypto::hash> resolved_hashes;
+    new_block.tx_hashes.resize(arg.short_tx_ids.size(), crypto::null_hash);
+    for (size_t i = 0; i < arg.short_tx_ids.size(); ++i)
+    {
+      auto it = pool_ids.find(arg.short_tx_ids[i]);
+      if (it == pool_ids.end() || it->second == crypto::null_hash)
+      {
+        need_tx_indices.push_back(i);
+        continue;
+      }
+      new_block.tx_hashes[i] = it->second;
+      resolved.push_back(i);
+      resolved_hashes.push_back(it->second);
+    }
+
+    std::vector<cryptonote::blobdata> resolved_txs;
+    std::vector<size_t> pool_missing;
+    m_core.get_pool_transactions(resolved_hashes, resolved_txs, pool_missing);
+    for (size_t idx: pool_missing)
+      need_tx_indices.push_back(resolved[idx]);
+
+    if (need_tx_indices.empty() && get_block_hash(new_block) != arg.block_hash)
+    {
+      // a short id matched the wrong pool tx, ask for everything
+      MDEBUG("Compact block " << arg.block_hash << " did not reconstruct, requesting all txes");
+      for (size_t i = 0; i < arg.short_tx_ids.size(); ++i)
+        need_tx_indices.push_back(i);
+    }
+
+    if (!need_tx_indices.empty())
+    {
+      MDEBUG("We are missing " << need_tx_indices.size() << " txes for this compact block");
+      std::sort(need_tx_indices.begin(), need_tx_indices.end());
+      NOTIFY_REQUEST_FLUFFY_MISSING_TX::request missing_tx_req;
+      missing_tx_req.block_hash = arg.block_hash;
+      missing_tx_req.current_blockchain_height = arg.current_blockchain_height;
+      missing_tx_req.missing_tx_indices = std::move(need_tx_indices);
+
+      m_core.resume_mine();
+      post_notify<NOTIFY_REQUEST_FLUFFY_MISSING_TX>(missing_tx_req, context);
+      return 1;
+    }
+
+    MDEBUG("We have all needed txes for this compact block");
+    std::list<blobdata> have_tx;
+    std::move(resolved_txs.begin(), resolved_txs.end(), std::back_inserter(have_tx));
+    return add_fluffy_block(t_serializable_object_to_blob(new_block), have_tx, arg.current_blockchain_height, context);
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  std::shared_ptr<const std::unordered_map<uint64_t, crypto::hash>> t_cryptonote_protocol_handler<t_core>::get_pool_short_ids(const crypto::hash &key)
+  {
+    const uint64_t cookie = m_core.get_pool_cookie();
+    boost::unique_lock<boost::mutex> lock(m_compact_block_lock);
+    if (m_compact_short_ids && m_compact_short_ids_key == key && m_compact_short_ids_cookie == cookie)
+      return m_compact_short_ids;
+    lock.unlock();
+
+    std::shared_ptr<std::unordered_map<uint64_t, crypto::hash>> short_ids = std::make_shared<std::unordered_map<uint64_t, crypto::hash>>();
+    m_core.get_pool_transaction_short_ids(key, *short_ids);
+
+    lock.lock();
+    m_compact_short_ids_key = key;
+    m_compact_short_ids_cookie = cookie;
+    m_compact_short_ids = short_ids;
+    return short_ids;
+  }
   //------------------------------------------------------------------------------------------------------------------------  
   template<class t_core>
   int t_cryptonote_protocol_handler<t_core>::handle_request_fluffy_missing_tx(int command, NOTIFY_REQUEST_FLUFFY_MISSING_TX::request& arg, cryptonote_connection_context& context)
@@ -1715,18 +1859,44 @@ skip:
     fluffy_arg.b = arg.b;
     fluffy_arg.b.txs = fluffy_txs;
 
+    // compact peers get the header, the prefilled coinbase and salted
+    // short ids of the other txes, and rebuild the rest from their pool
+    NOTIFY_NEW_COMPACT_BLOCK::request compact_arg = AUTO_VAL_INIT(compact_arg);
+    compact_arg.current_blockchain_height = arg.current_blockchain_height;
+    bool have_compact = false;
+    block b;
+    if (parse_and_validate_block_from_blob(arg.b.block, b))
+    {
+      compact_arg.block_header = t_serializable_object_to_blob(static_cast<const block_header&>(b));
+      compact_arg.miner_tx = t_serializable_object_to_blob(b.miner_tx);
+      compact_arg.block_hash = get_block_hash(b);
+      compact_arg.short_id_salt = crypto::rand<uint64_t>();
+      const crypto::hash key = get_short_tx_id_key(compact_arg.block_hash, compact_arg.short_id_salt);
+      compact_arg.short_tx_ids.reserve(b.tx_hashes.size());
+      for (const crypto::hash &tx_hash: b.tx_hashes)
+        compact_arg.short_tx_ids.push_back(get_short_tx_id(key, tx_hash));
+      have_compact = true;
+    }
+
     // pre-serialize them
-    std::string fullBlob, fluffyBlob;
+    std::string fullBlob, fluffyBlob, compactBlob;
     epee::serialization::store_t_to_binary(arg, fullBlob);
     epee::serialization::store_t_to_binary(fluffy_arg, fluffyBlob);
+    if (have_compact)
+      epee::serialization::store_t_to_binary(compact_arg, compactBlob);
 
-    // sort peers between fluffy ones and others
-    std::list<boost::uuids::uuid> fullConnections, fluffyConnections;
-    m_p2p->for_each_connection([this, &exclude_context, &fullConnections, &fluffyConnections](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
+    // sort peers between compact, fluffy and full ones
+    std::list<boost::uuids::uuid> fullConnections, fluffyConnections, compactConnections;
+    m_p2p->for_each_connection([this, &exclude_context, have_compact, &fullConnections, &fluffyConnections, &compactConnections](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
     {
       if (peer_id && exclude_context.m_connection_id != context.m_connection_id)
       {
-        if(m_core.fluffy_blocks_enabled() && (support_flags & P2P_SUPPORT_FLAG_FLUFFY_BLOCKS))
+        if(m_core.fluffy_blocks_enabled() && have_compact && (support_flags & P2P_SUPPORT_FLAG_COMPACT_BLOCKS))
+        {
+          LOG_DEBUG_CC(context, "PEER SUPPORTS COMPACT BLOCKS - RELAYING SHORT TX IDS");
+          compactConnections.push_back(context.m_connection_id);
+        }
+        else if(m_core.fluffy_blocks_enabled() && (support_flags & P2P_SUPPORT_FLAG_FLUFFY_BLOCKS))
         {
           LOG_DEBUG_CC(context, "PEER SUPPORTS FLUFFY BLOCKS - RELAYING THIN/COMPACT WHATEVER BLOCK");
           fluffyConnections.push_back(context.m_connection_id);
@@ -1740,7 +1910,9 @@ skip:
       return true;
     });
 
-    // send fluffy ones first, we want to encourage people to run that
+    // send compact and fluffy ones first, we want to encourage people to run that
+    if (!compactConnections.empty())
+      m_p2p->relay_notify_to_list(NOTIFY_NEW_COMPACT_BLOCK::ID, compactBlob, compactConnections);
     m_p2p->relay_notify_to_list(NOTIFY_NEW_FLUFFY_BLOCK::ID, fluffyBlob, fluffyConnections);
     m_p2p->relay_notify_to_list(NOTIFY_NEW_BLOCK::ID, fullBlob, fullConnections);
 
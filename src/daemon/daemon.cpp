@@ -32,6 +32,7 @@
 #include <memory>
 #include <stdexcept>
 #include <boost/algorithm/string/split.hpp>
+#include <boost/filesystem/path.hpp>
 #include "misc_log_ex.h"
 #include "daemon/daemon.h"
 #include "rpc/daemon_handler.h"
@@ -43,6 +44,7 @@
 #include "daemon/p2p.h"
 #include "daemon/protocol.h"
 #include "daemon/rpc.h"
+#include "rpc/light_wallet_service.h"
 #include "daemon/command_server.h"
 #include "daemon/command_server.h"
 #include "daemon/command_line_args.h"
@@ -63,6 +65,7 @@ private:
 public:
   t_core core;
   t_p2p p2p;
+  std::unique_ptr<cryptonote::light_wallet_service> light_wallet;
   std::vector<std::unique_ptr<t_rpc>> rpcs;
 
   t_internals(
@@ -88,6 +91,20 @@ public:
       auto restricted_rpc_port = command_line::get_arg(vm, restricted_rpc_port_arg);
       rpcs.emplace_back(new t_rpc{vm, core, p2p, true, testnet ? cryptonote::TESTNET : stagenet ? cryptonote::STAGENET : cryptonote::MAINNET, restricted_rpc_port, "restricted"});
     }
+
+    // one light wallet index is shared by all RPC servers, restricted ones do not serve it
+    if (command_line::get_arg(vm, cryptonote::light_wallet_service::arg_light_wallet_service))
+    {
+      boost::filesystem::path light_wallet_dir = command_line::get_arg(vm, cryptonote::arg_data_dir);
+      const std::string config_subdir = core.get_config_subdir();
+      if (!config_subdir.empty())
+        light_wallet_dir /= config_subdir;
+      light_wallet_dir /= "lightwallet";
+      light_wallet.reset(new cryptonote::light_wallet_service{core.get(), testnet ? cryptonote::TESTNET : stagenet ? cryptonote::STAGENET : cryptonote::MAINNET, light_wallet_dir.string(),
+          command_line::get_arg(vm, cryptonote::light_wallet_service::arg_light_wallet_max_accounts)});
+      for (auto& rpc: rpcs)
+        rpc->get_server()->set_light_wallet_service(light_wallet.get());
+    }
   }
 };
 
@@ -143,6 +160,9 @@ bool t_daemon::run(bool interactive)
     if (!mp_internals->core.run())
       return false;
 
+    if (mp_internals->light_wallet && !mp_internals->light_wallet->init())
+      return false;
+
     for(auto& rpc: mp_internals->rpcs)
       rpc->run();
 
@@ -186,6 +206,8 @@ bool t_daemon::run(bool interactive)
 
     for(auto& rpc : mp_internals->rpcs)
       rpc->stop();
+    if (mp_internals->light_wallet)
+      mp_internals->light_wallet->deinit();
     mp_internals->core.get().get_miner().stop();
     MGINFO("Node stopped.");
     return true;
@@ -212,6 +234,8 @@ void t_daemon::stop()
   mp_internals->p2p.stop();
   for(auto& rpc : mp_internals->rpcs)
     rpc->stop();
+  if (mp_internals->light_wallet)
+    mp_internals->light_wallet->deinit();
 
   mp_internals.reset(nullptr); // Ensure resources are cleaned up before we return
 }
@@ -502,7 +502,11 @@ bool t_rpc_command_executor::mining_status()
   if (mining_busy || !mres.active)
     tools::msg_writer() << "Not currently mining";
   else
+  {
     tools::msg_writer() << "Mining at " << get_mining_speed(mres.speed) << " with " << mres.threads_count << " threads";
+    for (size_t i = 0; i < mres.threads_speed.size(); ++i)
+      tools::msg_writer() << "  thread " << i << ": " << get_mining_speed(mres.threads_speed[i]);
+  }
 
   if (mres.active || mres.is_background_mining_enabled)
   {
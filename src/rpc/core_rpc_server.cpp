@@ -62,8 +62,13 @@ using namespace epee;
 #define MAX_RESTRICTED_FAKE_OUTS_COUNT 40
 #define MAX_RESTRICTED_GLOBAL_FAKE_OUTS_COUNT 5000
 
+#define MAX_RESTRICTED_LISTING_PAGE_SIZE 1000 // safex listing entries per page on restricted RPC
+
 #define OUTPUT_HISTOGRAM_RECENT_CUTOFF_RESTRICTION (3 * 86400) // 3 days max, the wallet requests 1.8 days
 
+#define GETBLOCKTEMPLATE_LONG_POLL_TIMEOUT 60 // seconds
+#define GETBLOCKTEMPLATE_MAX_LONG_POLLS 4 // per RPC server, each one holds a server thread
+
 namespace
 {
   void add_reason(std::string &reasons, const char *reason)
@@ -72,6 +77,23 @@ namespace
       reasons += ", ";
     reasons += reason;
   }
+
+  // max_limit bounds the page size, including "no limit" requests, unless it is 0
+  bool make_listing_page(const uint64_t limit, const std::string &start_after, const uint64_t max_limit, safex::listing_page &page)
+  {
+    page.limit = max_limit && (limit == 0 || limit > max_limit) ? max_limit : limit;
+    return start_after.empty() || epee::string_tools::parse_hexstr_to_binbuff(start_after, page.start_after);
+  }
+
+  // identifies a block template by its parent and transaction set, the only
+  // parts a miner cares about besides the timestamp
+  std::string get_block_template_id(const cryptonote::block &b)
+  {
+    std::string data(reinterpret_cast<const char*>(&b.prev_id), sizeof(b.prev_id));
+    for (const crypto::hash &tx_hash: b.tx_hashes)
+      data.append(reinterpret_cast<const char*>(&tx_hash), sizeof(tx_hash));
+    return epee::string_tools::pod_to_hex(crypto::cn_fast_hash(data.data(), data.size()));
+  }
 }
 
 namespace cryptonote
@@ -85,6 +107,7 @@ namespace cryptonote
     command_line::add_arg(desc, arg_restricted_rpc);
     command_line::add_arg(desc, arg_bootstrap_daemon_address);
     command_line::add_arg(desc, arg_bootstrap_daemon_login);
+    light_wallet_service::init_options(desc);
     cryptonote::rpc_args::init_options(desc);
   }
   //------------------------------------------------------------------------------------------------------------------------------
@@ -94,6 +117,8 @@ namespace cryptonote
     )
     : m_core(cr)
     , m_p2p(p2p)
+    , m_light_wallet_service(nullptr)
+    , m_long_polls(0)
   {}
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::init(
@@ -164,13 +189,18 @@ namespace cryptonote
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_SAFEX_ACCOUNTS>(invoke_http_mode::JON, "/get_safex_accounts", req, res, r))
         return r;
 
+    safex::listing_page page;
     std::vector<std::pair<std::string, std::string>> accounts;
-    bool result  = m_core.get_safex_accounts(accounts);
+    if (!make_listing_page(req.limit, req.start_after, m_restricted ? MAX_RESTRICTED_LISTING_PAGE_SIZE : 0, page) || !m_core.get_safex_accounts(accounts, page)) {
+        res.status = "Failed to get safex accounts";
+        return true;
+    }
 
     for(auto acc: accounts) {
         COMMAND_RPC_GET_SAFEX_ACCOUNTS::entry ent{acc.first, acc.second};
         res.accounts.push_back(ent);
     }
+    res.next = epee::string_tools::buff_to_hex_nodelimer(page.next);
     res.status = CORE_RPC_STATUS_OK;
     return true;
   }
@@ -182,16 +212,26 @@ namespace cryptonote
         if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_SAFEX_OFFERS>(invoke_http_mode::JON, "/get_safex_offers", req, res, r))
             return r;
 
+        safex::safex_offer_filter filter;
+        filter.seller = req.seller;
+        filter.only_active = req.only_active;
+        if (!req.price_peg_id.empty()) {
+            filter.price_peg_used = true;
+            if (!epee::string_tools::hex_to_pod(req.price_peg_id, filter.price_peg_id)) {
+                res.status = "Failed to parse price peg id";
+                return true;
+            }
+        }
+
+        safex::listing_page page;
         std::vector<safex::safex_offer> offers;
-        bool result  = m_core.get_safex_offers(offers);
+        if (!make_listing_page(req.limit, req.start_after, m_restricted ? MAX_RESTRICTED_LISTING_PAGE_SIZE : 0, page) || !m_core.get_safex_offers(offers, filter, page)) {
+            res.status = "Failed to get safex offers";
+            return true;
+        }
 
         for(auto offer: offers) {
-              if(offer.seller != req.seller && req.seller != "")
-                continue;
-              uint64_t offer_height;
-              result = m_core.get_safex_offer_height(offer.offer_id, offer_height);
-              if(!result)
-                  continue;
+              const uint64_t offer_height = offer.height;
               std::string offer_id_str = epee::string_tools::pod_to_hex(offer.offer_id);
               std::string price_peg_id_str = epee::string_tools::pod_to_hex(offer.price_peg_id);
               COMMAND_RPC_GET_SAFEX_OFFERS::entry ent{offer.title, offer.quantity, offer.price, offer.min_sfx_price, offer.description,
@@ -199,6 +239,7 @@ namespace cryptonote
                                                       offer.seller_address, offer_height};
               res.offers.push_back(ent);
         }
+        res.next = epee::string_tools::buff_to_hex_nodelimer(page.next);
         res.status = CORE_RPC_STATUS_OK;
         return true;
     }
@@ -210,16 +251,26 @@ namespace cryptonote
         if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_SAFEX_OFFERS_JSON>(invoke_http_mode::JON, "/get_safex_offers_json", req, res, r))
             return r;
 
+        safex::safex_offer_filter filter;
+        filter.seller = req.seller;
+        filter.only_active = req.only_active;
+        if (!req.price_peg_id.empty()) {
+            filter.price_peg_used = true;
+            if (!epee::string_tools::hex_to_pod(req.price_peg_id, filter.price_peg_id)) {
+                res.status = "Failed to parse price peg id";
+                return true;
+            }
+        }
+
+        safex::listing_page page;
         std::vector<safex::safex_offer> offers;
-        bool result  = m_core.get_safex_offers(offers);
+        if (!make_listing_page(req.limit, req.start_after, m_restricted ? MAX_RESTRICTED_LISTING_PAGE_SIZE : 0, page) || !m_core.get_safex_offers(offers, filter, page)) {
+            res.status = "Failed to get safex offers";
+            return true;
+        }
 
         for(auto offer: offers) {
-            if(offer.seller != req.seller && req.seller != "")
-                continue;
-            uint64_t offer_height;
-            result = m_core.get_safex_offer_height(offer.offer_id, offer_height);
-            if(!result)
-                continue;
+            const uint64_t offer_height = offer.height;
             std::string offer_id_str = epee::string_tools::pod_to_hex(offer.offer_id);
             std::string price_peg_id_str = epee::string_tools::pod_to_hex(offer.price_peg_id);
 
@@ -230,6 +281,7 @@ namespace cryptonote
                                                     seller_address, offer_height};
             res.offers.push_back(ent);
         }
+        res.next = epee::string_tools::buff_to_hex_nodelimer(page.next);
         res.status = CORE_RPC_STATUS_OK;
         return true;
     }
@@ -242,14 +294,19 @@ namespace cryptonote
       if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_SAFEX_PRICE_PEGS>(invoke_http_mode::JON, "/get_safex_price_pegs", req, res, r))
         return r;
 
+      safex::listing_page page;
       std::vector<safex::safex_price_peg> price_pegs;
-      bool result  = m_core.get_safex_price_pegs(price_pegs,req.currency);
+      if (!make_listing_page(req.limit, req.start_after, m_restricted ? MAX_RESTRICTED_LISTING_PAGE_SIZE : 0, page) || !m_core.get_safex_price_pegs(price_pegs, req.currency, page)) {
+        res.status = "Failed to get safex price pegs";
+        return true;
+      }
 
       for(auto price_peg: price_pegs) {
           std::string price_peg_id_str = epee::string_tools::pod_to_hex(price_peg.price_peg_id);
           COMMAND_RPC_GET_SAFEX_PRICE_PEGS::entry ent{price_peg.title,price_peg_id_str,price_peg.creator,price_peg.description,price_peg.currency,price_peg.rate};
           res.price_pegs.push_back(ent);
       }
+      res.next = epee::string_tools::buff_to_hex_nodelimer(page.next);
       res.status = CORE_RPC_STATUS_OK;
       return true;
     }
@@ -261,14 +318,37 @@ namespace cryptonote
       if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_SAFEX_RATINGS>(invoke_http_mode::JON, "/get_safex_ratings", req, res, r))
         return r;
 
+      safex::listing_page page;
+      if (!make_listing_page(req.limit, req.start_after, m_restricted ? MAX_RESTRICTED_LISTING_PAGE_SIZE : 0, page)) {
+        res.status = "Failed to get safex ratings";
+        return true;
+      }
+
       std::vector<safex::safex_feedback> feedbacks;
-      bool result  = m_core.get_safex_feedbacks(feedbacks, req.offer_id);
+      safex::safex_offer_rating rating{};
+      bool have_rating;
+      {
+        // the ratings and their summary come from the same state of the database
+        cryptonote::db_snapshot snapshot(m_core.get_blockchain_storage().get_db());
+        if (!m_core.get_safex_feedbacks(feedbacks, req.offer_id, page)) {
+          res.status = "Failed to get safex ratings";
+          return true;
+        }
+        have_rating = m_core.get_safex_offer_rating(req.offer_id, rating);
+      }
 
       for(auto feedback: feedbacks) {
         COMMAND_RPC_GET_SAFEX_RATINGS::entry ent{feedback.stars_given,feedback.comment};
         res.ratings.push_back(ent);
       }
-      res.offer_id = feedbacks.at(0).offer_id;
+
+      if (have_rating) {
+        res.ratings_count = rating.count;
+        res.average_rating = (rating.stars_sum * COIN)/rating.count;
+        res.stars_histogram.assign(std::begin(rating.stars_histogram), std::end(rating.stars_histogram));
+      }
+      res.offer_id = req.offer_id;
+      res.next = epee::string_tools::buff_to_hex_nodelimer(page.next);
       res.status = CORE_RPC_STATUS_OK;
       return true;
     }
@@ -325,6 +405,14 @@ namespace cryptonote
     res.status = CORE_RPC_STATUS_OK;
     res.start_time = (uint64_t)m_core.get_start_time();
     res.free_space = m_restricted ? std::numeric_limits<uint64_t>::max() : m_core.get_free_space();
+    if (!m_restricted)
+    {
+      const cryptonote::db_snapshot_stats db_stats = m_core.get_blockchain_storage().get_db().get_snapshot_stats();
+      res.db_readers = db_stats.readers;
+      res.db_max_readers = db_stats.max_readers;
+      res.db_snapshots = db_stats.active;
+      res.db_snapshots_expired = db_stats.expired;
+    }
     res.offline = m_core.offline();
     res.bootstrap_daemon_address = m_bootstrap_daemon_address;
     res.height_without_bootstrap = res.height;
@@ -844,6 +932,7 @@ namespace cryptonote
       if(b.size() != sizeof(crypto::key_image))
       {
         res.status = "Failed, size of data mismatch";
+        return true;
       }
       key_images.push_back(*reinterpret_cast<const crypto::key_image*>(b.data()));
     }
@@ -859,33 +948,17 @@ namespace cryptonote
       res.spent_status.push_back(spent_status[n] ? COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_BLOCKCHAIN : COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT);
 
     // check the pool too
-    std::vector<cryptonote::tx_info> txs;
-    std::vector<cryptonote::spent_key_image_info> ki;
-    r = m_core.get_pool_transactions_and_spent_keys_info(txs, ki, !request_has_rpc_origin || !m_restricted);
+    std::vector<bool> pool_spent_status;
+    r = m_core.are_key_images_spent_in_pool(key_images, pool_spent_status, !request_has_rpc_origin || !m_restricted);
     if(!r)
     {
       res.status = "Failed";
       return true;
     }
-    for (std::vector<cryptonote::spent_key_image_info>::const_iterator i = ki.begin(); i != ki.end(); ++i)
+    for (size_t n = 0; n < res.spent_status.size(); ++n)
     {
-      crypto::hash hash;
-      crypto::key_image spent_key_image;
-      if (parse_hash256(i->id_hash, hash))
-      {
-        memcpy(&spent_key_image, &hash, sizeof(hash)); // a bit dodgy, should be other parse functions somewhere
-        for (size_t n = 0; n < res.spent_status.size(); ++n)
-        {
-          if (res.spent_status[n] == COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT)
-          {
-            if (key_images[n] == spent_key_image)
-            {
-              res.spent_status[n] = COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_POOL;
-              break;
-            }
-          }
-        }
-      }
+      if (res.spent_status[n] == COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT && pool_spent_status[n])
+        res.spent_status[n] = COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_POOL;
     }
 
     res.status = CORE_RPC_STATUS_OK;
@@ -1117,6 +1190,7 @@ namespace cryptonote
     if ( lMiner.is_mining() ) {
       res.speed = lMiner.get_speed();
       res.threads_count = lMiner.get_threads_count();
+      res.threads_speed = lMiner.get_threads_speed();
       const account_public_address& lMiningAdr = lMiner.get_mining_address();
       res.address = get_account_address_as_str(m_nettype, false, lMiningAdr);
       const uint8_t major_version = m_core.get_blockchain_storage().get_current_hard_fork_version();
@@ -1360,12 +1434,36 @@ namespace cryptonote
     block b = AUTO_VAL_INIT(b);
     cryptonote::blobdata blob_reserve;
     blob_reserve.resize(req.reserve_size, 0);
-    if(!m_core.get_block_template(b, info.address, res.difficulty, res.height, res.expected_reward, blob_reserve))
+    // a long poll holds an RPC thread, so restricted RPC and callers past the
+    // limit get the current template right away and are left to poll again
+    bool long_poll = false;
+    if (!m_restricted && !req.long_poll_id.empty())
     {
-      error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
-      error_resp.message = "Internal error: failed to create block template";
-      LOG_ERROR("Failed to create block template");
-      return false;
+      if (m_long_polls.fetch_add(1) < GETBLOCKTEMPLATE_MAX_LONG_POLLS)
+        long_poll = true;
+      else
+        --m_long_polls;
+    }
+    epee::misc_utils::auto_scope_leave_caller long_poll_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (long_poll) --m_long_polls;});
+    const auto long_poll_deadline = boost::chrono::steady_clock::now() + boost::chrono::seconds(GETBLOCKTEMPLATE_LONG_POLL_TIMEOUT);
+    while (true)
+    {
+      const uint64_t pool_cookie = m_core.get_pool_cookie();
+      if(!m_core.get_block_template(b, info.address, res.difficulty, res.height, res.expected_reward, blob_reserve))
+      {
+        error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
+        error_resp.message = "Internal error: failed to create block template";
+        LOG_ERROR("Failed to create block template");
+        return false;
+      }
+      res.long_poll_id = get_block_template_id(b);
+      if (!long_poll || req.long_poll_id != res.long_poll_id)
+        break;
+
+      // the caller already has this template: wait for a new tip or a pool change
+      // that may alter it (both change the pool cookie), then rebuild and compare again
+      if (!m_core.wait_for_pool_cookie_change(pool_cookie, long_poll_deadline))
+        break;
     }
     if (b.major_version >= RX_BLOCK_VERSION)
     {
@@ -1832,6 +1930,14 @@ namespace cryptonote
     res.status = CORE_RPC_STATUS_OK;
     res.start_time = (uint64_t)m_core.get_start_time();
     res.free_space = m_restricted ? std::numeric_limits<uint64_t>::max() : m_core.get_free_space();
+    if (!m_restricted)
+    {
+      const cryptonote::db_snapshot_stats db_stats = m_core.get_blockchain_storage().get_db().get_snapshot_stats();
+      res.db_readers = db_stats.readers;
+      res.db_max_readers = db_stats.max_readers;
+      res.db_snapshots = db_stats.active;
+      res.db_snapshots_expired = db_stats.expired;
+    }
     res.offline = m_core.offline();
     res.bootstrap_daemon_address = m_bootstrap_daemon_address;
     res.height_without_bootstrap = res.height;
@@ -2295,6 +2401,83 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_login(const COMMAND_RPC_LOGIN::request& req, COMMAND_RPC_LOGIN::response& res)
+  {
+    PERF_TIMER(on_login);
+    try
+    {
+      return m_light_wallet_service->login(req, res);
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Light wallet login failed: " << e.what());
+      res.status = "error";
+      res.reason = "Internal error";
+      return true;
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_import_wallet_request(const COMMAND_RPC_IMPORT_WALLET_REQUEST::request& req, COMMAND_RPC_IMPORT_WALLET_REQUEST::response& res)
+  {
+    PERF_TIMER(on_import_wallet_request);
+    try
+    {
+      return m_light_wallet_service->import_wallet_request(req, res);
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Light wallet import request failed: " << e.what());
+      res.status = "error";
+      return true;
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_address_info(const COMMAND_RPC_GET_ADDRESS_INFO::request& req, COMMAND_RPC_GET_ADDRESS_INFO::response& res)
+  {
+    PERF_TIMER(on_get_address_info);
+    try
+    {
+      return m_light_wallet_service->get_address_info(req, res);
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Light wallet get_address_info failed: " << e.what());
+      res.status = "error";
+      return true;
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_address_txs(const COMMAND_RPC_GET_ADDRESS_TXS::request& req, COMMAND_RPC_GET_ADDRESS_TXS::response& res)
+  {
+    PERF_TIMER(on_get_address_txs);
+    try
+    {
+      return m_light_wallet_service->get_address_txs(req, res);
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Light wallet get_address_txs failed: " << e.what());
+      res.status = "error";
+      return true;
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_unspent_outs(const COMMAND_RPC_GET_UNSPENT_OUTS::request& req, COMMAND_RPC_GET_UNSPENT_OUTS::response& res)
+  {
+    PERF_TIMER(on_get_unspent_outs);
+    try
+    {
+      return m_light_wallet_service->get_unspent_outs(req, res);
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Light wallet get_unspent_outs failed: " << e.what());
+      res.status = "error";
+      res.reason = "Internal error";
+      return true;
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_relay_tx(const COMMAND_RPC_RELAY_TX::request& req, COMMAND_RPC_RELAY_TX::response& res, epee::json_rpc::error& error_resp)
   {
     PERF_TIMER(on_relay_tx);
@@ -2403,36 +2586,14 @@ namespace cryptonote
         
       for (uint64_t amount: req.amounts)
       {
-        static struct D
-        {
-          boost::mutex mutex;
-          std::vector<uint64_t> cached_distribution;
-          uint64_t cached_from, cached_to, cached_start_height, cached_base;
-          bool cached;
-          D(): cached_from(0), cached_to(0), cached_start_height(0), cached_base(0), cached(false) {}
-        } d;
-        boost::unique_lock<boost::mutex> lock(d.mutex);
-
-        if (d.cached && amount == 0 && d.cached_from == req.from_height && d.cached_to == req.to_height)
-        {
-          res.distributions.push_back({amount, d.cached_start_height, d.cached_distribution, d.cached_base});
-          continue;
-        }
-
         std::vector<uint64_t> distribution;
         uint64_t start_height, base;
-        if (!m_core.get_output_distribution(amount, output_type, req.from_height, start_height, distribution, base))
+        if (!m_core.get_output_distribution(amount, output_type, req.from_height, req.to_height, start_height, distribution, base))
         {
           error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
           error_resp.message = "Failed to get rct distribution";
           return false;
         }
-        if (req.to_height > 0 && req.to_height >= req.from_height)
-        {
-          uint64_t offset = std::max(req.from_height, start_height);
-          if (offset <= req.to_height && req.to_height - offset + 1 < distribution.size())
-            distribution.resize(req.to_height - offset + 1);
-        }
         if (req.cumulative)
         {
           distribution[0] += base;
@@ -2440,17 +2601,10 @@ namespace cryptonote
             distribution[n] += distribution[n-1];
         }
 
-        if (amount == 0)
-        {
-          d.cached_from = req.from_height;
-          d.cached_to = req.to_height;
-          d.cached_distribution = distribution;
-          d.cached_start_height = start_height;
-          d.cached_base = base;
-          d.cached = true;
-        }
-
-        res.distributions.push_back({amount, start_height, std::move(distribution), base});
+        if (req.compress)
+          res.distributions.push_back({amount, start_height, std::vector<uint64_t>(), base, compress_integer_array(distribution)});
+        else
+          res.distributions.push_back({amount, start_height, std::move(distribution), base, std::string()});
       }
     }
     catch (const std::exception &e)
@@ -31,12 +31,14 @@
 
 #pragma  once 
 
+#include <atomic>
 #include <boost/program_options/options_description.hpp>
 #include <boost/program_options/variables_map.hpp>
 
 #include "net/http_server_impl_base.h"
 #include "net/http_client.h"
 #include "core_rpc_server_commands_defs.h"
+#include "light_wallet_service.h"
 #include "cryptonote_core/cryptonote_core.h"
 #include "p2p/net_node.h"
 #include "cryptonote_protocol/cryptonote_protocol_handler.h"
@@ -75,6 +77,7 @@ namespace cryptonote
         const std::string& port
       );
     network_type nettype() const { return m_nettype; }
+    void set_light_wallet_service(light_wallet_service *service) { m_light_wallet_service = service; }
 
     CHAIN_HTTP_TO_MAP2(connection_context); //forward http requests to uri map
 
@@ -135,6 +138,11 @@ namespace cryptonote
       MAP_URI_AUTO_JON2_IF("/stop_save_graph", on_stop_save_graph, COMMAND_RPC_STOP_SAVE_GRAPH, !m_restricted)
       MAP_URI_AUTO_JON2("/get_outs", on_get_outs, COMMAND_RPC_GET_OUTPUTS)      
       MAP_URI_AUTO_JON2_IF("/update", on_update, COMMAND_RPC_UPDATE, !m_restricted)
+      MAP_URI_AUTO_JON2_IF("/login", on_login, COMMAND_RPC_LOGIN, m_light_wallet_service && !m_restricted)
+      MAP_URI_AUTO_JON2_IF("/import_wallet_request", on_import_wallet_request, COMMAND_RPC_IMPORT_WALLET_REQUEST, m_light_wallet_service && !m_restricted)
+      MAP_URI_AUTO_JON2_IF("/get_address_info", on_get_address_info, COMMAND_RPC_GET_ADDRESS_INFO, m_light_wallet_service && !m_restricted)
+      MAP_URI_AUTO_JON2_IF("/get_address_txs", on_get_address_txs, COMMAND_RPC_GET_ADDRESS_TXS, m_light_wallet_service && !m_restricted)
+      MAP_URI_AUTO_JON2_IF("/get_unspent_outs", on_get_unspent_outs, COMMAND_RPC_GET_UNSPENT_OUTS, m_light_wallet_service && !m_restricted)
       BEGIN_JSON_RPC_MAP("/json_rpc")
         MAP_JON_RPC("get_block_count",           on_getblockcount,              COMMAND_RPC_GETBLOCKCOUNT)
         MAP_JON_RPC("getblockcount",             on_getblockcount,              COMMAND_RPC_GETBLOCKCOUNT)
@@ -224,6 +232,11 @@ namespace cryptonote
     bool on_start_save_graph(const COMMAND_RPC_START_SAVE_GRAPH::request& req, COMMAND_RPC_START_SAVE_GRAPH::response& res);
     bool on_stop_save_graph(const COMMAND_RPC_STOP_SAVE_GRAPH::request& req, COMMAND_RPC_STOP_SAVE_GRAPH::response& res);
     bool on_update(const COMMAND_RPC_UPDATE::request& req, COMMAND_RPC_UPDATE::response& res);
+    bool on_login(const COMMAND_RPC_LOGIN::request& req, COMMAND_RPC_LOGIN::response& res);
+    bool on_import_wallet_request(const COMMAND_RPC_IMPORT_WALLET_REQUEST::request& req, COMMAND_RPC_IMPORT_WALLET_REQUEST::response& res);
+    bool on_get_address_info(const COMMAND_RPC_GET_ADDRESS_INFO::request& req, COMMAND_RPC_GET_ADDRESS_INFO::response& res);
+    bool on_get_address_txs(const COMMAND_RPC_GET_ADDRESS_TXS::request& req, COMMAND_RPC_GET_ADDRESS_TXS::response& res);
+    bool on_get_unspent_outs(const COMMAND_RPC_GET_UNSPENT_OUTS::request& req, COMMAND_RPC_GET_UNSPENT_OUTS::response& res);
     
     //json_rpc
     bool on_getblockcount(const COMMAND_RPC_GETBLOCKCOUNT::request& req, COMMAND_RPC_GETBLOCKCOUNT::response& res);
@@ -275,6 +288,8 @@ private:
     bool m_was_bootstrap_ever_used;
     network_type m_nettype;
     bool m_restricted;
+    light_wallet_service *m_light_wallet_service;
+    std::atomic<unsigned> m_long_polls;
   };
 }
 
@@ -34,6 +34,7 @@
 #include "cryptonote_basic/cryptonote_basic.h"
 #include "cryptonote_basic/difficulty.h"
 #include "crypto/hash.h"
+#include "common/varint.h"
 
 namespace cryptonote
 {
@@ -54,7 +55,7 @@ namespace cryptonote
 // advance which version they will stop working with
 // Don't go over 32767 for any of these
 #define CORE_RPC_VERSION_MAJOR 1
-#define CORE_RPC_VERSION_MINOR 19
+#define CORE_RPC_VERSION_MINOR 25
 #define MAKE_CORE_RPC_VERSION(major,minor) (((major)<<16)|(minor))
 #define CORE_RPC_VERSION MAKE_CORE_RPC_VERSION(CORE_RPC_VERSION_MAJOR, CORE_RPC_VERSION_MINOR)
 
@@ -85,7 +86,12 @@ namespace cryptonote
     {
         struct request_t
         {
+            uint64_t limit; //0 for all accounts, restricted RPC returns at most a server defined page
+            std::string start_after; //`next` of previous page
+
             BEGIN_KV_SERIALIZE_MAP()
+              KV_SERIALIZE_OPT(limit, (uint64_t)0)
+              KV_SERIALIZE(start_after)
             END_KV_SERIALIZE_MAP()
         };
         typedef epee::misc_utils::struct_init<request_t> request;
@@ -104,11 +110,13 @@ namespace cryptonote
         struct response_t
         {
             std::vector<entry> accounts;
+            std::string next; //continuation token, empty on last page
             std::string status;
             bool untrusted;
 
         BEGIN_KV_SERIALIZE_MAP()
                 KV_SERIALIZE(accounts)
+                KV_SERIALIZE(next)
                 KV_SERIALIZE(status)
                 KV_SERIALIZE(untrusted);
             END_KV_SERIALIZE_MAP()
@@ -121,8 +129,16 @@ namespace cryptonote
         struct request_t
         {
             std::string seller = "";
+            bool only_active;
+            std::string price_peg_id;
+            uint64_t limit; //0 for all offers, restricted RPC returns at most a server defined page
+            std::string start_after; //`next` of previous page
             BEGIN_KV_SERIALIZE_MAP()
               KV_SERIALIZE(seller);
+              KV_SERIALIZE_OPT(only_active, false)
+              KV_SERIALIZE(price_peg_id)
+              KV_SERIALIZE_OPT(limit, (uint64_t)0)
+              KV_SERIALIZE(start_after)
             END_KV_SERIALIZE_MAP()
         };
         typedef epee::misc_utils::struct_init<request_t> request;
@@ -163,11 +179,13 @@ namespace cryptonote
         struct response_t
         {
             std::vector<entry> offers;
+            std::string next; //continuation token, empty on last page
             std::string status;
             bool untrusted;
 
         BEGIN_KV_SERIALIZE_MAP()
                 KV_SERIALIZE(offers)
+                KV_SERIALIZE(next)
                 KV_SERIALIZE(status)
                 KV_SERIALIZE(untrusted);
             END_KV_SERIALIZE_MAP()
@@ -181,8 +199,16 @@ namespace cryptonote
         struct request_t
         {
             std::string seller = "";
+            bool only_active;
+            std::string price_peg_id;
+            uint64_t limit; //0 for all offers, restricted RPC returns at most a server defined page
+            std::string start_after; //`next` of previous page
             BEGIN_KV_SERIALIZE_MAP()
             KV_SERIALIZE(seller);
+            KV_SERIALIZE_OPT(only_active, false)
+            KV_SERIALIZE(price_peg_id)
+            KV_SERIALIZE_OPT(limit, (uint64_t)0)
+            KV_SERIALIZE(start_after)
             END_KV_SERIALIZE_MAP()
         };
         typedef epee::misc_utils::struct_init<request_t> request;
@@ -223,11 +249,13 @@ namespace cryptonote
         struct response_t
         {
             std::vector<entry> offers;
+            std::string next; //continuation token, empty on last page
             std::string status;
             bool untrusted;
 
             BEGIN_KV_SERIALIZE_MAP()
             KV_SERIALIZE(offers)
+            KV_SERIALIZE(next)
             KV_SERIALIZE(status)
             KV_SERIALIZE(untrusted);
             END_KV_SERIALIZE_MAP()
@@ -240,9 +268,13 @@ namespace cryptonote
         struct request_t
         {
             std::string currency;
+            uint64_t limit; //0 for all price pegs, restricted RPC returns at most a server defined page
+            std::string start_after; //`next` of previous page
 
             BEGIN_KV_SERIALIZE_MAP()
               KV_SERIALIZE(currency)
+              KV_SERIALIZE_OPT(limit, (uint64_t)0)
+              KV_SERIALIZE(start_after)
             END_KV_SERIALIZE_MAP()
         };
         typedef epee::misc_utils::struct_init<request_t> request;
@@ -269,11 +301,13 @@ namespace cryptonote
         struct response_t
         {
             std::vector<entry> price_pegs;
+            std::string next; //continuation token, empty on last page
             std::string status;
             bool untrusted;
 
         BEGIN_KV_SERIALIZE_MAP()
               KV_SERIALIZE(price_pegs)
+              KV_SERIALIZE(next)
               KV_SERIALIZE(status)
               KV_SERIALIZE(untrusted);
             END_KV_SERIALIZE_MAP()
@@ -286,9 +320,13 @@ namespace cryptonote
         struct request_t
         {
             crypto::hash offer_id;
+            uint64_t limit; //0 for all ratings, restricted RPC returns at most a server defined page
+            std::string start_after; //`next` of previous page
 
           BEGIN_KV_SERIALIZE_MAP()
               KV_SERIALIZE_VAL_POD_AS_BLOB(offer_id)
+              KV_SERIALIZE_OPT(limit, (uint64_t)0)
+              KV_SERIALIZE(start_after)
             END_KV_SERIALIZE_MAP()
         };
         typedef epee::misc_utils::struct_init<request_t> request;
@@ -307,13 +345,21 @@ namespace cryptonote
         struct response_t
         {
             crypto::hash offer_id;
+            uint64_t ratings_count; //over all feedbacks of the offer, not only this page
+            uint64_t average_rating; //multiplied by COIN
+            std::vector<uint64_t> stars_histogram; //number of feedbacks per star rating
             std::vector<entry> ratings;
+            std::string next; //continuation token, empty on last page
             std::string status;
             bool untrusted;
 
         BEGIN_KV_SERIALIZE_MAP()
                 KV_SERIALIZE_VAL_POD_AS_BLOB(offer_id)
+                KV_SERIALIZE(ratings_count)
+                KV_SERIALIZE(average_rating)
+                KV_SERIALIZE(stars_histogram)
                 KV_SERIALIZE(ratings)
+                KV_SERIALIZE(next)
                 KV_SERIALIZE(status)
                 KV_SERIALIZE(untrusted);
             END_KV_SERIALIZE_MAP()
@@ -600,6 +646,7 @@ namespace cryptonote
         uint64_t transaction_height;
         uint64_t blockchain_height;
         std::list<spent_output> spent_outputs;
+        std::string status;
         BEGIN_KV_SERIALIZE_MAP()
           KV_SERIALIZE(locked_funds)
           KV_SERIALIZE(total_received)
@@ -610,6 +657,7 @@ namespace cryptonote
           KV_SERIALIZE(transaction_height)
           KV_SERIALIZE(blockchain_height)
           KV_SERIALIZE(spent_outputs)
+          KV_SERIALIZE(status)
         END_KV_SERIALIZE_MAP()
       };
   };
@@ -640,6 +688,7 @@ namespace cryptonote
       
       struct output {
         uint64_t amount;
+        uint64_t token_amount;
         std::string public_key;
         uint64_t  index;
         uint64_t global_index;
@@ -654,6 +703,7 @@ namespace cryptonote
 
         BEGIN_KV_SERIALIZE_MAP()
           KV_SERIALIZE(amount)
+          KV_SERIALIZE_OPT(token_amount, (uint64_t)0)
           KV_SERIALIZE(public_key)
           KV_SERIALIZE(index)
           KV_SERIALIZE(global_index)
@@ -1366,6 +1416,10 @@ namespace cryptonote
       uint64_t migrated_tokens;
       uint64_t issued_tokens;
       uint64_t issued_coins;
+      uint64_t db_readers;
+      uint64_t db_max_readers;
+      uint64_t db_snapshots;
+      uint64_t db_snapshots_expired;
 
 
       BEGIN_KV_SERIALIZE_MAP()
@@ -1399,6 +1453,10 @@ namespace cryptonote
         KV_SERIALIZE(migrated_tokens)
         KV_SERIALIZE(issued_tokens)
         KV_SERIALIZE(issued_coins)
+        KV_SERIALIZE(db_readers)
+        KV_SERIALIZE(db_max_readers)
+        KV_SERIALIZE(db_snapshots)
+        KV_SERIALIZE(db_snapshots_expired)
       END_KV_SERIALIZE_MAP()
     };
     typedef epee::misc_utils::struct_init<response_t> response;
@@ -1449,6 +1507,7 @@ namespace cryptonote
       std::string address;
       std::string pow_algorithm;
       bool is_background_mining_enabled;
+      std::vector<uint64_t> threads_speed;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(status)
@@ -1458,6 +1517,7 @@ namespace cryptonote
         KV_SERIALIZE(address)
         KV_SERIALIZE(pow_algorithm)
         KV_SERIALIZE(is_background_mining_enabled)
+        KV_SERIALIZE(threads_speed)
       END_KV_SERIALIZE_MAP()
     };
     typedef epee::misc_utils::struct_init<response_t> response;
@@ -1518,10 +1578,12 @@ namespace cryptonote
     {
       uint64_t reserve_size;       //max 255 bytes
       std::string wallet_address;
+      std::string long_poll_id;    //if set to the current template id, wait until the template changes (not on restricted RPC)
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(reserve_size)
         KV_SERIALIZE(wallet_address)
+        KV_SERIALIZE_OPT(long_poll_id, std::string())
       END_KV_SERIALIZE_MAP()
     };
     typedef epee::misc_utils::struct_init<request_t> request;
@@ -1535,6 +1597,7 @@ namespace cryptonote
       std::string prev_hash;
       std::string seed_hash;
       std::string next_seed_hash;
+      std::string long_poll_id;
       blobdata blocktemplate_blob;
       blobdata blockhashing_blob;
       std::string status;
@@ -1552,6 +1615,7 @@ namespace cryptonote
         KV_SERIALIZE(untrusted)
         KV_SERIALIZE(seed_hash)
         KV_SERIALIZE(next_seed_hash)
+        KV_SERIALIZE(long_poll_id)
       END_KV_SERIALIZE_MAP()
     };
     typedef epee::misc_utils::struct_init<response_t> response;
@@ -2729,6 +2793,31 @@ namespace cryptonote
     typedef epee::misc_utils::struct_init<response_t> response;
   };
 
+  inline std::string compress_integer_array(const std::vector<uint64_t> &v)
+  {
+    std::string s;
+    s.reserve(v.size());
+    for (const uint64_t i: v)
+      tools::write_varint(std::back_inserter(s), i);
+    return s;
+  }
+
+  inline bool decompress_integer_array(const std::string &s, std::vector<uint64_t> &v)
+  {
+    v.clear();
+    size_t pos = 0;
+    while (pos < s.size())
+    {
+      uint64_t i;
+      const int read = tools::read_varint(s.begin() + pos, s.end(), i);
+      if (read <= 0)
+        return false;
+      pos += read;
+      v.push_back(i);
+    }
+    return true;
+  }
+
   struct COMMAND_RPC_GET_OUTPUT_DISTRIBUTION
   {
     struct request_t
@@ -2739,6 +2828,7 @@ namespace cryptonote
       bool cumulative;
       uint64_t out_type_as_int;
       tx_out_type out_type = cryptonote::tx_out_type::out_invalid;
+      bool compress;
       
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(amounts)
@@ -2747,6 +2837,7 @@ namespace cryptonote
         KV_SERIALIZE_OPT(cumulative, false)
         KV_SERIALIZE_OPT(out_type_as_int, (uint64_t)0)
         KV_SERIALIZE_VAL_POD_AS_BLOB(out_type)
+        KV_SERIALIZE_OPT(compress, false)
       END_KV_SERIALIZE_MAP()
     };
     typedef epee::misc_utils::struct_init<request_t> request;
@@ -2757,12 +2848,14 @@ namespace cryptonote
       uint64_t start_height;
       std::vector<uint64_t> distribution;
       uint64_t base;
+      std::string compressed_data; // varint encoded distribution, set instead of distribution when compress is requested
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(amount)
         KV_SERIALIZE(start_height)
         KV_SERIALIZE_CONTAINER_POD_AS_BLOB(distribution)
         KV_SERIALIZE(base)
+        KV_SERIALIZE_OPT(compressed_data, std::string())
       END_KV_SERIALIZE_MAP()
     };
 
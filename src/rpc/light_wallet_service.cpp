@@ -0,0 +1,1202 @@
+// Copyright (c) 2018, The Safex Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/thread/locks.hpp>
+#include "misc_log_ex.h"
+#include "misc_language.h"
+#include "string_tools.h"
+#include "common/util.h"
+#include "common/threadpool.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_basic/cryptonote_basic_impl.h"
+#include "device/device.hpp"
+#include "light_wallet_service.h"
+
+#undef SAFEX_DEFAULT_LOG_CATEGORY
+#define SAFEX_DEFAULT_LOG_CATEGORY "daemon.rpc.lightwallet"
+
+#define LIGHT_WALLET_SCAN_BATCH_SIZE 100 // blocks scanned per index write
+#define LIGHT_WALLET_SCAN_IDLE_INTERVAL 1 // seconds between polls once every account is caught up
+#define LIGHT_WALLET_FEE_ESTIMATE_GRACE_BLOCKS 10
+#define LIGHT_WALLET_IMPORT_INTERVAL 60 // seconds between two rescans from genesis, over all accounts
+
+#define CHECK_LMDB(dbr, message) CHECK_AND_ASSERT_THROW_MES(!(dbr), message << ": " << mdb_strerror(dbr))
+
+namespace
+{
+#pragma pack(push, 1)
+  struct account_record
+  {
+    cryptonote::account_public_address address;
+    crypto::secret_key view_secret_key;
+    uint64_t start_height;
+    uint64_t scanned_height;
+  };
+#pragma pack(pop)
+
+  // dups are sorted on their leading height, then on the rest of the record
+  int compare_height_record(const MDB_val *a, const MDB_val *b)
+  {
+    uint64_t va, vb;
+    memcpy(&va, a->mv_data, sizeof(va));
+    memcpy(&vb, b->mv_data, sizeof(vb));
+    if (va != vb)
+      return va < vb ? -1 : 1;
+    return memcmp((const char*)a->mv_data + sizeof(va), (const char*)b->mv_data + sizeof(vb), std::min(a->mv_size, b->mv_size) - sizeof(va));
+  }
+
+  int resize_env(MDB_env *env, const char *db_path, size_t needed)
+  {
+    MDB_envinfo mei;
+    MDB_stat mst;
+    int ret;
+
+    needed = std::max(needed, (size_t)(2ul * 1024 * 1024)); // at least 2 MB
+
+    ret = mdb_env_info(env, &mei);
+    if (ret)
+      return ret;
+    ret = mdb_env_stat(env, &mst);
+    if (ret)
+      return ret;
+    uint64_t size_used = mst.ms_psize * mei.me_last_pgno;
+    uint64_t mapsize = mei.me_mapsize;
+    if (size_used + needed > mei.me_mapsize)
+    {
+      try
+      {
+        boost::filesystem::path path(db_path);
+        boost::filesystem::space_info si = boost::filesystem::space(path);
+        if(si.available < needed)
+        {
+          MERROR("!! WARNING: Insufficient free space to extend database !!: " << (si.available >> 20L) << " MB available");
+          return ENOSPC;
+        }
+      }
+      catch(...)
+      {
+        // print something but proceed.
+        MWARNING("Unable to query free disk space.");
+      }
+
+      mapsize += needed;
+    }
+    return mdb_env_set_mapsize(env, mapsize);
+  }
+
+  void put_record(MDB_txn *txn, MDB_dbi dbi, const crypto::hash &id, const void *data, size_t size)
+  {
+    MDB_val k = {sizeof(id), (void*)&id};
+    MDB_val v = {size, (void*)data};
+    int dbr = mdb_put(txn, dbi, &k, &v, MDB_NODUPDATA);
+    // rescanning a range that was already indexed finds the same records again
+    if (dbr != MDB_KEYEXIST)
+      CHECK_LMDB(dbr, "Failed to add light wallet record");
+  }
+
+  // gets the amount and key offsets of an input spending a cash or token output
+  bool get_input_ring(const cryptonote::txin_v &txin, uint8_t &token, uint64_t &amount, const std::vector<uint64_t> *&key_offsets, crypto::key_image &k_image)
+  {
+    if (txin.type() == typeid(cryptonote::txin_to_key))
+    {
+      const cryptonote::txin_to_key &in = boost::get<cryptonote::txin_to_key>(txin);
+      token = 0;
+      amount = in.amount;
+      key_offsets = &in.key_offsets;
+      k_image = in.k_image;
+      return true;
+    }
+    if (txin.type() == typeid(cryptonote::txin_token_to_key))
+    {
+      const cryptonote::txin_token_to_key &in = boost::get<cryptonote::txin_token_to_key>(txin);
+      token = 1;
+      amount = in.token_amount;
+      key_offsets = &in.key_offsets;
+      k_image = in.k_image;
+      return true;
+    }
+    if (txin.type() == typeid(cryptonote::txin_to_script))
+    {
+      const cryptonote::txin_to_script &in = boost::get<cryptonote::txin_to_script>(txin);
+      const cryptonote::tx_out_type type = boost::apply_visitor(cryptonote::tx_output_type_visitor(), txin);
+      if (type != cryptonote::tx_out_type::out_cash && type != cryptonote::tx_out_type::out_token)
+        return false;
+      token = type == cryptonote::tx_out_type::out_token;
+      amount = token ? in.token_amount : in.amount;
+      key_offsets = &in.key_offsets;
+      k_image = in.k_image;
+      return true;
+    }
+    return false;
+  }
+
+  crypto::hash get_payment_id(const cryptonote::transaction &tx, const crypto::public_key &tx_pub_key, const crypto::secret_key &view_secret_key)
+  {
+    crypto::hash payment_id = crypto::null_hash;
+    std::vector<cryptonote::tx_extra_field> tx_extra_fields;
+    cryptonote::parse_tx_extra(tx.extra, tx_extra_fields);
+    cryptonote::tx_extra_nonce extra_nonce;
+    if (!cryptonote::find_tx_extra_field_by_type(tx_extra_fields, extra_nonce))
+      return payment_id;
+
+    crypto::hash8 payment_id8;
+    if (cryptonote::get_payment_id_from_tx_extra_nonce(extra_nonce.nonce, payment_id))
+      return payment_id;
+    if (cryptonote::get_encrypted_payment_id_from_tx_extra_nonce(extra_nonce.nonce, payment_id8)
+        && hw::get_device("default").decrypt_payment_id(payment_id8, tx_pub_key, view_secret_key))
+      memcpy(payment_id.data, payment_id8.data, sizeof(payment_id8));
+    return payment_id;
+  }
+
+  class core_light_wallet_chain: public cryptonote::i_light_wallet_chain
+  {
+  public:
+    core_light_wallet_chain(cryptonote::core &cr): m_core(cr) {}
+    uint64_t get_current_blockchain_height() const { return m_core.get_current_blockchain_height(); }
+    crypto::hash get_block_id_by_height(uint64_t height) const { return m_core.get_block_id_by_height(height); }
+    bool get_blocks(uint64_t start_offset, size_t count, std::list<std::pair<cryptonote::blobdata, cryptonote::block>> &blocks, std::list<cryptonote::blobdata> &txs) const { return m_core.get_blocks(start_offset, count, blocks, txs); }
+    bool get_tx_outputs_gindexs(const crypto::hash &tx_id, std::vector<uint64_t> &indexs) const { return m_core.get_tx_outputs_gindexs(tx_id, indexs); }
+    uint64_t get_dynamic_per_kb_fee_estimate(uint64_t grace_blocks) const { return m_core.get_blockchain_storage().get_dynamic_per_kb_fee_estimate(grace_blocks); }
+
+  private:
+    cryptonote::core &m_core;
+  };
+}
+
+namespace cryptonote
+{
+  const command_line::arg_descriptor<bool> light_wallet_service::arg_light_wallet_service = {
+      "light-wallet-service"
+    , "Register light wallet view keys and serve /login, /get_address_info, /get_address_txs and /get_unspent_outs from a local index (view keys are stored unencrypted)"
+    , false
+    };
+  const command_line::arg_descriptor<uint64_t> light_wallet_service::arg_light_wallet_max_accounts = {
+      "light-wallet-max-accounts"
+    , "Maximum number of light wallet accounts that may be registered, 0 for no limit"
+    , 1000
+    };
+  //-----------------------------------------------------------------------------------
+  void light_wallet_service::init_options(boost::program_options::options_description& desc)
+  {
+    command_line::add_arg(desc, arg_light_wallet_service);
+    command_line::add_arg(desc, arg_light_wallet_max_accounts);
+  }
+  //-----------------------------------------------------------------------------------
+  light_wallet_service::light_wallet_service(core &cr, network_type nettype, const std::string &db_path, uint64_t max_accounts)
+    : m_core_chain(new core_light_wallet_chain(cr))
+    , m_chain(*m_core_chain)
+    , m_nettype(nettype)
+    , m_db_path(db_path)
+    , m_max_accounts(max_accounts)
+    , m_env(nullptr)
+    , m_last_import(0)
+    , m_stop(false)
+  {}
+  //-----------------------------------------------------------------------------------
+  light_wallet_service::light_wallet_service(i_light_wallet_chain &chain, network_type nettype, const std::string &db_path, uint64_t max_accounts)
+    : m_chain(chain)
+    , m_nettype(nettype)
+    , m_db_path(db_path)
+    , m_max_accounts(max_accounts)
+    , m_env(nullptr)
+    , m_last_import(0)
+    , m_stop(false)
+  {}
+  //-----------------------------------------------------------------------------------
+  light_wallet_service::~light_wallet_service()
+  {
+    try
+    {
+      deinit();
+    }
+    catch (...)
+    {
+      MERROR("Failed to close light wallet index");
+    }
+  }
+  //-----------------------------------------------------------------------------------
+  bool light_wallet_service::init()
+  {
+    try
+    {
+      MDB_txn *txn;
+      MDB_cursor *cur;
+      MDB_val k, v;
+      bool tx_active = false;
+      int dbr;
+
+      tools::create_directories_if_necessary(m_db_path);
+
+      dbr = mdb_env_create(&m_env);
+      CHECK_LMDB(dbr, "Failed to create LMDB environment");
+      dbr = mdb_env_set_maxdbs(m_env, 4);
+      CHECK_LMDB(dbr, "Failed to set max env dbs");
+      dbr = mdb_env_open(m_env, m_db_path.c_str(), 0, 0600);
+      CHECK_LMDB(dbr, "Failed to open light wallet database '" << m_db_path << "'");
+
+      // the index holds view secret keys in the clear, keep it to the daemon's user,
+      // including for indexes created before the files were opened with 0600
+      const boost::filesystem::path db_dir(m_db_path);
+      boost::filesystem::permissions(db_dir, boost::filesystem::owner_all);
+      for (const char *name: {"data.mdb", "lock.mdb"})
+        if (boost::filesystem::exists(db_dir / name))
+          boost::filesystem::permissions(db_dir / name, boost::filesystem::owner_read | boost::filesystem::owner_write);
+      dbr = resize_env(m_env, m_db_path.c_str(), 0);
+      CHECK_LMDB(dbr, "Failed to set env map size");
+
+      dbr = mdb_txn_begin(m_env, NULL, 0, &txn);
+      CHECK_LMDB(dbr, "Failed to create LMDB transaction");
+      epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
+      tx_active = true;
+
+      dbr = mdb_dbi_open(txn, "accounts", MDB_CREATE, &m_accounts_dbi);
+      CHECK_LMDB(dbr, "Failed to open LMDB dbi");
+      dbr = mdb_dbi_open(txn, "outputs", MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, &m_outputs_dbi);
+      CHECK_LMDB(dbr, "Failed to open LMDB dbi");
+      mdb_set_dupsort(txn, m_outputs_dbi, compare_height_record);
+      dbr = mdb_dbi_open(txn, "spends", MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, &m_spends_dbi);
+      CHECK_LMDB(dbr, "Failed to open LMDB dbi");
+      mdb_set_dupsort(txn, m_spends_dbi, compare_height_record);
+      dbr = mdb_dbi_open(txn, "blocks", MDB_CREATE | MDB_INTEGERKEY, &m_blocks_dbi);
+      CHECK_LMDB(dbr, "Failed to open LMDB dbi");
+
+      dbr = mdb_cursor_open(txn, m_accounts_dbi, &cur);
+      CHECK_LMDB(dbr, "Failed to open cursor");
+      for (dbr = mdb_cursor_get(cur, &k, &v, MDB_FIRST); dbr == 0; dbr = mdb_cursor_get(cur, &k, &v, MDB_NEXT))
+      {
+        CHECK_AND_ASSERT_THROW_MES(k.mv_size == sizeof(crypto::hash) && v.mv_size == sizeof(account_record), "Invalid light wallet account record");
+        const crypto::hash id = *(const crypto::hash*)k.mv_data;
+        account_record record;
+        memcpy(&record, v.mv_data, sizeof(record));
+        account_state &account = m_accounts[id];
+        account.address = record.address;
+        account.view_secret_key = record.view_secret_key;
+        account.start_height = record.start_height;
+        account.scanned_height = record.scanned_height;
+        account.generation = 0;
+      }
+      mdb_cursor_close(cur);
+      CHECK_AND_ASSERT_THROW_MES(dbr == MDB_NOTFOUND, "Failed to read light wallet accounts: " << mdb_strerror(dbr));
+
+      dbr = mdb_cursor_open(txn, m_outputs_dbi, &cur);
+      CHECK_LMDB(dbr, "Failed to open cursor");
+      for (dbr = mdb_cursor_get(cur, &k, &v, MDB_FIRST); dbr == 0; dbr = mdb_cursor_get(cur, &k, &v, MDB_NEXT))
+      {
+        CHECK_AND_ASSERT_THROW_MES(v.mv_size == sizeof(output_record), "Invalid light wallet output record");
+        output_record out;
+        memcpy(&out, v.mv_data, sizeof(out));
+        m_output_refs[std::make_tuple(out.token, out.amount, out.amount_index)] = {*(const crypto::hash*)k.mv_data, out.out_key, out.tx_pub_key, out.out_index};
+      }
+      mdb_cursor_close(cur);
+      CHECK_AND_ASSERT_THROW_MES(dbr == MDB_NOTFOUND, "Failed to read light wallet outputs: " << mdb_strerror(dbr));
+
+      dbr = mdb_txn_commit(txn);
+      CHECK_LMDB(dbr, "Failed to commit txn creating/opening database");
+      tx_active = false;
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to open light wallet index: " << e.what());
+      if (m_env)
+      {
+        mdb_env_close(m_env);
+        m_env = nullptr;
+      }
+      return false;
+    }
+
+    m_stop = false;
+    m_scan_thread = boost::thread(boost::bind(&light_wallet_service::scan_loop, this));
+    MGINFO("Light wallet service started, " << m_accounts.size() << " registered accounts");
+    return true;
+  }
+  //-----------------------------------------------------------------------------------
+  void light_wallet_service::deinit()
+  {
+    if (m_scan_thread.joinable())
+    {
+      m_stop = true;
+      m_scan_thread.interrupt();
+      m_scan_thread.join();
+    }
+    if (m_env)
+    {
+      mdb_dbi_close(m_env, m_accounts_dbi);
+      mdb_dbi_close(m_env, m_outputs_dbi);
+      mdb_dbi_close(m_env, m_spends_dbi);
+      mdb_dbi_close(m_env, m_blocks_dbi);
+      mdb_env_close(m_env);
+      m_env = nullptr;
+    }
+  }
+  //-----------------------------------------------------------------------------------
+  bool light_wallet_service::check_account(const std::string &address, const std::string &view_key, crypto::hash &id, account_state &account, std::string &reason) const
+  {
+    address_parse_info info;
+    if (!get_account_address_from_str(info, m_nettype, address))
+    {
+      reason = "Invalid address";
+      return false;
+    }
+    if (info.is_subaddress || info.has_payment_id)
+    {
+      reason = "Only standard addresses are supported";
+      return false;
+    }
+
+    crypto::public_key view_public_key;
+    if (!epee::string_tools::hex_to_pod(view_key, account.view_secret_key)
+        || !crypto::secret_key_to_public_key(account.view_secret_key, view_public_key)
+        || view_public_key != info.address.m_view_public_key)
+    {
+      reason = "View key does not match address";
+      return false;
+    }
+
+    account.address = info.address;
+    id = crypto::cn_fast_hash(&info.address, sizeof(info.address));
+    return true;
+  }
+  //-----------------------------------------------------------------------------------
+  bool light_wallet_service::read_account(const std::string &address, const std::string &view_key, account_state &account, std::vector<output_record> &outputs, std::vector<spend_record> &spends, std::string &reason) const
+  {
+    crypto::hash id;
+    if (!check_account(address, view_key, id, account, reason))
+      return false;
+
+    boost::shared_lock<boost::shared_mutex> lock(m_lock);
+    const auto it = m_accounts.find(id);
+    if (it == m_accounts.end())
+    {
+      reason = "Account does not exist";
+      return false;
+    }
+    account = it->second;
+
+    MDB_txn *txn;
+    bool tx_active = false;
+    int dbr = mdb_txn_begin(m_env, NULL, MDB_RDONLY, &txn);
+    CHECK_LMDB(dbr, "Failed to create LMDB transaction");
+    epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
+    tx_active = true;
+    get_account_records(txn, id, outputs, spends);
+    return true;
+  }
+  //-----------------------------------------------------------------------------------
+  bool light_wallet_service::is_output_unlocked(const output_record &out, uint64_t blockchain_height) const
+  {
+    if (out.height + CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE > blockchain_height)
+      return false;
+    if (out.unlock_time < CRYPTONOTE_MAX_BLOCK_NUMBER)
+      return blockchain_height - 1 + CRYPTONOTE_LOCKED_TX_ALLOWED_DELTA_BLOCKS >= out.unlock_time;
+    return (uint64_t)time(NULL) + CRYPTONOTE_LOCKED_TX_ALLOWED_DELTA_SECONDS >= out.unlock_time;
+  }
+  //-----------------------------------------------------------------------------------
+  void light_wallet_service::put_account(MDB_txn *txn, const crypto::hash &id, const account_state &account)
+  {
+    account_record record;
+    record.address = account.address;
+    record.view_secret_key = account.view_secret_key;
+    record.start_height = account.start_height;
+    record.scanned_height = account.scanned_height;
+
+    MDB_val k = {sizeof(id), (void*)&id};
+    MDB_val v = {sizeof(record), (void*)&record};
+    int dbr = mdb_put(txn, m_accounts_dbi, &k, &v, 0);
+    CHECK_LMDB(dbr, "Failed to store light wallet account");
+  }
+  //-----------------------------------------------------------------------------------
+  void light_wallet_service::remove_account_records(MDB_txn *txn, const crypto::hash &id, uint64_t from_height, std::vector<output_ref_key> &removed_refs)
+  {
+    for (MDB_dbi dbi: {m_outputs_dbi, m_spends_dbi})
+    {
+      MDB_cursor *cur;
+      int dbr = mdb_cursor_open(txn, dbi, &cur);
+      CHECK_LMDB(dbr, "Failed to open cursor");
+      epee::misc_utils::auto_scope_leave_caller cur_dtor = epee::misc_utils::create_scope_leave_handler([&](){mdb_cursor_close(cur);});
+
+      // records are sorted by height, so drop them from the end
+      while (true)
+      {
+        MDB_val k = {sizeof(id), (void*)&id};
+        MDB_val v;
+        dbr = mdb_cursor_get(cur, &k, &v, MDB_SET);
+        if (dbr == MDB_NOTFOUND)
+          break;
+        CHECK_LMDB(dbr, "Failed to look up light wallet records");
+        dbr = mdb_cursor_get(cur, &k, &v, MDB_LAST_DUP);
+        CHECK_LMDB(dbr, "Failed to look up light wallet records");
+
+        uint64_t height;
+        memcpy(&height, v.mv_data, sizeof(height));
+        if (height < from_height)
+          break;
+        if (dbi == m_outputs_dbi)
+        {
+          output_record out;
+          memcpy(&out, v.mv_data, sizeof(out));
+          removed_refs.push_back(std::make_tuple(out.token, out.amount, out.amount_index));
+        }
+        dbr = mdb_cursor_del(cur, 0);
+        CHECK_LMDB(dbr, "Failed to remove light wallet record");
+      }
+    }
+  }
+  //-----------------------------------------------------------------------------------
+  void light_wallet_service::get_account_records(MDB_txn *txn, const crypto::hash &id, std::vector<output_record> &outputs, std::vector<spend_record> &spends) const
+  {
+    MDB_cursor *cur;
+    int dbr;
+
+    dbr = mdb_cursor_open(txn, m_outputs_dbi, &cur);
+    CHECK_LMDB(dbr, "Failed to open cursor");
+    MDB_val k = {sizeof(id), (void*)&id};
+    MDB_val v;
+    for (dbr = mdb_cursor_get(cur, &k, &v, MDB_SET); dbr == 0; dbr = mdb_cursor_get(cur, &k, &v, MDB_NEXT_DUP))
+    {
+      outputs.push_back(output_record());
+      memcpy(&outputs.back(), v.mv_data, sizeof(output_record));
+    }
+    mdb_cursor_close(cur);
+    CHECK_AND_ASSERT_THROW_MES(dbr == MDB_NOTFOUND, "Failed to read light wallet outputs: " << mdb_strerror(dbr));
+
+    dbr = mdb_cursor_open(txn, m_spends_dbi, &cur);
+    CHECK_LMDB(dbr, "Failed to open cursor");
+    k = {sizeof(id), (void*)&id};
+    for (dbr = mdb_cursor_get(cur, &k, &v, MDB_SET); dbr == 0; dbr = mdb_cursor_get(cur, &k, &v, MDB_NEXT_DUP))
+    {
+      spends.push_back(spend_record());
+      memcpy(&spends.back(), v.mv_data, sizeof(spend_record));
+    }
+    mdb_cursor_close(cur);
+    CHECK_AND_ASSERT_THROW_MES(dbr == MDB_NOTFOUND, "Failed to read light wallet spends: " << mdb_strerror(dbr));
+  }
+  //-----------------------------------------------------------------------------------
+  void light_wallet_service::scan_loop()
+  {
+    while (!m_stop)
+    {
+      bool scanned = false;
+      try
+      {
+        scanned = scan_step();
+      }
+      catch (const std::exception &e)
+      {
+        MERROR("Light wallet scan failed: " << e.what());
+      }
+
+      if (!scanned)
+      {
+        try
+        {
+          boost::this_thread::sleep_for(boost::chrono::seconds(LIGHT_WALLET_SCAN_IDLE_INTERVAL));
+        }
+        catch (const boost::thread_interrupted&)
+        {
+          break;
+        }
+      }
+    }
+  }
+  //-----------------------------------------------------------------------------------
+  void light_wallet_service::detect_reorg(uint64_t blockchain_height)
+  {
+    MDB_txn *txn;
+    MDB_cursor *cur;
+    MDB_val k, v;
+    bool tx_active = false;
+    int dbr;
+
+    dbr = mdb_txn_begin(m_env, NULL, MDB_RDONLY, &txn);
+    CHECK_LMDB(dbr, "Failed to create LMDB transaction");
+    epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
+    tx_active = true;
+
+    dbr = mdb_cursor_open(txn, m_blocks_dbi, &cur);
+    CHECK_LMDB(dbr, "Failed to open cursor");
+    dbr = mdb_cursor_get(cur, &k, &v, MDB_LAST);
+    if (dbr == MDB_NOTFOUND)
+    {
+      mdb_cursor_close(cur);
+      return;
+    }
+    CHECK_LMDB(dbr, "Failed to look up light wallet blocks");
+
+    // walk down from the last scanned block to the first one still on the chain
+    const uint64_t top_height = *(const uint64_t*)k.mv_data;
+    uint64_t fork_height = top_height + 1;
+    while (dbr == 0)
+    {
+      const uint64_t height = *(const uint64_t*)k.mv_data;
+      if (height + 1 != fork_height)
+        break;
+      if (height < blockchain_height && m_chain.get_block_id_by_height(height) == *(const crypto::hash*)v.mv_data)
+        break;
+      fork_height = height;
+      dbr = mdb_cursor_get(cur, &k, &v, MDB_PREV);
+    }
+    mdb_cursor_close(cur);
+    mdb_txn_abort(txn);
+    tx_active = false;
+
+    if (fork_height > top_height)
+      return;
+
+    MWARNING("Chain reorganization detected, rolling light wallet index back to height " << fork_height);
+
+    dbr = resize_env(m_env, m_db_path.c_str(), 0);
+    CHECK_LMDB(dbr, "Failed to set env map size");
+    dbr = mdb_txn_begin(m_env, NULL, 0, &txn);
+    CHECK_LMDB(dbr, "Failed to create LMDB transaction");
+    tx_active = true;
+
+    std::unordered_map<crypto::hash, account_state> accounts = m_accounts;
+    std::vector<output_ref_key> removed_refs;
+    for (auto &e: accounts)
+    {
+      remove_account_records(txn, e.first, fork_height, removed_refs);
+      if (e.second.scanned_height > fork_height)
+      {
+        e.second.scanned_height = fork_height;
+        put_account(txn, e.first, e.second);
+      }
+    }
+
+    dbr = mdb_cursor_open(txn, m_blocks_dbi, &cur);
+    CHECK_LMDB(dbr, "Failed to open cursor");
+    for (dbr = mdb_cursor_get(cur, &k, &v, MDB_LAST); dbr == 0; dbr = mdb_cursor_get(cur, &k, &v, MDB_LAST))
+    {
+      if (*(const uint64_t*)k.mv_data < fork_height)
+        break;
+      dbr = mdb_cursor_del(cur, 0);
+      CHECK_LMDB(dbr, "Failed to remove light wallet block");
+    }
+    mdb_cursor_close(cur);
+    CHECK_AND_ASSERT_THROW_MES(dbr == 0 || dbr == MDB_NOTFOUND, "Failed to remove light wallet blocks: " << mdb_strerror(dbr));
+
+    dbr = mdb_txn_commit(txn);
+    CHECK_LMDB(dbr, "Failed to commit light wallet rollback");
+    tx_active = false;
+    m_accounts = std::move(accounts);
+    for (const output_ref_key &ref: removed_refs)
+      m_output_refs.erase(ref);
+  }
+  //-----------------------------------------------------------------------------------
+  void light_wallet_service::scan_account(const account_state &account, const std::vector<scan_tx> &txs, std::vector<scan_match> &matches) const
+  {
+    for (size_t t = 0; t < txs.size(); ++t)
+    {
+      const scan_tx &stx = txs[t];
+      if (stx.height < account.scanned_height)
+        continue;
+      const std::vector<tx_out> &vout = stx.tx.vout;
+      std::vector<bool> matched(vout.size(), false);
+
+      // a single derivation per tx public key covers all of the tx outputs
+      crypto::key_derivation derivation;
+      crypto::public_key out_key;
+      for (const crypto::public_key &tx_pub_key: stx.pub_keys)
+      {
+        if (!crypto::generate_key_derivation(tx_pub_key, account.view_secret_key, derivation))
+          continue;
+        for (size_t i = 0; i < vout.size(); ++i)
+        {
+          if (matched[i] || (vout[i].target.type() != typeid(txout_to_key) && vout[i].target.type() != typeid(txout_token_to_key)))
+            continue;
+          if (!crypto::derive_public_key(derivation, i, account.address.m_spend_public_key, out_key))
+            continue;
+          if (out_key == *boost::apply_visitor(destination_public_key_visitor(), vout[i].target))
+          {
+            matched[i] = true;
+            matches.push_back({t, i, tx_pub_key});
+          }
+        }
+      }
+
+      if (stx.additional_pub_keys.size() != vout.size())
+        continue;
+      for (size_t i = 0; i < vout.size(); ++i)
+      {
+        if (matched[i] || (vout[i].target.type() != typeid(txout_to_key) && vout[i].target.type() != typeid(txout_token_to_key)))
+          continue;
+        if (!crypto::generate_key_derivation(stx.additional_pub_keys[i], account.view_secret_key, derivation))
+          continue;
+        if (!crypto::derive_public_key(derivation, i, account.address.m_spend_public_key, out_key))
+          continue;
+        if (out_key == *boost::apply_visitor(destination_public_key_visitor(), vout[i].target))
+          matches.push_back({t, i, stx.additional_pub_keys[i]});
+      }
+    }
+  }
+  //-----------------------------------------------------------------------------------
+  bool light_wallet_service::scan_step()
+  {
+    // the thread pool waiter and the index transaction must not be torn down halfway
+    boost::this_thread::disable_interruption no_interruption;
+
+    const uint64_t blockchain_height = m_chain.get_current_blockchain_height();
+    std::vector<std::pair<crypto::hash, account_state>> accounts;
+    uint64_t start_height = blockchain_height;
+    {
+      boost::unique_lock<boost::shared_mutex> lock(m_lock);
+      detect_reorg(blockchain_height);
+      for (const auto &e: m_accounts)
+      {
+        if (e.second.scanned_height < blockchain_height)
+        {
+          accounts.push_back(e);
+          start_height = std::min(start_height, e.second.scanned_height);
+        }
+      }
+    }
+    if (accounts.empty())
+      return false;
+
+    std::list<std::pair<blobdata, block>> blocks;
+    std::list<blobdata> tx_blobs;
+    const size_t count = std::min<uint64_t>(blockchain_height - start_height, LIGHT_WALLET_SCAN_BATCH_SIZE);
+    if (!m_chain.get_blocks(start_height, count, blocks, tx_blobs) || blocks.empty())
+      return false;
+
+    // flatten the batch into a single list of transactions in chain order
+    std::vector<scan_tx> txs;
+    std::vector<crypto::hash> block_hashes;
+    txs.reserve(blocks.size() + tx_blobs.size());
+    auto add_tx = [&txs](transaction &tx, const crypto::hash &tx_hash, uint64_t height, uint64_t timestamp, bool coinbase)
+    {
+      txs.push_back(scan_tx());
+      scan_tx &stx = txs.back();
+      stx.height = height;
+      stx.timestamp = timestamp;
+      stx.coinbase = coinbase;
+      stx.hash = tx_hash;
+      stx.tx = std::move(tx);
+
+      std::vector<tx_extra_field> tx_extra_fields;
+      parse_tx_extra(stx.tx.extra, tx_extra_fields);
+      tx_extra_pub_key pub_key_field;
+      for (size_t pk_index = 0; find_tx_extra_field_by_type(tx_extra_fields, pub_key_field, pk_index); ++pk_index)
+        stx.pub_keys.push_back(pub_key_field.pub_key);
+      tx_extra_additional_pub_keys additional_pub_keys;
+      if (find_tx_extra_field_by_type(tx_extra_fields, additional_pub_keys))
+        stx.additional_pub_keys = std::move(additional_pub_keys.data);
+    };
+
+    auto tx_blob = tx_blobs.begin();
+    uint64_t height = start_height;
+    for (auto &b: blocks)
+    {
+      block_hashes.push_back(get_block_hash(b.second));
+      const crypto::hash miner_tx_hash = get_transaction_hash(b.second.miner_tx);
+      add_tx(b.second.miner_tx, miner_tx_hash, height, b.second.timestamp, true);
+      for (const crypto::hash &tx_hash: b.second.tx_hashes)
+      {
+        CHECK_AND_ASSERT_MES(tx_blob != tx_blobs.end(), false, "Missing transactions for block " << height);
+        transaction tx;
+        CHECK_AND_ASSERT_MES(parse_and_validate_tx_from_blob(*tx_blob++, tx), false, "Failed to parse transaction " << tx_hash);
+        add_tx(tx, tx_hash, height, b.second.timestamp, false);
+      }
+      ++height;
+    }
+    const uint64_t end_height = height;
+
+    // match outputs for all accounts in parallel, each worker taking a slice of the accounts
+    std::vector<std::vector<scan_match>> matches(accounts.size());
+    tools::threadpool &tpool = tools::threadpool::getInstance();
+    tools::threadpool::waiter waiter;
+    const size_t threads = std::max(1, tpool.get_max_concurrency());
+    const size_t slice = (accounts.size() + threads - 1) / threads;
+    for (size_t first = 0; first < accounts.size(); first += slice)
+    {
+      const size_t last = std::min(accounts.size(), first + slice);
+      tpool.submit(&waiter, [this, &accounts, &txs, &matches, first, last]() {
+        for (size_t a = first; a < last; ++a)
+          scan_account(accounts[a].second, txs, matches[a]);
+      });
+    }
+    waiter.wait();
+
+    boost::unique_lock<boost::shared_mutex> lock(m_lock);
+
+    // the chain may have moved under us while scanning, the next step will catch up
+    if (m_chain.get_block_id_by_height(end_height - 1) != block_hashes.back())
+      return true;
+
+    // accounts removed or rescanned meanwhile are left out of this batch
+    std::unordered_map<crypto::hash, size_t> batch_accounts;
+    std::vector<std::vector<std::pair<size_t, const scan_match*>>> tx_matches(txs.size());
+    size_t n_matches = 0;
+    for (size_t a = 0; a < accounts.size(); ++a)
+    {
+      const auto it = m_accounts.find(accounts[a].first);
+      if (it == m_accounts.end() || it->second.generation != accounts[a].second.generation)
+        continue;
+      batch_accounts[accounts[a].first] = a;
+      for (const scan_match &match: matches[a])
+        tx_matches[match.tx].push_back(std::make_pair(a, &match));
+      n_matches += matches[a].size();
+    }
+
+    MDB_txn *txn;
+    bool tx_active = false;
+    int dbr = resize_env(m_env, m_db_path.c_str(), blocks.size() * 64 + n_matches * (sizeof(output_record) + 8 * sizeof(spend_record)));
+    CHECK_LMDB(dbr, "Failed to set env map size");
+    dbr = mdb_txn_begin(m_env, NULL, 0, &txn);
+    CHECK_LMDB(dbr, "Failed to create LMDB transaction");
+    epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
+    tx_active = true;
+
+    // outputs found in this batch only go to m_output_refs once the index write
+    // is committed, but later transactions in the batch may already spend them
+    std::map<output_ref_key, output_ref> new_refs;
+    auto find_ref = [this, &new_refs](const output_ref_key &key) -> const output_ref*
+    {
+      auto it = new_refs.find(key);
+      if (it != new_refs.end())
+        return &it->second;
+      it = m_output_refs.find(key);
+      return it == m_output_refs.end() ? nullptr : &it->second;
+    };
+
+    for (size_t t = 0; t < txs.size(); ++t)
+    {
+      const scan_tx &stx = txs[t];
+
+      // inputs whose ring references an indexed output; which of them are real
+      // spends can only be told with the spend key, so all are recorded
+      for (const txin_v &in: stx.tx.vin)
+      {
+        uint8_t token;
+        uint64_t amount;
+        const std::vector<uint64_t> *key_offsets;
+        crypto::key_image k_image;
+        if (!get_input_ring(in, token, amount, key_offsets, k_image))
+          continue;
+        for (uint64_t index: relative_output_offsets_to_absolute(*key_offsets))
+        {
+          const output_ref *ref = find_ref(std::make_tuple(token, amount, index));
+          if (!ref)
+            continue;
+          const auto a = batch_accounts.find(ref->account);
+          if (a == batch_accounts.end() || stx.height < accounts[a->second].second.scanned_height)
+            continue;
+
+          spend_record spend = AUTO_VAL_INIT(spend);
+          spend.height = stx.height;
+          spend.key_image = k_image;
+          spend.out_key = ref->out_key;
+          spend.tx_hash = stx.hash;
+          spend.tx_pub_key = ref->tx_pub_key;
+          spend.timestamp = stx.timestamp;
+          spend.unlock_time = stx.tx.unlock_time;
+          spend.amount = amount;
+          spend.out_index = ref->out_index;
+          spend.mixin = key_offsets->size() - 1;
+          spend.token = token;
+          put_record(txn, m_spends_dbi, ref->account, &spend, sizeof(spend));
+        }
+      }
+
+      if (tx_matches[t].empty())
+        continue;
+
+      std::vector<uint64_t> amount_indices;
+      CHECK_AND_ASSERT_THROW_MES(m_chain.get_tx_outputs_gindexs(stx.hash, amount_indices) && amount_indices.size() == stx.tx.vout.size(),
+          "Failed to get output indices for transaction " << stx.hash);
+      const crypto::hash tx_prefix_hash = get_transaction_prefix_hash(stx.tx);
+      for (const auto &m: tx_matches[t])
+      {
+        const crypto::hash &id = accounts[m.first].first;
+        const scan_match &match = *m.second;
+        const tx_out &vout = stx.tx.vout[match.out];
+
+        output_record out = AUTO_VAL_INIT(out);
+        out.height = stx.height;
+        out.out_key = *boost::apply_visitor(destination_public_key_visitor(), vout.target);
+        out.tx_hash = stx.hash;
+        out.tx_prefix_hash = tx_prefix_hash;
+        out.tx_pub_key = match.tx_pub_key;
+        out.payment_id = get_payment_id(stx.tx, match.tx_pub_key, accounts[m.first].second.view_secret_key);
+        out.timestamp = stx.timestamp;
+        out.unlock_time = stx.tx.unlock_time;
+        out.token = vout.target.type() == typeid(txout_token_to_key);
+        out.amount = out.token ? vout.token_amount : vout.amount;
+        out.amount_index = amount_indices[match.out];
+        out.out_index = match.out;
+        out.coinbase = stx.coinbase;
+        put_record(txn, m_outputs_dbi, id, &out, sizeof(out));
+        new_refs[std::make_tuple(out.token, out.amount, out.amount_index)] = {id, out.out_key, out.tx_pub_key, out.out_index};
+      }
+    }
+
+    for (size_t i = 0; i < block_hashes.size(); ++i)
+    {
+      uint64_t block_height = start_height + i;
+      MDB_val k = {sizeof(block_height), (void*)&block_height};
+      MDB_val v = {sizeof(crypto::hash), (void*)&block_hashes[i]};
+      dbr = mdb_put(txn, m_blocks_dbi, &k, &v, 0);
+      CHECK_LMDB(dbr, "Failed to store light wallet block");
+    }
+
+    std::vector<std::pair<crypto::hash, account_state>> updated;
+    for (const auto &e: batch_accounts)
+    {
+      account_state account = m_accounts[e.first];
+      account.scanned_height = std::max(account.scanned_height, end_height);
+      put_account(txn, e.first, account);
+      updated.push_back(std::make_pair(e.first, account));
+    }
+
+    dbr = mdb_txn_commit(txn);
+    CHECK_LMDB(dbr, "Failed to commit light wallet scan");
+    tx_active = false;
+
+    for (const auto &e: updated)
+      m_accounts[e.first] = e.second;
+    for (auto &e: new_refs)
+      m_output_refs[e.first] = e.second;
+
+    MDEBUG("Scanned blocks " << start_height << "-" << end_height - 1 << " for " << batch_accounts.size() << " light wallet accounts, " << n_matches << " outputs found");
+    return true;
+  }
+  //-----------------------------------------------------------------------------------
+  bool light_wallet_service::login(const COMMAND_RPC_LOGIN::request &req, COMMAND_RPC_LOGIN::response &res)
+  {
+    crypto::hash id;
+    account_state account;
+    res.new_address = false;
+    if (!check_account(req.address, req.view_key, id, account, res.reason))
+    {
+      res.status = "error";
+      return true;
+    }
+
+    boost::unique_lock<boost::shared_mutex> lock(m_lock);
+    if (m_accounts.find(id) == m_accounts.end())
+    {
+      if (!req.create_account)
+      {
+        res.status = "error";
+        res.reason = "Account does not exist";
+        return true;
+      }
+      // every account costs a key derivation per transaction scanned
+      if (m_max_accounts > 0 && m_accounts.size() >= m_max_accounts)
+      {
+        res.status = "error";
+        res.reason = "Too many accounts";
+        return true;
+      }
+
+      // new accounts only care about blocks from now on, /import_wallet_request rescans from genesis
+      account.start_height = account.scanned_height = m_chain.get_current_blockchain_height();
+      account.generation = 0;
+
+      MDB_txn *txn;
+      bool tx_active = false;
+      int dbr = resize_env(m_env, m_db_path.c_str(), 0);
+      CHECK_LMDB(dbr, "Failed to set env map size");
+      dbr = mdb_txn_begin(m_env, NULL, 0, &txn);
+      CHECK_LMDB(dbr, "Failed to create LMDB transaction");
+      epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
+      tx_active = true;
+      put_account(txn, id, account);
+      dbr = mdb_txn_commit(txn);
+      CHECK_LMDB(dbr, "Failed to commit light wallet account");
+      tx_active = false;
+
+      m_accounts[id] = account;
+      res.new_address = true;
+      MINFO("Registered light wallet account " << req.address << " at height " << account.start_height);
+    }
+
+    res.status = "success";
+    return true;
+  }
+  //-----------------------------------------------------------------------------------
+  bool light_wallet_service::import_wallet_request(const COMMAND_RPC_IMPORT_WALLET_REQUEST::request &req, COMMAND_RPC_IMPORT_WALLET_REQUEST::response &res)
+  {
+    crypto::hash id;
+    account_state account;
+    std::string reason;
+    res.import_fee = 0;
+    res.new_request = false;
+    res.request_fulfilled = false;
+    if (!check_account(req.address, req.view_key, id, account, reason))
+    {
+      res.status = reason;
+      return true;
+    }
+
+    boost::unique_lock<boost::shared_mutex> lock(m_lock);
+    const auto it = m_accounts.find(id);
+    if (it == m_accounts.end())
+    {
+      res.status = "Account does not exist";
+      return true;
+    }
+
+    // imports are free here, the account is simply rescanned from genesis
+    if (it->second.start_height > 0)
+    {
+      const time_t now = time(NULL);
+      if (now < m_last_import + LIGHT_WALLET_IMPORT_INTERVAL)
+      {
+        res.status = "Too many import requests, try again later";
+        return true;
+      }
+
+      account = it->second;
+      account.start_height = account.scanned_height = 0;
+      ++account.generation;
+
+      MDB_txn *txn;
+      bool tx_active = false;
+      int dbr = resize_env(m_env, m_db_path.c_str(), 0);
+      CHECK_LMDB(dbr, "Failed to set env map size");
+      dbr = mdb_txn_begin(m_env, NULL, 0, &txn);
+      CHECK_LMDB(dbr, "Failed to create LMDB transaction");
+      epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
+      tx_active = true;
+      std::vector<output_ref_key> removed_refs;
+      remove_account_records(txn, id, 0, removed_refs);
+      put_account(txn, id, account);
+      dbr = mdb_txn_commit(txn);
+      CHECK_LMDB(dbr, "Failed to commit light wallet account");
+      tx_active = false;
+
+      for (const output_ref_key &ref: removed_refs)
+        m_output_refs.erase(ref);
+
+      it->second = account;
+      m_last_import = now;
+      res.new_request = true;
+      MINFO("Light wallet account " << req.address << " will be rescanned from genesis");
+    }
+
+    res.request_fulfilled = true;
+    res.status = "success";
+    return true;
+  }
+  //-----------------------------------------------------------------------------------
+  bool light_wallet_service::get_address_info(const COMMAND_RPC_GET_ADDRESS_INFO::request &req, COMMAND_RPC_GET_ADDRESS_INFO::response &res)
+  {
+    account_state account;
+    std::vector<output_record> outputs;
+    std::vector<spend_record> spends;
+    std::string reason;
+    const uint64_t blockchain_height = m_chain.get_current_blockchain_height();
+    if (!read_account(req.address, req.view_key, account, outputs, spends, reason))
+    {
+      MWARNING("get_address_info: " << reason);
+      res.status = "error";
+      return true;
+    }
+
+    res.locked_funds = 0;
+    res.total_received = 0;
+    res.total_sent = 0;
+    for (const output_record &out: outputs)
+    {
+      if (out.token)
+        continue;
+      res.total_received += out.amount;
+      if (!is_output_unlocked(out, blockchain_height))
+        res.locked_funds += out.amount;
+    }
+    for (const spend_record &spend: spends)
+    {
+      if (spend.token)
+        continue;
+      res.total_sent += spend.amount;
+      COMMAND_RPC_GET_ADDRESS_INFO::spent_output so;
+      so.amount = spend.amount;
+      so.key_image = epee::string_tools::pod_to_hex(spend.key_image);
+      so.tx_pub_key = epee::string_tools::pod_to_hex(spend.tx_pub_key);
+      so.out_index = spend.out_index;
+      so.mixin = spend.mixin;
+      res.spent_outputs.push_back(so);
+    }
+
+    res.scanned_height = account.scanned_height;
+    res.scanned_block_height = account.scanned_height;
+    res.start_height = account.start_height;
+    res.transaction_height = blockchain_height;
+    res.blockchain_height = blockchain_height;
+    res.status = "success";
+    return true;
+  }
+  //-----------------------------------------------------------------------------------
+  bool light_wallet_service::get_address_txs(const COMMAND_RPC_GET_ADDRESS_TXS::request &req, COMMAND_RPC_GET_ADDRESS_TXS::response &res)
+  {
+    account_state account;
+    std::vector<output_record> outputs;
+    std::vector<spend_record> spends;
+    std::string reason;
+    const uint64_t blockchain_height = m_chain.get_current_blockchain_height();
+    if (!read_account(req.address, req.view_key, account, outputs, spends, reason))
+    {
+      MWARNING("get_address_txs: " << reason);
+      res.status = "error";
+      return true;
+    }
+
+    // group by transaction, in chain order
+    std::map<std::pair<uint64_t, std::string>, COMMAND_RPC_GET_ADDRESS_TXS::transaction> txs;
+    for (const output_record &out: outputs)
+    {
+      const std::string tx_hash = epee::string_tools::pod_to_hex(out.tx_hash);
+      COMMAND_RPC_GET_ADDRESS_TXS::transaction &tx = txs[std::make_pair(out.height, tx_hash)];
+      tx.hash = tx_hash;
+      tx.timestamp = out.timestamp;
+      tx.unlock_time = out.unlock_time;
+      tx.height = out.height;
+      tx.payment_id = epee::string_tools::pod_to_hex(out.payment_id);
+      tx.coinbase = out.coinbase;
+      const bool unlocked = is_output_unlocked(out, blockchain_height);
+      if (out.token)
+      {
+        tx.token_total_received += out.amount;
+        tx.token_transaction = true;
+        res.token_total_received += out.amount;
+        if (unlocked)
+          res.token_total_received_unlocked += out.amount;
+      }
+      else
+      {
+        tx.total_received += out.amount;
+        res.total_received += out.amount;
+        if (unlocked)
+          res.total_received_unlocked += out.amount;
+      }
+    }
+    for (const spend_record &spend: spends)
+    {
+      const std::string tx_hash = epee::string_tools::pod_to_hex(spend.tx_hash);
+      COMMAND_RPC_GET_ADDRESS_TXS::transaction &tx = txs[std::make_pair(spend.height, tx_hash)];
+      if (tx.hash.empty())
+      {
+        tx.hash = tx_hash;
+        tx.timestamp = spend.timestamp;
+        tx.unlock_time = spend.unlock_time;
+        tx.height = spend.height;
+        tx.payment_id = epee::string_tools::pod_to_hex(crypto::null_hash);
+      }
+      tx.mixin = spend.mixin;
+
+      COMMAND_RPC_GET_ADDRESS_TXS::spent_output so;
+      so.amount = spend.token ? 0 : spend.amount;
+      so.token_amount = spend.token ? spend.amount : 0;
+      so.key_image = epee::string_tools::pod_to_hex(spend.key_image);
+      so.tx_pub_key = epee::string_tools::pod_to_hex(spend.tx_pub_key);
+      so.out_index = spend.out_index;
+      so.mixin = spend.mixin;
+      tx.spent_outputs.push_back(so);
+      if (spend.token)
+      {
+        tx.token_total_sent += spend.amount;
+        tx.token_transaction = true;
+      }
+      else
+      {
+        tx.total_sent += spend.amount;
+      }
+    }
+
+    uint64_t id = 0;
+    for (auto &e: txs)
+    {
+      e.second.id = id++;
+      e.second.mempool = false;
+      res.transactions.push_back(std::move(e.second));
+    }
+
+    res.scanned_height = account.scanned_height;
+    res.scanned_block_height = account.scanned_height;
+    res.blockchain_height = blockchain_height;
+    res.status = "success";
+    return true;
+  }
+  //-----------------------------------------------------------------------------------
+  bool light_wallet_service::get_unspent_outs(const COMMAND_RPC_GET_UNSPENT_OUTS::request &req, COMMAND_RPC_GET_UNSPENT_OUTS::response &res)
+  {
+    account_state account;
+    std::vector<output_record> outputs;
+    std::vector<spend_record> spends;
+    uint64_t min_amount = 0, dust_threshold = 0;
+    res.amount = 0;
+    res.per_kb_fee = 0;
+    if ((!req.amount.empty() && !epee::string_tools::get_xtype_from_string(min_amount, req.amount))
+        || (!req.use_dust && !req.dust_threshold.empty() && !epee::string_tools::get_xtype_from_string(dust_threshold, req.dust_threshold)))
+    {
+      res.status = "error";
+      res.reason = "Invalid amount";
+      return true;
+    }
+    if (!read_account(req.address, req.view_key, account, outputs, spends, res.reason))
+    {
+      res.status = "error";
+      return true;
+    }
+
+    std::unordered_map<crypto::public_key, std::vector<std::string>> spend_key_images;
+    for (const spend_record &spend: spends)
+      spend_key_images[spend.out_key].push_back(epee::string_tools::pod_to_hex(spend.key_image));
+
+    for (const output_record &out: outputs)
+    {
+      if (!out.token && (out.amount < min_amount || out.amount < dust_threshold))
+        continue;
+
+      COMMAND_RPC_GET_UNSPENT_OUTS::output o;
+      o.amount = out.token ? 0 : out.amount;
+      o.token_amount = out.token ? out.amount : 0;
+      o.public_key = epee::string_tools::pod_to_hex(out.out_key);
+      o.index = out.out_index;
+      o.global_index = out.amount_index;
+      o.tx_hash = epee::string_tools::pod_to_hex(out.tx_hash);
+      o.tx_pub_key = epee::string_tools::pod_to_hex(out.tx_pub_key);
+      o.tx_prefix_hash = epee::string_tools::pod_to_hex(out.tx_prefix_hash);
+      const auto ki = spend_key_images.find(out.out_key);
+      if (ki != spend_key_images.end())
+        o.spend_key_images = ki->second;
+      o.timestamp = out.timestamp;
+      o.height = out.height;
+      res.outputs.push_back(std::move(o));
+      if (!out.token)
+        res.amount += out.amount;
+    }
+
+    res.per_kb_fee = m_chain.get_dynamic_per_kb_fee_estimate(LIGHT_WALLET_FEE_ESTIMATE_GRACE_BLOCKS);
+    res.status = "success";
+    return true;
+  }
+}
@@ -0,0 +1,229 @@
+// Copyright (c) 2018, The Safex Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include <lmdb.h>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/shared_mutex.hpp>
+
+#include "common/command_line.h"
+#include "crypto/crypto.h"
+#include "crypto/hash.h"
+#include "cryptonote_basic/cryptonote_basic.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "core_rpc_server_commands_defs.h"
+
+namespace cryptonote
+{
+  /**
+   * @brief the blockchain queries the light wallet service scans with
+   */
+  class i_light_wallet_chain
+  {
+  public:
+    virtual ~i_light_wallet_chain() {}
+    virtual uint64_t get_current_blockchain_height() const = 0;
+    virtual crypto::hash get_block_id_by_height(uint64_t height) const = 0;
+    virtual bool get_blocks(uint64_t start_offset, size_t count, std::list<std::pair<blobdata, block>> &blocks, std::list<blobdata> &txs) const = 0;
+    virtual bool get_tx_outputs_gindexs(const crypto::hash &tx_id, std::vector<uint64_t> &indexs) const = 0;
+    virtual uint64_t get_dynamic_per_kb_fee_estimate(uint64_t grace_blocks) const = 0;
+  };
+
+  /**
+   * @brief view key scanning service backing the light wallet RPC calls
+   *
+   * Wallets register their address and view secret key through /login.  A
+   * background thread walks each new block once for all registered accounts,
+   * splitting the accounts over the shared thread pool, and records received
+   * cash and token outputs, as well as inputs whose rings reference them, in a
+   * local LMDB index.  /get_address_info, /get_address_txs and
+   * /get_unspent_outs are then answered from that index alone.
+   *
+   * Only view keys are ever stored, so the service can tell which outputs an
+   * account received but not which of the candidate spends are real; that is
+   * left to the wallet, which can compute its own key images.
+   *
+   * The view secret keys are kept unencrypted in the index, since the scanner
+   * needs them without user interaction. Anyone able to read the index can see
+   * all incoming transactions of every account, so the index directory and its
+   * files are restricted to the user running the daemon.
+   *
+   * Each account adds to the cost of every scanned block, so the endpoints are
+   * only mapped on unrestricted RPC servers, the number of accounts is capped
+   * and rescans from genesis are rate limited.
+   */
+  class light_wallet_service
+  {
+  public:
+    static const command_line::arg_descriptor<bool> arg_light_wallet_service;
+    static const command_line::arg_descriptor<uint64_t> arg_light_wallet_max_accounts;
+
+    light_wallet_service(core &cr, network_type nettype, const std::string &db_path, uint64_t max_accounts);
+    light_wallet_service(i_light_wallet_chain &chain, network_type nettype, const std::string &db_path, uint64_t max_accounts);
+    ~light_wallet_service();
+
+    static void init_options(boost::program_options::options_description &desc);
+
+    /**
+     * @brief opens the index and starts the scanning thread
+     *
+     * Must be called after the core has been initialized.
+     */
+    bool init();
+
+    /**
+     * @brief stops the scanning thread and closes the index
+     */
+    void deinit();
+
+    bool login(const COMMAND_RPC_LOGIN::request &req, COMMAND_RPC_LOGIN::response &res);
+    bool import_wallet_request(const COMMAND_RPC_IMPORT_WALLET_REQUEST::request &req, COMMAND_RPC_IMPORT_WALLET_REQUEST::response &res);
+    bool get_address_info(const COMMAND_RPC_GET_ADDRESS_INFO::request &req, COMMAND_RPC_GET_ADDRESS_INFO::response &res);
+    bool get_address_txs(const COMMAND_RPC_GET_ADDRESS_TXS::request &req, COMMAND_RPC_GET_ADDRESS_TXS::response &res);
+    bool get_unspent_outs(const COMMAND_RPC_GET_UNSPENT_OUTS::request &req, COMMAND_RPC_GET_UNSPENT_OUTS::response &res);
+
+#pragma pack(push, 1)
+    // Both record types start with the height so that an account's entries
+    // are sorted by height, which keeps rollbacks a walk from the end
+    struct output_record
+    {
+      uint64_t height;
+      crypto::public_key out_key;
+      crypto::hash tx_hash;
+      crypto::hash tx_prefix_hash;
+      crypto::public_key tx_pub_key;
+      crypto::hash payment_id;
+      uint64_t timestamp;
+      uint64_t unlock_time;
+      uint64_t amount;
+      uint64_t amount_index;
+      uint32_t out_index;
+      uint8_t token;
+      uint8_t coinbase;
+    };
+
+    struct spend_record
+    {
+      uint64_t height;
+      crypto::key_image key_image;
+      crypto::public_key out_key; //!< the account output referenced by the ring
+      crypto::hash tx_hash;
+      crypto::public_key tx_pub_key; //!< of the referenced output
+      uint64_t timestamp;
+      uint64_t unlock_time;
+      uint64_t amount;
+      uint32_t out_index;
+      uint32_t mixin;
+      uint8_t token;
+    };
+#pragma pack(pop)
+
+  private:
+    struct account_state
+    {
+      account_public_address address;
+      crypto::secret_key view_secret_key;
+      uint64_t start_height;
+      uint64_t scanned_height;
+      uint64_t generation; //!< bumped on every rescan so in-flight batches can tell
+    };
+
+    struct output_ref
+    {
+      crypto::hash account;
+      crypto::public_key out_key;
+      crypto::public_key tx_pub_key;
+      uint32_t out_index;
+    };
+
+    // (token, amount, amount index) of an output, as referenced by input key offsets
+    typedef std::tuple<uint8_t, uint64_t, uint64_t> output_ref_key;
+
+    struct scan_tx
+    {
+      uint64_t height;
+      uint64_t timestamp;
+      bool coinbase;
+      crypto::hash hash;
+      transaction tx;
+      std::vector<crypto::public_key> pub_keys;
+      std::vector<crypto::public_key> additional_pub_keys;
+    };
+
+    struct scan_match
+    {
+      size_t tx;
+      size_t out;
+      crypto::public_key tx_pub_key;
+    };
+
+    bool check_account(const std::string &address, const std::string &view_key, crypto::hash &id, account_state &account, std::string &reason) const;
+    bool read_account(const std::string &address, const std::string &view_key, account_state &account, std::vector<output_record> &outputs, std::vector<spend_record> &spends, std::string &reason) const;
+    bool is_output_unlocked(const output_record &out, uint64_t blockchain_height) const;
+
+    void scan_loop();
+    bool scan_step();
+    void scan_account(const account_state &account, const std::vector<scan_tx> &txs, std::vector<scan_match> &matches) const;
+    void detect_reorg(uint64_t blockchain_height);
+
+    void put_account(MDB_txn *txn, const crypto::hash &id, const account_state &account);
+    void remove_account_records(MDB_txn *txn, const crypto::hash &id, uint64_t from_height, std::vector<output_ref_key> &removed_refs);
+    void get_account_records(MDB_txn *txn, const crypto::hash &id, std::vector<output_record> &outputs, std::vector<spend_record> &spends) const;
+
+    std::unique_ptr<i_light_wallet_chain> m_core_chain;
+    i_light_wallet_chain &m_chain;
+    network_type m_nettype;
+    std::string m_db_path;
+    uint64_t m_max_accounts;
+
+    MDB_env *m_env;
+    MDB_dbi m_accounts_dbi;
+    MDB_dbi m_outputs_dbi;
+    MDB_dbi m_spends_dbi;
+    MDB_dbi m_blocks_dbi;
+
+    // m_lock guards the in-memory state below and serializes index writes
+    // (and thus map resizes) against the RPC readers
+    mutable boost::shared_mutex m_lock;
+    std::unordered_map<crypto::hash, account_state> m_accounts;
+    std::map<output_ref_key, output_ref> m_output_refs;
+    time_t m_last_import;
+
+    boost::thread m_scan_thread;
+    std::atomic<bool> m_stop;
+  };
+}
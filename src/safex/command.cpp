@@ -20,7 +20,7 @@ namespace safex
 {
 
 
-  token_stake_result* token_stake::execute(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin)
+  token_stake_result* token_stake::execute(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin) const
   {
 
     execution_status result = validate(blokchainDB, txin);
@@ -37,7 +37,7 @@ namespace safex
     return cr;
   }
 
-  execution_status token_stake::validate(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin)
+  execution_status token_stake::validate(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin) const
   {
 
     //per input execution, one input could be less than SAFEX_MINIMUM_TOKEN_STAKE_AMOUNT, all inputs must be SAFEX_MINIMUM_TOKEN_STAKE_AMOUNT
@@ -49,7 +49,7 @@ namespace safex
     return execution_status::ok;
   }
 
-  token_unstake_result* token_unstake::execute(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin)
+  token_unstake_result* token_unstake::execute(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin) const
   {
 
     execution_status result = validate(blokchainDB, txin);
@@ -70,7 +70,7 @@ namespace safex
     return cr;
   }
 
-  execution_status token_unstake::validate(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin)
+  execution_status token_unstake::validate(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin) const
   {
 
     if(txin.key_offsets.size() != 1)
@@ -104,7 +104,7 @@ namespace safex
   }
 
 
-  token_collect_result* token_collect::execute(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin)
+  token_collect_result* token_collect::execute(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin) const
   {
 
     execution_status result = validate(blokchainDB, txin);
@@ -123,7 +123,7 @@ namespace safex
     return cr;
   }
 
-  execution_status token_collect::validate(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin)
+  execution_status token_collect::validate(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin) const
   {
 
     //TODO: GRKI Do not allow token_collect for now
@@ -136,7 +136,7 @@ namespace safex
   }
 
 
-  donate_fee_result* donate_fee::execute(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin)
+  donate_fee_result* donate_fee::execute(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin) const
   {
 
     execution_status result = validate(blokchainDB, txin);
@@ -150,7 +150,7 @@ namespace safex
     return cr;
   };
 
-  execution_status donate_fee::validate(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin)
+  execution_status donate_fee::validate(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin) const
   {
 
     if(!(txin.amount > 0))
@@ -161,7 +161,7 @@ namespace safex
     return execution_status::ok;
   };
 
-  simple_purchase_result* simple_purchase::execute(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin)
+  simple_purchase_result* simple_purchase::execute(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin) const
   {
 
     execution_status result = validate(blokchainDB, txin);
@@ -178,22 +178,20 @@ namespace safex
     return cr;
   };
 
-  execution_status simple_purchase::validate(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin)
+  execution_status simple_purchase::validate(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin) const
   {
-    std::unique_ptr<safex::simple_purchase> cmd = safex::safex_command_serializer::parse_safex_command<safex::simple_purchase>(txin.script);
-
     safex::safex_offer sfx_offer{};
-    if (!blokchainDB.get_offer(cmd->offer_id,sfx_offer)) {
+    if (!blokchainDB.get_offer(this->offer_id,sfx_offer)) {
         return execution_status::error_offer_non_existant;
     }
 
     if(!sfx_offer.active)
         return execution_status::error_purchase_offer_not_active;
 
-    if(sfx_offer.quantity < cmd->quantity)
+    if(sfx_offer.quantity < this->quantity)
         return execution_status::error_purchase_out_of_stock;
 
-    if(cmd->quantity==0)
+    if(this->quantity==0)
       return execution_status::error_purchase_quantity_zero;
 
     uint64_t sfx_price = sfx_offer.min_sfx_price;
@@ -203,28 +201,25 @@ namespace safex
       if (!blokchainDB.get_safex_price_peg(sfx_offer.price_peg_id,sfx_price_peg)) {
         return execution_status::error_offer_price_peg_not_existant;
       }
-      std::string rate_str = cryptonote::print_money(sfx_price_peg.rate);
-      double rate = stod(rate_str);
-
-      std::string price_str = cryptonote::print_money(sfx_offer.price);
-      double price_dbl = stod(price_str);
-
-      uint64_t pegged_price = (price_dbl*rate)*SAFEX_CASH_COIN;
+      uint64_t pegged_price = 0;
+      const uint8_t hf_version = blokchainDB.get_hard_fork_version(blokchainDB.height() - 1);
+      if (!safex::convert_pegged_price(sfx_offer.price, sfx_price_peg.rate, hf_version, pegged_price))
+        return execution_status::error_purchase_not_enough_funds;
 
       if(sfx_price < pegged_price)
         sfx_price = pegged_price;
     }
 
-    if(sfx_price * cmd->quantity > cmd->price)
+    if(sfx_price * this->quantity > this->price)
         return execution_status::error_purchase_not_enough_funds;
 
-    if(sfx_offer.get_hash() != cmd->get_offerhash())
+    if(sfx_offer.get_hash() != this->get_offerhash())
         return execution_status::error_purchase_wrong_hash;
 
     return execution_status::ok;
   };
 
-  create_account_result* create_account::execute(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin)
+  create_account_result* create_account::execute(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin) const
   {
 
     execution_status result = validate(blokchainDB, txin);
@@ -237,34 +232,32 @@ namespace safex
     return cr;
   };
 
-  execution_status create_account::validate(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin)
+  execution_status create_account::validate(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin) const
   {
     if(txin.token_amount == 0)
         return execution_status::error_account_no_tokens;
 
-    std::unique_ptr<safex::create_account> cmd = safex::safex_command_serializer::parse_safex_command<safex::create_account>(txin.script);
-
-    for (auto ch: cmd->get_username()) {
+    for (auto ch: this->get_username()) {
       if (!(std::islower(ch) || std::isdigit(ch)) && ch!='_' && ch!='-') {
         return execution_status::error_invalid_account_name;
       }
     }
 
     std::vector<uint8_t>  dummy{};
-    if (blokchainDB.get_account_data(cmd->get_username(), dummy)) {
+    if (blokchainDB.get_account_data(this->get_username(), dummy)) {
       return execution_status::error_account_already_exists;
     }
 
-    if (!crypto::check_key(cmd->get_account_key())) {
+    if (!crypto::check_key(this->get_account_key())) {
         return execution_status::error_account_pkey_invalid;
     }
 
-    if (cmd->get_username().length() > SAFEX_ACCOUNT_USERNAME_MAX_SIZE)
+    if (this->get_username().length() > SAFEX_ACCOUNT_USERNAME_MAX_SIZE)
     {
       return execution_status::error_account_data_too_big;
     }
 
-    if (cmd->get_account_data().size() > SAFEX_ACCOUNT_DATA_MAX_SIZE)
+    if (this->get_account_data().size() > SAFEX_ACCOUNT_DATA_MAX_SIZE)
     {
       return execution_status::error_account_data_too_big;
     }
@@ -272,7 +265,7 @@ namespace safex
     return execution_status::ok;
   };
 
-  edit_account_result* edit_account::execute(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin)
+  edit_account_result* edit_account::execute(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin) const
   {
 
     execution_status result = validate(blokchainDB, txin);
@@ -285,11 +278,9 @@ namespace safex
     return cr;
   };
 
-    execution_status edit_account::validate(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin)
+    execution_status edit_account::validate(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin) const
     {
 
-        std::unique_ptr<safex::edit_account> cmd = safex::safex_command_serializer::parse_safex_command<safex::edit_account>(txin.script);
-
 
         if(txin.key_offsets.size() != 1)
             return execution_status::error_account_offset_not_one;
@@ -297,7 +288,7 @@ namespace safex
         uint64_t safex_account_index = txin.key_offsets[0];
 
         std::vector<uint8_t>  dummy{};
-        if (!blokchainDB.get_account_data(cmd->get_username(), dummy)) {
+        if (!blokchainDB.get_account_data(this->get_username(), dummy)) {
             return execution_status::error_account_non_existant;
         }
 
@@ -310,7 +301,7 @@ namespace safex
           cryptonote::parse_and_validate_from_blob(accblob, account);
           std::string accusername(begin(account.username), end(account.username));
 
-          if(accusername != cmd->get_username())
+          if(accusername != this->get_username())
               return execution_status::error_invalid_account_name;
         }
         catch (...)
@@ -318,7 +309,7 @@ namespace safex
           return execution_status::error_account_non_existant;
         }
 
-        if (cmd->get_new_account_data().size() > SAFEX_ACCOUNT_DATA_MAX_SIZE)
+        if (this->get_new_account_data().size() > SAFEX_ACCOUNT_DATA_MAX_SIZE)
         {
           return execution_status::error_account_data_too_big;
         }
@@ -327,7 +318,7 @@ namespace safex
     };
 
 
-    create_offer_result* create_offer::execute(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin)
+    create_offer_result* create_offer::execute(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin) const
     {
 
         execution_status result = validate(blokchainDB, txin);
@@ -340,18 +331,16 @@ namespace safex
         return cr;
     };
 
-    execution_status create_offer::validate(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin)
+    execution_status create_offer::validate(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin) const
     {
 
-        std::unique_ptr<safex::create_offer> cmd = safex::safex_command_serializer::parse_safex_command<safex::create_offer>(txin.script);
-
         if(txin.key_offsets.size() != 1)
             return execution_status::error_offer_offset_not_one;
 
         uint64_t safex_account_index = txin.key_offsets[0];
 
         std::vector<uint8_t>  dummy{};
-        if (!blokchainDB.get_account_data(cmd->get_seller(), dummy)) {
+        if (!blokchainDB.get_account_data(this->get_seller(), dummy)) {
             return execution_status::error_account_non_existant;
         }
 
@@ -363,7 +352,7 @@ namespace safex
           const cryptonote::blobdata accblob(std::begin(od.data), std::end(od.data));
           cryptonote::parse_and_validate_from_blob(accblob, account);
 
-          if(account.username != cmd->get_seller())
+          if(account.username != this->get_seller())
               return execution_status::error_invalid_account_name;
         }
         catch (...)
@@ -373,43 +362,43 @@ namespace safex
 
 
         safex::safex_offer sfx_offer{};
-        if (blokchainDB.get_offer(cmd->get_offerid(),sfx_offer)) {
+        if (blokchainDB.get_offer(this->get_offerid(),sfx_offer)) {
             return execution_status::error_offer_already_exists;
         }
 
-        if(cmd->get_min_sfx_price() < SAFEX_OFFER_MINIMUM_PRICE){
+        if(this->get_min_sfx_price() < SAFEX_OFFER_MINIMUM_PRICE){
             return execution_status::error_offer_price_too_small;
         }
 
-        if(cmd->get_min_sfx_price() > MONEY_SUPPLY){
+        if(this->get_min_sfx_price() > MONEY_SUPPLY){
             return execution_status::error_offer_price_too_big;
         }
 
-        if(!cmd->get_price_peg_used() && cmd->get_min_sfx_price() > cmd->get_price()){
+        if(!this->get_price_peg_used() && this->get_min_sfx_price() > this->get_price()){
             return execution_status::error_offer_price_mismatch;
         }
 
-        if (cmd->get_title().size() > SAFEX_OFFER_NAME_MAX_SIZE)
+        if (this->get_title().size() > SAFEX_OFFER_NAME_MAX_SIZE)
         {
           MERROR("Offer title is bigger than max allowed " + std::to_string(SAFEX_OFFER_NAME_MAX_SIZE));
           return execution_status::error_offer_data_too_big;
         }
 
-        if (cmd->get_description().size() > SAFEX_OFFER_DATA_MAX_SIZE)
+        if (this->get_description().size() > SAFEX_OFFER_DATA_MAX_SIZE)
         {
           MERROR("Offer data is bigger than max allowed " + std::to_string(SAFEX_OFFER_DATA_MAX_SIZE));
           return execution_status::error_offer_data_too_big;
         }
 
         safex::safex_price_peg sfx_price_peg{};
-        if(cmd->get_price_peg_used() && !blokchainDB.get_safex_price_peg(cmd->get_price_peg_id(),sfx_price_peg)){
+        if(this->get_price_peg_used() && !blokchainDB.get_safex_price_peg(this->get_price_peg_id(),sfx_price_peg)){
           return execution_status::error_offer_price_peg_not_existant;
         }
 
         return execution_status::ok;
     };
 
-    edit_offer_result* edit_offer::execute(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin)
+    edit_offer_result* edit_offer::execute(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin) const
     {
         execution_status result = validate(blokchainDB, txin);
         SAFEX_COMMAND_CHECK_AND_ASSERT_THROW_MES(result == execution_status::ok, "Failed to validate edit offer command", this->get_command_type());
@@ -421,23 +410,21 @@ namespace safex
         return cr;
     };
 
-    execution_status edit_offer::validate(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin)
+    execution_status edit_offer::validate(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin) const
     {
 
-        std::unique_ptr<safex::edit_offer> cmd = safex::safex_command_serializer::parse_safex_command<safex::edit_offer>(txin.script);
-
         if(txin.key_offsets.size() != 1)
             return execution_status::error_offer_offset_not_one;
 
         uint64_t safex_offer_index = txin.key_offsets[0];
 
         std::vector<uint8_t>  dummy{};
-        if (!blokchainDB.get_account_data(cmd->get_seller(), dummy)) {
+        if (!blokchainDB.get_account_data(this->get_seller(), dummy)) {
             return execution_status::error_account_non_existant;
         }
 
         safex::safex_offer sfx_dummy{};
-        if (!blokchainDB.get_offer(cmd->get_offerid(), sfx_dummy)) {
+        if (!blokchainDB.get_offer(this->get_offerid(), sfx_dummy)) {
             return execution_status::error_offer_non_existant;
         }
 
@@ -449,7 +436,7 @@ namespace safex
           const cryptonote::blobdata offerblob(std::begin(od.data), std::end(od.data));
           cryptonote::parse_and_validate_from_blob(offerblob, offer);
 
-          if(offer.offer_id != cmd->get_offerid())
+          if(offer.offer_id != this->get_offerid())
               return execution_status::error_offer_invalid_offer_id;
         }
         catch (...)
@@ -457,39 +444,39 @@ namespace safex
           return execution_status::error_account_non_existant;
         }
 
-        if(cmd->get_min_sfx_price() < SAFEX_OFFER_MINIMUM_PRICE){
+        if(this->get_min_sfx_price() < SAFEX_OFFER_MINIMUM_PRICE){
             return execution_status::error_offer_price_too_small;
         }
 
-        if(cmd->get_min_sfx_price() > MONEY_SUPPLY){
+        if(this->get_min_sfx_price() > MONEY_SUPPLY){
             return execution_status::error_offer_price_too_big;
         }
 
-        if(!cmd->get_price_peg_used() && cmd->get_min_sfx_price() > cmd->get_price()){
+        if(!this->get_price_peg_used() && this->get_min_sfx_price() > this->get_price()){
             return execution_status::error_offer_price_mismatch;
         }
 
-        if (cmd->get_title().size() > SAFEX_OFFER_NAME_MAX_SIZE)
+        if (this->get_title().size() > SAFEX_OFFER_NAME_MAX_SIZE)
         {
           MERROR("Offer title is bigger than max allowed " + std::to_string(SAFEX_OFFER_NAME_MAX_SIZE));
           return execution_status::error_offer_data_too_big;
         }
 
-        if (cmd->get_description().size() > SAFEX_OFFER_DATA_MAX_SIZE)
+        if (this->get_description().size() > SAFEX_OFFER_DATA_MAX_SIZE)
         {
           MERROR("Offer data is bigger than max allowed " + std::to_string(SAFEX_OFFER_DATA_MAX_SIZE));
           return execution_status::error_offer_data_too_big;
         }
 
         safex::safex_price_peg sfx_price_peg{};
-        if(cmd->get_price_peg_used() && !blokchainDB.get_safex_price_peg(cmd->get_price_peg_id(),sfx_price_peg)){
+        if(this->get_price_peg_used() && !blokchainDB.get_safex_price_peg(this->get_price_peg_id(),sfx_price_peg)){
           return execution_status::error_offer_price_peg_not_existant;
         }
 
         return execution_status::ok;
     };
 
-    create_feedback_result* create_feedback::execute(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin)
+    create_feedback_result* create_feedback::execute(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin) const
     {
         execution_status result = validate(blokchainDB, txin);
         SAFEX_COMMAND_CHECK_AND_ASSERT_THROW_MES(result == execution_status::ok, "Failed to validate create feedback command", this->get_command_type());
@@ -501,11 +488,9 @@ namespace safex
         return cr;
     };
 
-    execution_status create_feedback::validate(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin)
+    execution_status create_feedback::validate(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin) const
     {
 
-        std::unique_ptr<safex::create_feedback> cmd = safex::safex_command_serializer::parse_safex_command<safex::create_feedback>(txin.script);
-
         if(txin.key_offsets.size() != 1)
             return execution_status::error_feedback_offset_not_one;
 
@@ -523,22 +508,22 @@ namespace safex
 
 
         safex::safex_offer sfx_dummy{};
-        if (!blokchainDB.get_offer(cmd->get_offerid(), sfx_dummy)) {
+        if (!blokchainDB.get_offer(this->get_offerid(), sfx_dummy)) {
             return execution_status::error_offer_non_existant;
         }
 
-        uint64_t rating_given = cmd->get_stars_given();
+        uint64_t rating_given = this->get_stars_given();
 
         if(rating_given > SAFEX_FEEDBACK_MAX_RATING )
           return execution_status::error_feedback_invalid_rating;
 
-        if(cmd->get_comment().size() > SAFEX_FEEDBACK_DATA_MAX_SIZE)
+        if(this->get_comment().size() > SAFEX_FEEDBACK_DATA_MAX_SIZE)
           return execution_status::error_feedback_data_too_big;
 
         return execution_status::ok;
     };
 
-    create_price_peg_result* create_price_peg::execute(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin)
+    create_price_peg_result* create_price_peg::execute(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin) const
     {
 
       execution_status result = validate(blokchainDB, txin);
@@ -551,13 +536,11 @@ namespace safex
       return cr;
     };
 
-    execution_status create_price_peg::validate(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin)
+    execution_status create_price_peg::validate(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin) const
     {
 
-      std::unique_ptr<safex::create_price_peg> cmd = safex::safex_command_serializer::parse_safex_command<safex::create_price_peg>(txin.script);
-
       std::vector<uint8_t>  dummy{};
-      if (!blokchainDB.get_account_data(cmd->get_creator(), dummy)) {
+      if (!blokchainDB.get_account_data(this->get_creator(), dummy)) {
           return execution_status::error_account_non_existant;
       }
 
@@ -574,7 +557,7 @@ namespace safex
         const cryptonote::blobdata accblob(std::begin(od.data), std::end(od.data));
         cryptonote::parse_and_validate_from_blob(accblob, account);
 
-        if(account.username != cmd->get_creator())
+        if(account.username != this->get_creator())
             return execution_status::error_invalid_account_name;
       }
       catch (...)
@@ -583,34 +566,34 @@ namespace safex
       }
 
       safex::safex_price_peg dummy_price_peg{};
-      if(blokchainDB.get_safex_price_peg(cmd->get_price_peg_id(),dummy_price_peg))
+      if(blokchainDB.get_safex_price_peg(this->get_price_peg_id(),dummy_price_peg))
       {
         return execution_status::error_price_peg_already_exists;
       }
 
-      if (cmd->get_title().size() > SAFEX_PRICE_PEG_NAME_MAX_SIZE)
+      if (this->get_title().size() > SAFEX_PRICE_PEG_NAME_MAX_SIZE)
       {
         return execution_status::error_price_peg_data_too_big;
       }
 
-      if (cmd->get_currency().size() > SAFEX_PRICE_PEG_CURRENCY_MAX_SIZE)
+      if (this->get_currency().size() > SAFEX_PRICE_PEG_CURRENCY_MAX_SIZE)
       {
         return execution_status::error_price_peg_data_too_big;
       }
 
-      for (auto ch: cmd->get_currency()) {
+      for (auto ch: this->get_currency()) {
         if (!std::isupper(ch)) {
           return execution_status::error_price_peg_bad_currency_format;
         }
       }
 
-      if(cmd->get_rate() == 0)
+      if(this->get_rate() == 0)
       {
           return execution_status::error_price_peg_rate_zero;
       }
 
       //check price peg data size
-      if (cmd->get_description().size() > SAFEX_PRICE_PEG_DATA_MAX_SIZE)
+      if (this->get_description().size() > SAFEX_PRICE_PEG_DATA_MAX_SIZE)
       {
         return execution_status::error_price_peg_data_too_big;
       }
@@ -618,7 +601,7 @@ namespace safex
       return execution_status::ok;
     };
 
-    update_price_peg_result* update_price_peg::execute(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin)
+    update_price_peg_result* update_price_peg::execute(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin) const
     {
 
       execution_status result = validate(blokchainDB, txin);
@@ -631,11 +614,9 @@ namespace safex
       return cr;
     };
 
-    execution_status update_price_peg::validate(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin)
+    execution_status update_price_peg::validate(const cryptonote::BlockchainDB &blokchainDB, const cryptonote::txin_to_script &txin) const
     {
 
-      std::unique_ptr<safex::update_price_peg> cmd = safex::safex_command_serializer::parse_safex_command<safex::update_price_peg>(txin.script);
-
       if(txin.key_offsets.size() != 1)
           return execution_status::error_price_peg_offset_not_one;
 
@@ -649,7 +630,7 @@ namespace safex
         const cryptonote::blobdata price_pegblob(std::begin(od.data), std::end(od.data));
         cryptonote::parse_and_validate_from_blob(price_pegblob, price_peg);
 
-        if(price_peg.price_peg_id != cmd->get_price_peg_id())
+        if(price_peg.price_peg_id != this->get_price_peg_id())
             return execution_status::error_price_peg_invalid_price_peg_id;
       }
       catch (...)
@@ -657,13 +638,13 @@ namespace safex
         return execution_status::error_account_non_existant;
       }
 
-      if(cmd->get_rate() == 0)
+      if(this->get_rate() == 0)
       {
           return execution_status::error_price_peg_rate_zero;
       }
 
       safex::safex_price_peg sfx_dummy{};
-      if (!blokchainDB.get_safex_price_peg(cmd->get_price_peg_id(), sfx_dummy)) {
+      if (!blokchainDB.get_safex_price_peg(this->get_price_peg_id(), sfx_dummy)) {
         return execution_status::error_price_peg_not_existant;
       }
 
@@ -680,7 +661,7 @@ namespace safex
           LOG_ERROR("Commands that don't have key image verification must have only 1 key offset");
           return false;
         }
-      std::unique_ptr<command> cmd = safex_command_serializer::parse_safex_object(txin.script, txin.command_type);
+      std::shared_ptr<const command> cmd = safex_command_serializer::get_safex_command(txin);
       execution_status result{cmd->validate(blokchainDB, txin)};
       if (result != execution_status::ok)
       {
@@ -704,7 +685,7 @@ namespace safex
     //parse command and execute it
     try
     {
-      std::unique_ptr<command> cmd = safex_command_serializer::parse_safex_object(txin.script, txin.command_type);
+      std::shared_ptr<const command> cmd = safex_command_serializer::get_safex_command(txin);
       std::shared_ptr<execution_result> result{cmd->execute(blokchainDB, txin)};
       if (result->status != execution_status::ok)
       {
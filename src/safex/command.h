@@ -168,7 +168,7 @@ namespace safex
 
   struct edit_account_result : public execution_result
   {
-    edit_account_result(const std::vector<uint8_t> &_username, std::vector<uint8_t>& _account_data):
+    edit_account_result(const std::vector<uint8_t> &_username, const std::vector<uint8_t>& _account_data):
             username{_username}, account_data{_account_data} {
     }
     std::vector<uint8_t> username{};
@@ -197,6 +197,8 @@ struct create_offer_result : public execution_result
     uint64_t output_id{};
     uint64_t output_id_creation{};
     bool edited{false};
+    uint64_t height{}; //height of the last edit, or of creation if offer is not edited
+    uint64_t height_creation{};
 
     BEGIN_SERIALIZE_OBJECT()
         FIELD(offer_id)
@@ -207,6 +209,8 @@ struct create_offer_result : public execution_result
         FIELD(output_id)
         FIELD(output_id_creation)
         FIELD(edited)
+        FIELD(height)
+        FIELD(height_creation)
     END_SERIALIZE()
 
 };
@@ -585,8 +589,8 @@ struct create_price_peg_result : public execution_result
 
       }
 
-      virtual execution_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) = 0;
-      virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) = 0;
+      virtual execution_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const = 0;
+      virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const = 0;
 
       uint32_t get_version() const
       { return version; }
@@ -616,8 +620,8 @@ struct create_price_peg_result : public execution_result
 
       dummy_command() :  command(0, command_t::nop) {}
 
-      virtual execution_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) override {return new execution_result{};};
-      virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) override {return execution_status::ok;};
+      virtual execution_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const override {return new execution_result{};};
+      virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const override {return execution_status::ok;};
 
       BEGIN_SERIALIZE_OBJECT()
         FIELDS(*static_cast<command *>(this))
@@ -646,8 +650,8 @@ struct create_price_peg_result : public execution_result
 
       uint64_t get_staked_token_amount() const { return stake_token_amount; }
 
-      virtual token_stake_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) override;
-      virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) override;
+      virtual token_stake_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const override;
+      virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const override;
 
       BEGIN_SERIALIZE_OBJECT()
         FIELDS(*static_cast<command *>(this))
@@ -683,8 +687,8 @@ struct create_price_peg_result : public execution_result
 
       uint64_t get_staked_token_output_index() const { return staked_token_output_index; }
 
-      virtual token_unstake_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) override;
-      virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) override;
+      virtual token_unstake_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const override;
+      virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const override;
 
       BEGIN_SERIALIZE_OBJECT()
         FIELDS(*static_cast<command*>(this))
@@ -717,8 +721,8 @@ struct create_price_peg_result : public execution_result
 
       uint64_t get_staked_token_output_index() const { return staked_token_output_index; }
 
-      virtual token_collect_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) override;
-      virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) override;
+      virtual token_collect_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const override;
+      virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const override;
 
       BEGIN_SERIALIZE_OBJECT()
         FIELDS(*static_cast<command *>(this))
@@ -747,8 +751,8 @@ struct create_price_peg_result : public execution_result
 
       uint64_t get_locked_token_output_index() const { return donation_safex_cash_amount; }
 
-      virtual donate_fee_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) override;
-      virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) override;
+      virtual donate_fee_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const override;
+      virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const override;
 
       BEGIN_SERIALIZE_OBJECT()
         FIELDS(*static_cast<command *>(this))
@@ -776,14 +780,14 @@ struct create_price_peg_result : public execution_result
 
       simple_purchase() : command(0, command_t::simple_purchase) {}
 
-      crypto::hash get_offerid(){ return offer_id; }
-      crypto::hash get_offerhash(){ return offer_hash; }
-      uint64_t get_quantity(){ return quantity; }
-      uint64_t get_price(){ return price; }
-      bool get_shipping() { return shipping; }
+      crypto::hash get_offerid() const { return offer_id; }
+      crypto::hash get_offerhash() const { return offer_hash; }
+      uint64_t get_quantity() const { return quantity; }
+      uint64_t get_price() const { return price; }
+      bool get_shipping() const { return shipping; }
 
-      virtual simple_purchase_result* execute(const cryptonote::BlockchainDB &blockchain, const cryptonote::txin_to_script &txin) override;
-      virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) override;
+      virtual simple_purchase_result* execute(const cryptonote::BlockchainDB &blockchain, const cryptonote::txin_to_script &txin) const override;
+      virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const override;
 
       BEGIN_SERIALIZE_OBJECT()
         FIELDS(*static_cast<command *>(this))
@@ -827,8 +831,8 @@ struct create_price_peg_result : public execution_result
       crypto::public_key get_account_key() const { return pkey; }
       std::vector<uint8_t> get_account_data() const { return account_data; }
 
-      virtual create_account_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) override;
-      virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) override;
+      virtual create_account_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const override;
+      virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const override;
 
       BEGIN_SERIALIZE_OBJECT()
         FIELDS(*static_cast<command *>(this))
@@ -867,8 +871,8 @@ struct create_price_peg_result : public execution_result
       std::string get_username() const { return std::string(username.begin(), username.end()); }
       std::vector<uint8_t> get_new_account_data() const { return new_account_data; }
 
-      virtual edit_account_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) override;
-      virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) override;
+      virtual edit_account_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const override;
+      virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const override;
 
       BEGIN_SERIALIZE_OBJECT()
         FIELDS(*static_cast<command *>(this))
@@ -913,8 +917,8 @@ public:
     cryptonote::account_public_address get_seller_address() const { return seller_address; }
     crypto::secret_key get_seller_private_view_key() const { return seller_private_view_key; }
 
-    virtual create_offer_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) override;
-    virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) override;
+    virtual create_offer_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const override;
+    virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const override;
 
     BEGIN_SERIALIZE_OBJECT()
         FIELDS(*static_cast<command *>(this))
@@ -977,8 +981,8 @@ public:
     std::vector<uint8_t> get_title() const { return title; };
     std::vector<uint8_t> get_description() const { return description; }
 
-    virtual edit_offer_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) override;
-    virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) override;
+    virtual edit_offer_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const override;
+    virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const override;
 
     BEGIN_SERIALIZE_OBJECT()
         FIELDS(*static_cast<command *>(this))
@@ -1027,8 +1031,8 @@ public:
     std::vector<uint8_t> get_comment() const { return comment; }
     uint8_t get_stars_given() const { return stars_given; }
 
-    virtual create_feedback_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) override;
-    virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) override;
+    virtual create_feedback_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const override;
+    virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const override;
 
     BEGIN_SERIALIZE_OBJECT()
         FIELDS(*static_cast<command *>(this))
@@ -1067,8 +1071,8 @@ public:
     std::vector<uint8_t> get_currency() const { return currency; }
     uint64_t get_rate() const { return rate; }
 
-    virtual create_price_peg_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) override;
-    virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) override;
+    virtual create_price_peg_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const override;
+    virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const override;
 
     BEGIN_SERIALIZE_OBJECT()
       FIELDS(*static_cast<command *>(this))
@@ -1109,8 +1113,8 @@ public:
     crypto::hash get_price_peg_id() const { return price_peg_id; }
     uint64_t get_rate() const { return rate; }
 
-    virtual update_price_peg_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) override;
-    virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) override;
+    virtual update_price_peg_result* execute(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const override;
+    virtual execution_status validate(const cryptonote::BlockchainDB &blokchain, const cryptonote::txin_to_script &txin) const override;
 
     BEGIN_SERIALIZE_OBJECT()
       FIELDS(*static_cast<command *>(this))
@@ -1195,6 +1199,33 @@ private:
         }
       }
 
+      /**
+       * Returns command parsed from input script. Script is parsed only on first call, parsed command is
+       * kept with the input (and its copies) for the rest of tx verification and block insertion. Code that
+       * assigns script or command type of an input must reset its parsed_command.
+       *
+       * @param txin input with the command script
+       * @return parsed command, throws command_exception if script could not be parsed
+       */
+      static std::shared_ptr<const command> get_safex_command(const cryptonote::txin_to_script &txin)
+      {
+        std::shared_ptr<const command> cached = std::atomic_load(&txin.parsed_command);
+        if (cached && cached->get_command_type() == txin.command_type)
+          return cached;
+
+        std::shared_ptr<const command> parsed(parse_safex_object(txin.script, txin.command_type).release());
+        std::atomic_store(&txin.parsed_command, parsed);
+        return parsed;
+      }
+
+      template<typename CMD>
+      static std::shared_ptr<const CMD> get_safex_command(const cryptonote::txin_to_script &txin)
+      {
+        std::shared_ptr<const CMD> cmd = std::dynamic_pointer_cast<const CMD>(get_safex_command(txin));
+        SAFEX_COMMAND_CHECK_AND_ASSERT_THROW_MES(cmd, "Could not get command, wrong command type", txin.command_type);
+        return cmd;
+      }
+
       static inline command_t get_command_type(const std::vector<uint8_t> &script)
       {
 
@@ -44,6 +44,18 @@ namespace safex
 
   };
 
+/**
+ * Cursor based paging of Safex listings. Entries are walked in table key order,
+ * start_after and next hold raw key of an entry, so a page stays valid while entries
+ * are added or removed.
+ * */
+  struct listing_page
+  {
+    uint64_t limit{0}; //maximal number of returned entries, 0 for no limit
+    std::string start_after; //key of the last entry of previous page, empty for first page
+    std::string next; //key of the last returned entry if listing continues, empty otherwise
+  };
+
 /**
 * It is indicator in transaction version 2 extra field, to ease transaction verification
 * */
@@ -102,6 +102,16 @@ namespace safex
 
 
     };
+
+    /**
+     * Feedback totals of one offer, updated whenever a feedback is added or removed
+     */
+    struct safex_offer_rating
+    {
+        uint64_t count;
+        uint64_t stars_sum;
+        uint64_t stars_histogram[SAFEX_FEEDBACK_MAX_RATING + 1];
+    };
 }
 
 
@@ -120,11 +120,27 @@ namespace safex
       std::string seller; // username of the seller
       crypto::secret_key seller_private_view_key;
       cryptonote::account_public_address seller_address;
+      uint64_t height{0}; //height of the last edit (or creation), filled in from blockchain, not serialized
+      uint64_t height_creation{0};
 
   private:
       crypto::hash create_offer_id(std::string& username);
 
   };
+
+  /**
+   * Criteria for selecting offers through the secondary offer indexes.
+   * Empty seller, only_active == false and price_peg_used == false mean "any".
+   */
+  struct safex_offer_filter
+  {
+    safex_offer_filter(): seller{}, only_active{false}, price_peg_used{false}, price_peg_id{} {}
+
+    std::string seller; //username of the seller
+    bool only_active; //return only active offers
+    bool price_peg_used; //return only offers pegged to price_peg_id
+    crypto::hash price_peg_id;
+  };
 }
 
 
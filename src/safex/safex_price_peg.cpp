@@ -3,10 +3,12 @@
 //
 
 #include <vector>
+#include <limits>
 #include <iostream>
 #include <stdint.h>
 #include <chrono>
 
+#include "common/int-util.h"
 #include "cryptonote_basic/cryptonote_format_utils.h"
 #include "cryptonote_core/cryptonote_core.h"
 #include "safex/command.h"
@@ -36,4 +38,41 @@ namespace safex
         return id;
     }
 
+    bool convert_pegged_price(const uint64_t price, const uint64_t rate, uint64_t &sfx_price)
+    {
+      static_assert(SAFEX_CASH_COIN % 100000 == 0, "SAFEX_CASH_COIN must be divisible by 100000");
+      static_assert(SAFEX_CASH_COIN / 100000 <= std::numeric_limits<uint32_t>::max(), "SAFEX_CASH_COIN is too large");
+
+      uint64_t hi, lo = mul128(price, rate, &hi);
+
+      // divide in two steps, since the divisor must be 32 bits, but SAFEX_CASH_COIN isn't
+      div128_32(hi, lo, SAFEX_CASH_COIN / 100000, &hi, &lo);
+      div128_32(hi, lo, 100000, &hi, &lo);
+      if (hi != 0)
+        return false;
+
+      sfx_price = lo;
+      return true;
+    }
+
+    uint64_t convert_pegged_price_legacy(const uint64_t price, const uint64_t rate)
+    {
+      std::string rate_str = cryptonote::print_money(rate);
+      double rate_dbl = stod(rate_str);
+
+      std::string price_str = cryptonote::print_money(price);
+      double price_dbl = stod(price_str);
+
+      return (price_dbl*rate_dbl)*SAFEX_CASH_COIN;
+    }
+
+    bool convert_pegged_price(const uint64_t price, const uint64_t rate, const uint8_t hf_version, uint64_t &sfx_price)
+    {
+      if (hf_version >= HF_VERSION_SAFEX_FIXED_POINT_PRICE_PEG)
+        return convert_pegged_price(price, rate, sfx_price);
+
+      sfx_price = convert_pegged_price_legacy(price, rate);
+      return true;
+    }
+
 }
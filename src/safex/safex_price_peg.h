@@ -91,6 +91,29 @@ namespace safex
       crypto::hash create_price_peg_id(std::string& username);
 
   };
+
+  /**
+  * Converts price in price peg currency to SFX using 128 bit integer fixed point arithmetic
+  *
+  * @param price price in atomic units of the price peg currency
+  * @param rate price peg rate, SFX for one unit of the price peg currency in atomic units
+  * @param sfx_price converted price in SFX atomic units, rounded down
+  * @return false if converted price does not fit in 64 bits
+  */
+  bool convert_pegged_price(const uint64_t price, const uint64_t rate, uint64_t &sfx_price);
+
+  /**
+  * Converts price in price peg currency to SFX through print_money/stod doubles.
+  * Kept only to validate purchases made before HF_VERSION_SAFEX_FIXED_POINT_PRICE_PEG
+  */
+  uint64_t convert_pegged_price_legacy(const uint64_t price, const uint64_t rate);
+
+  /**
+  * Converts price in price peg currency to SFX with conversion rules of given hard fork version
+  *
+  * @return false if converted price does not fit in 64 bits
+  */
+  bool convert_pegged_price(const uint64_t price, const uint64_t rate, const uint8_t hf_version, uint64_t &sfx_price);
 }
 
 
@@ -115,6 +115,9 @@ using namespace cryptonote;
 #define STAGENET_SEGREGATION_FORK_HEIGHT 10000000
 #define SEGREGATION_FORK_VICINITY 1500 /* blocks */
 
+#define CACHE_JOURNAL_MAX_ENTRIES 1000
+#define CACHE_JOURNAL_MAX_RATIO 2 // rewrite the cache once the journal grows over half its size
+
 
 
 
@@ -1546,7 +1549,10 @@ void wallet::process_new_transaction(const crypto::hash &txid, const cryptonote:
           m_callback->on_unconfirmed_money_received(height, txid, tx, payment.m_amount, payment.m_subaddr_index);
       }
       else
+      {
         m_payments.emplace(payment_id, payment);
+        cache_journal_payment(payment_id, payment);
+      }
       LOG_PRINT_L2("Payment found in " << (pool ? "pool" : "block") << ": " << payment_id << " / " << payment.m_tx_hash << " / " << payment.m_amount);
     }
 
@@ -1567,7 +1573,10 @@ void wallet::process_new_transaction(const crypto::hash &txid, const cryptonote:
           m_callback->on_unconfirmed_tokens_received(height, txid, tx, payment.m_token_amount, payment.m_subaddr_index);
       }
       else
+      {
         m_payments.emplace(payment_id, payment);
+        cache_journal_payment(payment_id, payment);
+      }
       LOG_PRINT_L2("Token payment found in " << (pool ? "pool" : "block") << ": " << payment_id << " / " << payment.m_tx_hash << " / " << payment.m_token_amount);
     }
   }
@@ -1583,6 +1592,7 @@ void wallet::process_unconfirmed(const crypto::hash &txid, const cryptonote::tra
     if (store_tx_info()) {
       try {
         m_confirmed_txs.insert(std::make_pair(txid, confirmed_transfer_details(unconf_it->second, height)));
+        cache_journal_confirmed_tx(txid);
       }
       catch (...) {
         // can fail if the tx has unexpected input types
@@ -1597,6 +1607,7 @@ void wallet::process_outgoing(const crypto::hash &txid, const cryptonote::transa
     uint32_t subaddr_account, const std::set<uint32_t>& subaddr_indices)
 {
   std::pair<std::unordered_map<crypto::hash, confirmed_transfer_details>::iterator, bool> entry = m_confirmed_txs.insert(std::make_pair(txid, confirmed_transfer_details()));
+  cache_journal_confirmed_tx(txid);
   // fill with the info we know, some info might already be there
   if (entry.second)
   {
@@ -2553,6 +2564,9 @@ void wallet::detach_blockchain(uint64_t height)
   }
   m_transfers.erase(it, m_transfers.end());
 
+  // drop offers, price pegs and feedbacks that came with the detached outputs
+  reprocess_safex_outputs();
+
   size_t blocks_detached = m_blockchain.size() - height;
   m_blockchain.crop(height);
   m_local_bc_height -= blocks_detached;
@@ -2573,6 +2587,9 @@ void wallet::detach_blockchain(uint64_t height)
       ++it;
   }
 
+  // the journal only records additions, rewrite the cache on the next store
+  invalidate_cache_journal();
+
   LOG_PRINT_L0("Detached blockchain on height " << height << ", transfers detached " << transfers_detached << ", blocks detached " << blocks_detached);
 }
 //----------------------------------------------------------------------------------------------------
@@ -2584,6 +2601,7 @@ bool wallet::deinit()
 //----------------------------------------------------------------------------------------------------
 bool wallet::clear()
 {
+  invalidate_cache_journal();
   m_blockchain.clear();
   m_transfers.clear();
   m_key_images.clear();
@@ -2604,6 +2622,7 @@ bool wallet::clear()
   m_safex_given_feedbacks.clear();
   m_safex_offers.clear();
   m_safex_price_pegs.clear();
+  rebuild_safex_indexes();
   return true;
 }
 
@@ -3523,6 +3542,7 @@ void wallet::load(const std::string& wallet_, const epee::wipeable_string& passw
     std::string buf;
     bool r = epee::file_io_utils::load_file_to_string(m_wallet_file, buf);
     THROW_WALLET_EXCEPTION_IF(!r, error::file_read_error, m_wallet_file);
+    bool journal_base = false;
 
     // try to read it as an encrypted cache
     try
@@ -3542,6 +3562,7 @@ void wallet::load(const std::string& wallet_, const epee::wipeable_string& passw
         iss << cache_data;
         boost::archive::portable_binary_iarchive ar(iss);
         ar >> *this;
+        journal_base = true;
       }
       catch (...)
       {
@@ -3589,6 +3610,14 @@ void wallet::load(const std::string& wallet_, const epee::wipeable_string& passw
       m_account_public_address.m_spend_public_key != m_account.get_keys().m_account_address.m_spend_public_key ||
       m_account_public_address.m_view_public_key  != m_account.get_keys().m_account_address.m_view_public_key,
       error::wallet_files_doesnt_correspond, m_keys_file, m_wallet_file);
+
+    // older cache formats get no journal until they are rewritten
+    if (journal_base)
+    {
+      crypto::chacha_key key;
+      generate_chacha_key_from_secret_keys(key);
+      load_cache_journal(cache_file_data.iv, cache_file_data.cache_data.size(), key);
+    }
   }
 
   if (!load_safex_keys(m_safex_keys_file, password))
@@ -3762,6 +3791,13 @@ void wallet::store_to(const std::string &path, const epee::wipeable_string &pass
       }
     }
   }
+  crypto::chacha_key key;
+  generate_chacha_key_from_secret_keys(key);
+
+  // usually only what changed since the last store needs writing
+  if (same_file && store_cache_journal(key))
+    return;
+
   // preparing wallet data
   std::stringstream oss;
   boost::archive::portable_binary_oarchive ar(oss);
@@ -3769,8 +3805,6 @@ void wallet::store_to(const std::string &path, const epee::wipeable_string &pass
 
   wallet::cache_file_data cache_file_data = boost::value_initialized<wallet::cache_file_data>();
   cache_file_data.cache_data = oss.str();
-  crypto::chacha_key key;
-  generate_chacha_key_from_secret_keys(key);
   std::string cipher;
   cipher.resize(cache_file_data.cache_data.size());
   cache_file_data.iv = crypto::rand<crypto::chacha_iv>();
@@ -3782,6 +3816,7 @@ void wallet::store_to(const std::string &path, const epee::wipeable_string &pass
   const std::string old_keys_file = m_keys_file;
   const std::string old_safex_keys_file = m_safex_keys_file;
   const std::string old_address_file = m_wallet_file + ".address.txt";
+  const std::string old_journal_file = get_cache_journal_file();
 
   // save keys to the new file
   // if we here, main wallet file is saved and we only need to save keys and address files
@@ -3818,6 +3853,10 @@ void wallet::store_to(const std::string &path, const epee::wipeable_string &pass
     if (!r) {
       LOG_ERROR("error removing file: " << old_address_file);
     }
+    // remove old cache journal, if any
+    boost::system::error_code ignored_ec;
+    boost::filesystem::remove(old_journal_file, ignored_ec);
+    invalidate_cache_journal();
   } else {
     // save to new file
 #ifdef WIN32
@@ -3841,7 +3880,371 @@ void wallet::store_to(const std::string &path, const epee::wipeable_string &pass
     // here we have "*.new" file, we need to rename it to be without ".new"
     std::error_code e = tools::replace_file(new_file, m_wallet_file);
     THROW_WALLET_EXCEPTION_IF(e, error::file_save_error, m_wallet_file, e);
+
+    // the new cache has everything journaled so far, start a new journal
+    boost::system::error_code ignored_ec;
+    boost::filesystem::remove(old_journal_file, ignored_ec);
+    reset_cache_journal(cache_file_data.iv, cache_file_data.cache_data.size());
+  }
+}
+//----------------------------------------------------------------------------------------------------
+wallet::cache_journal_transfer_state wallet::get_cache_journal_transfer_state(const transfer_details &td)
+{
+  cache_journal_transfer_state state;
+  state.txid = td.m_txid;
+  state.multisig_hash = crypto::null_hash;
+  if (!td.m_multisig_k.empty() || !td.m_multisig_info.empty())
+  {
+    std::string blob;
+    blob.append((const char*)td.m_multisig_k.data(), td.m_multisig_k.size() * sizeof(rct::key));
+    for (const multisig_info &info: td.m_multisig_info)
+    {
+      const uint64_t sizes[2] = {info.m_LR.size(), info.m_partial_key_images.size()};
+      blob.append((const char*)sizes, sizeof(sizes));
+      blob.append((const char*)&info.m_signer, sizeof(info.m_signer));
+      blob.append((const char*)info.m_LR.data(), info.m_LR.size() * sizeof(multisig_info::LR));
+      blob.append((const char*)info.m_partial_key_images.data(), info.m_partial_key_images.size() * sizeof(crypto::key_image));
+    }
+    state.multisig_hash = crypto::cn_fast_hash(blob.data(), blob.size());
+  }
+  state.key_image = td.m_key_image;
+  state.mask = td.m_mask;
+  state.block_height = td.m_block_height;
+  state.global_output_index = td.m_global_output_index;
+  state.spent_height = td.m_spent_height;
+  state.amount = td.m_amount;
+  state.token_amount = td.m_token_amount;
+  state.pk_index = td.m_pk_index;
+  state.subaddr_index = td.m_subaddr_index;
+  state.output_type = td.m_output_type;
+  state.spent = td.m_spent;
+  state.key_image_known = td.m_key_image_known;
+  state.key_image_partial = td.m_key_image_partial;
+  return state;
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet::same_cache_journal_transfer_state(const cache_journal_transfer_state &a, const cache_journal_transfer_state &b)
+{
+  return a.txid == b.txid && a.multisig_hash == b.multisig_hash && a.key_image == b.key_image && a.mask == b.mask &&
+      a.block_height == b.block_height && a.global_output_index == b.global_output_index && a.spent_height == b.spent_height &&
+      a.amount == b.amount && a.token_amount == b.token_amount && a.pk_index == b.pk_index && a.subaddr_index == b.subaddr_index &&
+      a.output_type == b.output_type && a.spent == b.spent && a.key_image_known == b.key_image_known && a.key_image_partial == b.key_image_partial;
+}
+//----------------------------------------------------------------------------------------------------
+template <class t_archive>
+void wallet::serialize_cache_journal_state(t_archive &a)
+{
+  // small parts of the state, journaled whole
+  a & m_unconfirmed_txs;
+  a & m_tx_notes;
+  a & m_address_book;
+  a & m_scanned_pool_txs[0];
+  a & m_scanned_pool_txs[1];
+  a & m_subaddress_labels;
+  a & m_attributes;
+  a & m_unconfirmed_payments;
+  a & m_account_tags;
+  a & m_ring_history_saved;
+  a & m_safex_accounts;
+  a & m_safex_offers;
+  a & m_safex_feedback_tokens;
+  a & m_safex_given_feedbacks;
+  a & m_safex_price_pegs;
+
+  if (t_archive::is_loading::value)
+    rebuild_safex_indexes();
+}
+//----------------------------------------------------------------------------------------------------
+void wallet::reset_cache_journal(const crypto::chacha_iv &base_iv, uint64_t base_size)
+{
+  m_cache_journal.valid = true;
+  m_cache_journal.base_iv = base_iv;
+  m_cache_journal.base_size = base_size;
+  m_cache_journal.size = 0;
+  m_cache_journal.entries = 0;
+  m_cache_journal.blockchain_offset = m_blockchain.offset();
+  m_cache_journal.blockchain_size = m_blockchain.size();
+  m_cache_journal.subaddresses_size = m_subaddresses.size();
+  m_cache_journal.transfers.clear();
+  m_cache_journal.transfers.reserve(m_transfers.size());
+  for (const transfer_details &td: m_transfers)
+    m_cache_journal.transfers.push_back(get_cache_journal_transfer_state(td));
+  m_cache_journal.payments.clear();
+  m_cache_journal.confirmed_txs.clear();
+  m_cache_journal.tx_keys.clear();
+}
+//----------------------------------------------------------------------------------------------------
+void wallet::cache_journal_payment(const crypto::hash &payment_id, const payment_details &payment)
+{
+  if (m_cache_journal.valid)
+    m_cache_journal.payments.push_back(std::make_pair(payment_id, payment));
+}
+//----------------------------------------------------------------------------------------------------
+void wallet::cache_journal_confirmed_tx(const crypto::hash &txid)
+{
+  if (m_cache_journal.valid)
+    m_cache_journal.confirmed_txs.insert(txid);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet::cache_journal_tx_key(const crypto::hash &txid)
+{
+  if (m_cache_journal.valid)
+    m_cache_journal.tx_keys.insert(txid);
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet::store_cache_journal(const crypto::chacha_key &key)
+{
+  if (!m_cache_journal.valid)
+    return false;
+  if (m_cache_journal.entries >= CACHE_JOURNAL_MAX_ENTRIES || m_cache_journal.size * CACHE_JOURNAL_MAX_RATIO > m_cache_journal.base_size)
+  {
+    MDEBUG("Compacting wallet cache journal: " << m_cache_journal.entries << " entries, " << m_cache_journal.size << " bytes");
+    return false;
+  }
+  // anything but growth of the hash chain and transfers needs a full rewrite
+  if (m_blockchain.offset() != m_cache_journal.blockchain_offset || m_blockchain.size() < m_cache_journal.blockchain_size ||
+      m_transfers.size() < m_cache_journal.transfers.size())
+    return false;
+
+  std::vector<std::pair<size_t, cache_journal_transfer_state>> changed_transfers;
+  for (size_t i = 0; i < m_transfers.size(); ++i)
+  {
+    cache_journal_transfer_state state = get_cache_journal_transfer_state(m_transfers[i]);
+    if (i >= m_cache_journal.transfers.size() || !same_cache_journal_transfer_state(state, m_cache_journal.transfers[i]))
+      changed_transfers.push_back(std::make_pair(i, state));
+  }
+
+  std::stringstream oss;
+  {
+    boost::archive::portable_binary_oarchive ar(oss);
+
+    const uint64_t blockchain_start = m_cache_journal.blockchain_size, blockchain_size = m_blockchain.size();
+    ar << blockchain_start << blockchain_size;
+    for (size_t n = blockchain_start; n < blockchain_size; ++n)
+      ar << m_blockchain[n];
+
+    const uint64_t transfers_size = m_transfers.size(), transfers_changed = changed_transfers.size();
+    ar << transfers_size << transfers_changed;
+    for (const auto &e: changed_transfers)
+    {
+      const uint64_t idx = e.first;
+      ar << idx << m_transfers[e.first];
+    }
+
+    const uint64_t payments = m_cache_journal.payments.size();
+    ar << payments;
+    for (const auto &e: m_cache_journal.payments)
+      ar << e.first << e.second;
+
+    std::vector<std::unordered_map<crypto::hash, confirmed_transfer_details>::const_iterator> confirmed_txs;
+    for (const crypto::hash &txid: m_cache_journal.confirmed_txs)
+    {
+      const auto i = m_confirmed_txs.find(txid);
+      if (i != m_confirmed_txs.end())
+        confirmed_txs.push_back(i);
+    }
+    const uint64_t confirmed_txs_count = confirmed_txs.size();
+    ar << confirmed_txs_count;
+    for (const auto &i: confirmed_txs)
+      ar << i->first << i->second;
+
+    std::vector<std::unordered_map<crypto::hash, crypto::secret_key>::const_iterator> tx_keys;
+    for (const crypto::hash &txid: m_cache_journal.tx_keys)
+    {
+      const auto i = m_tx_keys.find(txid);
+      if (i != m_tx_keys.end())
+        tx_keys.push_back(i);
+    }
+    const uint64_t tx_keys_count = tx_keys.size();
+    ar << tx_keys_count;
+    for (const auto &i: tx_keys)
+    {
+      const auto j = m_additional_tx_keys.find(i->first);
+      const std::vector<crypto::secret_key> additional_tx_keys = j == m_additional_tx_keys.end() ? std::vector<crypto::secret_key>() : j->second;
+      ar << i->first << i->second << additional_tx_keys;
+    }
+
+    const bool subaddresses_changed = m_subaddresses.size() != m_cache_journal.subaddresses_size;
+    ar << subaddresses_changed;
+    if (subaddresses_changed)
+      ar << m_subaddresses;
+
+    serialize_cache_journal_state(ar);
+  }
+
+  const std::string entry_data = oss.str();
+  wallet::cache_journal_record record = boost::value_initialized<wallet::cache_journal_record>();
+  record.base_iv = m_cache_journal.base_iv;
+  record.iv = crypto::rand<crypto::chacha_iv>();
+  record.entry_data.resize(entry_data.size());
+  crypto::chacha20(entry_data.data(), entry_data.size(), key, record.iv, &record.entry_data[0]);
+
+  std::ostringstream ross;
+  binary_archive<true> oar(ross);
+  if (!::serialization::serialize(oar, record) || !epee::file_io_utils::append_string_to_file(get_cache_journal_file(), ross.str()))
+  {
+    MWARNING("Failed to append to the wallet cache journal, rewriting the whole cache");
+    return false;
   }
+
+  for (auto &e: changed_transfers)
+  {
+    if (e.first < m_cache_journal.transfers.size())
+      m_cache_journal.transfers[e.first] = e.second;
+    else
+      m_cache_journal.transfers.push_back(e.second);
+  }
+  m_cache_journal.blockchain_size = m_blockchain.size();
+  m_cache_journal.subaddresses_size = m_subaddresses.size();
+  m_cache_journal.payments.clear();
+  m_cache_journal.confirmed_txs.clear();
+  m_cache_journal.tx_keys.clear();
+  m_cache_journal.size += ross.str().size();
+  ++m_cache_journal.entries;
+  MDEBUG("Appended " << changed_transfers.size() << " changed transfers to the wallet cache journal, now " << m_cache_journal.size << " bytes");
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet::apply_cache_journal_entry(const std::string &entry_data)
+{
+  std::stringstream iss;
+  iss << entry_data;
+  boost::archive::portable_binary_iarchive ar(iss);
+
+  uint64_t blockchain_start, blockchain_size;
+  ar >> blockchain_start >> blockchain_size;
+  THROW_WALLET_EXCEPTION_IF(blockchain_start < m_blockchain.offset() || blockchain_start > m_blockchain.size() || blockchain_size < blockchain_start,
+      error::wallet_internal_error, "Hash chain in cache journal does not match the wallet cache");
+  m_blockchain.crop(blockchain_start);
+  for (uint64_t n = blockchain_start; n < blockchain_size; ++n)
+  {
+    crypto::hash hash;
+    ar >> hash;
+    m_blockchain.push_back(hash);
+  }
+
+  uint64_t transfers_size, transfers_changed;
+  ar >> transfers_size >> transfers_changed;
+  THROW_WALLET_EXCEPTION_IF(transfers_size < m_transfers.size(), error::wallet_internal_error, "Transfers in cache journal do not match the wallet cache");
+  const size_t old_transfers_size = m_transfers.size();
+  m_transfers.resize(transfers_size);
+  for (uint64_t n = 0; n < transfers_changed; ++n)
+  {
+    uint64_t idx;
+    ar >> idx;
+    THROW_WALLET_EXCEPTION_IF(idx >= m_transfers.size(), error::wallet_internal_error, "Transfer index in cache journal out of range");
+    transfer_details &td = m_transfers[idx];
+    if (idx < old_transfers_size)
+    {
+      const auto ki = m_key_images.find(td.m_key_image);
+      if (ki != m_key_images.end() && ki->second == idx)
+        m_key_images.erase(ki);
+      const auto pk = m_pub_keys.find(td.get_public_key());
+      if (pk != m_pub_keys.end() && pk->second == idx)
+        m_pub_keys.erase(pk);
+    }
+    ar >> td;
+    if (td.m_key_image_known)
+      m_key_images[td.m_key_image] = idx;
+    m_pub_keys[td.get_public_key()] = idx;
+  }
+
+  uint64_t payments;
+  ar >> payments;
+  for (uint64_t n = 0; n < payments; ++n)
+  {
+    crypto::hash payment_id;
+    payment_details payment;
+    ar >> payment_id >> payment;
+    m_payments.emplace(payment_id, payment);
+  }
+
+  uint64_t confirmed_txs;
+  ar >> confirmed_txs;
+  for (uint64_t n = 0; n < confirmed_txs; ++n)
+  {
+    crypto::hash txid;
+    confirmed_transfer_details ctd;
+    ar >> txid >> ctd;
+    m_confirmed_txs[txid] = ctd;
+  }
+
+  uint64_t tx_keys;
+  ar >> tx_keys;
+  for (uint64_t n = 0; n < tx_keys; ++n)
+  {
+    crypto::hash txid;
+    crypto::secret_key tx_key;
+    std::vector<crypto::secret_key> additional_tx_keys;
+    ar >> txid >> tx_key >> additional_tx_keys;
+    m_tx_keys[txid] = tx_key;
+    m_additional_tx_keys[txid] = additional_tx_keys;
+  }
+
+  bool subaddresses_changed;
+  ar >> subaddresses_changed;
+  if (subaddresses_changed)
+    ar >> m_subaddresses;
+
+  serialize_cache_journal_state(ar);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet::load_cache_journal(const crypto::chacha_iv &base_iv, uint64_t base_size, const crypto::chacha_key &key)
+{
+  const std::string journal_file = get_cache_journal_file();
+  std::string buf;
+  boost::system::error_code e;
+  if (boost::filesystem::exists(journal_file, e) && !e)
+  {
+    bool r = epee::file_io_utils::load_file_to_string(journal_file, buf);
+    THROW_WALLET_EXCEPTION_IF(!r, error::file_read_error, journal_file);
+  }
+
+  std::istringstream iss(buf);
+  binary_archive<false> ar(iss);
+  uint64_t journal_size = 0, entries = 0;
+  bool rewrite = false;
+  while (journal_size < buf.size())
+  {
+    wallet::cache_journal_record record;
+    std::streamoff pos = -1;
+    if (!::serialization::serialize(ar, record) || (pos = iss.tellg()) < 0)
+    {
+      // most likely a store was interrupted while appending
+      MWARNING("Wallet cache journal " << journal_file << " ends with an incomplete entry, ignoring it");
+      rewrite = true;
+      break;
+    }
+    journal_size = pos;
+    if (memcmp(&record.base_iv, &base_iv, sizeof(base_iv)))
+    {
+      // left over from before the cache was last rewritten
+      rewrite = true;
+      continue;
+    }
+
+    std::string entry_data;
+    entry_data.resize(record.entry_data.size());
+    crypto::chacha20(record.entry_data.data(), record.entry_data.size(), key, record.iv, &entry_data[0]);
+    try
+    {
+      apply_cache_journal_entry(entry_data);
+    }
+    catch (const std::exception &ex)
+    {
+      MERROR("Failed to apply wallet cache journal entry " << entries << ": " << ex.what());
+      THROW_WALLET_EXCEPTION_IF(true, error::file_read_error, journal_file);
+    }
+    ++entries;
+  }
+  if (entries)
+    LOG_PRINT_L1("Applied " << entries << " wallet cache journal entries");
+
+  reset_cache_journal(base_iv, base_size);
+  m_cache_journal.size = journal_size;
+  m_cache_journal.entries = entries;
+  if (rewrite)
+    invalidate_cache_journal();
 }
 //----------------------------------------------------------------------------------------------------
 uint64_t wallet::balance(uint32_t index_major) const
@@ -5065,6 +5468,7 @@ void wallet::commit_tx(pending_tx& ptx)
   {
     m_tx_keys.insert(std::make_pair(txid, ptx.tx_key));
     m_additional_tx_keys.insert(std::make_pair(txid, ptx.additional_tx_keys));
+    cache_journal_tx_key(txid);
   }
 
   LOG_PRINT_L2("transaction " << txid << " generated ok and sent to daemon, key_images: [" << ptx.key_images << "]");
@@ -5239,6 +5643,7 @@ bool wallet::sign_tx(unsigned_tx_set &exported_txs, const std::string &signed_fi
       const crypto::hash txid = get_transaction_hash(ptx.tx);
       m_tx_keys.insert(std::make_pair(txid, tx_key));
       m_additional_tx_keys.insert(std::make_pair(txid, additional_tx_keys));
+      cache_journal_tx_key(txid);
     }
 
     std::string key_images;
@@ -5977,7 +6382,7 @@ void wallet::light_wallet_get_outs(std::vector<std::vector<tools::wallet::get_ou
       crypto::public_key tx_public_key;
       rct::key mask = AUTO_VAL_INIT(mask); // decrypted mask - not used here
       rct::key rct_commit = AUTO_VAL_INIT(rct_commit);
-      THROW_WALLET_EXCEPTION_IF(string_tools::validate_hex(64, ores.amount_outs[amount_key].outputs[i].public_key), error::wallet_internal_error, "Invalid public_key");
+      THROW_WALLET_EXCEPTION_IF(!string_tools::validate_hex(64, ores.amount_outs[amount_key].outputs[i].public_key), error::wallet_internal_error, "Invalid public_key");
       string_tools::hex_to_pod(ores.amount_outs[amount_key].outputs[i].public_key, tx_public_key);
       const uint64_t global_index = ores.amount_outs[amount_key].outputs[i].global_index;
       if(!light_wallet_parse_rct_str(ores.amount_outs[amount_key].outputs[i].rct, tx_public_key, 0, mask, rct_commit, false))
@@ -7110,6 +7515,9 @@ void wallet::light_wallet_get_unspent_outs()
 {
   MDEBUG("Getting unspent outs");
 
+  // the outputs are rebuilt from what the server returns
+  invalidate_cache_journal();
+
   cryptonote::COMMAND_RPC_GET_UNSPENT_OUTS::request oreq;
   cryptonote::COMMAND_RPC_GET_UNSPENT_OUTS::response ores;
 
@@ -7149,14 +7557,14 @@ void wallet::light_wallet_get_unspent_outs()
     bool add_transfer = true;
     crypto::key_image unspent_key_image;
     crypto::public_key tx_public_key = AUTO_VAL_INIT(tx_public_key);
-    THROW_WALLET_EXCEPTION_IF(string_tools::validate_hex(64, o.tx_pub_key), error::wallet_internal_error, "Invalid tx_pub_key field");
+    THROW_WALLET_EXCEPTION_IF(!string_tools::validate_hex(64, o.tx_pub_key), error::wallet_internal_error, "Invalid tx_pub_key field");
     string_tools::hex_to_pod(o.tx_pub_key, tx_public_key);
 
     for (const std::string &ski: o.spend_key_images) {
       spent = false;
 
       // Check if key image is ours
-      THROW_WALLET_EXCEPTION_IF(string_tools::validate_hex(64, ski), error::wallet_internal_error, "Invalid key image");
+      THROW_WALLET_EXCEPTION_IF(!string_tools::validate_hex(64, ski), error::wallet_internal_error, "Invalid key image");
       string_tools::hex_to_pod(ski, unspent_key_image);
       if(light_wallet_key_image_is_ours(unspent_key_image, tx_public_key, o.index)){
         MTRACE("Output " << o.public_key << " is spent. Key image: " <<  ski);
@@ -7171,9 +7579,9 @@ void wallet::light_wallet_get_unspent_outs()
     crypto::hash txid;
     crypto::public_key tx_pub_key;
     crypto::public_key public_key;
-    THROW_WALLET_EXCEPTION_IF(string_tools::validate_hex(64, o.tx_hash), error::wallet_internal_error, "Invalid tx_hash field");
-    THROW_WALLET_EXCEPTION_IF(string_tools::validate_hex(64, o.public_key), error::wallet_internal_error, "Invalid public_key field");
-    THROW_WALLET_EXCEPTION_IF(string_tools::validate_hex(64, o.tx_pub_key), error::wallet_internal_error, "Invalid tx_pub_key field");
+    THROW_WALLET_EXCEPTION_IF(!string_tools::validate_hex(64, o.tx_hash), error::wallet_internal_error, "Invalid tx_hash field");
+    THROW_WALLET_EXCEPTION_IF(!string_tools::validate_hex(64, o.public_key), error::wallet_internal_error, "Invalid public_key field");
+    THROW_WALLET_EXCEPTION_IF(!string_tools::validate_hex(64, o.tx_pub_key), error::wallet_internal_error, "Invalid tx_pub_key field");
     string_tools::hex_to_pod(o.tx_hash, txid);
     string_tools::hex_to_pod(o.public_key, public_key);
     string_tools::hex_to_pod(o.tx_pub_key, tx_pub_key);
@@ -7203,13 +7611,20 @@ void wallet::light_wallet_get_unspent_outs()
     td.m_key_image_known = !m_watch_only;
     td.m_key_image_partial = m_multisig;
     td.m_amount = o.amount;
+    td.m_token_amount = o.token_amount;
+    td.m_token_transfer = o.token_amount > 0;
+    td.m_output_type = td.m_token_transfer ? cryptonote::tx_out_type::out_token : cryptonote::tx_out_type::out_cash;
     td.m_pk_index = 0;
     td.m_internal_output_index = o.index;
     td.m_spent = spent;
 
     tx_out txout;
-    txout.target = txout_to_key(public_key);
+    if (td.m_token_transfer)
+      txout.target = txout_token_to_key(public_key);
+    else
+      txout.target = txout_to_key(public_key);
     txout.amount = td.m_amount;
+    txout.token_amount = td.m_token_amount;
 
     td.m_tx.vout.resize(td.m_internal_output_index + 1);
     td.m_tx.vout[td.m_internal_output_index] = txout;
@@ -7270,7 +7685,8 @@ bool wallet::light_wallet_get_address_info(cryptonote::COMMAND_RPC_GET_ADDRESS_I
   bool r = epee::net_utils::invoke_http_json("/get_address_info", request, response, m_http_client, rpc_timeout, "POST");
   m_daemon_rpc_mutex.unlock();
   THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "get_address_info");
-  // TODO: Validate result
+  // MyMonero does not send a status
+  THROW_WALLET_EXCEPTION_IF((!response.status.empty() && response.status != "success"), error::no_connection_to_daemon, "get_address_info");
   return true;
 }
 
@@ -7278,6 +7694,8 @@ void wallet::light_wallet_get_address_txs()
 {
   MDEBUG("Refreshing light wallet");
 
+  invalidate_cache_journal();
+
   cryptonote::COMMAND_RPC_GET_ADDRESS_TXS::request ireq;
   cryptonote::COMMAND_RPC_GET_ADDRESS_TXS::response ires;
 
@@ -7321,8 +7739,8 @@ void wallet::light_wallet_get_address_txs()
     {
       crypto::public_key tx_public_key;
       crypto::key_image key_image;
-      THROW_WALLET_EXCEPTION_IF(string_tools::validate_hex(64, so.tx_pub_key), error::wallet_internal_error, "Invalid tx_pub_key field");
-      THROW_WALLET_EXCEPTION_IF(string_tools::validate_hex(64, so.key_image), error::wallet_internal_error, "Invalid key_image field");
+      THROW_WALLET_EXCEPTION_IF(!string_tools::validate_hex(64, so.tx_pub_key), error::wallet_internal_error, "Invalid tx_pub_key field");
+      THROW_WALLET_EXCEPTION_IF(!string_tools::validate_hex(64, so.key_image), error::wallet_internal_error, "Invalid key_image field");
       string_tools::hex_to_pod(so.tx_pub_key, tx_public_key);
       string_tools::hex_to_pod(so.key_image, key_image);
 
@@ -7341,8 +7759,8 @@ void wallet::light_wallet_get_address_txs()
     crypto::hash payment_id = null_hash;
     crypto::hash tx_hash;
 
-    THROW_WALLET_EXCEPTION_IF(string_tools::validate_hex(64, t.payment_id), error::wallet_internal_error, "Invalid payment_id field");
-    THROW_WALLET_EXCEPTION_IF(string_tools::validate_hex(64, t.hash), error::wallet_internal_error, "Invalid hash field");
+    THROW_WALLET_EXCEPTION_IF(!string_tools::validate_hex(64, t.payment_id), error::wallet_internal_error, "Invalid payment_id field");
+    THROW_WALLET_EXCEPTION_IF(!string_tools::validate_hex(64, t.hash), error::wallet_internal_error, "Invalid hash field");
     string_tools::hex_to_pod(t.payment_id, payment_id);
     string_tools::hex_to_pod(t.hash, tx_hash);
 
@@ -7511,8 +7929,8 @@ bool wallet::light_wallet_parse_rct_str(const std::string& rct_string, const cry
   rct::key encrypted_mask;
   std::string rct_commit_str = rct_string.substr(0,64);
   std::string encrypted_mask_str = rct_string.substr(64,64);
-  THROW_WALLET_EXCEPTION_IF(string_tools::validate_hex(64, rct_commit_str), error::wallet_internal_error, "Invalid rct commit hash: " + rct_commit_str);
-  THROW_WALLET_EXCEPTION_IF(string_tools::validate_hex(64, encrypted_mask_str), error::wallet_internal_error, "Invalid rct mask: " + encrypted_mask_str);
+  THROW_WALLET_EXCEPTION_IF(!string_tools::validate_hex(64, rct_commit_str), error::wallet_internal_error, "Invalid rct commit hash: " + rct_commit_str);
+  THROW_WALLET_EXCEPTION_IF(!string_tools::validate_hex(64, encrypted_mask_str), error::wallet_internal_error, "Invalid rct mask: " + encrypted_mask_str);
   string_tools::hex_to_pod(rct_commit_str, rct_commit);
   string_tools::hex_to_pod(encrypted_mask_str, encrypted_mask);
   if (decrypt) {
@@ -11866,6 +12284,7 @@ uint64_t wallet::import_key_images(const std::vector<std::pair<crypto::key_image
       {
         if (j->second.m_tx_hash == *spent_txid)
         {
+          invalidate_cache_journal();
           m_payments.erase(j);
           break;
         }
@@ -11886,6 +12305,7 @@ uint64_t wallet::import_key_images(const std::vector<std::pair<crypto::key_image
       pd.m_block_height = get_daemon_blockchain_height(err);  // spent block height is unknown, so hypothetically set to the highest
       crypto::hash spent_txid = crypto::rand<crypto::hash>(); // spent txid is unknown, so hypothetically set to random
       m_confirmed_txs.insert(std::make_pair(spent_txid, pd));
+      cache_journal_confirmed_tx(spent_txid);
     }
   }
 
@@ -11902,6 +12322,7 @@ wallet::payment_container wallet::export_payments() const
 }
 void wallet::import_payments(const payment_container &payments)
 {
+  invalidate_cache_journal();
   m_payments.clear();
   for (auto const &p : payments)
   {
@@ -11910,6 +12331,7 @@ void wallet::import_payments(const payment_container &payments)
 }
 void wallet::import_payments_out(const std::list<std::pair<crypto::hash,wallet::confirmed_transfer_details>> &confirmed_payments)
 {
+  invalidate_cache_journal();
   m_confirmed_txs.clear();
   for (auto const &p : confirmed_payments)
   {
@@ -11931,6 +12353,7 @@ std::tuple<size_t,crypto::hash,std::vector<crypto::hash>> wallet::export_blockch
 
 void wallet::import_blockchain(const std::tuple<size_t, crypto::hash, std::vector<crypto::hash>> &bc)
 {
+  invalidate_cache_journal();
   m_blockchain.clear();
   if (std::get<0>(bc))
   {
@@ -11966,6 +12389,7 @@ std::vector<tools::wallet::transfer_details> wallet::export_outputs() const
 //----------------------------------------------------------------------------------------------------
 size_t wallet::import_outputs(const std::vector<tools::wallet::transfer_details> &outputs)
 {
+  invalidate_cache_journal();
   m_transfers.clear();
   m_transfers.reserve(outputs.size());
   for (size_t i = 0; i < outputs.size(); ++i)
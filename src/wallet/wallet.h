@@ -72,6 +72,7 @@
 
 class Serialization_portability_wallet_Test;
 class Serialization_serialize_wallet_Test;
+class wallet_cache_journal_round_trips_transfers_payments_and_confirmed_txs_Test;
 
 namespace tools
 {
@@ -155,6 +156,7 @@ namespace tools
   {
     friend class ::Serialization_portability_wallet_Test;
     friend class ::Serialization_serialize_wallet_Test;
+    friend class ::wallet_cache_journal_round_trips_transfers_payments_and_confirmed_txs_Test;
   public:
     static constexpr const std::chrono::seconds rpc_timeout = std::chrono::minutes(3) + std::chrono::seconds(30);
 
@@ -482,6 +484,21 @@ namespace tools
       END_SERIALIZE()
     };
 
+    // one entry of the cache journal, holding what changed since the previous
+    // entry; base_iv ties it to the cache file it applies on top of
+    struct cache_journal_record
+    {
+      crypto::chacha_iv base_iv;
+      crypto::chacha_iv iv;
+      std::string entry_data;
+
+      BEGIN_SERIALIZE_OBJECT()
+        FIELD(base_iv)
+        FIELD(iv)
+        FIELD(entry_data)
+      END_SERIALIZE()
+    };
+
     // GUI Address book
     struct address_book_row
     {
@@ -773,18 +790,21 @@ namespace tools
       a & m_account_tags;
       a & m_ring_history_saved;
 
-      if (ver < 1) return;
-
-      a & m_safex_accounts;
+      if (ver >= 1)
+      {
+        a & m_safex_accounts;
 
-      a & m_safex_offers;
+        a & m_safex_offers;
 
-      a & m_safex_feedback_tokens;
+        a & m_safex_feedback_tokens;
 
-      a & m_safex_given_feedbacks;
+        a & m_safex_given_feedbacks;
 
-      a & m_safex_price_pegs;
+        a & m_safex_price_pegs;
+      }
 
+      if (t_archive::is_loading::value)
+        rebuild_safex_indexes();
     }
 
       static std::string get_default_ringdb_path()
@@ -1121,6 +1141,10 @@ namespace tools
     std::vector<safex::safex_price_peg> get_my_safex_price_pegs();
 
   private:
+    void rebuild_safex_indexes();
+    // replays offer, price peg and feedback outputs of the current transfers
+    void reprocess_safex_outputs();
+
     /*!
      * \brief  Stores wallet information to wallet file.
      * \param  keys_file_name Name of wallet file
@@ -1177,6 +1201,17 @@ namespace tools
     void scan_output(const cryptonote::transaction &tx, const crypto::public_key &tx_pub_key, size_t i, tx_scan_info_t &tx_scan_info, int &num_vouts_received,
         std::unordered_map<cryptonote::subaddress_index, uint64_t> &tx_money_got_in_outs, std::unordered_map<cryptonote::subaddress_index, uint64_t> &tx_token_got_in_outs, std::vector<size_t> &outs) const;
     void trim_hashchain();
+    std::string get_cache_journal_file() const { return m_wallet_file + ".journal"; }
+    bool store_cache_journal(const crypto::chacha_key &key);
+    void load_cache_journal(const crypto::chacha_iv &base_iv, uint64_t base_size, const crypto::chacha_key &key);
+    void apply_cache_journal_entry(const std::string &entry_data);
+    void reset_cache_journal(const crypto::chacha_iv &base_iv, uint64_t base_size);
+    void invalidate_cache_journal() { m_cache_journal.valid = false; }
+    void cache_journal_payment(const crypto::hash &payment_id, const payment_details &payment);
+    void cache_journal_confirmed_tx(const crypto::hash &txid);
+    void cache_journal_tx_key(const crypto::hash &txid);
+    template <class t_archive>
+    void serialize_cache_journal_state(t_archive &a);
     bool add_rings(const crypto::chacha_key &key, const cryptonote::transaction_prefix &tx);
     bool add_rings(const cryptonote::transaction_prefix &tx);
     bool remove_rings(const cryptonote::transaction_prefix &tx);
@@ -1302,6 +1337,52 @@ namespace tools
     std::vector<safex::safex_feedback> m_safex_given_feedbacks;
 
     std::vector<safex::safex_price_peg> m_safex_price_pegs;
+
+    // positions in the vectors above, which stay the serialized form
+    std::unordered_map<std::string, size_t> m_safex_account_index;
+    std::unordered_map<crypto::hash, size_t> m_safex_offer_index;
+    std::unordered_map<crypto::hash, size_t> m_safex_price_peg_index;
+
+    // The cache file is only rewritten in full from time to time, stores in
+    // between append what changed to the journal. This is what was last
+    // written, to find out what changed since.
+    struct cache_journal_transfer_state
+    {
+      crypto::hash txid;
+      crypto::hash multisig_hash;
+      crypto::key_image key_image;
+      rct::key mask;
+      uint64_t block_height;
+      uint64_t global_output_index;
+      uint64_t spent_height;
+      uint64_t amount;
+      uint64_t token_amount;
+      size_t pk_index;
+      cryptonote::subaddress_index subaddr_index;
+      cryptonote::tx_out_type output_type;
+      bool spent;
+      bool key_image_known;
+      bool key_image_partial;
+    };
+    struct cache_journal_state
+    {
+      bool valid = false;
+      crypto::chacha_iv base_iv;
+      uint64_t base_size = 0;
+      uint64_t size = 0;
+      uint64_t entries = 0;
+      size_t blockchain_offset = 0;
+      size_t blockchain_size = 0;
+      size_t subaddresses_size = 0;
+      std::vector<cache_journal_transfer_state> transfers;
+      std::vector<std::pair<crypto::hash, payment_details>> payments;
+      std::unordered_set<crypto::hash> confirmed_txs;
+      std::unordered_set<crypto::hash> tx_keys;
+    };
+    cache_journal_state m_cache_journal;
+
+    static cache_journal_transfer_state get_cache_journal_transfer_state(const transfer_details &td);
+    static bool same_cache_journal_transfer_state(const cache_journal_transfer_state &a, const cache_journal_transfer_state &b);
   };
 }
 BOOST_CLASS_VERSION(tools::wallet, 1)
@@ -251,11 +251,7 @@ namespace tools
   //-----------------------------------------------------------------------------------------------------------------
   bool wallet::generate_safex_account(const std::string &username, const std::vector<uint8_t> &account_data)
   {
-    auto sfx_account = find_if(m_safex_accounts.begin(),m_safex_accounts.end(),[&username](const safex::safex_account& it){
-        return it.username == username;
-    });
-
-    if(sfx_account != m_safex_accounts.end())
+    if(m_safex_account_index.find(username) != m_safex_account_index.end())
       return false;
 
     safex::safex_account_key_handler new_safex_account_keys;
@@ -269,6 +265,7 @@ namespace tools
 
     m_safex_accounts_keys.push_back(new_safex_account_keys.get_keys());
     m_safex_accounts.push_back(new_safex_account);
+    m_safex_account_index[username] = m_safex_accounts.size() - 1;
 
     return true;
 
@@ -277,20 +274,21 @@ namespace tools
   bool wallet::remove_safex_account(const std::string &username)
   {
 
-    safex::safex_account new_safex_account;
+    auto idx = m_safex_account_index.find(username);
+    if (idx == m_safex_account_index.end())
+      return true;
+
+    auto pkey = m_safex_accounts[idx->second].pkey;
+    auto safex_keys = find_if(m_safex_accounts_keys.begin(),m_safex_accounts_keys.end(),[&pkey](const safex::safex_account_keys& it){
+        return it.get_public_key() == pkey;
+    });
 
-    for (uint32_t i=0;i<m_safex_accounts.size();i++) {
-      if (m_safex_accounts[i].username == username) {
-        auto pkey = m_safex_accounts[i].pkey;
-        auto safex_keys = find_if(m_safex_accounts_keys.begin(),m_safex_accounts_keys.end(),[&pkey](const safex::safex_account_keys& it){
-            return it.get_public_key() == pkey;
-        });
+    m_safex_accounts.erase(m_safex_accounts.begin()+idx->second);
+    if(safex_keys != m_safex_accounts_keys.end())
+      m_safex_accounts_keys.erase(safex_keys);
 
-        m_safex_accounts.erase(m_safex_accounts.begin()+i);
-        if(safex_keys != m_safex_accounts_keys.end())
-          m_safex_accounts_keys.erase(safex_keys);
-      }
-    }
+    // later accounts moved down
+    rebuild_safex_indexes();
 
     return true;
 
@@ -299,13 +297,11 @@ namespace tools
   bool wallet::update_safex_account_data(const std::string &username, const std::vector<uint8_t> accdata)
   {
 
-    for (uint32_t i = 0; i < m_safex_accounts.size(); i++)
+    auto idx = m_safex_account_index.find(username);
+    if (idx != m_safex_account_index.end())
     {
-      if (m_safex_accounts[i].username == username)
-      {
-        m_safex_accounts[i].account_data = accdata;
-        m_safex_accounts[i].activated = true;
-      }
+      m_safex_accounts[idx->second].account_data = accdata;
+      m_safex_accounts[idx->second].activated = true;
     }
 
     return true;
@@ -328,21 +324,21 @@ namespace tools
     if(!get_safex_account_keys(username,sfx_keys))
       m_safex_accounts_keys.push_back(recover_safex_account_keys.get_keys());
     if(!get_safex_account(username,recover_safex_account))
+    {
         m_safex_accounts.push_back(recover_safex_account);
+        m_safex_account_index[username] = m_safex_accounts.size() - 1;
+    }
 
     return true;
   }
 //-----------------------------------------------------------------------------------------------------------------
   bool wallet::get_safex_account(const std::string &username, safex::safex_account &my_account) {
-    for (const safex::safex_account& acc: m_safex_accounts) {
-      if (username == acc.username)
-      {
-        my_account = acc;
-        return true;
-      }
-    }
+    auto idx = m_safex_account_index.find(username);
+    if (idx == m_safex_account_index.end())
+      return false;
 
-    return false;
+    my_account = m_safex_accounts[idx->second];
+    return true;
   }
 //-----------------------------------------------------------------------------------------------------------------
 
@@ -407,58 +403,44 @@ namespace tools
   bool wallet::get_safex_account_keys(const std::string &username, safex::safex_account_keys &acckeys)
   {
 
-    for (uint32_t i = 0; i < m_safex_accounts.size(); i++)
-    {
-      if (m_safex_accounts[i].username == username)
-      {
-        auto pkey = m_safex_accounts[i].pkey;
-        auto safex_keys = find_if(m_safex_accounts_keys.begin(),m_safex_accounts_keys.end(),[&pkey](const safex::safex_account_keys& it){
-            return it.get_public_key() == pkey;
-        });
-        if(safex_keys == m_safex_accounts_keys.end())
-          return false;
-        acckeys = *safex_keys;
-        return true;
-      }
-    }
+    auto idx = m_safex_account_index.find(username);
+    if (idx == m_safex_account_index.end())
+      return false;
 
-    return false;
+    auto pkey = m_safex_accounts[idx->second].pkey;
+    auto safex_keys = find_if(m_safex_accounts_keys.begin(),m_safex_accounts_keys.end(),[&pkey](const safex::safex_account_keys& it){
+        return it.get_public_key() == pkey;
+    });
+    if(safex_keys == m_safex_accounts_keys.end())
+      return false;
+    acckeys = *safex_keys;
+    return true;
   }
 
   bool wallet::add_safex_offer(const safex::safex_offer& offer){
-      auto exists = std::find_if(m_safex_offers.begin(), m_safex_offers.end(), [offer] (const safex::safex_offer& sfx_offer) {
-          return sfx_offer.offer_id == offer.offer_id;
-      });
-      if(exists == m_safex_offers.end())
+      if(m_safex_offer_index.find(offer.offer_id) == m_safex_offer_index.end())
+      {
          m_safex_offers.push_back(offer);
+         m_safex_offer_index[offer.offer_id] = m_safex_offers.size() - 1;
+      }
 
       return true;
   }
 
     bool wallet::update_safex_offer(const safex::safex_offer& offer){
 
-        for (uint32_t i = 0; i < m_safex_offers.size(); i++)
-        {
-            if (m_safex_offers[i].offer_id == offer.offer_id)
-            {
-                m_safex_offers[i]=offer;
-                return true;
-            }
-        }
+        auto idx = m_safex_offer_index.find(offer.offer_id);
+        if (idx != m_safex_offer_index.end())
+            m_safex_offers[idx->second]=offer;
 
         return true;
     }
 
     bool wallet::update_safex_offer(const safex::create_purchase_data& purchase){
 
-      for (auto & m_safex_offer : m_safex_offers)
-      {
-        if (m_safex_offer.offer_id == purchase.offer_id)
-        {
-          m_safex_offer.quantity -= purchase.quantity;
-          return true;
-        }
-      }
+      auto idx = m_safex_offer_index.find(purchase.offer_id);
+      if (idx != m_safex_offer_index.end())
+        m_safex_offers[idx->second].quantity -= purchase.quantity;
 
       return true;
     }
@@ -485,26 +467,31 @@ namespace tools
   std::vector<safex::safex_offer> wallet::get_safex_offers()
   {
       cryptonote::COMMAND_RPC_GET_SAFEX_OFFERS::request req = AUTO_VAL_INIT(req);
-      cryptonote::COMMAND_RPC_GET_SAFEX_OFFERS::response res = AUTO_VAL_INIT(res);
 
       std::vector<safex::safex_offer> offers;
 
-      m_daemon_rpc_mutex.lock();
-      bool r = net_utils::invoke_http_json("/get_safex_offers", req, res, m_http_client, rpc_timeout);
-      m_daemon_rpc_mutex.unlock();
-
-      THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "get_safex_offers");
-      THROW_WALLET_EXCEPTION_IF(res.status != "OK", error::no_connection_to_daemon, "Failed to get safex offers");
-
-      for (auto &item : res.offers) {
-          if(item.height + CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE > m_local_bc_height)
-              continue;
-          crypto::hash offer_hash{};
-          epee::string_tools::hex_to_pod(item.offer_id, offer_hash);
-          crypto::hash price_peg_hash{};
-          epee::string_tools::hex_to_pod(item.price_peg_id, price_peg_hash);
-          offers.emplace_back(item.title, item.quantity, item.price, item.description, offer_hash, item.seller, item.active,item.seller_address,item.price_peg_used,price_peg_hash,item.min_sfx_price);
-      }
+      // restricted daemons return the listing in pages
+      do {
+        cryptonote::COMMAND_RPC_GET_SAFEX_OFFERS::response res = AUTO_VAL_INIT(res);
+
+        m_daemon_rpc_mutex.lock();
+        bool r = net_utils::invoke_http_json("/get_safex_offers", req, res, m_http_client, rpc_timeout);
+        m_daemon_rpc_mutex.unlock();
+
+        THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "get_safex_offers");
+        THROW_WALLET_EXCEPTION_IF(res.status != "OK", error::no_connection_to_daemon, "Failed to get safex offers");
+
+        for (auto &item : res.offers) {
+            if(item.height + CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE > m_local_bc_height)
+                continue;
+            crypto::hash offer_hash{};
+            epee::string_tools::hex_to_pod(item.offer_id, offer_hash);
+            crypto::hash price_peg_hash{};
+            epee::string_tools::hex_to_pod(item.price_peg_id, price_peg_hash);
+            offers.emplace_back(item.title, item.quantity, item.price, item.description, offer_hash, item.seller, item.active,item.seller_address,item.price_peg_used,price_peg_hash,item.min_sfx_price);
+        }
+        req.start_after = res.next;
+      } while (!req.start_after.empty());
 
       return offers;
   }
@@ -512,24 +499,29 @@ namespace tools
     std::vector<safex::safex_price_peg> wallet::get_safex_price_pegs(const std::string &currency)
     {
       cryptonote::COMMAND_RPC_GET_SAFEX_PRICE_PEGS::request req = AUTO_VAL_INIT(req);
-      cryptonote::COMMAND_RPC_GET_SAFEX_PRICE_PEGS::response res = AUTO_VAL_INIT(res);
 
       std::vector<safex::safex_price_peg> price_pegs;
 
       req.currency = currency;
 
-      m_daemon_rpc_mutex.lock();
-      bool r = net_utils::invoke_http_json("/get_safex_price_pegs", req, res, m_http_client, rpc_timeout);
-      m_daemon_rpc_mutex.unlock();
+      // restricted daemons return the listing in pages
+      do {
+        cryptonote::COMMAND_RPC_GET_SAFEX_PRICE_PEGS::response res = AUTO_VAL_INIT(res);
 
-      THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "get_safex_price_pegs");
-      THROW_WALLET_EXCEPTION_IF(res.status != "OK", error::no_connection_to_daemon, "Failed to get safex price pegs");
+        m_daemon_rpc_mutex.lock();
+        bool r = net_utils::invoke_http_json("/get_safex_price_pegs", req, res, m_http_client, rpc_timeout);
+        m_daemon_rpc_mutex.unlock();
 
-      for (auto &item : res.price_pegs) {
-        crypto::hash hash{};
-        epee::string_tools::hex_to_pod(item.price_peg_id, hash);
-        price_pegs.emplace_back(item.title,item.creator,item.currency,item.description,hash,item.rate);
-      }
+        THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "get_safex_price_pegs");
+        THROW_WALLET_EXCEPTION_IF(res.status != "OK", error::no_connection_to_daemon, "Failed to get safex price pegs");
+
+        for (auto &item : res.price_pegs) {
+          crypto::hash hash{};
+          epee::string_tools::hex_to_pod(item.price_peg_id, hash);
+          price_pegs.emplace_back(item.title,item.creator,item.currency,item.description,hash,item.rate);
+        }
+        req.start_after = res.next;
+      } while (!req.start_after.empty());
 
       return price_pegs;
     }
@@ -537,22 +529,27 @@ namespace tools
   std::vector<safex::safex_feedback> wallet::get_safex_ratings(const crypto::hash& offer_id)
   {
       cryptonote::COMMAND_RPC_GET_SAFEX_RATINGS::request req = AUTO_VAL_INIT(req);
-      cryptonote::COMMAND_RPC_GET_SAFEX_RATINGS::response res = AUTO_VAL_INIT(res);
 
       std::vector<safex::safex_feedback> feedbacks;
 
       req.offer_id = offer_id;
 
-      m_daemon_rpc_mutex.lock();
-      bool r = net_utils::invoke_http_json("/get_safex_ratings", req, res, m_http_client, rpc_timeout);
-      m_daemon_rpc_mutex.unlock();
+      // restricted daemons return the listing in pages
+      do {
+        cryptonote::COMMAND_RPC_GET_SAFEX_RATINGS::response res = AUTO_VAL_INIT(res);
 
-      THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "get_safex_ratings");
-      THROW_WALLET_EXCEPTION_IF(res.status != CORE_RPC_STATUS_OK, error::no_connection_to_daemon, "Failed to get safex ratings");
+        m_daemon_rpc_mutex.lock();
+        bool r = net_utils::invoke_http_json("/get_safex_ratings", req, res, m_http_client, rpc_timeout);
+        m_daemon_rpc_mutex.unlock();
 
-      for (auto &item : res.ratings) {
-        feedbacks.emplace_back(item.star_rating,item.comment,res.offer_id);
-      }
+        THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "get_safex_ratings");
+        THROW_WALLET_EXCEPTION_IF(res.status != CORE_RPC_STATUS_OK, error::no_connection_to_daemon, "Failed to get safex ratings");
+
+        for (auto &item : res.ratings) {
+          feedbacks.emplace_back(item.star_rating,item.comment,res.offer_id);
+        }
+        req.start_after = res.next;
+      } while (!req.start_after.empty());
 
       return feedbacks;
   }
@@ -570,13 +567,12 @@ namespace tools
         if(it == sfx_price_pegs.end())
           return false;
 
-        std::string rate_str = print_money(it->rate);
-        double rate = stod(rate_str);
-
-        std::string price_str = print_money(sfx_offer.price);
-        double price = stod(price_str);
+        uint64_t pegged_price = 0;
+        if(!safex::convert_pegged_price(sfx_offer.price, it->rate, pegged_price))
+          return false;
 
-        uint64_t pegged_price = (price*rate)*SAFEX_CASH_COIN;
+        //pay enough for both conversion rules, so purchase stays valid on both sides of HF_VERSION_SAFEX_FIXED_POINT_PRICE_PEG
+        pegged_price = std::max(pegged_price, safex::convert_pegged_price_legacy(sfx_offer.price, it->rate));
 
         if(pegged_price > sfx_price)
           sfx_price = pegged_price;
@@ -614,20 +610,17 @@ namespace tools
     bool wallet::add_safex_price_peg(const safex::safex_price_peg& price_peg){
 
         m_safex_price_pegs.push_back(price_peg);
+        // updates go to the first price peg with the id
+        m_safex_price_peg_index.emplace(price_peg.price_peg_id, m_safex_price_pegs.size() - 1);
 
         return true;
     }
 
     bool wallet::update_safex_price_peg(const crypto::hash &price_peg_id, const uint64_t& rate) {
 
-      for (uint32_t i = 0; i < m_safex_price_pegs.size(); i++)
-      {
-        if (m_safex_price_pegs[i].price_peg_id == price_peg_id)
-        {
-          m_safex_price_pegs[i].rate=rate;
-          return true;
-        }
-      }
+      auto idx = m_safex_price_peg_index.find(price_peg_id);
+      if (idx != m_safex_price_peg_index.end())
+        m_safex_price_pegs[idx->second].rate=rate;
 
       return true;
     }
@@ -635,6 +628,7 @@ namespace tools
   std::vector<safex::safex_offer> wallet::get_my_safex_offers()
   {
         m_safex_offers.clear();
+        m_safex_offer_index.clear();
 
         for (const auto& td: m_transfers)
         {
@@ -652,6 +646,7 @@ namespace tools
     std::vector<safex::safex_price_peg> wallet::get_my_safex_price_pegs()
     {
         m_safex_price_pegs.clear();
+        m_safex_price_peg_index.clear();
 
         for (const auto& td: m_transfers)
         {
@@ -701,10 +696,47 @@ namespace tools
 
   safex::safex_offer wallet::get_my_safex_offer(crypto::hash& offer_id)
   {
-        for(auto it: m_safex_offers)
-            if(it.offer_id == offer_id)
-                return it;
-        return safex::safex_offer{};
+        auto idx = m_safex_offer_index.find(offer_id);
+        if (idx == m_safex_offer_index.end())
+            return safex::safex_offer{};
+        return m_safex_offers[idx->second];
+  }
+
+  void wallet::rebuild_safex_indexes()
+  {
+      m_safex_account_index.clear();
+      for (size_t i = 0; i < m_safex_accounts.size(); i++)
+          m_safex_account_index.emplace(m_safex_accounts[i].username, i);
+
+      m_safex_offer_index.clear();
+      for (size_t i = 0; i < m_safex_offers.size(); i++)
+          m_safex_offer_index.emplace(m_safex_offers[i].offer_id, i);
+
+      m_safex_price_peg_index.clear();
+      for (size_t i = 0; i < m_safex_price_pegs.size(); i++)
+          m_safex_price_peg_index.emplace(m_safex_price_pegs[i].price_peg_id, i);
+  }
+
+  void wallet::reprocess_safex_outputs()
+  {
+      m_safex_offers.clear();
+      m_safex_offer_index.clear();
+      m_safex_price_pegs.clear();
+      m_safex_price_peg_index.clear();
+      m_safex_feedback_tokens.clear();
+      m_safex_given_feedbacks.clear();
+
+      for (const auto& td: m_transfers)
+      {
+          if(td.m_output_type == tx_out_type::out_safex_offer || td.m_output_type == tx_out_type::out_safex_offer_update
+                  || td.m_output_type == tx_out_type::out_safex_purchase
+                  || td.m_output_type == tx_out_type::out_safex_feedback_token || td.m_output_type == tx_out_type::out_safex_feedback
+                  || td.m_output_type == tx_out_type::out_safex_price_peg || td.m_output_type == tx_out_type::out_safex_price_peg_update)
+          {
+              const txout_to_script &txout = boost::get<txout_to_script>(td.m_tx.vout[td.m_internal_output_index].target);
+              process_advanced_output(txout, td.m_output_type);
+          }
+      }
   }
 
   void wallet::process_advanced_output(const cryptonote::txout_to_script &txout, const cryptonote::tx_out_type& output_type){
@@ -94,6 +94,10 @@ namespace tests
     virtual void on_transaction_relayed(const cryptonote::blobdata& tx) {}
     cryptonote::network_type get_nettype() const { return cryptonote::MAINNET; }
     bool get_pool_transaction(const crypto::hash& id, cryptonote::blobdata& tx_blob) const { return false; }
+    bool get_pool_transactions(const std::vector<crypto::hash>& ids, std::vector<cryptonote::blobdata>& txblobs, std::vector<size_t>& missing_indices) const { return false; }
+    bool get_pool_transaction_short_ids(const crypto::hash& key, std::unordered_map<uint64_t, crypto::hash>& short_ids) const { return false; }
+    uint64_t get_pool_cookie() const { return 0; }
+    uint64_t get_block_size_limit() const { return CRYPTONOTE_BLOCK_GRANTED_FULL_REWARD_ZONE_V2; }
     bool pool_has_tx(const crypto::hash &txid) const { return false; }
     bool get_blocks(uint64_t start_offset, size_t count, std::list<std::pair<cryptonote::blobdata, cryptonote::block>>& blocks, std::list<cryptonote::blobdata>& txs) const { return false; }
     bool get_transactions(const std::vector<crypto::hash>& txs_ids, std::list<cryptonote::transaction>& txs, std::list<crypto::hash>& missed_txs) const { return false; }
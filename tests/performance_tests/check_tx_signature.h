@@ -98,3 +98,62 @@ private:
   cryptonote::transaction m_tx;
   crypto::hash m_tx_prefix_hash;
 };
+
+template<size_t a_ring_size, size_t a_inputs, bool a_batched>
+class test_check_tx_signature_batch
+{
+  static_assert(0 < a_ring_size, "ring_size must be greater than 0");
+  static_assert(0 < a_inputs, "inputs must be greater than 0");
+
+public:
+  static const size_t loop_count = a_ring_size * a_inputs < 100 ? 100 : 10;
+  static const size_t ring_size = a_ring_size;
+  static const size_t inputs = a_inputs;
+  static const bool batched = a_batched;
+
+  bool init()
+  {
+    m_prefix_hash = crypto::rand<crypto::hash>();
+    m_public_keys.resize(inputs * ring_size);
+    m_public_key_ptrs.resize(inputs * ring_size);
+    m_key_images.resize(inputs);
+    m_signatures.resize(inputs * ring_size);
+    for (size_t i = 0; i < inputs; ++i)
+    {
+      const size_t real_index = (i * 7) % ring_size;
+      crypto::secret_key real_sec, sec;
+      for (size_t j = 0; j < ring_size; ++j)
+      {
+        crypto::generate_keys(m_public_keys[i * ring_size + j], sec);
+        m_public_key_ptrs[i * ring_size + j] = &m_public_keys[i * ring_size + j];
+        if (j == real_index)
+          real_sec = sec;
+      }
+      crypto::generate_key_image(m_public_keys[i * ring_size + real_index], real_sec, m_key_images[i]);
+      crypto::generate_ring_signature(m_prefix_hash, m_key_images[i], &m_public_key_ptrs[i * ring_size], ring_size, real_sec, real_index, &m_signatures[i * ring_size]);
+      m_checks.push_back({&m_prefix_hash, &m_key_images[i], &m_public_key_ptrs[i * ring_size], ring_size, &m_signatures[i * ring_size]});
+    }
+    return true;
+  }
+
+  bool test()
+  {
+    if (batched)
+      return crypto::check_ring_signatures(m_checks);
+
+    for (const crypto::ring_signature_check &check: m_checks)
+    {
+      if (!crypto::check_ring_signature(*check.prefix_hash, *check.image, check.pubs, check.pubs_count, check.sig))
+        return false;
+    }
+    return true;
+  }
+
+private:
+  crypto::hash m_prefix_hash;
+  std::vector<crypto::public_key> m_public_keys;
+  std::vector<const crypto::public_key *> m_public_key_ptrs;
+  std::vector<crypto::key_image> m_key_images;
+  std::vector<crypto::signature> m_signatures;
+  std::vector<crypto::ring_signature_check> m_checks;
+};
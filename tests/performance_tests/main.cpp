@@ -52,6 +52,8 @@
 #include "sc_reduce32.h"
 #include "cn_fast_hash.h"
 #include "rct_mlsag.h"
+#include "safex_command_parse.h"
+#include "safex_pegged_price.h"
 
 namespace po = boost::program_options;
 
@@ -145,6 +147,13 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE2(filter, test_check_tx_signature, 10, false);
   TEST_PERFORMANCE2(filter, test_check_tx_signature, 100, false);
 
+  TEST_PERFORMANCE3(filter, test_check_tx_signature_batch, 11, 1, false);
+  TEST_PERFORMANCE3(filter, test_check_tx_signature_batch, 11, 1, true);
+  TEST_PERFORMANCE3(filter, test_check_tx_signature_batch, 11, 4, false);
+  TEST_PERFORMANCE3(filter, test_check_tx_signature_batch, 11, 4, true);
+  TEST_PERFORMANCE3(filter, test_check_tx_signature_batch, 11, 16, false);
+  TEST_PERFORMANCE3(filter, test_check_tx_signature_batch, 11, 16, true);
+
   TEST_PERFORMANCE0(filter, test_is_out_to_acc);
   TEST_PERFORMANCE0(filter, test_is_out_to_acc_precomp);
   TEST_PERFORMANCE0(filter, test_generate_key_image_helper);
@@ -171,6 +180,14 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE3(filter, test_ringct_mlsag, 1, 10, true);
   TEST_PERFORMANCE3(filter, test_ringct_mlsag, 1, 100, true);
 
+  TEST_PERFORMANCE2(filter, test_safex_command_parse, 10, false);
+  TEST_PERFORMANCE2(filter, test_safex_command_parse, 10, true);
+  TEST_PERFORMANCE2(filter, test_safex_command_parse, 100, false);
+  TEST_PERFORMANCE2(filter, test_safex_command_parse, 100, true);
+
+  TEST_PERFORMANCE1(filter, test_safex_pegged_price, false);
+  TEST_PERFORMANCE1(filter, test_safex_pegged_price, true);
+
   std::cout << "Tests finished. Elapsed time: " << timer.elapsed_ms() / 1000 << " sec" << std::endl;
 
   return 0;
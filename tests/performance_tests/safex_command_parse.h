@@ -0,0 +1,101 @@
+// Copyright (c) 2018, The Safex Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
+// Parts of this file are originally copyright (c) 2014-2018 The Monero Project
+
+#pragma once
+
+#include "crypto/crypto.h"
+#include "cryptonote_basic/cryptonote_basic.h"
+#include "safex/command.h"
+
+/**
+ * Parsing of Safex command scripts for a block with `inputs` create offer commands.
+ * Every command script is looked up 8 times on its way through tx verification and block insertion
+ * (signature check, validate and execute with their inner validate, tx command restrictions).
+ * Without `cached` each lookup deserializes the script again, with it only the first one does.
+ */
+template<size_t inputs, bool cached>
+class test_safex_command_parse
+{
+public:
+  static const size_t loop_count = inputs < 100 ? 1000 : 100;
+  static const size_t lookups_per_input = 8;
+
+  bool init()
+  {
+    cryptonote::account_base seller;
+    seller.generate();
+
+    for (size_t i = 0; i < inputs; ++i)
+    {
+      const std::string title = "Offer " + std::to_string(i);
+      const std::string description(1024, 'd');
+      safex::create_offer_data offer_data{crypto::rand<crypto::hash>(), std::vector<uint8_t>{'s', 'e', 'l', 'l', 'e', 'r'},
+                                          std::vector<uint8_t>(title.begin(), title.end()), 10, 1000000, std::vector<uint8_t>(description.begin(), description.end()),
+                                          true, seller.get_keys().m_account_address, seller.get_keys().m_view_secret_key, crypto::null_hash, 1000000, false};
+      safex::create_offer cmd{SAFEX_COMMAND_PROTOCOL_VERSION, offer_data};
+
+      cryptonote::txin_to_script txin = AUTO_VAL_INIT(txin);
+      txin.command_type = safex::command_t::create_offer;
+      txin.key_offsets.push_back(i);
+      safex::safex_command_serializer::serialize_safex_object(cmd, txin.script);
+      m_inputs.push_back(txin);
+    }
+
+    return true;
+  }
+
+  bool test()
+  {
+    for (const cryptonote::txin_to_script &txin: m_inputs)
+    {
+      txin.parsed_command.reset();
+      for (size_t i = 0; i < lookups_per_input; ++i)
+      {
+        if (cached)
+        {
+          std::shared_ptr<const safex::create_offer> cmd = safex::safex_command_serializer::get_safex_command<safex::create_offer>(txin);
+          if (cmd->get_offerid() == crypto::null_hash)
+            return false;
+        }
+        else
+        {
+          std::unique_ptr<safex::create_offer> cmd = safex::safex_command_serializer::parse_safex_command<safex::create_offer>(txin.script);
+          if (cmd->get_offerid() == crypto::null_hash)
+            return false;
+        }
+      }
+    }
+    return true;
+  }
+
+private:
+  std::vector<cryptonote::txin_to_script> m_inputs;
+};
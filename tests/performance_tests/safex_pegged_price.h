@@ -0,0 +1,67 @@
+// Copyright (c) 2018, The Safex Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
+// Parts of this file are originally copyright (c) 2014-2018 The Monero Project
+
+#pragma once
+
+#include "crypto/crypto.h"
+#include "safex/safex_price_peg.h"
+
+/**
+ * Conversion of offer price to SFX with price peg rate, as done by every purchase validation.
+ * `fixed_point` selects 128 bit integer conversion, otherwise legacy print_money/stod conversion is used.
+ */
+template<bool fixed_point>
+class test_safex_pegged_price
+{
+public:
+  static const size_t loop_count = 100000;
+
+  bool init()
+  {
+    m_price = crypto::rand<uint64_t>() % (1000 * SAFEX_CASH_COIN);
+    m_rate = crypto::rand<uint64_t>() % (100 * SAFEX_CASH_COIN) + 1;
+    return true;
+  }
+
+  bool test()
+  {
+    uint64_t sfx_price = 0;
+    if (fixed_point)
+      return safex::convert_pegged_price(m_price, m_rate, sfx_price);
+
+    sfx_price = safex::convert_pegged_price_legacy(m_price, m_rate);
+    return sfx_price <= MONEY_SUPPLY;
+  }
+
+private:
+  uint64_t m_price;
+  uint64_t m_rate;
+};
@@ -34,6 +34,7 @@
 #include <iostream>
 #include <chrono>
 #include <thread>
+#include <numeric>
 
 #include "gtest/gtest.h"
 
@@ -439,4 +440,207 @@ TYPED_TEST(BlockchainDBTest, RetrieveBlockData)
   ASSERT_HASH_EQ(get_block_hash(this->m_blocks[NUMBER_OF_BLOCKS-1]), hashes[NUMBER_OF_BLOCKS-1]);
 }
 
+TYPED_TEST(BlockchainDBTest, ReadSnapshot)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  for (int i=0;i<NUMBER_OF_BLOCKS-1; i++)
+    ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[i], this->m_test_sizes[i], this->m_test_diffs[i], this->m_test_coins[i], this->m_test_tokens[i], this->m_txs[i]));
+
+  {
+    db_snapshot snapshot(*this->m_db);
+    ASSERT_EQ(1, this->m_db->get_snapshot_stats().active);
+    ASSERT_EQ(NUMBER_OF_BLOCKS-1, this->m_db->height());
+
+    // a nested snapshot joins the outer one
+    {
+      db_snapshot nested(*this->m_db);
+      ASSERT_EQ(1, this->m_db->get_snapshot_stats().active);
+    }
+    ASSERT_EQ(1, this->m_db->get_snapshot_stats().active);
+
+    // a block added meanwhile is not seen until the snapshot is released
+    std::thread writer([this]() {
+      const int i = NUMBER_OF_BLOCKS-1;
+      this->m_db->add_block(this->m_blocks[i], this->m_test_sizes[i], this->m_test_diffs[i], this->m_test_coins[i], this->m_test_tokens[i], this->m_txs[i]);
+    });
+    writer.join();
+    ASSERT_EQ(NUMBER_OF_BLOCKS-1, this->m_db->height());
+    ASSERT_FALSE(snapshot.expired());
+
+    snapshot.release();
+    ASSERT_EQ(0, this->m_db->get_snapshot_stats().active);
+    ASSERT_EQ(NUMBER_OF_BLOCKS, this->m_db->height());
+  }
+
+  const db_snapshot_stats stats = this->m_db->get_snapshot_stats();
+  ASSERT_EQ(0, stats.active);
+  ASSERT_EQ(1, stats.opened);
+  ASSERT_EQ(0, stats.expired);
+  ASSERT_LE(stats.readers, stats.max_readers);
+}
+
+TYPED_TEST(BlockchainDBTest, BatchedKeyImages)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  for (int i=0;i<NUMBER_OF_BLOCKS; i++)
+    ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[i], this->m_test_sizes[i], this->m_test_diffs[i], this->m_test_coins[i], this->m_test_tokens[i], this->m_txs[i]));
+
+  // spent images interleaved with unknown ones, and a duplicate
+  std::vector<crypto::key_image> images;
+  for (const auto &txs : this->m_txs)
+  {
+    for (const auto &tx : txs)
+    {
+      for (const auto &in : tx.vin)
+      {
+        images.push_back(boost::get<txin_to_key>(in).k_image);
+        images.push_back(rct::rct2ki(rct::skGen()));
+      }
+    }
+  }
+  ASSERT_FALSE(images.empty());
+  images.push_back(images.front());
+
+  std::vector<bool> found;
+  ASSERT_NO_THROW(this->m_db->has_key_images(images, found));
+  ASSERT_EQ(images.size(), found.size());
+  for (size_t i = 0; i < images.size(); ++i)
+    ASSERT_EQ(this->m_db->has_key_image(images[i]), found[i]);
+  ASSERT_TRUE(found.front());
+  ASSERT_FALSE(found[1]);
+}
+
+TYPED_TEST(BlockchainDBTest, OutputDistribution)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  for (int i=0;i<NUMBER_OF_BLOCKS; i++)
+    ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[i], this->m_test_sizes[i], this->m_test_diffs[i], this->m_test_coins[i], this->m_test_tokens[i], this->m_txs[i]));
+
+  // the stored distribution must match a full scan of the outputs, for any range
+  auto check = [this]() {
+    std::map<uint64_t, std::vector<uint64_t>> expected;
+    const uint64_t db_height = this->m_db->height();
+    ASSERT_TRUE(this->m_db->for_all_outputs([&](uint64_t amount, const crypto::hash &tx_hash, uint64_t height, size_t tx_idx) {
+      std::vector<uint64_t> &counts = expected[amount];
+      counts.resize(db_height, 0);
+      counts[height]++;
+      return true;
+    }, tx_out_type::out_cash));
+    ASSERT_FALSE(expected.empty());
+
+    for (const auto &e : expected)
+    {
+      for (uint64_t from = 0; from < db_height; ++from)
+      {
+        for (uint64_t to = from; to < db_height; ++to)
+        {
+          std::vector<uint64_t> distribution;
+          uint64_t base;
+          ASSERT_TRUE(this->m_db->get_output_distribution(e.first, tx_out_type::out_cash, from, to, distribution, base));
+          ASSERT_EQ(std::vector<uint64_t>(e.second.begin() + from, e.second.begin() + to + 1), distribution);
+          ASSERT_EQ(std::accumulate(e.second.begin(), e.second.begin() + from, (uint64_t)0), base);
+        }
+      }
+    }
+  };
+
+  check();
+
+  // popping the top block takes its outputs out of the distribution
+  block blk;
+  std::vector<transaction> txs;
+  ASSERT_NO_THROW(this->m_db->pop_block(blk, txs));
+  ASSERT_EQ(NUMBER_OF_BLOCKS-1, this->m_db->height());
+  check();
+
+  std::vector<uint64_t> distribution;
+  uint64_t base;
+  ASSERT_FALSE(this->m_db->get_output_distribution(0, tx_out_type::out_cash, 2, 1, distribution, base));
+  ASSERT_TRUE(this->m_db->get_output_distribution(123456789, tx_out_type::out_token, 0, NUMBER_OF_BLOCKS-2, distribution, base));
+  ASSERT_EQ(std::vector<uint64_t>(NUMBER_OF_BLOCKS-1, 0), distribution);
+  ASSERT_EQ(0, base);
+}
+
+TYPED_TEST(BlockchainDBTest, OutputHistogram)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  for (int i=0;i<NUMBER_OF_BLOCKS; i++)
+    ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[i], this->m_test_sizes[i], this->m_test_diffs[i], this->m_test_coins[i], this->m_test_tokens[i], this->m_txs[i]));
+
+  // the searched histogram must match walking the outputs one at a time, cached or not
+  auto check = [this]() {
+    const uint64_t blockchain_height = this->m_db->height();
+    std::vector<uint64_t> cutoffs(1, 0);
+    for (uint64_t h = 0; h < blockchain_height; ++h)
+      cutoffs.push_back(this->m_db->get_block_timestamp(h));
+    for (const uint64_t recent_cutoff : cutoffs)
+    {
+      const auto histogram = this->m_db->get_output_histogram(std::vector<uint64_t>(), true, recent_cutoff, tx_out_type::out_cash);
+      ASSERT_FALSE(histogram.empty());
+      for (const auto &e : histogram)
+      {
+        uint64_t num_elems = std::get<0>(e.second);
+        while (num_elems > 0)
+        {
+          const tx_out_index toi = this->m_db->get_output_tx_and_index(e.first, num_elems - 1, tx_out_type::out_cash);
+          if (blockchain_height - 1 + CRYPTONOTE_LOCKED_TX_ALLOWED_DELTA_BLOCKS >= this->m_db->get_tx_unlock_time(toi.first) && this->m_db->get_tx_block_height(toi.first) + CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE <= blockchain_height)
+            break;
+          --num_elems;
+        }
+        ASSERT_EQ(num_elems, std::get<1>(e.second));
+        uint64_t recent = 0;
+        while (recent_cutoff > 0 && num_elems > 0)
+        {
+          const tx_out_index toi = this->m_db->get_output_tx_and_index(e.first, num_elems - 1, tx_out_type::out_cash);
+          if (this->m_db->get_block_timestamp(this->m_db->get_tx_block_height(toi.first)) < recent_cutoff)
+            break;
+          --num_elems;
+          ++recent;
+        }
+        ASSERT_EQ(recent, std::get<2>(e.second));
+      }
+      ASSERT_EQ(histogram, this->m_db->get_output_histogram(std::vector<uint64_t>(), true, recent_cutoff, tx_out_type::out_cash));
+    }
+  };
+
+  check();
+
+  block blk;
+  std::vector<transaction> txs;
+  ASSERT_NO_THROW(this->m_db->pop_block(blk, txs));
+  check();
+}
+
 }  // anonymous namespace
@@ -0,0 +1,165 @@
+// Copyright (c) 2018, The Safex Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include "gtest/gtest.h"
+
+#include "blockchain_utilities/bootstrap_file.h"
+#include "blockchain_utilities/bootstrap_serialization.h"
+#include "serialization/binary_utils.h"
+
+namespace
+{
+  // same layout as BootstrapFile::initialize_file
+  const uint32_t blockchain_raw_magic = 0x28721586;
+  const uint32_t header_size = 1024;
+
+  std::string make_header()
+  {
+    std::string header, blob;
+    uint32_t file_magic = blockchain_raw_magic;
+    EXPECT_TRUE(::serialization::dump_binary(file_magic, blob));
+    header += blob;
+
+    cryptonote::bootstrap::file_info bfi;
+    bfi.major_version = 0;
+    bfi.minor_version = 1;
+    bfi.header_size = header_size;
+    const cryptonote::blobdata bd = cryptonote::t_serializable_object_to_blob(bfi);
+    uint32_t bd_size = bd.size();
+    EXPECT_TRUE(::serialization::dump_binary(bd_size, blob));
+    header += blob;
+    header += bd;
+    header += std::string(sizeof(file_magic) + header_size - header.size(), 0);
+    return header;
+  }
+
+  std::string make_chunk(const std::string &payload)
+  {
+    std::string blob;
+    uint32_t chunk_size = payload.size();
+    EXPECT_TRUE(::serialization::dump_binary(chunk_size, blob));
+    return blob + payload;
+  }
+
+  class bootstrap_file_reader : public ::testing::Test
+  {
+  protected:
+    virtual void SetUp()
+    {
+      path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    }
+
+    virtual void TearDown()
+    {
+      reader.close();
+      boost::system::error_code ec;
+      boost::filesystem::remove(path, ec);
+    }
+
+    void write(const std::string &contents)
+    {
+      std::ofstream out(path.string(), std::ios::binary | std::ios::trunc);
+      out << contents;
+      ASSERT_TRUE(out.good());
+    }
+
+    boost::filesystem::path path;
+    BootstrapFileReader reader;
+  };
+}
+
+TEST_F(bootstrap_file_reader, reads_every_chunk)
+{
+  write(make_header() + make_chunk("first") + make_chunk("second"));
+  ASSERT_TRUE(reader.open(path.string()));
+  reader.seek_to_first_chunk();
+
+  epee::span<const uint8_t> chunk;
+  ASSERT_TRUE(reader.next_chunk(chunk));
+  ASSERT_EQ(std::string(reinterpret_cast<const char*>(chunk.data()), chunk.size()), "first");
+  ASSERT_TRUE(reader.next_chunk(chunk));
+  ASSERT_EQ(std::string(reinterpret_cast<const char*>(chunk.data()), chunk.size()), "second");
+  ASSERT_FALSE(reader.next_chunk(chunk));
+  ASSERT_EQ(reader.tell(), reader.size());
+}
+
+TEST_F(bootstrap_file_reader, stops_cleanly_at_a_truncated_last_chunk)
+{
+  const std::string complete = make_header() + make_chunk("first") + make_chunk("second");
+  const std::string last = make_chunk("third");
+  write(complete + last.substr(0, last.size() - 2));
+  ASSERT_TRUE(reader.open(path.string()));
+  const uint64_t first_chunk = reader.seek_to_first_chunk();
+
+  // what the importer reads: every complete chunk, then a clean end of file
+  size_t chunks = 0;
+  epee::span<const uint8_t> chunk;
+  ASSERT_NO_THROW({
+    while (reader.next_chunk(chunk))
+      ++chunks;
+  });
+  ASSERT_EQ(chunks, 2);
+  ASSERT_EQ(reader.tell(), complete.size());
+
+  // the batch sizing and the resume skip stop at the same place
+  ASSERT_EQ(reader.count_bytes(first_chunk, 3), complete.size() - first_chunk);
+  reader.seek(first_chunk);
+  ASSERT_EQ(reader.skip_chunks(3), 2);
+}
+
+TEST_F(bootstrap_file_reader, stops_cleanly_at_a_truncated_chunk_size)
+{
+  const std::string complete = make_header() + make_chunk("first");
+  write(complete + make_chunk("second").substr(0, 2));
+  ASSERT_TRUE(reader.open(path.string()));
+  reader.seek_to_first_chunk();
+
+  epee::span<const uint8_t> chunk;
+  ASSERT_TRUE(reader.next_chunk(chunk));
+  ASSERT_NO_THROW(ASSERT_FALSE(reader.next_chunk(chunk)));
+  ASSERT_EQ(reader.tell(), complete.size());
+}
+
+TEST_F(bootstrap_file_reader, throws_on_an_oversized_chunk)
+{
+  std::string blob;
+  uint32_t chunk_size = BUFFER_SIZE + 1;
+  ASSERT_TRUE(::serialization::dump_binary(chunk_size, blob));
+  write(make_header() + make_chunk("first") + blob + std::string(16, 0));
+  ASSERT_TRUE(reader.open(path.string()));
+  reader.seek_to_first_chunk();
+
+  epee::span<const uint8_t> chunk;
+  ASSERT_TRUE(reader.next_chunk(chunk));
+  ASSERT_THROW(reader.next_chunk(chunk), std::runtime_error);
+}
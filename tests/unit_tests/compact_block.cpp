@@ -0,0 +1,380 @@
+// Copyright (c) 2018, The Safex Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
+
+#include "gtest/gtest.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_protocol/cryptonote_protocol_handler.h"
+#include "cryptonote_protocol/cryptonote_protocol_handler.inl"
+
+namespace cryptonote {
+  class blockchain_storage;
+}
+
+namespace
+{
+  // core with an in-memory pool, recording the blocks handed to it
+  class compact_block_core
+  {
+  public:
+    void on_synchronized(){}
+    void safesyncmode(const bool){}
+    uint64_t get_current_blockchain_height() const {return 1;}
+    void set_target_blockchain_height(uint64_t) {}
+    bool init(const boost::program_options::variables_map& vm) {return true ;}
+    bool deinit(){return true;}
+    bool get_short_chain_history(std::list<crypto::hash>& ids) const { return true; }
+    bool get_stat_info(cryptonote::core_stat_info& st_inf) const {return true;}
+    bool have_block(const crypto::hash& id) const {return blocks.find(id) != blocks.end();}
+    void get_blockchain_top(uint64_t& height, crypto::hash& top_id)const{height=0;top_id=crypto::null_hash;}
+    bool handle_incoming_tx(const cryptonote::blobdata& tx_blob, cryptonote::tx_verification_context& tvc, bool keeped_by_block, bool relayed, bool do_not_relay) { return true; }
+    bool handle_incoming_txs(const std::list<cryptonote::blobdata>& tx_blob, std::vector<cryptonote::tx_verification_context>& tvc, bool keeped_by_block, bool relayed, bool do_not_relay) { return true; }
+    bool handle_incoming_block(const cryptonote::blobdata& block_blob, cryptonote::block_verification_context& bvc, bool update_miner_blocktemplate = true) { incoming_blocks.push_back(block_blob); return true; }
+    void pause_mine(){}
+    void resume_mine(){}
+    bool on_idle(){return true;}
+    bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, cryptonote::NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp){return true;}
+    bool handle_get_objects(cryptonote::NOTIFY_REQUEST_GET_OBJECTS::request& arg, cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, cryptonote::cryptonote_connection_context& context){return true;}
+    cryptonote::blockchain_storage &get_blockchain_storage() { throw std::runtime_error("Called invalid member function: please never call get_blockchain_storage on the TESTING class compact_block_core."); }
+    bool get_test_drop_download() const {return true;}
+    bool get_test_drop_download_height() const {return true;}
+    bool prepare_handle_incoming_blocks(const std::list<cryptonote::block_complete_entry>  &blocks) { incoming_txs.clear(); for (const auto &b: blocks) incoming_txs.insert(incoming_txs.end(), b.txs.begin(), b.txs.end()); return true; }
+    bool cleanup_handle_incoming_blocks(bool force_sync = false) { return true; }
+    uint64_t get_target_blockchain_height() const { return 1; }
+    size_t get_block_sync_size(uint64_t height) const { return BLOCKS_SYNCHRONIZING_DEFAULT_COUNT; }
+    virtual void on_transaction_relayed(const cryptonote::blobdata& tx) {}
+    cryptonote::network_type get_nettype() const { return cryptonote::MAINNET; }
+    bool get_pool_transaction(const crypto::hash& id, cryptonote::blobdata& tx_blob) const
+    {
+      auto i = pool.find(id);
+      if (i == pool.end())
+        return false;
+      tx_blob = i->second;
+      return true;
+    }
+    bool get_pool_transactions(const std::vector<crypto::hash>& ids, std::vector<cryptonote::blobdata>& txblobs, std::vector<size_t>& missing_indices) const
+    {
+      txblobs.resize(ids.size());
+      for (size_t i = 0; i < ids.size(); ++i)
+        if (!get_pool_transaction(ids[i], txblobs[i]))
+          missing_indices.push_back(i);
+      return true;
+    }
+    // same as tx_memory_pool::get_transaction_short_ids, with forced short id
+    // clashes applied on top
+    bool get_pool_transaction_short_ids(const crypto::hash& key, std::unordered_map<uint64_t, crypto::hash>& short_ids) const
+    {
+      ++short_id_passes;
+      for (const auto &e: pool)
+      {
+        auto ins = short_ids.emplace(cryptonote::get_short_tx_id(key, e.first), e.first);
+        if (!ins.second)
+          ins.first->second = crypto::null_hash;
+      }
+      for (const auto &e: clashes)
+        short_ids[cryptonote::get_short_tx_id(key, e.first)] = e.second;
+      return true;
+    }
+    uint64_t get_pool_cookie() const { return pool_cookie; }
+    uint64_t get_block_size_limit() const { return CRYPTONOTE_BLOCK_GRANTED_FULL_REWARD_ZONE_V2; }
+    bool pool_has_tx(const crypto::hash &txid) const { return pool.find(txid) != pool.end(); }
+    bool get_blocks(uint64_t start_offset, size_t count, std::list<std::pair<cryptonote::blobdata, cryptonote::block>>& blocks, std::list<cryptonote::blobdata>& txs) const { return false; }
+    bool get_transactions(const std::vector<crypto::hash>& txs_ids, std::list<cryptonote::transaction>& txs, std::list<crypto::hash>& missed_txs) const { return false; }
+    bool get_block_by_hash(const crypto::hash &h, cryptonote::block &blk, bool *orphan = NULL) const { return false; }
+    uint8_t get_ideal_hard_fork_version(uint64_t height) const { return 0; }
+    uint8_t get_hard_fork_version(uint64_t height) const { return 0; }
+    cryptonote::difficulty_type get_block_cumulative_difficulty(uint64_t height) const { return 0; }
+    bool fluffy_blocks_enabled() const { return false; }
+    uint64_t prevalidate_block_hashes(uint64_t height, const std::list<crypto::hash> &hashes) { return 0; }
+    void stop() {}
+
+    std::unordered_set<crypto::hash> blocks;
+    std::unordered_map<crypto::hash, cryptonote::blobdata> pool;
+    uint64_t pool_cookie = 0;
+    mutable size_t short_id_passes = 0;
+    std::unordered_map<crypto::hash, crypto::hash> clashes; //!< short id of the key tx resolves to the value tx
+    std::vector<cryptonote::blobdata> incoming_blocks;
+    std::vector<cryptonote::blobdata> incoming_txs;
+  };
+
+  // p2p layer recording what the protocol handler sends back to the peer
+  struct compact_block_p2p: public nodetool::p2p_endpoint_stub<cryptonote::cryptonote_connection_context>
+  {
+    virtual bool invoke_notify_to_peer(int command, const std::string& req_buff, const epee::net_utils::connection_context_base& context)
+    {
+      notifications.push_back(std::make_pair(command, req_buff));
+      return true;
+    }
+    virtual bool drop_connection(const epee::net_utils::connection_context_base& context)
+    {
+      ++dropped;
+      return true;
+    }
+
+    std::vector<std::pair<int, std::string>> notifications;
+    size_t dropped = 0;
+  };
+
+  typedef cryptonote::t_cryptonote_protocol_handler<compact_block_core> protocol_handler;
+
+  cryptonote::transaction make_tx(uint64_t n)
+  {
+    cryptonote::transaction tx;
+    tx.version = 1;
+    tx.unlock_time = n;
+    tx.vin.push_back(cryptonote::txin_gen{n});
+    return tx;
+  }
+
+  class compact_block_test: public ::testing::Test
+  {
+  protected:
+    compact_block_test(): handler(core, &p2p, true)
+    {
+      context.m_state = cryptonote::cryptonote_connection_context::state_normal;
+      core.blocks.insert(crypto::cn_fast_hash("parent", 6));
+
+      blk.major_version = 1;
+      blk.minor_version = 1;
+      blk.timestamp = 1000;
+      blk.prev_id = crypto::cn_fast_hash("parent", 6);
+      blk.nonce = 0;
+      blk.miner_tx = make_tx(0);
+      for (uint64_t n = 1; n <= 4; ++n)
+      {
+        const cryptonote::transaction tx = make_tx(n);
+        const crypto::hash txid = cryptonote::get_transaction_hash(tx);
+        blk.tx_hashes.push_back(txid);
+        tx_blobs.push_back(cryptonote::tx_to_blob(tx));
+      }
+    }
+
+    void add_to_pool(size_t idx)
+    {
+      core.pool[blk.tx_hashes[idx]] = tx_blobs[idx];
+    }
+
+    // the announcement a compact peer gets from relay_block
+    cryptonote::NOTIFY_NEW_COMPACT_BLOCK::request make_compact_block(uint64_t salt)
+    {
+      cryptonote::NOTIFY_NEW_COMPACT_BLOCK::request arg = AUTO_VAL_INIT(arg);
+      arg.block_header = cryptonote::t_serializable_object_to_blob(static_cast<const cryptonote::block_header&>(blk));
+      arg.miner_tx = cryptonote::t_serializable_object_to_blob(blk.miner_tx);
+      arg.block_hash = cryptonote::get_block_hash(blk);
+      arg.short_id_salt = salt;
+      arg.current_blockchain_height = 2;
+      const crypto::hash key = cryptonote::get_short_tx_id_key(arg.block_hash, salt);
+      for (const crypto::hash &txid: blk.tx_hashes)
+        arg.short_tx_ids.push_back(cryptonote::get_short_tx_id(key, txid));
+      return arg;
+    }
+
+    void notify(cryptonote::NOTIFY_NEW_COMPACT_BLOCK::request &arg)
+    {
+      std::string blob, out;
+      epee::serialization::store_t_to_binary(arg, blob);
+      bool handled = false;
+      handler.handle_invoke_map(true, cryptonote::NOTIFY_NEW_COMPACT_BLOCK::ID, blob, out, context, handled);
+      ASSERT_TRUE(handled);
+    }
+
+    std::vector<uint64_t> requested_tx_indices()
+    {
+      EXPECT_EQ(1, p2p.notifications.size());
+      if (p2p.notifications.size() != 1)
+        return {};
+      EXPECT_EQ(cryptonote::NOTIFY_REQUEST_FLUFFY_MISSING_TX::ID, p2p.notifications[0].first);
+      cryptonote::NOTIFY_REQUEST_FLUFFY_MISSING_TX::request req;
+      EXPECT_TRUE(epee::serialization::load_t_from_binary(req, p2p.notifications[0].second));
+      EXPECT_EQ(cryptonote::get_block_hash(blk), req.block_hash);
+      return req.missing_tx_indices;
+    }
+
+    compact_block_core core;
+    compact_block_p2p p2p;
+    protocol_handler handler;
+    cryptonote::cryptonote_connection_context context;
+    cryptonote::block blk;
+    std::vector<cryptonote::blobdata> tx_blobs;
+  };
+}
+
+TEST(compact_block, short_tx_id_key_depends_on_block_and_salt)
+{
+  const crypto::hash block_hash = crypto::cn_fast_hash("block", 5);
+  const crypto::hash other_block_hash = crypto::cn_fast_hash("other", 5);
+
+  ASSERT_EQ(cryptonote::get_short_tx_id_key(block_hash, 1), cryptonote::get_short_tx_id_key(block_hash, 1));
+  ASSERT_NE(cryptonote::get_short_tx_id_key(block_hash, 1), cryptonote::get_short_tx_id_key(block_hash, 2));
+  ASSERT_NE(cryptonote::get_short_tx_id_key(block_hash, 1), cryptonote::get_short_tx_id_key(other_block_hash, 1));
+}
+
+TEST(compact_block, short_tx_id_depends_on_key_and_txid)
+{
+  const crypto::hash key = cryptonote::get_short_tx_id_key(crypto::cn_fast_hash("block", 5), 1);
+  const crypto::hash other_key = cryptonote::get_short_tx_id_key(crypto::cn_fast_hash("block", 5), 2);
+  const crypto::hash txid = crypto::cn_fast_hash("tx", 2);
+  const crypto::hash other_txid = crypto::cn_fast_hash("other tx", 8);
+
+  ASSERT_EQ(cryptonote::get_short_tx_id(key, txid), cryptonote::get_short_tx_id(key, txid));
+  ASSERT_NE(cryptonote::get_short_tx_id(key, txid), cryptonote::get_short_tx_id(key, other_txid));
+  ASSERT_NE(cryptonote::get_short_tx_id(key, txid), cryptonote::get_short_tx_id(other_key, txid));
+
+  // the id is the first 8 bytes of the salted hash, read as little endian
+  char data[2 * sizeof(crypto::hash)];
+  memcpy(data, &key, sizeof(key));
+  memcpy(data + sizeof(key), &txid, sizeof(txid));
+  const crypto::hash h = crypto::cn_fast_hash(data, sizeof(data));
+  uint64_t expected = 0;
+  for (int i = 7; i >= 0; --i)
+    expected = (expected << 8) | (uint8_t)h.data[i];
+  ASSERT_EQ(expected, cryptonote::get_short_tx_id(key, txid));
+}
+
+TEST_F(compact_block_test, reconstructs_block_from_pool)
+{
+  for (size_t i = 0; i < tx_blobs.size(); ++i)
+    add_to_pool(i);
+  cryptonote::NOTIFY_NEW_COMPACT_BLOCK::request arg = make_compact_block(42);
+  notify(arg);
+
+  ASSERT_TRUE(p2p.notifications.empty());
+  ASSERT_EQ(0, p2p.dropped);
+  ASSERT_EQ(1, core.incoming_blocks.size());
+  cryptonote::block b;
+  ASSERT_TRUE(cryptonote::parse_and_validate_block_from_blob(core.incoming_blocks[0], b));
+  ASSERT_EQ(cryptonote::get_block_hash(blk), cryptonote::get_block_hash(b));
+  ASSERT_EQ(tx_blobs, core.incoming_txs);
+}
+
+TEST_F(compact_block_test, requests_txes_missing_from_pool)
+{
+  add_to_pool(0);
+  add_to_pool(2);
+  cryptonote::NOTIFY_NEW_COMPACT_BLOCK::request arg = make_compact_block(42);
+  notify(arg);
+
+  ASSERT_TRUE(core.incoming_blocks.empty());
+  ASSERT_EQ(std::vector<uint64_t>({1, 3}), requested_tx_indices());
+}
+
+TEST_F(compact_block_test, requests_txes_with_ambiguous_short_ids)
+{
+  for (size_t i = 0; i < tx_blobs.size(); ++i)
+    add_to_pool(i);
+  // two pool txes sharing the short id of tx 2
+  core.clashes[blk.tx_hashes[2]] = crypto::null_hash;
+  cryptonote::NOTIFY_NEW_COMPACT_BLOCK::request arg = make_compact_block(42);
+  notify(arg);
+
+  ASSERT_TRUE(core.incoming_blocks.empty());
+  ASSERT_EQ(std::vector<uint64_t>({2}), requested_tx_indices());
+}
+
+TEST_F(compact_block_test, requests_all_txes_when_a_short_id_matches_the_wrong_tx)
+{
+  for (size_t i = 0; i < tx_blobs.size(); ++i)
+    add_to_pool(i);
+  const cryptonote::transaction other_tx = make_tx(100);
+  const crypto::hash other_txid = cryptonote::get_transaction_hash(other_tx);
+  core.pool[other_txid] = cryptonote::tx_to_blob(other_tx);
+  // the short id of tx 1 only matches an unrelated pool tx
+  core.clashes[blk.tx_hashes[1]] = other_txid;
+  cryptonote::NOTIFY_NEW_COMPACT_BLOCK::request arg = make_compact_block(42);
+  notify(arg);
+
+  ASSERT_TRUE(core.incoming_blocks.empty());
+  ASSERT_EQ(std::vector<uint64_t>({0, 1, 2, 3}), requested_tx_indices());
+}
+
+TEST_F(compact_block_test, drops_peer_sending_a_bad_header)
+{
+  cryptonote::NOTIFY_NEW_COMPACT_BLOCK::request arg = make_compact_block(42);
+  arg.block_header = "garbage";
+  notify(arg);
+
+  ASSERT_EQ(1, p2p.dropped);
+  ASSERT_TRUE(p2p.notifications.empty());
+  ASSERT_TRUE(core.incoming_blocks.empty());
+}
+
+TEST_F(compact_block_test, ignores_a_block_it_already_has)
+{
+  for (size_t i = 0; i < tx_blobs.size(); ++i)
+    add_to_pool(i);
+  core.blocks.insert(cryptonote::get_block_hash(blk));
+  cryptonote::NOTIFY_NEW_COMPACT_BLOCK::request arg = make_compact_block(42);
+  notify(arg);
+
+  ASSERT_EQ(0, core.short_id_passes);
+  ASSERT_TRUE(p2p.notifications.empty());
+  ASSERT_TRUE(core.incoming_blocks.empty());
+}
+
+TEST_F(compact_block_test, drops_peer_sending_more_short_ids_than_fit_in_a_block)
+{
+  cryptonote::NOTIFY_NEW_COMPACT_BLOCK::request arg = make_compact_block(42);
+  arg.short_tx_ids.resize(CRYPTONOTE_BLOCK_GRANTED_FULL_REWARD_ZONE_V2 / (sizeof(crypto::key_image) + sizeof(crypto::signature)) + 1);
+  notify(arg);
+
+  ASSERT_EQ(1, p2p.dropped);
+  ASSERT_EQ(0, core.short_id_passes);
+  ASSERT_TRUE(core.incoming_blocks.empty());
+}
+
+TEST_F(compact_block_test, requests_all_txes_of_a_block_with_an_unknown_parent)
+{
+  for (size_t i = 0; i < tx_blobs.size(); ++i)
+    add_to_pool(i);
+  core.blocks.clear();
+  cryptonote::NOTIFY_NEW_COMPACT_BLOCK::request arg = make_compact_block(42);
+  notify(arg);
+
+  ASSERT_EQ(0, core.short_id_passes);
+  ASSERT_TRUE(core.incoming_blocks.empty());
+  ASSERT_EQ(std::vector<uint64_t>({0, 1, 2, 3}), requested_tx_indices());
+}
+
+TEST_F(compact_block_test, reuses_pool_short_ids_while_key_and_pool_are_unchanged)
+{
+  add_to_pool(0);
+  add_to_pool(2);
+  cryptonote::NOTIFY_NEW_COMPACT_BLOCK::request arg = make_compact_block(42);
+  notify(arg);
+  notify(arg);
+  ASSERT_EQ(1, core.short_id_passes);
+
+  cryptonote::NOTIFY_NEW_COMPACT_BLOCK::request other_salt_arg = make_compact_block(43);
+  notify(other_salt_arg);
+  ASSERT_EQ(2, core.short_id_passes);
+
+  ++core.pool_cookie;
+  notify(other_salt_arg);
+  ASSERT_EQ(3, core.short_id_passes);
+}
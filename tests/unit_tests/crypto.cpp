@@ -75,3 +75,38 @@ TEST(Crypto, Ostream)
   EXPECT_TRUE(is_formatted<crypto::key_derivation>());
   EXPECT_TRUE(is_formatted<crypto::key_image>());
 }
+
+TEST(Crypto, CheckRingSignatures)
+{
+  static const size_t ring_size = 5;
+  static const size_t inputs = 3;
+
+  const crypto::hash prefix_hash = crypto::rand<crypto::hash>();
+  std::vector<crypto::public_key> pubs(inputs * ring_size);
+  std::vector<const crypto::public_key *> pub_ptrs(inputs * ring_size);
+  std::vector<crypto::key_image> images(inputs);
+  std::vector<crypto::signature> sigs(inputs * ring_size);
+  std::vector<crypto::ring_signature_check> checks;
+  for (size_t i = 0; i < inputs; ++i)
+  {
+    crypto::secret_key real_sec, sec;
+    for (size_t j = 0; j < ring_size; ++j)
+    {
+      crypto::generate_keys(pubs[i * ring_size + j], sec);
+      pub_ptrs[i * ring_size + j] = &pubs[i * ring_size + j];
+      if (j == i)
+        real_sec = sec;
+    }
+    crypto::generate_key_image(pubs[i * ring_size + i], real_sec, images[i]);
+    crypto::generate_ring_signature(prefix_hash, images[i], &pub_ptrs[i * ring_size], ring_size, real_sec, i, &sigs[i * ring_size]);
+    checks.push_back({&prefix_hash, &images[i], &pub_ptrs[i * ring_size], ring_size, &sigs[i * ring_size]});
+  }
+
+  EXPECT_TRUE(crypto::check_ring_signatures(checks));
+  EXPECT_TRUE(crypto::check_ring_signatures(checks.data(), 0));
+
+  sigs[ring_size + 2].r.data[0] ^= 1;
+  EXPECT_FALSE(crypto::check_ring_signatures(checks));
+  EXPECT_TRUE(crypto::check_ring_signatures(checks.data(), 1));
+  EXPECT_FALSE(crypto::check_ring_signature(prefix_hash, images[1], &pub_ptrs[ring_size], ring_size, &sigs[ring_size]));
+}
@@ -0,0 +1,403 @@
+// Copyright (c) 2018, The Safex Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include "gtest/gtest.h"
+
+#include "cryptonote_basic/account.h"
+#include "cryptonote_basic/cryptonote_basic_impl.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "device/device.hpp"
+#include "rpc/light_wallet_service.h"
+
+namespace
+{
+  // an in-memory chain the service scans in place of the core
+  class test_chain: public cryptonote::i_light_wallet_chain
+  {
+  public:
+    uint64_t get_current_blockchain_height() const
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      return m_blocks.size();
+    }
+
+    crypto::hash get_block_id_by_height(uint64_t height) const
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      return height < m_blocks.size() ? cryptonote::get_block_hash(m_blocks[height]) : crypto::null_hash;
+    }
+
+    bool get_blocks(uint64_t start_offset, size_t count, std::list<std::pair<cryptonote::blobdata, cryptonote::block>> &blocks, std::list<cryptonote::blobdata> &txs) const
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      for (uint64_t height = start_offset; height < m_blocks.size() && height < start_offset + count; ++height)
+      {
+        const cryptonote::block &b = m_blocks[height];
+        blocks.push_back(std::make_pair(cryptonote::block_to_blob(b), b));
+        for (const crypto::hash &tx_hash: b.tx_hashes)
+          txs.push_back(cryptonote::tx_to_blob(m_txs.at(tx_hash).first));
+      }
+      return true;
+    }
+
+    bool get_tx_outputs_gindexs(const crypto::hash &tx_id, std::vector<uint64_t> &indexs) const
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      const auto it = m_txs.find(tx_id);
+      if (it == m_txs.end())
+        return false;
+      indexs = it->second.second;
+      return true;
+    }
+
+    uint64_t get_dynamic_per_kb_fee_estimate(uint64_t grace_blocks) const
+    {
+      return 0;
+    }
+
+    void add_block(const std::vector<cryptonote::transaction> &txs)
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      cryptonote::block b;
+      b.major_version = 1;
+      b.minor_version = 1;
+      b.timestamp = 1000000 + m_blocks.size();
+      b.prev_id = m_blocks.empty() ? crypto::null_hash : cryptonote::get_block_hash(m_blocks.back());
+      b.nonce = m_nonce++;
+      b.miner_tx.version = 1;
+      b.miner_tx.unlock_time = m_blocks.size() + CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW;
+      b.miner_tx.vin.push_back(cryptonote::txin_gen{m_blocks.size()});
+      add_tx(b.miner_tx);
+      for (const cryptonote::transaction &tx: txs)
+      {
+        add_tx(tx);
+        b.tx_hashes.push_back(cryptonote::get_transaction_hash(tx));
+      }
+      m_blocks.push_back(b);
+    }
+
+    void pop_block()
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      const cryptonote::block b = m_blocks.back();
+      m_blocks.pop_back();
+      for (const crypto::hash &tx_hash: b.tx_hashes)
+        remove_tx(tx_hash);
+      remove_tx(cryptonote::get_transaction_hash(b.miner_tx));
+    }
+
+  private:
+    void add_tx(const cryptonote::transaction &tx)
+    {
+      std::vector<uint64_t> indices;
+      for (const cryptonote::tx_out &out: tx.vout)
+        indices.push_back(m_output_counts[out.amount]++);
+      m_txs[cryptonote::get_transaction_hash(tx)] = std::make_pair(tx, indices);
+    }
+
+    void remove_tx(const crypto::hash &tx_hash)
+    {
+      for (const cryptonote::tx_out &out: m_txs[tx_hash].first.vout)
+        --m_output_counts[out.amount];
+      m_txs.erase(tx_hash);
+    }
+
+    mutable boost::mutex m_lock;
+    std::vector<cryptonote::block> m_blocks;
+    std::unordered_map<crypto::hash, std::pair<cryptonote::transaction, std::vector<uint64_t>>> m_txs;
+    std::map<uint64_t, uint64_t> m_output_counts;
+    uint32_t m_nonce = 0;
+  };
+
+  // a transaction paying amount to the given address, spending the given inputs
+  cryptonote::transaction make_tx(const cryptonote::account_public_address &to, uint64_t amount, const std::vector<cryptonote::txin_to_key> &inputs = {})
+  {
+    cryptonote::transaction tx;
+    tx.version = 1;
+    tx.unlock_time = 0;
+    for (const cryptonote::txin_to_key &in: inputs)
+    {
+      tx.vin.push_back(in);
+      tx.signatures.push_back(std::vector<crypto::signature>(in.key_offsets.size()));
+    }
+
+    const cryptonote::keypair tx_key = cryptonote::keypair::generate(hw::get_device("default"));
+    cryptonote::add_tx_pub_key_to_extra(tx, tx_key.pub);
+    crypto::key_derivation derivation;
+    crypto::public_key out_key;
+    crypto::generate_key_derivation(to.m_view_public_key, tx_key.sec, derivation);
+    crypto::derive_public_key(derivation, 0, to.m_spend_public_key, out_key);
+    cryptonote::tx_out out;
+    out.amount = amount;
+    out.target = cryptonote::txout_to_key(out_key);
+    tx.vout.push_back(out);
+    return tx;
+  }
+
+  class light_wallet_service_test: public ::testing::Test
+  {
+  protected:
+    light_wallet_service_test(uint64_t max_accounts = 0)
+      : m_dir(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path())
+      , m_service(m_chain, cryptonote::MAINNET, m_dir.string(), max_accounts)
+    {
+      m_account.generate();
+      m_other.generate();
+      for (int i = 0; i < 3; ++i)
+        m_chain.add_block({});
+    }
+
+    virtual void SetUp()
+    {
+      ASSERT_TRUE(m_service.init());
+    }
+
+    virtual void TearDown()
+    {
+      m_service.deinit();
+      boost::system::error_code ec;
+      boost::filesystem::remove_all(m_dir, ec);
+    }
+
+    std::string address(const cryptonote::account_base &account) const
+    {
+      return cryptonote::get_account_address_as_str(cryptonote::MAINNET, false, account.get_keys().m_account_address);
+    }
+
+    std::string view_key(const cryptonote::account_base &account) const
+    {
+      return epee::string_tools::pod_to_hex(account.get_keys().m_view_secret_key);
+    }
+
+    cryptonote::COMMAND_RPC_LOGIN::response login(const cryptonote::account_base &account, bool create_account)
+    {
+      cryptonote::COMMAND_RPC_LOGIN::request req;
+      cryptonote::COMMAND_RPC_LOGIN::response res;
+      req.address = address(account);
+      req.view_key = view_key(account);
+      req.create_account = create_account;
+      EXPECT_TRUE(m_service.login(req, res));
+      return res;
+    }
+
+    cryptonote::COMMAND_RPC_IMPORT_WALLET_REQUEST::response import_wallet(const cryptonote::account_base &account)
+    {
+      cryptonote::COMMAND_RPC_IMPORT_WALLET_REQUEST::request req;
+      cryptonote::COMMAND_RPC_IMPORT_WALLET_REQUEST::response res;
+      req.address = address(account);
+      req.view_key = view_key(account);
+      EXPECT_TRUE(m_service.import_wallet_request(req, res));
+      return res;
+    }
+
+    cryptonote::COMMAND_RPC_GET_UNSPENT_OUTS::response get_unspent_outs(const cryptonote::account_base &account)
+    {
+      cryptonote::COMMAND_RPC_GET_UNSPENT_OUTS::request req;
+      cryptonote::COMMAND_RPC_GET_UNSPENT_OUTS::response res;
+      req.address = address(account);
+      req.view_key = view_key(account);
+      req.mixin = 0;
+      req.use_dust = true;
+      EXPECT_TRUE(m_service.get_unspent_outs(req, res));
+      return res;
+    }
+
+    cryptonote::COMMAND_RPC_GET_ADDRESS_INFO::response get_address_info(const cryptonote::account_base &account)
+    {
+      cryptonote::COMMAND_RPC_GET_ADDRESS_INFO::request req;
+      cryptonote::COMMAND_RPC_GET_ADDRESS_INFO::response res;
+      req.address = address(account);
+      req.view_key = view_key(account);
+      EXPECT_TRUE(m_service.get_address_info(req, res));
+      return res;
+    }
+
+    // waits for the scanning thread to catch up with the chain
+    bool wait_for_scan(const cryptonote::account_base &account)
+    {
+      for (int i = 0; i < 200; ++i)
+      {
+        const cryptonote::COMMAND_RPC_GET_ADDRESS_INFO::response res = get_address_info(account);
+        if (res.status == "success" && res.scanned_height == m_chain.get_current_blockchain_height())
+          return true;
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+      }
+      return false;
+    }
+
+    boost::filesystem::path m_dir;
+    test_chain m_chain;
+    cryptonote::light_wallet_service m_service;
+    cryptonote::account_base m_account;
+    cryptonote::account_base m_other;
+  };
+
+  class light_wallet_service_capped_test: public light_wallet_service_test
+  {
+  protected:
+    light_wallet_service_capped_test(): light_wallet_service_test(1) {}
+  };
+}
+
+TEST_F(light_wallet_service_test, login_creates_accounts)
+{
+  cryptonote::COMMAND_RPC_LOGIN::response res = login(m_account, false);
+  EXPECT_EQ("error", res.status);
+  EXPECT_EQ("Account does not exist", res.reason);
+
+  res = login(m_account, true);
+  EXPECT_EQ("success", res.status);
+  EXPECT_TRUE(res.new_address);
+
+  res = login(m_account, false);
+  EXPECT_EQ("success", res.status);
+  EXPECT_FALSE(res.new_address);
+
+  // new accounts start at the current height
+  const cryptonote::COMMAND_RPC_GET_ADDRESS_INFO::response info = get_address_info(m_account);
+  EXPECT_EQ("success", info.status);
+  EXPECT_EQ(m_chain.get_current_blockchain_height(), info.start_height);
+
+  EXPECT_EQ("error", get_address_info(m_other).status);
+}
+
+TEST_F(light_wallet_service_test, login_checks_view_key)
+{
+  cryptonote::COMMAND_RPC_LOGIN::request req;
+  cryptonote::COMMAND_RPC_LOGIN::response res;
+  req.address = address(m_account);
+  req.view_key = view_key(m_other);
+  req.create_account = true;
+  ASSERT_TRUE(m_service.login(req, res));
+  EXPECT_EQ("error", res.status);
+  EXPECT_EQ("View key does not match address", res.reason);
+}
+
+TEST_F(light_wallet_service_capped_test, login_caps_accounts)
+{
+  EXPECT_EQ("success", login(m_account, true).status);
+  const cryptonote::COMMAND_RPC_LOGIN::response res = login(m_other, true);
+  EXPECT_EQ("error", res.status);
+  EXPECT_EQ("Too many accounts", res.reason);
+  EXPECT_EQ("success", login(m_account, false).status);
+}
+
+TEST_F(light_wallet_service_test, scan_matches_outputs)
+{
+  ASSERT_EQ("success", login(m_account, true).status);
+  ASSERT_EQ("success", login(m_other, true).status);
+  m_chain.add_block({make_tx(m_account.get_keys().m_account_address, 1000), make_tx(m_other.get_keys().m_account_address, 2000)});
+  m_chain.add_block({make_tx(m_account.get_keys().m_account_address, 3000)});
+  ASSERT_TRUE(wait_for_scan(m_account));
+  ASSERT_TRUE(wait_for_scan(m_other));
+
+  cryptonote::COMMAND_RPC_GET_UNSPENT_OUTS::response res = get_unspent_outs(m_account);
+  ASSERT_EQ("success", res.status);
+  ASSERT_EQ(2, res.outputs.size());
+  EXPECT_EQ(4000, res.amount);
+  EXPECT_EQ(1000, res.outputs.front().amount);
+  EXPECT_EQ(0, res.outputs.front().global_index);
+  EXPECT_EQ(3, res.outputs.front().height);
+  EXPECT_EQ(3000, res.outputs.back().amount);
+  EXPECT_EQ(4, res.outputs.back().height);
+
+  res = get_unspent_outs(m_other);
+  ASSERT_EQ(1, res.outputs.size());
+  EXPECT_EQ(2000, res.outputs.front().amount);
+}
+
+TEST_F(light_wallet_service_test, scan_detects_spends)
+{
+  ASSERT_EQ("success", login(m_account, true).status);
+  m_chain.add_block({make_tx(m_account.get_keys().m_account_address, 1000)});
+  ASSERT_TRUE(wait_for_scan(m_account));
+
+  // a ring referencing the output, by amount and global index, is a candidate spend
+  cryptonote::txin_to_key in;
+  in.amount = 1000;
+  in.key_offsets.push_back(0);
+  in.k_image = crypto::key_image(rct::rct2ki(rct::skGen()));
+  m_chain.add_block({make_tx(m_other.get_keys().m_account_address, 900, {in})});
+  ASSERT_TRUE(wait_for_scan(m_account));
+
+  const cryptonote::COMMAND_RPC_GET_ADDRESS_INFO::response info = get_address_info(m_account);
+  EXPECT_EQ(1000, info.total_received);
+  EXPECT_EQ(1000, info.total_sent);
+  ASSERT_EQ(1, info.spent_outputs.size());
+  EXPECT_EQ(epee::string_tools::pod_to_hex(in.k_image), info.spent_outputs.front().key_image);
+
+  const cryptonote::COMMAND_RPC_GET_UNSPENT_OUTS::response res = get_unspent_outs(m_account);
+  ASSERT_EQ(1, res.outputs.size());
+  ASSERT_EQ(1, res.outputs.front().spend_key_images.size());
+  EXPECT_EQ(epee::string_tools::pod_to_hex(in.k_image), res.outputs.front().spend_key_images.front());
+}
+
+TEST_F(light_wallet_service_test, scan_rolls_back_reorgs)
+{
+  ASSERT_EQ("success", login(m_account, true).status);
+  m_chain.add_block({make_tx(m_account.get_keys().m_account_address, 1000)});
+  ASSERT_TRUE(wait_for_scan(m_account));
+  ASSERT_EQ(1, get_unspent_outs(m_account).outputs.size());
+
+  m_chain.pop_block();
+  m_chain.add_block({});
+  m_chain.add_block({});
+  ASSERT_TRUE(wait_for_scan(m_account));
+  EXPECT_EQ(0, get_unspent_outs(m_account).outputs.size());
+}
+
+TEST_F(light_wallet_service_test, import_rescans_from_genesis)
+{
+  m_chain.add_block({make_tx(m_account.get_keys().m_account_address, 1000)});
+  ASSERT_EQ("success", login(m_account, true).status);
+  ASSERT_EQ("success", login(m_other, true).status);
+  ASSERT_TRUE(wait_for_scan(m_account));
+  EXPECT_EQ(0, get_unspent_outs(m_account).outputs.size());
+
+  cryptonote::COMMAND_RPC_IMPORT_WALLET_REQUEST::response res = import_wallet(m_account);
+  EXPECT_EQ("success", res.status);
+  EXPECT_TRUE(res.new_request);
+  EXPECT_TRUE(res.request_fulfilled);
+  ASSERT_TRUE(wait_for_scan(m_account));
+  EXPECT_EQ(0, get_address_info(m_account).start_height);
+  ASSERT_EQ(1, get_unspent_outs(m_account).outputs.size());
+
+  // an account already scanned from genesis has nothing left to import
+  res = import_wallet(m_account);
+  EXPECT_EQ("success", res.status);
+  EXPECT_FALSE(res.new_request);
+  EXPECT_TRUE(res.request_fulfilled);
+
+  // and rescans are rate limited
+  res = import_wallet(m_other);
+  EXPECT_NE("success", res.status);
+  EXPECT_FALSE(res.new_request);
+}
@@ -0,0 +1,111 @@
+// Copyright (c) 2018, The Safex Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Parts of this file are originally copyright (c) 2014-2018 The Monero Project
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_basic/account.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "safex/safex_offer.h"
+#include "safex/command.h"
+
+
+namespace
+{  // anonymous namespace
+
+  class SafexCommandCache : public ::testing::Test
+  {
+  protected:
+    virtual void SetUp()
+    {
+      acc_base.generate();
+    }
+
+    safex::create_offer make_command(const std::string &title)
+    {
+      safex::safex_offer offer = safex::safex_offer(title,10,100*COIN,"This is an offer",
+                                                    "username",acc_base.get_keys().m_view_secret_key,
+                                                    acc_base.get_keys().m_account_address);
+      return safex::create_offer{SAFEX_COMMAND_PROTOCOL_VERSION, safex::create_offer_data{offer}};
+    }
+
+    cryptonote::txin_to_script make_input(const safex::create_offer &command)
+    {
+      cryptonote::txin_to_script txin = AUTO_VAL_INIT(txin);
+      txin.command_type = safex::command_t::create_offer;
+      safex::safex_command_serializer::serialize_safex_object(command, txin.script);
+      return txin;
+    }
+
+    cryptonote::account_base acc_base;
+  };
+
+  TEST_F(SafexCommandCache, ParsesScriptOnce)
+  {
+    safex::create_offer apple_command = make_command("Apple");
+    cryptonote::txin_to_script txin = make_input(apple_command);
+
+    std::shared_ptr<const safex::create_offer> cached = safex::safex_command_serializer::get_safex_command<safex::create_offer>(txin);
+    ASSERT_EQ(apple_command.get_title(), cached->get_title()) << "Command must be parsed from the input script";
+    ASSERT_EQ(cached, safex::safex_command_serializer::get_safex_command<safex::create_offer>(txin)) << "Unchanged input must not be parsed again";
+
+    cryptonote::txin_to_script txin_copy = txin;
+    ASSERT_EQ(cached, safex::safex_command_serializer::get_safex_command<safex::create_offer>(txin_copy)) << "Copy of input must share the parsed command";
+  }
+
+  TEST_F(SafexCommandCache, ParsesAgainAfterReset)
+  {
+    safex::create_offer apple_command = make_command("Apple");
+    safex::create_offer pear_command = make_command("Pear");
+    cryptonote::txin_to_script txin = make_input(apple_command);
+    safex::safex_command_serializer::get_safex_command(txin);
+
+    // a copy given another script must not reuse the command parsed for the original
+    cryptonote::txin_to_script txin_copy = txin;
+    txin_copy.script.clear();
+    safex::safex_command_serializer::serialize_safex_object(pear_command, txin_copy.script);
+    txin_copy.parsed_command.reset();
+    ASSERT_EQ(pear_command.get_title(), safex::safex_command_serializer::get_safex_command<safex::create_offer>(txin_copy)->get_title()) << "Reassigned script must be parsed again";
+    ASSERT_EQ(apple_command.get_title(), safex::safex_command_serializer::get_safex_command<safex::create_offer>(txin)->get_title()) << "Original input must keep its own command";
+  }
+
+  TEST_F(SafexCommandCache, DeserializedInputParsesItsOwnScript)
+  {
+    safex::create_offer apple_command = make_command("Apple");
+    safex::create_offer pear_command = make_command("Pear");
+    cryptonote::txin_to_script txin = make_input(apple_command);
+    safex::safex_command_serializer::get_safex_command(txin);
+
+    // deserializing over an input with a parsed command drops it
+    cryptonote::txin_to_script pear_txin = make_input(pear_command);
+    ASSERT_TRUE(cryptonote::t_serializable_object_from_blob(txin, cryptonote::t_serializable_object_to_blob(pear_txin)));
+    ASSERT_EQ(pear_command.get_title(), safex::safex_command_serializer::get_safex_command<safex::create_offer>(txin)->get_title()) << "Deserialized input must be parsed from its own script";
+  }
+
+}
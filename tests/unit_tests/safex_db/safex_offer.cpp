@@ -549,6 +549,165 @@ namespace
 
   }
 
+  TYPED_TEST(SafexOfferTest, OfferIndexes) {
+        boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+        std::string dirPath = tempPath.string();
+
+        this->set_prefix(dirPath);
+
+        // make sure open does not throw
+        ASSERT_NO_THROW(this->m_db->open(dirPath));
+        this->get_filenames();
+        this->init_hard_fork();
+
+        for (int i = 0; i < NUMBER_OF_BLOCKS2; i++) {
+            ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[i], this->m_test_sizes[i], this->m_test_diffs[i],
+                                                  this->m_test_coins[i], this->m_test_tokens[i], this->m_txs[i]));
+        }
+
+        std::vector<safex::safex_offer> offers;
+        safex::safex_offer_filter filter;
+        safex::listing_page page;
+        filter.seller = this->m_safex_account1.username;
+        ASSERT_TRUE(this->m_db->get_safex_offers(offers, filter, page));
+        ASSERT_EQ(offers.size(), 2);
+        for (auto &offer: offers)
+            ASSERT_EQ(offer.seller, this->m_safex_account1.username);
+
+        offers.clear();
+        filter.seller = this->m_safex_account2.username;
+        ASSERT_TRUE(this->m_db->get_safex_offers(offers, filter, page));
+        ASSERT_EQ(offers.size(), 1);
+        ASSERT_EQ(offers[0].offer_id, this->m_safex_offer[1].offer_id);
+
+        offers.clear();
+        filter = safex::safex_offer_filter{};
+        filter.price_peg_used = true;
+        filter.price_peg_id = this->m_safex_price_peg.price_peg_id;
+        ASSERT_TRUE(this->m_db->get_safex_offers(offers, filter, page));
+        ASSERT_EQ(offers.size(), 1);
+        ASSERT_EQ(offers[0].offer_id, this->m_safex_offer[2].offer_id);
+
+        //Edited offer must be indexed only once, with its new state
+        std::vector<safex::safex_offer> all_offers;
+        ASSERT_TRUE(this->m_db->get_safex_offers(all_offers));
+        offers.clear();
+        filter = safex::safex_offer_filter{};
+        filter.only_active = true;
+        ASSERT_TRUE(this->m_db->get_safex_offers(offers, filter, page));
+        ASSERT_EQ(offers.size(), std::count_if(all_offers.begin(), all_offers.end(), [](const safex::safex_offer &offer){ return offer.active; }));
+
+        offers.clear();
+        filter.seller = "not_a_seller";
+        ASSERT_TRUE(this->m_db->get_safex_offers(offers, filter, page));
+        ASSERT_TRUE(offers.empty());
+
+        ASSERT_NO_THROW(this->m_db->close());
+  }
+
+  TYPED_TEST(SafexOfferTest, OfferPaging) {
+        boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+        std::string dirPath = tempPath.string();
+
+        this->set_prefix(dirPath);
+
+        // make sure open does not throw
+        ASSERT_NO_THROW(this->m_db->open(dirPath));
+        this->get_filenames();
+        this->init_hard_fork();
+
+        for (int i = 0; i < NUMBER_OF_BLOCKS2; i++) {
+            ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[i], this->m_test_sizes[i], this->m_test_diffs[i],
+                                                  this->m_test_coins[i], this->m_test_tokens[i], this->m_txs[i]));
+        }
+
+        std::vector<safex::safex_offer> all_offers;
+        ASSERT_TRUE(this->m_db->get_safex_offers(all_offers));
+        ASSERT_EQ(all_offers.size(), 3);
+
+        //One offer per page, pages must follow listing order without gaps
+        std::vector<safex::safex_offer> paged_offers;
+        safex::listing_page page;
+        page.limit = 1;
+        do {
+            std::vector<safex::safex_offer> offers;
+            ASSERT_TRUE(this->m_db->get_safex_offers(offers, safex::safex_offer_filter{}, page));
+            ASSERT_LE(offers.size(), 1);
+            paged_offers.insert(paged_offers.end(), offers.begin(), offers.end());
+            page.start_after = page.next;
+        } while (!page.next.empty());
+
+        ASSERT_EQ(paged_offers.size(), all_offers.size());
+        for (size_t i = 0; i < all_offers.size(); i++)
+            ASSERT_EQ(paged_offers[i].offer_id, all_offers[i].offer_id);
+
+        //Same for index walk
+        safex::safex_offer_filter filter;
+        filter.seller = this->m_safex_account1.username;
+        page = safex::listing_page{};
+        page.limit = 1;
+        std::vector<safex::safex_offer> seller_offers;
+        ASSERT_TRUE(this->m_db->get_safex_offers(seller_offers, filter, page));
+        ASSERT_EQ(seller_offers.size(), 1);
+        ASSERT_FALSE(page.next.empty());
+        page.start_after = page.next;
+        ASSERT_TRUE(this->m_db->get_safex_offers(seller_offers, filter, page));
+        ASSERT_EQ(seller_offers.size(), 2);
+        ASSERT_TRUE(page.next.empty());
+        ASSERT_NE(seller_offers[0].offer_id, seller_offers[1].offer_id);
+
+        //Malformed continuation token
+        page.start_after = "short";
+        std::vector<safex::safex_offer> offers;
+        ASSERT_FALSE(this->m_db->get_safex_offers(offers, filter, page));
+
+        ASSERT_NO_THROW(this->m_db->close());
+  }
+
+  TYPED_TEST(SafexOfferTest, OfferHeights) {
+        boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+        std::string dirPath = tempPath.string();
+
+        this->set_prefix(dirPath);
+
+        // make sure open does not throw
+        ASSERT_NO_THROW(this->m_db->open(dirPath));
+        this->get_filenames();
+        this->init_hard_fork();
+
+        for (int i = 0; i < NUMBER_OF_BLOCKS2; i++) {
+            ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[i], this->m_test_sizes[i], this->m_test_diffs[i],
+                                                  this->m_test_coins[i], this->m_test_tokens[i], this->m_txs[i]));
+        }
+
+        //Offers 0 and 1 are created in block 7, offer 2 in block 12, offer 0 is edited in block 16
+        std::vector<safex::safex_offer> offers;
+        ASSERT_TRUE(this->m_db->get_safex_offers(offers));
+        ASSERT_EQ(offers.size(), 3);
+        for (auto &offer: offers) {
+            const uint64_t created = offer.offer_id == this->m_safex_offer[2].offer_id ? 12 : 7;
+            const uint64_t edited = offer.offer_id == this->m_edited_safex_offer.offer_id ? 16 : created;
+            ASSERT_EQ(offer.height_creation, created);
+            ASSERT_EQ(offer.height, edited);
+
+            uint64_t height = 0;
+            ASSERT_TRUE(this->m_db->get_safex_offer_height(offer.offer_id, height));
+            ASSERT_EQ(height, edited);
+        }
+
+        //Removing edit restores height of creation
+        while (this->m_db->height() > 16) {
+            cryptonote::block blk;
+            std::vector<cryptonote::transaction> txs;
+            ASSERT_NO_THROW(this->m_db->pop_block(blk, txs));
+        }
+        uint64_t height = 0;
+        ASSERT_TRUE(this->m_db->get_safex_offer_height(this->m_edited_safex_offer.offer_id, height));
+        ASSERT_EQ(height, 7);
+
+        ASSERT_NO_THROW(this->m_db->close());
+  }
+
   TYPED_TEST(SafexOfferTest, CreateOfferExceptions) {
         boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
         std::string dirPath = tempPath.string();
@@ -397,6 +397,25 @@ namespace
 
   }
 
+  TEST(SafexPricePeg, ConvertPeggedPrice)
+  {
+     uint64_t sfx_price = 0;
+
+     ASSERT_TRUE(safex::convert_pegged_price(2*SAFEX_CASH_COIN, 35*SAFEX_CASH_COIN/10, sfx_price));
+     ASSERT_EQ(sfx_price, 7*SAFEX_CASH_COIN);
+
+     ASSERT_TRUE(safex::convert_pegged_price(MONEY_SUPPLY, SAFEX_CASH_COIN, sfx_price));
+     ASSERT_EQ(sfx_price, MONEY_SUPPLY) << "Conversion must be exact for prices above 2^53";
+
+     ASSERT_TRUE(safex::convert_pegged_price(SAFEX_CASH_COIN + 1, SAFEX_CASH_COIN - 1, sfx_price));
+     ASSERT_EQ(sfx_price, SAFEX_CASH_COIN - 1) << "Converted price must be rounded down";
+
+     ASSERT_FALSE(safex::convert_pegged_price(MONEY_SUPPLY, 2*MONEY_SUPPLY, sfx_price)) << "Converted price does not fit in 64 bits";
+
+     ASSERT_TRUE(safex::convert_pegged_price(3*SAFEX_CASH_COIN, 1828, 1, sfx_price));
+     ASSERT_EQ(sfx_price, safex::convert_pegged_price_legacy(3*SAFEX_CASH_COIN, 1828)) << "Legacy conversion must be used before fork";
+  }
+
   TYPED_TEST(SafexPricePegTest, CreatePricePegCommand) {
         boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
         std::string dirPath = tempPath.string();
@@ -890,6 +890,65 @@ namespace
 
   }
 
+  TYPED_TEST(SafexBlockchainFeeTest, CumulativeInterest)
+  {
+    boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    std::string dirPath = tempPath.string();
+
+    this->set_prefix(dirPath);
+
+    // make sure open does not throw
+    ASSERT_NO_THROW(this->m_db->open(dirPath));
+    this->get_filenames();
+    this->init_hard_fork();
+
+    for (int i = 0; i < NUMBER_OF_BLOCKS - 1; i++)
+    {
+      try
+      {
+        this->m_db->add_block(this->m_blocks[i], this->m_test_sizes[i], this->m_test_diffs[i], this->m_test_coins[i], this->m_test_tokens[i], this->m_txs[i]);
+      }
+      catch (std::exception &e)
+      {
+        std::cout << "Error: " << e.what() << std::endl;
+      }
+    }
+
+    const uint64_t top_height = this->m_db->height() - 1;
+    const uint64_t last_finished_interval = safex::calculate_interval_for_height(top_height, cryptonote::network_type::FAKECHAIN)
+                                            - (safex::is_interval_last_block(top_height, cryptonote::network_type::FAKECHAIN) ? 0 : 1);
+
+    safex::map_interval_interest interest_map;
+    ASSERT_TRUE(this->m_db->get_interval_interest_map(1, last_finished_interval, interest_map));
+
+    uint64_t previous_cumulative_interest = 0;
+    ASSERT_TRUE(this->m_db->get_cumulative_interest_for_interval(0, previous_cumulative_interest));
+    for (uint64_t interval = 1; interval <= last_finished_interval; interval++)
+    {
+      uint64_t cumulative_interest = 0;
+      ASSERT_TRUE(this->m_db->get_cumulative_interest_for_interval(interval, cumulative_interest));
+      ASSERT_EQ(cumulative_interest - previous_cumulative_interest, interest_map[interval]);
+      previous_cumulative_interest = cumulative_interest;
+    }
+
+    uint64_t cumulative_interest = 0;
+    ASSERT_FALSE(this->m_db->get_cumulative_interest_for_interval(last_finished_interval + 1, cumulative_interest));
+
+    // pop blocks back to the last block of previous interval, last interval is not finished any more
+    while (safex::calculate_interval_for_height(this->m_db->height() - 1, cryptonote::network_type::FAKECHAIN) == last_finished_interval)
+    {
+      cryptonote::block blk;
+      std::vector<cryptonote::transaction> txs;
+      ASSERT_NO_THROW(this->m_db->pop_block(blk, txs));
+    }
+
+    ASSERT_FALSE(this->m_db->get_cumulative_interest_for_interval(last_finished_interval, cumulative_interest));
+    ASSERT_TRUE(this->m_db->get_cumulative_interest_for_interval(last_finished_interval - 1, cumulative_interest));
+
+    ASSERT_NO_THROW(this->m_db->close());
+
+  }
+
 #endif
 
 
@@ -507,6 +507,23 @@ namespace
         }
         ASSERT_EQ(fee_sum,this->offers_total_fee);
 
+        safex::safex_offer_rating rating;
+        result = this->m_db->get_offer_rating(this->m_safex_purchase.offer_id, rating);
+        ASSERT_TRUE(result);
+        ASSERT_EQ(rating.count, 1);
+        ASSERT_EQ(rating.stars_sum, this->m_safex_feedback.stars_given);
+        for (uint64_t stars = 0; stars <= SAFEX_FEEDBACK_MAX_RATING; stars++)
+            ASSERT_EQ(rating.stars_histogram[stars], stars == this->m_safex_feedback.stars_given ? 1 : 0);
+
+        //Removing the feedback block takes it out of the rating
+        while (this->m_db->height() > 25) {
+            cryptonote::block blk;
+            std::vector<cryptonote::transaction> txs;
+            ASSERT_NO_THROW(this->m_db->pop_block(blk, txs));
+        }
+        ASSERT_FALSE(this->m_db->get_offer_rating(this->m_safex_purchase.offer_id, rating));
+        ASSERT_FALSE(this->m_db->get_offer_stars_given(this->m_safex_purchase.offer_id, stars_given));
+
     ASSERT_NO_THROW(this->m_db->close());
 
   }
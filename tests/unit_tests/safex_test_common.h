@@ -35,6 +35,9 @@ public:
   virtual void block_txn_start(bool readonly=false)  override{}
   virtual void block_txn_stop()  override{}
   virtual void block_txn_abort()  override{}
+  virtual bool snapshot_start() const override{ return false; }
+  virtual void snapshot_stop() const override{}
+  virtual void get_reader_count(uint64_t &readers, uint64_t &max_readers) const override{ readers = 0; max_readers = 0; }
   virtual void drop_hard_fork_info()  override{}
   virtual bool block_exists(const crypto::hash& h, uint64_t *height) const  override{ return false; }
   virtual blobdata get_block_blob_from_height(const uint64_t& height) const  override{ return cryptonote::t_serializable_object_to_blob(get_block_from_height(height)); }
@@ -78,6 +81,7 @@ public:
   virtual std::vector<uint64_t> get_tx_output_indices(const crypto::hash& h) const { return std::vector<uint64_t>(); }
   virtual std::vector<uint64_t> get_tx_amount_output_indices(const uint64_t tx_index) const  override{ return std::vector<uint64_t>(); }
   virtual bool has_key_image(const crypto::key_image& img) const  override{ return false; }
+  virtual void has_key_images(const std::vector<crypto::key_image> &imgs, std::vector<bool> &found) const  override{ found.assign(imgs.size(), false); }
   virtual void remove_block()  override{ blocks.pop_back(); }
   virtual uint64_t add_transaction_data(const crypto::hash& blk_hash, const transaction& tx, const crypto::hash& tx_hash)  override{return 0;}
   virtual void remove_transaction_data(const crypto::hash& tx_hash, const transaction& tx)  override{}
@@ -90,6 +94,8 @@ public:
   virtual uint64_t update_staked_token_sum_for_interval(const uint64_t interval_starting_block, const int64_t delta) {return 0;}
   virtual uint64_t update_staked_token_for_interval(const uint64_t interval, const uint64_t new_staked_tokens_in_interval)  override{ return 0;}
   virtual bool remove_staked_token_for_interval(const uint64_t interval) override{return true;};
+  virtual uint64_t update_cumulative_interest_for_interval(const uint64_t interval) override{ return 0;}
+  virtual bool remove_cumulative_interest_for_interval(const uint64_t interval) override{return true;};
   virtual uint64_t update_network_fee_sum_for_interval(const uint64_t interval_starting_block, const uint64_t collected_fee) override{return 0;}
   virtual bool get_account_key(const safex::account_username &username, crypto::public_key &pkey) const  override{ return true;}
   virtual bool get_account_data(const safex::account_username &username, std::vector<uint8_t> &data) const  override{ return false;}
@@ -99,11 +105,16 @@ public:
   virtual bool get_offer_quantity(const crypto::hash offer_id, uint64_t &quantity) const  override{ return true; };
   virtual bool get_offer_active_status(const crypto::hash offer_id, bool &active) const  override{ return true; };
   virtual bool get_safex_accounts(std::vector<std::pair<std::string,std::string>> &accounts) const  override{ return true; };
+  virtual bool get_safex_accounts(std::vector<std::pair<std::string,std::string>> &accounts, safex::listing_page &page) const  override{ return true; };
   virtual bool get_safex_offers(std::vector<safex::safex_offer> &offers) const  override{ return true; };
+  virtual bool get_safex_offers(std::vector<safex::safex_offer> &offers, const safex::safex_offer_filter &filter, safex::listing_page &page) const  override{ return true; };
   virtual bool get_safex_offer_height( crypto::hash &offer_id, uint64_t& height) const  override{ return true; };
   virtual bool get_offer_stars_given(const crypto::hash offer_id, uint64_t &stars_received) const  override{ return true; };
+  virtual bool get_offer_rating(const crypto::hash &offer_id, safex::safex_offer_rating &rating) const override { return false; }
   virtual bool get_safex_feedbacks( std::vector<safex::safex_feedback> &safex_feedbacks, const crypto::hash& offer_id) const  override{ return true; };
+  virtual bool get_safex_feedbacks( std::vector<safex::safex_feedback> &safex_feedbacks, const crypto::hash& offer_id, safex::listing_page &page) const  override{ return true; };
   virtual bool get_safex_price_pegs( std::vector<safex::safex_price_peg> &safex_price_pegs, const std::string& currency) const  override{ return true; };
+  virtual bool get_safex_price_pegs( std::vector<safex::safex_price_peg> &safex_price_pegs, const std::string& currency, safex::listing_page &page) const  override{ return true; };
   virtual bool get_safex_price_peg( const crypto::hash& price_peg_id,safex::safex_price_peg &safex_price_peg) const  override{ return true; };
 
   virtual bool get_table_sizes( std::vector<uint64_t> &table_sizes) const  override{ return true; };
@@ -114,6 +125,7 @@ public:
   virtual bool for_all_transactions(std::function<bool(const crypto::hash&, const cryptonote::transaction&)>) const  override{ return true; }
   virtual bool for_all_outputs(std::function<bool(uint64_t amount, const crypto::hash &tx_hash, uint64_t height, size_t tx_idx)> f, const tx_out_type output_type) const  override{ return true; }
   virtual bool for_all_outputs(uint64_t amount, const std::function<bool(uint64_t height)> &f, const tx_out_type output_type) const  override{ return true; }
+  virtual bool get_output_distribution(uint64_t amount, const tx_out_type output_type, uint64_t from_height, uint64_t to_height, std::vector<uint64_t> &distribution, uint64_t &base) const override { return false; }
   virtual bool for_all_advanced_outputs(std::function<bool(const crypto::hash &tx_hash, uint64_t height, uint64_t output_id, const txout_to_script& txout)> f, const tx_out_type output_type) const  override{ return true;}
   virtual bool is_read_only() const  override{ return false; }
   virtual std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> get_output_histogram(const std::vector<uint64_t> &amounts, bool unlocked, uint64_t recent_cutoff, const tx_out_type output_type) const  override{ return std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>>(); }
@@ -134,6 +146,7 @@ public:
   virtual std::vector<uint64_t> get_token_stake_expiry_outputs(const uint64_t block_height) const override{return std::vector<uint64_t>{};}
   virtual bool get_interval_interest_map(const uint64_t start_height, const uint64_t  end_height, safex::map_interval_interest &map) const override{return true;}
   virtual uint64_t calculate_staked_token_interest_for_output(const txin_to_script &txin, const uint64_t unlock_height) const override{ return 0; }
+  virtual bool get_cumulative_interest_for_interval(const uint64_t interval, uint64_t &cumulative_interest) const override{ return false; }
 
   virtual void add_block( const block& blk
                         , const size_t& block_size
@@ -0,0 +1,84 @@
+// Copyright (c) 2018, The Safex Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_core/blockchain.h"
+#include "cryptonote_core/tx_pool.h"
+
+using namespace cryptonote;
+
+namespace
+{
+  // the pool and the chain refer to each other, as in cryptonote::core
+  struct pool_and_chain
+  {
+    tx_memory_pool pool;
+    Blockchain chain;
+    pool_and_chain(): pool(chain), chain(pool) {}
+  };
+
+  crypto::hash make_txid(uint64_t n)
+  {
+    crypto::hash txid = crypto::null_hash;
+    memcpy(&txid, &n, sizeof(n));
+    return txid;
+  }
+}
+
+TEST(tx_pool, parsed_tx_cache_evicts_least_recently_used)
+{
+  pool_and_chain pc;
+  tx_memory_pool &pool = pc.pool;
+  const size_t max_size = MAX_PARSED_TX_CACHE_SIZE;
+
+  for (uint64_t n = 0; n < max_size; ++n)
+    pool.add_parsed_tx(make_txid(n), tx_memory_pool::parsed_tx_cache_entry());
+  ASSERT_EQ(max_size, pool.m_parsed_tx_cache.size());
+
+  // the oldest entry was used again, so the next oldest one goes first
+  ASSERT_TRUE(pool.find_parsed_tx(make_txid(0)) != nullptr);
+  pool.add_parsed_tx(make_txid(max_size), tx_memory_pool::parsed_tx_cache_entry());
+  ASSERT_EQ(max_size, pool.m_parsed_tx_cache.size());
+  ASSERT_EQ(max_size, pool.m_parsed_tx_lru.size());
+  ASSERT_TRUE(pool.find_parsed_tx(make_txid(0)) != nullptr);
+  ASSERT_TRUE(pool.find_parsed_tx(make_txid(1)) == nullptr);
+  ASSERT_TRUE(pool.find_parsed_tx(make_txid(max_size)) != nullptr);
+
+  // further above the cap, entries go in the order they were last used
+  pool.add_parsed_tx(make_txid(max_size + 1), tx_memory_pool::parsed_tx_cache_entry());
+  ASSERT_TRUE(pool.find_parsed_tx(make_txid(2)) == nullptr);
+  ASSERT_TRUE(pool.find_parsed_tx(make_txid(3)) != nullptr);
+  pool.add_parsed_tx(make_txid(max_size + 2), tx_memory_pool::parsed_tx_cache_entry());
+  ASSERT_TRUE(pool.find_parsed_tx(make_txid(3)) != nullptr);
+  ASSERT_TRUE(pool.find_parsed_tx(make_txid(4)) == nullptr);
+  ASSERT_EQ(max_size, pool.m_parsed_tx_cache.size());
+  ASSERT_EQ(max_size, pool.m_parsed_tx_lru.size());
+}
@@ -0,0 +1,232 @@
+// Copyright (c) 2018, The Safex Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
+
+#include <boost/filesystem.hpp>
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "wallet/wallet.h"
+
+TEST(wallet_cache_journal, store_appends_and_load_replays)
+{
+  const boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  ASSERT_TRUE(boost::filesystem::create_directories(dir));
+  const std::string wallet_file = (dir / "wallet").string();
+  const std::string journal_file = wallet_file + ".journal";
+  const epee::wipeable_string password = "testpass";
+
+  tools::wallet w1;
+  ASSERT_NO_THROW(w1.generate(wallet_file, password, crypto::secret_key(), true, false));
+  EXPECT_TRUE(boost::filesystem::exists(wallet_file));
+  EXPECT_FALSE(boost::filesystem::exists(journal_file));
+
+  // a store after a full one only appends the changes
+  const auto cache_size = boost::filesystem::file_size(wallet_file);
+  w1.set_attribute("journal", "first");
+  w1.set_tx_note(crypto::null_hash, "note");
+  ASSERT_NO_THROW(w1.store());
+  EXPECT_TRUE(boost::filesystem::exists(journal_file));
+  EXPECT_EQ(cache_size, boost::filesystem::file_size(wallet_file));
+
+  tools::wallet w2;
+  ASSERT_NO_THROW(w2.load(wallet_file, password));
+  EXPECT_EQ("first", w2.get_attribute("journal"));
+  EXPECT_EQ("note", w2.get_tx_note(crypto::null_hash));
+
+  // later changes win, whether still journaled or compacted into the cache
+  w1.set_attribute("journal", "second");
+  ASSERT_NO_THROW(w1.store());
+
+  tools::wallet w3;
+  ASSERT_NO_THROW(w3.load(wallet_file, password));
+  EXPECT_EQ("second", w3.get_attribute("journal"));
+  EXPECT_EQ("note", w3.get_tx_note(crypto::null_hash));
+
+  boost::system::error_code ec;
+  boost::filesystem::remove_all(dir, ec);
+}
+
+TEST(wallet_cache_journal, round_trips_transfers_payments_and_confirmed_txs)
+{
+  const boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  ASSERT_TRUE(boost::filesystem::create_directories(dir));
+  const std::string wallet_file = (dir / "wallet").string();
+  const std::string journal_file = wallet_file + ".journal";
+  const epee::wipeable_string password = "testpass";
+
+  tools::wallet w1;
+  ASSERT_NO_THROW(w1.generate(wallet_file, password, crypto::secret_key(), true, false));
+  const auto cache_size = boost::filesystem::file_size(wallet_file);
+
+  const crypto::public_key out_key = cryptonote::keypair::generate(hw::get_device("default")).pub;
+  tools::wallet::transfer_details td;
+  td.m_block_height = 10;
+  td.m_tx.version = 1;
+  td.m_tx.vout.push_back(cryptonote::tx_out());
+  td.m_tx.vout.back().amount = 1000;
+  td.m_tx.vout.back().target = cryptonote::txout_to_key(out_key);
+  td.m_txid = crypto::rand<crypto::hash>();
+  td.m_internal_output_index = 0;
+  td.m_global_output_index = 5;
+  td.m_spent = false;
+  td.m_spent_height = 0;
+  td.m_key_image = crypto::rand<crypto::key_image>();
+  td.m_mask = rct::identity();
+  td.m_amount = 1000;
+  td.m_key_image_known = true;
+  td.m_pk_index = 0;
+  td.m_subaddr_index = {0, 0};
+  td.m_key_image_partial = false;
+  td.m_output_type = cryptonote::tx_out_type::out_cash;
+  w1.m_transfers.push_back(td);
+  w1.m_key_images[td.m_key_image] = 0;
+  w1.m_pub_keys[out_key] = 0;
+
+  const crypto::hash payment_id = crypto::rand<crypto::hash>();
+  tools::wallet::payment_details payment = AUTO_VAL_INIT(payment);
+  payment.m_tx_hash = td.m_txid;
+  payment.m_amount = 1000;
+  payment.m_block_height = 10;
+  w1.m_payments.emplace(payment_id, payment);
+  w1.cache_journal_payment(payment_id, payment);
+
+  const crypto::hash spent_txid = crypto::rand<crypto::hash>();
+  tools::wallet::confirmed_transfer_details ctd = AUTO_VAL_INIT(ctd);
+  ctd.m_amount_in = 1000;
+  ctd.m_amount_out = 900;
+  ctd.m_block_height = 11;
+  w1.m_confirmed_txs[spent_txid] = ctd;
+  w1.cache_journal_confirmed_tx(spent_txid);
+
+  ASSERT_NO_THROW(w1.store());
+  EXPECT_TRUE(boost::filesystem::exists(journal_file));
+  EXPECT_EQ(cache_size, boost::filesystem::file_size(wallet_file));
+
+  tools::wallet w2;
+  ASSERT_NO_THROW(w2.load(wallet_file, password));
+  ASSERT_EQ(1, w2.m_transfers.size());
+  EXPECT_EQ(td.m_txid, w2.m_transfers[0].m_txid);
+  EXPECT_EQ(5, w2.m_transfers[0].m_global_output_index);
+  EXPECT_EQ(1000, w2.m_transfers[0].amount());
+  EXPECT_FALSE(w2.m_transfers[0].m_spent);
+  EXPECT_EQ(0, w2.m_key_images[td.m_key_image]);
+  EXPECT_EQ(0, w2.m_pub_keys[out_key]);
+  ASSERT_EQ(1, w2.m_payments.count(payment_id));
+  EXPECT_EQ(td.m_txid, w2.m_payments.find(payment_id)->second.m_tx_hash);
+  ASSERT_EQ(1, w2.m_confirmed_txs.count(spent_txid));
+  EXPECT_EQ(900, w2.m_confirmed_txs[spent_txid].m_amount_out);
+
+  // changes to a known transfer are journaled too
+  w1.m_transfers[0].m_spent = true;
+  w1.m_transfers[0].m_spent_height = 11;
+  ASSERT_NO_THROW(w1.store());
+  EXPECT_EQ(cache_size, boost::filesystem::file_size(wallet_file));
+
+  tools::wallet w3;
+  ASSERT_NO_THROW(w3.load(wallet_file, password));
+  ASSERT_EQ(1, w3.m_transfers.size());
+  EXPECT_TRUE(w3.m_transfers[0].m_spent);
+  EXPECT_EQ(11, w3.m_transfers[0].m_spent_height);
+  EXPECT_EQ(1, w3.m_payments.size());
+  EXPECT_EQ(1, w3.m_confirmed_txs.size());
+
+  boost::system::error_code ec;
+  boost::filesystem::remove_all(dir, ec);
+}
+
+TEST(wallet_cache_journal, truncated_entry_is_ignored)
+{
+  const boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  ASSERT_TRUE(boost::filesystem::create_directories(dir));
+  const std::string wallet_file = (dir / "wallet").string();
+  const std::string journal_file = wallet_file + ".journal";
+  const epee::wipeable_string password = "testpass";
+
+  tools::wallet w1;
+  ASSERT_NO_THROW(w1.generate(wallet_file, password, crypto::secret_key(), true, false));
+  w1.set_attribute("first", "1");
+  ASSERT_NO_THROW(w1.store());
+  w1.set_attribute("second", "2");
+  ASSERT_NO_THROW(w1.store());
+
+  // as if a store was interrupted while appending the second entry
+  boost::filesystem::resize_file(journal_file, boost::filesystem::file_size(journal_file) - 8);
+
+  tools::wallet w2;
+  ASSERT_NO_THROW(w2.load(wallet_file, password));
+  EXPECT_EQ("1", w2.get_attribute("first"));
+  EXPECT_EQ("", w2.get_attribute("second"));
+
+  // the damaged journal is not appended to, the next store rewrites the cache
+  ASSERT_NO_THROW(w2.store());
+  EXPECT_FALSE(boost::filesystem::exists(journal_file));
+
+  tools::wallet w3;
+  ASSERT_NO_THROW(w3.load(wallet_file, password));
+  EXPECT_EQ("1", w3.get_attribute("first"));
+
+  boost::system::error_code ec;
+  boost::filesystem::remove_all(dir, ec);
+}
+
+TEST(wallet_cache_journal, stale_journal_is_discarded)
+{
+  const boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  ASSERT_TRUE(boost::filesystem::create_directories(dir));
+  const std::string wallet_file = (dir / "wallet").string();
+  const std::string journal_file = wallet_file + ".journal";
+  const epee::wipeable_string password = "testpass";
+
+  tools::wallet w1;
+  ASSERT_NO_THROW(w1.generate(wallet_file, password, crypto::secret_key(), true, false));
+  w1.set_attribute("journal", "stale");
+  ASSERT_NO_THROW(w1.store());
+  ASSERT_TRUE(boost::filesystem::exists(journal_file));
+  const std::string stale_journal_file = (dir / "stale.journal").string();
+  boost::filesystem::copy_file(journal_file, stale_journal_file);
+
+  // importing payments forces a full rewrite, with a new cache IV
+  w1.set_attribute("journal", "fresh");
+  w1.import_payments(tools::wallet::payment_container());
+  ASSERT_NO_THROW(w1.store());
+  EXPECT_FALSE(boost::filesystem::exists(journal_file));
+
+  // a journal written against the previous cache must not be replayed
+  boost::filesystem::copy_file(stale_journal_file, journal_file);
+  tools::wallet w2;
+  ASSERT_NO_THROW(w2.load(wallet_file, password));
+  EXPECT_EQ("fresh", w2.get_attribute("journal"));
+
+  ASSERT_NO_THROW(w2.store());
+  EXPECT_FALSE(boost::filesystem::exists(journal_file));
+
+  boost::system::error_code ec;
+  boost::filesystem::remove_all(dir, ec);
+}